@@ -11,17 +11,23 @@ public:
     const static uint16_t ALARM_SERVICE_UUID = 0xE000;
     const static uint16_t ALARM_STATE_CHARACTERISTIC_UUID = 0xE001;
 
+    /* GATT layout, see GattLayout.h */
+    const static uint8_t CHARACTERISTIC_COUNT = 1;
+    const static uint8_t CCCD_COUNT = 1;
+    const static uint16_t VALUE_BYTES = 1;
+
     ALARMService(BLEDevice &_ble) : 
         ble(_ble),
         alarmState(0), 
         AlarmCharacteristic(ALARM_STATE_CHARACTERISTIC_UUID, &alarmState, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY)
     {
         GattCharacteristic *charTable[] = {&AlarmCharacteristic};
+        MBED_STATIC_ASSERT(sizeof(charTable) / sizeof(GattCharacteristic *) == CHARACTERISTIC_COUNT, "The GATT layout of the service is out of date");
         GattService alarmService(ALARM_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
 
-        ble.addService(alarmService);
+        AlarmCharacteristic.setWriteCallback(this, &ALARMService::onAlarmWritten);
 
-        ble.gattServer().onDataWritten(this, &ALARMService::onDataWritten);
+        ble.addService(alarmService);
     }
 
     GattAttribute::Handle_t getValueHandle() const 
@@ -34,11 +40,15 @@ public:
         ble.gattServer().write(AlarmCharacteristic.getValueHandle(), &alarmState, 1);
     }
     
+    uint8_t getAlarmState() const {
+        return alarmState;
+    }
+    
 protected:
     
-    virtual void onDataWritten(const GattWriteCallbackParams *params)
+    virtual void onAlarmWritten(const GattWriteCallbackParams *params)
     {          
-        if ((params->handle == AlarmCharacteristic.getValueHandle()) && (params->len == 1) && authenticated)
+        if ((params->len == 1) && authenticated)
         {
             updateAlarmState(*(params->data));
         }
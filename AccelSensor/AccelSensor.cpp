@@ -1,7 +1,7 @@
 #include "mbed.h"
 #include "AccelSensor.h"
 
-AccelSensor::AccelSensor(PinName sda, PinName scl) : _i2c(sda, scl) {
+AccelSensor::AccelSensor(PinName sda, PinName scl) : _i2c(sda, scl), _motionSrc(0) {
     //No need to initialise anything else.
 }
 
@@ -17,12 +17,19 @@ void AccelSensor::init() {
 
 void AccelSensor::standby() {
     char c = readRegister(CTRL_REG1);
-    writeRegister(CTRL_REG1, c & ~(0x01)); //Clear the active bit to go into standby
+    writeRegister(CTRL_REG1, c & ~(CTRL_REG1_ACTIVE)); //Clear the active bit to go into standby
 }
 
 void AccelSensor::active() {
     char c = readRegister(CTRL_REG1);
-    writeRegister(CTRL_REG1, c | 0x01); //Set the active bit to begin detection
+    writeRegister(CTRL_REG1, c | CTRL_REG1_ACTIVE); //Set the active bit to begin detection
+}
+
+void AccelSensor::setFastRead(bool enable) {
+    standby(); // F_READ can only be changed in standby
+    char c = readRegister(CTRL_REG1);
+    writeRegister(CTRL_REG1, enable ? (c | CTRL_REG1_F_READ) : (c & ~(CTRL_REG1_F_READ)));
+    active();
 }
 
 void AccelSensor::readData(int *destination) {
@@ -40,8 +47,86 @@ void AccelSensor::readData(int *destination) {
     }
 }
 
+void AccelSensor::readData8(int8_t *destination) {
+    char rawData[3]; // x/y/z MSB register data, contiguous in F_READ mode
+    readRegisters(OUT_X_MSB, 3, rawData);
+    for(int i = 0; i < 3 ; i++) {
+        destination[i] = (int8_t)rawData[i]; // MSB already holds the sign
+    }
+}
+
+void AccelSensor::enableMotionDetection(MotionEngine engine, char threshold, char debounce) {
+    char cfg, ths, count, cfgValue, intBit;
+    if (engine == MOTION_TRANSIENT) {
+        cfg = TRANSIENT_CFG; ths = TRANSIENT_THS; count = TRANSIENT_COUNT;
+        cfgValue = TRANSIENT_CFG_ANY; intBit = INT_TRANS; _motionSrc = TRANSIENT_SRC;
+    } else {
+        cfg = FF_MT_CFG; ths = FF_MT_THS; count = FF_MT_COUNT;
+        cfgValue = FF_MT_CFG_MOTION; intBit = INT_FF_MT; _motionSrc = FF_MT_SRC;
+    }
+
+    standby(); // Must be in standby to change registers
+    writeRegister(cfg, cfgValue);
+    writeRegister(ths, threshold & THS_MASK);
+    writeRegister(count, debounce);
+    writeRegister(CTRL_REG4, intBit); // Enable only this interrupt source
+    writeRegister(CTRL_REG5, intBit); // and route it to INT1
+    active();
+    readRegister(_motionSrc); // Clear any event latched while reconfiguring
+}
+
+void AccelSensor::disableMotionDetection() {
+    standby();
+    writeRegister(CTRL_REG4, 0x00);
+    active();
+    _motionSrc = 0;
+}
+
+bool AccelSensor::readMotionEvent() {
+    if (_motionSrc == 0) return false;
+    return (readRegister(_motionSrc) & SRC_EA) != 0; // Reading the source register releases INT1
+}
+
+bool AccelSensor::readRegistersAsync(TwiTransaction &t, char reg, int range, char *dest, Callback<void(TwiTransaction *)> done) {
+    t.address = ADDRESS;
+    t.reg = reg;
+    t.read = true;
+    t.data = dest;
+    t.length = range;
+    t.callback = done;
+    return _i2c.submit(&t);
+}
+
+bool AccelSensor::writeRegisterAsync(TwiTransaction &t, char reg, char *data, Callback<void(TwiTransaction *)> done) {
+    t.address = ADDRESS;
+    t.reg = reg;
+    t.read = false;
+    t.data = data;
+    t.length = 1;
+    t.callback = done;
+    return _i2c.submit(&t);
+}
+
+bool AccelSensor::readData8Async(TwiTransaction &t, char *dest, Callback<void(TwiTransaction *)> done) {
+    return readRegistersAsync(t, OUT_X_MSB, 3, dest, done);
+}
+
+bool AccelSensor::readMotionEventAsync(TwiTransaction &t, char *dest, Callback<void(TwiTransaction *)> done) {
+    if (_motionSrc == 0) return false;
+    return readRegistersAsync(t, _motionSrc, 1, dest, done);
+}
+
+TwiQueue &AccelSensor::bus() {
+    return _i2c;
+}
+
+void AccelSensor::waitIdle() {
+    while (_i2c.busy()) { /* let queued transfers finish before a blocking access */ }
+}
+
 void AccelSensor::readRegisters(char reg, int range, char* dest) {
     int ack = 0;
+    waitIdle();
     _i2c.start();
     ack = _i2c.write((ADDRESS << 1));
     ack = _i2c.write(reg);
@@ -54,6 +139,7 @@ void AccelSensor::readRegisters(char reg, int range, char* dest) {
 
 char AccelSensor::readRegister(char reg) {
     int ack = 0;
+    waitIdle();
     _i2c.start();
     ack = _i2c.write((ADDRESS << 1));
     ack = _i2c.write(reg);
@@ -66,6 +152,7 @@ char AccelSensor::readRegister(char reg) {
 
 void AccelSensor::writeRegister(char reg, char data) {
     int ack = 0;
+    waitIdle();
     _i2c.start();
     ack = _i2c.write((ADDRESS << 1));
     ack = _i2c.write(reg);
@@ -2,6 +2,7 @@
 #define MBED_NOKIALCD_H
 
 #include "mbed.h"
+#include "TwiAsync.h"
 
 //http://dlnmh9ip6v2uc.cloudfront.net/datasheets/Sensors/Accelerometers/MMA8452Q.pdf
 //http://dlnmh9ip6v2uc.cloudfront.net/datasheets/Sensors/Accelerometers/MMA8452Q-Breakout-v11-fixed.pdf
@@ -14,8 +15,29 @@
 #define XYZ_DATA_CFG 0x0E //14
 #define WHO_AM_I 0x0D //13
 #define CTRL_REG1 0x2A //42
+#define CTRL_REG1_ACTIVE 0x01
+#define CTRL_REG1_F_READ 0x02 // Fast read: burst reads skip the LSB registers
+#define CTRL_REG4 0x2D //45
+#define CTRL_REG5 0x2E //46
 #define GSCALE 2 // Sets full-scale range to +/-2, 4, or 8g. Used to calc real g values.
 
+// Freefall/motion and transient detection engines, see AN4070 and AN4071
+#define FF_MT_CFG 0x15 //21
+#define FF_MT_SRC 0x16 //22
+#define FF_MT_THS 0x17 //23
+#define FF_MT_COUNT 0x18 //24
+#define TRANSIENT_CFG 0x1D //29
+#define TRANSIENT_SRC 0x1E //30
+#define TRANSIENT_THS 0x1F //31
+#define TRANSIENT_COUNT 0x20 //32
+
+#define FF_MT_CFG_MOTION 0xF8 // ELE | OAE | ZEFE | YEFE | XEFE: latched motion on any axis
+#define TRANSIENT_CFG_ANY 0x1E // ELE | ZTEFE | YTEFE | XTEFE: latched high-passed motion on any axis
+#define SRC_EA 0x80 // Event active flag of FF_MT_SRC / TRANSIENT_SRC
+#define INT_FF_MT 0x04 // INT_EN_FF_MT / INT_CFG_FF_MT bit of CTRL_REG4 / CTRL_REG5
+#define INT_TRANS 0x20 // INT_EN_TRANS / INT_CFG_TRANS bit of CTRL_REG4 / CTRL_REG5
+#define THS_MASK 0x7F // Thresholds are 7 bits, 0.063g per count
+
 class AccelSensor {
 public:
     AccelSensor(PinName sda, PinName scl);
@@ -23,11 +45,46 @@ public:
     void standby();
     void init();
     void readData(int *destination);
+
+    // Select 8-bit fast read mode. readData() needs it off, readData8() on.
+    void setFastRead(bool enable);
+    // Read the three MSB registers in one 3-byte burst (F_READ mode only).
+    // One count is 1/128 of the full scale range.
+    void readData8(int8_t *destination);
+
+    // Detection engine routed to the INT1 pin by enableMotionDetection()
+    enum MotionEngine {
+        MOTION_FF_MT,     // absolute acceleration above threshold (gravity included)
+        MOTION_TRANSIENT  // high-pass filtered acceleration above threshold
+    };
+
+    // Program the detection engine and route its event to INT1 (active low).
+    // threshold is in 0.063g counts, debounce in samples at the current ODR.
+    void enableMotionDetection(MotionEngine engine, char threshold, char debounce = 0);
+    // Stop generating motion interrupts.
+    void disableMotionDetection();
+    // Read (and so acknowledge) the latched event, true if motion was detected.
+    bool readMotionEvent();
+
+    // Non-blocking variants: the transfer is queued on the bus and run from
+    // the TWI interrupt, `done` is called from there once it completes.
+    // `t` and the buffers must stay valid until then. Return false if `t`
+    // is still queued.
+    bool readRegistersAsync(TwiTransaction &t, char reg, int range, char *dest, Callback<void(TwiTransaction *)> done);
+    bool writeRegisterAsync(TwiTransaction &t, char reg, char *data, Callback<void(TwiTransaction *)> done);
+    // Three MSB registers (F_READ mode), convert with (int8_t)dest[i].
+    bool readData8Async(TwiTransaction &t, char *dest, Callback<void(TwiTransaction *)> done);
+    // Latched motion source, motion was detected if (*dest & SRC_EA).
+    bool readMotionEventAsync(TwiTransaction &t, char *dest, Callback<void(TwiTransaction *)> done);
+    // The underlying queue, so that other sensors can share the bus.
+    TwiQueue &bus();
 private:
     void readRegisters(char reg, int range, char* dest);
     char readRegister(char reg);
     void writeRegister(char reg, char data);
-    I2C _i2c;
+    void waitIdle();
+    TwiAsync _i2c;
+    char _motionSrc; // source register of the engine in use, 0 if none
 };
 
 #endif
\ No newline at end of file
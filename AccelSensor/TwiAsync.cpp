@@ -0,0 +1,183 @@
+#include "mbed.h"
+#include "TwiAsync.h"
+
+#define TWI_IRQ_PRIORITY 3 // APP_IRQ_PRIORITY_LOW, below the SoftDevice
+#define TWI_EVENTS_MASK (TWI_INTENSET_STOPPED_Msk | TWI_INTENSET_ERROR_Msk | TWI_INTENSET_TXDSENT_Msk | TWI_INTENSET_RXDREADY_Msk)
+
+TwiQueue::TwiQueue() : _head(NULL), _tail(NULL), _state(IDLE), _index(0), _failed(false) {
+    //No need to initialise anything else.
+}
+
+bool TwiQueue::submit(TwiTransaction *transaction) {
+    core_util_critical_section_enter();
+    for (TwiTransaction *t = _head; t != NULL; t = t->next) {
+        if (t == transaction) {
+            core_util_critical_section_exit();
+            return false;
+        }
+    }
+
+    transaction->status = TwiTransaction::PENDING;
+    transaction->next = NULL;
+    if (_tail != NULL) _tail->next = transaction;
+    else _head = transaction;
+    _tail = transaction;
+
+    if (_state == IDLE) startNext();
+    core_util_critical_section_exit();
+    return true;
+}
+
+bool TwiQueue::busy() const {
+    return _state != IDLE;
+}
+
+void TwiQueue::startNext() {
+    if (_head == NULL) {
+        _state = IDLE;
+        busIdle();
+        return;
+    }
+
+    _index = 0;
+    _failed = false;
+    _state = SEND_REG;
+    busStart(_head->address, _head->reg);
+}
+
+void TwiQueue::onByteSent() {
+    if (_state == SEND_REG) {
+        if (_head->read && _head->length > 0) {
+            _state = RECEIVE;
+            busStartRead(_head->address, _head->length == 1);
+            return;
+        }
+        _state = SEND_DATA;
+    } else if (_state != SEND_DATA) {
+        return;
+    }
+
+    if (_index < _head->length) {
+        busWrite(_head->data[_index++]);
+    } else {
+        _state = STOPPING;
+        busStop();
+    }
+}
+
+void TwiQueue::onByteReceived(char data) {
+    if (_state != RECEIVE) return;
+
+    _head->data[_index++] = data;
+    if (_index < _head->length) {
+        busReadNext(_index == _head->length - 1);
+    } else {
+        _state = STOPPING; // STOP already requested with the last byte
+    }
+}
+
+void TwiQueue::onStopped() {
+    if (_state == IDLE || _head == NULL) return;
+
+    TwiTransaction *done = _head;
+    _head = done->next;
+    if (_head == NULL) _tail = NULL;
+    done->next = NULL;
+    done->status = (_failed || _state != STOPPING) ? TwiTransaction::FAILED : TwiTransaction::DONE;
+
+    // Start the next transfer before the callback so it can queue new ones
+    startNext();
+    if (done->callback) done->callback(done);
+}
+
+void TwiQueue::onError() {
+    if (_state == IDLE) return;
+
+    _failed = true;
+    _state = STOPPING;
+    busStop();
+}
+
+TwiAsync *TwiAsync::_instances[2] = {NULL, NULL};
+
+TwiAsync::TwiAsync(PinName sda, PinName scl) : I2C(sda, scl), TwiQueue() {
+    int index = (_i2c.i2c == NRF_TWI0) ? 0 : 1;
+    _instances[index] = this;
+    _irq = (index == 0) ? SPI0_TWI0_IRQn : SPI1_TWI1_IRQn;
+
+    NVIC_SetVector(_irq, (index == 0) ? (uint32_t)&TwiAsync::twi0IrqHandler : (uint32_t)&TwiAsync::twi1IrqHandler);
+    NVIC_SetPriority(_irq, TWI_IRQ_PRIORITY);
+    NVIC_ClearPendingIRQ(_irq);
+    NVIC_EnableIRQ(_irq);
+}
+
+void TwiAsync::busStart(char address, char data) {
+    NRF_TWI_Type *twi = _i2c.i2c;
+    twi->EVENTS_STOPPED = 0;
+    twi->EVENTS_ERROR = 0;
+    twi->EVENTS_TXDSENT = 0;
+    twi->EVENTS_RXDREADY = 0;
+    twi->SHORTS = 0;
+    twi->ADDRESS = address;
+    twi->INTENSET = TWI_EVENTS_MASK; // Only while we own the bus, blocking I2C calls poll the same events
+    twi->TXD = data;
+    twi->TASKS_STARTTX = 1;
+}
+
+void TwiAsync::busWrite(char data) {
+    _i2c.i2c->TXD = data;
+}
+
+void TwiAsync::busStartRead(char address, bool last) {
+    NRF_TWI_Type *twi = _i2c.i2c;
+    twi->ADDRESS = address;
+    twi->SHORTS = last ? TWI_SHORTS_BB_STOP_Msk : TWI_SHORTS_BB_SUSPEND_Msk;
+    twi->TASKS_STARTRX = 1;
+}
+
+void TwiAsync::busReadNext(bool last) {
+    NRF_TWI_Type *twi = _i2c.i2c;
+    twi->SHORTS = last ? TWI_SHORTS_BB_STOP_Msk : TWI_SHORTS_BB_SUSPEND_Msk;
+    twi->TASKS_RESUME = 1;
+}
+
+void TwiAsync::busStop() {
+    NRF_TWI_Type *twi = _i2c.i2c;
+    twi->SHORTS = 0;
+    twi->TASKS_STOP = 1;
+    twi->TASKS_RESUME = 1; // In case the bus was suspended mid-read
+}
+
+void TwiAsync::busIdle() {
+    _i2c.i2c->INTENCLR = TWI_EVENTS_MASK;
+}
+
+void TwiAsync::irqHandler() {
+    NRF_TWI_Type *twi = _i2c.i2c;
+
+    if (twi->EVENTS_ERROR) {
+        twi->EVENTS_ERROR = 0;
+        twi->ERRORSRC = twi->ERRORSRC; // Write ones to clear
+        onError();
+    }
+    if (twi->EVENTS_TXDSENT) {
+        twi->EVENTS_TXDSENT = 0;
+        onByteSent();
+    }
+    if (twi->EVENTS_RXDREADY) {
+        twi->EVENTS_RXDREADY = 0;
+        onByteReceived(twi->RXD);
+    }
+    if (twi->EVENTS_STOPPED) {
+        twi->EVENTS_STOPPED = 0;
+        onStopped();
+    }
+}
+
+void TwiAsync::twi0IrqHandler() {
+    if (_instances[0] != NULL) _instances[0]->irqHandler();
+}
+
+void TwiAsync::twi1IrqHandler() {
+    if (_instances[1] != NULL) _instances[1]->irqHandler();
+}
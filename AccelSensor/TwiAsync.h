@@ -0,0 +1,101 @@
+#ifndef MBED_TWI_ASYNC_H
+#define MBED_TWI_ASYNC_H
+
+#include "mbed.h"
+
+// One register access on the bus: write `reg` then either write `length`
+// bytes from `data` or, after a repeated start, read `length` bytes into it.
+// Transactions are owned by the caller and must stay alive until `callback`
+// runs; it is invoked from interrupt context.
+struct TwiTransaction {
+    enum Status {
+        PENDING,
+        DONE,
+        FAILED
+    };
+
+    char address; // 7-bit slave address
+    char reg;
+    bool read;
+    char *data;
+    uint8_t length;
+    Callback<void(TwiTransaction *)> callback;
+
+    volatile Status status;
+    TwiTransaction *next; // queue link, managed by TwiQueue
+};
+
+// Hardware independent transaction queue and bus state machine. A derived
+// class provides the bus primitives and reports the bus events.
+class TwiQueue {
+public:
+    TwiQueue();
+    virtual ~TwiQueue() {}
+
+    // Queue a transaction, the bus is started if idle. Returns false if the
+    // transaction is already queued.
+    bool submit(TwiTransaction *transaction);
+    bool busy() const;
+
+protected:
+    // START, address (write) and first byte
+    virtual void busStart(char address, char data) = 0;
+    // Next byte of a write
+    virtual void busWrite(char data) = 0;
+    // Repeated START, address (read) and first byte, STOP after it if last
+    virtual void busStartRead(char address, bool last) = 0;
+    // Next byte of a read, STOP after it if last
+    virtual void busReadNext(bool last) = 0;
+    virtual void busStop() = 0;
+    // Called once the queue has drained
+    virtual void busIdle() {}
+
+    // Bus events, to be reported by the derived class
+    void onByteSent();
+    void onByteReceived(char data);
+    void onStopped();
+    void onError();
+
+private:
+    enum State {
+        IDLE,
+        SEND_REG,
+        SEND_DATA,
+        RECEIVE,
+        STOPPING
+    };
+
+    void startNext();
+
+    TwiTransaction *_head;
+    TwiTransaction *_tail;
+    volatile State _state;
+    uint8_t _index;
+    bool _failed;
+};
+
+// TwiQueue running on the nRF51 TWI peripheral picked by the mbed I2C driver,
+// from the TWI interrupt. The blocking I2C methods must not be used while
+// busy() is true.
+class TwiAsync : public I2C, public TwiQueue {
+public:
+    TwiAsync(PinName sda, PinName scl);
+
+protected:
+    virtual void busStart(char address, char data);
+    virtual void busWrite(char data);
+    virtual void busStartRead(char address, bool last);
+    virtual void busReadNext(bool last);
+    virtual void busStop();
+    virtual void busIdle();
+
+private:
+    void irqHandler();
+    static void twi0IrqHandler();
+    static void twi1IrqHandler();
+
+    static TwiAsync *_instances[2];
+    IRQn_Type _irq;
+};
+
+#endif
@@ -6,40 +6,104 @@
 #include "ble/Gap.h"
 #include "AccelSensor/AccelSensor.h"
 
-#define ACCEL_DETECTION_THRESHOLD 110
+#define ACCEL_DETECTION_THRESHOLD 7 // MSB counts, 15.6mg each at 2g
+
+/* When set, motion is detected by the accelerometer itself and reported on
+ * its INT1 pin, so the I2C bus is only used when an event is pending. The
+ * board must then define ACCEL_INT_PIN, the pin wired to INT1: none of the
+ * supported boards documents that wire, so the default is to sample the
+ * axes, one sample per requestSample().
+ * In both modes the bus is driven from the TWI interrupt, updateAccelDetection()
+ * only consumes the result of the last completed transfer. */
+#ifndef ACCEL_MOTION_INTERRUPT
+#define ACCEL_MOTION_INTERRUPT 0
+#endif
+#if ACCEL_MOTION_INTERRUPT && !defined(ACCEL_INT_PIN)
+#error "ACCEL_MOTION_INTERRUPT needs ACCEL_INT_PIN, the pin wired to the MMA8452Q INT1"
+#endif
+#define ACCEL_MOTION_THRESHOLD 8 // 0.063g counts, ~0.5g
+#define ACCEL_MOTION_DEBOUNCE 1 // samples
+#define ACCEL_ACK_RETRIES 3 // failed acknowledge reads retried from the TWI interrupt
 
 class AccelSensorService {
 public:
     const static uint16_t ACCEL_SENSOR_SERVICE_UUID = 0xD000;
     const static uint16_t ACCEL_DETECTION_UUID = 0xD001;
 
+    /* GATT layout, see GattLayout.h */
+    const static uint8_t CHARACTERISTIC_COUNT = 1;
+    const static uint8_t CCCD_COUNT = 1;
+    const static uint16_t VALUE_BYTES = 1;
+
     AccelSensorService(BLEDevice &_ble) : 
         ble(_ble), 
         accelerometer(P0_22, P0_20),// waveshare //accelerometer(P0_24, P0_21),// nuevo
         accelDetection(0),
+#if ACCEL_MOTION_INTERRUPT
+        accelInterrupt(ACCEL_INT_PIN),
+        motionPending(false),
+        ackFailures(0),
+#else
+        sampleReady(false),
+#endif
         AccelDetectionCharacteristic(ACCEL_DETECTION_UUID, &accelDetection, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY)
     {
         GattCharacteristic *charTable[] = {&AccelDetectionCharacteristic};
+        MBED_STATIC_ASSERT(sizeof(charTable) / sizeof(GattCharacteristic *) == CHARACTERISTIC_COUNT, "The GATT layout of the service is out of date");
         GattService accelSensorService(ACCEL_SENSOR_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
 
         ble.addService(accelSensorService);
-        
+    }
+    
+    /* Bring-up of the accelerometer, a sequence of blocking I2C transfers.
+     * Kept out of the constructor so that it can run once advertising has
+     * started, no motion is reported until then. */
+    void start() {
         accelerometer.init();
+        accelerometer.setFastRead(true);
         updateAccel();       
+        
+#if ACCEL_MOTION_INTERRUPT
+        accelerometer.enableMotionDetection(AccelSensor::MOTION_TRANSIENT, ACCEL_MOTION_THRESHOLD, ACCEL_MOTION_DEBOUNCE);
+        accelInterrupt.fall(callback(this, &AccelSensorService::onMotionInterrupt));
+        /* An event latched before the handler was attached already holds
+         * INT1 low, no falling edge will report it */
+        if (accelInterrupt.read() == 0)
+            acknowledgeMotion();
+#endif
     }
             
     void updateAccel() {
-        int aux_accel[3];
-        accelerometer.readData(aux_accel);
-        
-        for(int i = 0; i < 3; i++)
-            accel[i] = (uint8_t)aux_accel[i];
+        accelerometer.readData8(accel);
     }
     
     bool updateAccelDetection() {
-        uint8_t passAccel[3] = {accel[0], accel[1], accel[2]};      
-        updateAccel();
-        if( abs(accel[0] - passAccel[0]) > ACCEL_DETECTION_THRESHOLD || abs(accel[1] - passAccel[1]) > ACCEL_DETECTION_THRESHOLD || abs(accel[2] - passAccel[2]) > ACCEL_DETECTION_THRESHOLD )
+        bool detected = false;
+        
+        core_util_critical_section_enter();
+#if ACCEL_MOTION_INTERRUPT
+        detected = motionPending;
+        motionPending = false;
+        /* Level triggered backstop: INT1 left low by acknowledge reads that
+         * gave up on the bus sends no further edge */
+        if (accelInterrupt.read() == 0)
+        {
+            ackFailures = 0;
+            acknowledgeMotion();
+        }
+#else
+        if (sampleReady)
+        {
+            sampleReady = false;
+            int8_t passAccel[3] = {accel[0], accel[1], accel[2]};      
+            for(int i = 0; i < 3; i++)
+                accel[i] = accelSample[i];
+            detected = abs(accel[0] - passAccel[0]) > ACCEL_DETECTION_THRESHOLD || abs(accel[1] - passAccel[1]) > ACCEL_DETECTION_THRESHOLD || abs(accel[2] - passAccel[2]) > ACCEL_DETECTION_THRESHOLD;
+        }
+#endif
+        core_util_critical_section_exit();
+        
+        if (detected)
         {
             accelDetection = 1;
             ble.gattServer().write(AccelDetectionCharacteristic.getValueHandle(), &accelDetection, 1);            
@@ -52,16 +116,81 @@ public:
         
         return ((accelDetection > 0) ? true: false);
     }
+    
+    uint8_t getAccelDetection() const {
+        return accelDetection;
+    }
+
+#if !ACCEL_MOTION_INTERRUPT
+    /* Queue the next sample, no-op while the previous one is in flight */
+    void requestSample() {
+        accelerometer.readData8Async(accelTransfer, accelRaw, callback(this, &AccelSensorService::onTransferDone));
+    }
+#endif
 
 private:
+#if ACCEL_MOTION_INTERRUPT
+    void onMotionInterrupt() {
+        acknowledgeMotion();
+    }
+
+    /* Reading the source register acknowledges the event and releases INT1.
+     * No-op while the previous read is queued, onTransferDone() then reads
+     * again if INT1 is still low. */
+    void acknowledgeMotion() {
+        accelerometer.readMotionEventAsync(accelTransfer, accelRaw, callback(this, &AccelSensorService::onTransferDone));
+    }
+#endif
+
+    /* TWI interrupt context */
+    void onTransferDone(TwiTransaction *transfer) {
+#if ACCEL_MOTION_INTERRUPT
+        if (transfer->status == TwiTransaction::DONE)
+        {
+            ackFailures = 0;
+            if (accelRaw[0] & SRC_EA)
+                motionPending = true;
+        }
+        else
+            ackFailures++;
+        
+        /* Still low after a failed read, or latched again while the read
+         * was queued and the edge refused */
+        if (accelInterrupt.read() == 0 && ackFailures <= ACCEL_ACK_RETRIES)
+            acknowledgeMotion();
+#else
+        if (transfer->status == TwiTransaction::DONE)
+        {
+            /* accelRaw is the target of the next transfer, which a
+             * requestSample() may start before the main loop consumes
+             * this one */
+            for(int i = 0; i < 3; i++)
+                accelSample[i] = (int8_t)accelRaw[i];
+            sampleReady = true;
+        }
+#endif
+    }
+
     BLEDevice &ble;
     
     AccelSensor accelerometer;
     
-    uint8_t accel[3];
+    int8_t accel[3];
     uint8_t accelDetection;
     
+    TwiTransaction accelTransfer;
+    char accelRaw[3];
+    
+#if ACCEL_MOTION_INTERRUPT
+    InterruptIn accelInterrupt;
+    volatile bool motionPending;
+    uint8_t ackFailures;
+#else
+    int8_t accelSample[3]; // last completed sample, copied out of accelRaw
+    volatile bool sampleReady;
+#endif
+    
     ReadOnlyGattCharacteristic < uint8_t > AccelDetectionCharacteristic;    
 };
 
-#endif /* #ifndef __BLE_ACCEL_SENSOR_SERVICE_H__ */
\ No newline at end of file
+#endif /* #ifndef __BLE_ACCEL_SENSOR_SERVICE_H__ */
\ No newline at end of file
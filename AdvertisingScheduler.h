@@ -0,0 +1,117 @@
+#ifndef __ADVERTISING_SCHEDULER_H__
+#define __ADVERTISING_SCHEDULER_H__
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "ble/Gap.h"
+#include "TimerWheel.h"
+#include "ReconnectionAdvertiser.h"
+
+/* One step of the advertising back-off */
+struct AdvertisingStep {
+    uint16_t interval; // ms
+    uint32_t duration; // ms before moving to the next step, 0 to stay (up to ~71 min)
+};
+
+/* Advertising interval policy. Vehicle activity (contact on, motion,
+ * disconnection) restarts the back-off table from its first, fastest, step;
+ * without activity the scheduler walks the table down to its last step.
+ * The advertising type is left alone, so the device stays connectable: the
+ * interval is changed by restarting advertising right away, or picked up on
+ * the next startAdvertising() while connected or while the reconnection
+ * advertiser runs its directed and whitelisted stages. */
+class AdvertisingScheduler {
+public:
+    AdvertisingScheduler(TimerWheel &_wheel, const AdvertisingStep *_steps, uint8_t _stepCount) :
+        wheel(_wheel),
+        steps(_steps),
+        stepCount(_stepCount),
+        step(0),
+        appliedInterval(0),
+        gap(NULL),
+        reconnection(NULL),
+        nextStepTimer(callback(this, &AdvertisingScheduler::nextStep))
+    {
+    }
+
+    /* Take over the advertising interval, starting from the first step. The
+     * reconnection advertiser, if any, owns the restarts until it is back to
+     * open advertising. */
+    void start(Gap &_gap, ReconnectionAdvertiser *_reconnection = NULL)
+    {
+        gap = &_gap;
+        reconnection = _reconnection;
+        appliedInterval = 0;
+        trigger();
+    }
+
+    /* Vehicle activity, advertise fast again. Calling it repeatedly extends
+     * the fast window. */
+    void trigger()
+    {
+        enter(0);
+    }
+
+    uint8_t getStep() const
+    {
+        return step;
+    }
+
+    uint16_t getInterval() const
+    {
+        return steps[step].interval;
+    }
+
+private:
+    void nextStep()
+    {
+        if (step + 1 < stepCount)
+            enter(step + 1);
+    }
+
+    void enter(uint8_t index)
+    {
+        step = index;
+
+        if (steps[step].duration != 0 && step + 1 < stepCount)
+            wheel.arm(nextStepTimer, TIMER_WHEEL_MS(steps[step].duration));
+        else
+            wheel.cancel(nextStepTimer);
+
+        apply();
+    }
+
+    void apply()
+    {
+        uint16_t interval = steps[step].interval;
+        if (gap == NULL || interval == appliedInterval)
+            return;
+
+        gap->setAdvertisingInterval(interval);
+        appliedInterval = interval;
+
+        /* Advertising stops on connection, the disconnection callback
+         * restarts it with the new interval. A restart would end the
+         * directed burst or drop the whitelist, the end of either stage
+         * restarts advertising with the new interval. */
+        if (reconnection != NULL && reconnection->getStage() != ReconnectionAdvertiser::STAGE_OPEN)
+            return;
+
+        if (gap->getState().advertising)
+        {
+            gap->stopAdvertising();
+            gap->startAdvertising();
+        }
+    }
+
+    TimerWheel &wheel;
+    const AdvertisingStep *steps;
+    uint8_t stepCount;
+    uint8_t step;
+    uint16_t appliedInterval;
+    Gap *gap;
+    ReconnectionAdvertiser *reconnection;
+    WheelTimer nextStepTimer;
+};
+
+#endif /* #ifndef __ADVERTISING_SCHEDULER_H__ */
@@ -54,9 +54,19 @@
  *     chain.call();
  * }
  * @endcode
+ *
+ * By default every callback is allocated on the heap when it is added. A non
+ * zero @p Capacity selects a chain storing up to @p Capacity callbacks inline,
+ * with the same interface and call order.
+ */
+template <typename ContextType, unsigned Capacity = 0>
+class CallChainOfFunctionPointersWithContext;
+
+/**
+ * Heap allocated callchain, the callbacks are kept in a linked list.
  */
 template <typename ContextType>
-class CallChainOfFunctionPointersWithContext : public SafeBool<CallChainOfFunctionPointersWithContext<ContextType> > {
+class CallChainOfFunctionPointersWithContext<ContextType, 0> : public SafeBool<CallChainOfFunctionPointersWithContext<ContextType, 0> > {
 public:
     /**
      * The type of each callback in the callchain.
@@ -176,6 +186,15 @@ public:
         return (chainHead != NULL);
     }
 
+    /**
+     * Check whether add() would refuse another callback.
+     *
+     * @return false, the chain grows on the heap.
+     */
+    bool isFull(void) const {
+        return false;
+    }
+
     /**
      * Call all the functions in the chain in sequence.
      */
@@ -268,4 +287,193 @@ private:
     CallChainOfFunctionPointersWithContext & operator = (const CallChainOfFunctionPointersWithContext &);
 };
 
+/**
+ * Fixed capacity callchain. The callbacks are stored by value in a contiguous
+ * array, in the order they have been added, and called from the most recent
+ * one, like the heap allocated chain. Adding and detaching never allocate;
+ * add() fails once @p Capacity callbacks are registered.
+ *
+ * @note The function object returned by add() is only valid until the chain
+ *       is next modified.
+ */
+template <typename ContextType, unsigned Capacity>
+class CallChainOfFunctionPointersWithContext : public SafeBool<CallChainOfFunctionPointersWithContext<ContextType, Capacity> > {
+public:
+    /**
+     * The type of each callback in the callchain.
+     */
+    typedef FunctionPointerWithContext<ContextType> *pFunctionPointerWithContext_t;
+
+public:
+    /**
+     * Create an empty chain.
+     */
+    CallChainOfFunctionPointersWithContext() : count(0), currentCalled(-1) {
+        /* empty */
+    }
+
+    /**
+     * Add a function at the front of the chain.
+     *
+     * @param[in]  function
+     *              A pointer to a void function.
+     *
+     * @return  The function object stored for @p function, NULL if the chain
+     *          is full.
+     */
+    pFunctionPointerWithContext_t add(void (*function)(ContextType context)) {
+        return common_add(FunctionPointerWithContext<ContextType>(function));
+    }
+
+    /**
+     * Add a function at the front of the chain.
+     *
+     * @param[in] tptr
+     *              Pointer to the object to call the member function on.
+     * @param[in] mptr
+     *              Pointer to the member function to be called.
+     *
+     * @return  The function object stored for @p tptr and @p mptr, NULL if the
+     *          chain is full.
+     */
+    template<typename T>
+    pFunctionPointerWithContext_t add(T *tptr, void (T::*mptr)(ContextType context)) {
+        return common_add(FunctionPointerWithContext<ContextType>(tptr, mptr));
+    }
+
+    /**
+     * Add a function at the front of the chain.
+     *
+     * @param[in] func
+     *              The FunctionPointerWithContext to add.
+     *
+     * @return  The function object stored for @p func, NULL if the chain is
+     *          full.
+     */
+    pFunctionPointerWithContext_t add(const FunctionPointerWithContext<ContextType>& func) {
+        return common_add(func);
+    }
+
+    /**
+     * Detach a function pointer from a callchain.
+     *
+     * @param[in] toDetach
+     *              FunctionPointerWithContext to detach from this callchain.
+     *
+     * @return true if a function pointer has been detached and false otherwise.
+     *
+     * @note It is safe to remove a function pointer while the chain is
+     *       traversed by call(ContextType).
+     */
+    bool detach(const FunctionPointerWithContext<ContextType>& toDetach) {
+        /* Most recent first, like the heap allocated chain */
+        for (int index = count - 1; index >= 0; --index) {
+            if (callbacks[index] == toDetach) {
+                for (int i = index; i < count - 1; ++i) {
+                    callbacks[i] = callbacks[i + 1];
+                }
+                --count;
+
+                /* Keep call() on the callback it is running, which moved down
+                 * if it was above the removed one */
+                if (index < currentCalled) {
+                    --currentCalled;
+                }
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Clear the call chain (remove all functions in the chain).
+     */
+    void clear(void) {
+        count = 0;
+        currentCalled = -1;
+    }
+
+    /**
+     * Check whether the callchain contains any callbacks.
+     *
+     * @return true if the callchain is not empty and false otherwise.
+     */
+    bool hasCallbacksAttached(void) const {
+        return (count != 0);
+    }
+
+    /**
+     * Check whether add() would refuse another callback. The registration
+     * API of Gap and GattServer does not report a refused callback, this is
+     * how to tell that the capacity is too small.
+     *
+     * @return true if the chain holds Capacity callbacks and false otherwise.
+     */
+    bool isFull(void) const {
+        return ((unsigned) count == Capacity);
+    }
+
+    /**
+     * Call all the functions in the chain in sequence.
+     */
+    void call(ContextType context) {
+        ((const CallChainOfFunctionPointersWithContext*) this)->call(context);
+    }
+
+    /**
+     * Same as call() above, but const.
+     */
+    void call(ContextType context) const {
+        /* Callbacks added while calling are not called in this pass */
+        for (currentCalled = count - 1; currentCalled >= 0; --currentCalled) {
+            callbacks[currentCalled].call(context);
+        }
+    }
+
+    /**
+     * Same as call(), but with function call operator.
+     */
+    void operator()(ContextType context) const {
+        call(context);
+    }
+
+    /**
+     * Bool conversion operation.
+     *
+     * @return true if the callchain is not empty and false otherwise.
+     */
+    bool toBool() const {
+        return count != 0;
+    }
+
+private:
+    pFunctionPointerWithContext_t common_add(const FunctionPointerWithContext<ContextType>& func) {
+        if ((unsigned) count == Capacity) {
+            return NULL;
+        }
+
+        callbacks[count] = func;
+        return &callbacks[count++];
+    }
+
+private:
+    FunctionPointerWithContext<ContextType> callbacks[Capacity];
+
+    /**
+     * Number of callbacks in the chain.
+     */
+    int count;
+
+    /**
+     * Index of the callback being called, -1 outside of call().
+     */
+    mutable int currentCalled;
+
+    /* Disallow copy constructor and assignment operators. */
+private:
+    CallChainOfFunctionPointersWithContext(const CallChainOfFunctionPointersWithContext &);
+    CallChainOfFunctionPointersWithContext & operator = (const CallChainOfFunctionPointersWithContext &);
+};
+
 #endif
\ No newline at end of file
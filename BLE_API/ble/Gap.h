@@ -26,6 +26,22 @@
 #include "FunctionPointerWithContext.h"
 #include "deprecate.h"
 
+/*
+ * Capacity of the Gap event callchains: the callbacks are stored inline, 0
+ * allocates each of them on the heap instead. A registration past the
+ * capacity is dropped, onConnection().isFull() and the like tell whether
+ * there is room left.
+ */
+#ifndef YOTTA_CFG_BLE_GAP_TIMEOUT_CALLBACKS
+    #define YOTTA_CFG_BLE_GAP_TIMEOUT_CALLBACKS 2
+#endif
+#ifndef YOTTA_CFG_BLE_GAP_CONNECTION_CALLBACKS
+    #define YOTTA_CFG_BLE_GAP_CONNECTION_CALLBACKS 4
+#endif
+#ifndef YOTTA_CFG_BLE_GAP_DISCONNECTION_CALLBACKS
+    #define YOTTA_CFG_BLE_GAP_DISCONNECTION_CALLBACKS 6
+#endif
+
 /* Forward declarations for classes that will only be used for pointers or references in the following. */
 class GapAdvertisingParams;
 class GapScanningParams;
@@ -306,7 +322,7 @@ public:
     /**
      * Type for the timeout event callchain. Refer to Gap::onTimeout().
      */
-    typedef CallChainOfFunctionPointersWithContext<TimeoutSource_t> TimeoutEventCallbackChain_t;
+    typedef CallChainOfFunctionPointersWithContext<TimeoutSource_t, YOTTA_CFG_BLE_GAP_TIMEOUT_CALLBACKS> TimeoutEventCallbackChain_t;
 
     /**
      * Type for the registered callbacks added to the connection event
@@ -316,7 +332,7 @@ public:
     /**
      * Type for the connection event callchain. Refer to Gap::onConnection().
      */
-    typedef CallChainOfFunctionPointersWithContext<const ConnectionCallbackParams_t *> ConnectionEventCallbackChain_t;
+    typedef CallChainOfFunctionPointersWithContext<const ConnectionCallbackParams_t *, YOTTA_CFG_BLE_GAP_CONNECTION_CALLBACKS> ConnectionEventCallbackChain_t;
 
     /**
      * Type for the registered callbacks added to the disconnection event
@@ -326,7 +342,7 @@ public:
     /**
      * Type for the disconnection event callchain. Refer to Gap::onDisconnection().
      */
-    typedef CallChainOfFunctionPointersWithContext<const DisconnectionCallbackParams_t*> DisconnectionEventCallbackChain_t;
+    typedef CallChainOfFunctionPointersWithContext<const DisconnectionCallbackParams_t*, YOTTA_CFG_BLE_GAP_DISCONNECTION_CALLBACKS> DisconnectionEventCallbackChain_t;
 
     /**
      * Type for the handlers of radio notification callback events. Refer to
@@ -428,6 +444,27 @@ public:
         return BLE_ERROR_NOT_IMPLEMENTED; /* Requesting action from porter(s): override this API if this capability is supported. */
     }
 
+    /**
+     * Start high duty cycle connectable directed advertising to a known
+     * peer, for a fast reconnection. The stack stops it after 1.28 seconds
+     * at most, which is reported as an advertising timeout (refer to
+     * Gap::onTimeout()). The current advertising parameters are not used.
+     *
+     * @param[in] peerAddrType
+     *              The peer's BLE address type.
+     * @param[in] peerAddr
+     *              The peer's BLE address.
+     *
+     * @return BLE_ERROR_NONE if directed advertising started.
+     */
+    virtual ble_error_t startDirectedAdvertising(BLEProtocol::AddressType_t peerAddrType, const BLEProtocol::AddressBytes_t peerAddr) {
+        /* Avoid compiler warnings about unused variables. */
+        (void)peerAddrType;
+        (void)peerAddr;
+
+        return BLE_ERROR_NOT_IMPLEMENTED; /* Requesting action from porter(s): override this API if this capability is supported. */
+    }
+
     /**
      * Stop scanning. The current scanning parameters remain in effect.
      *
@@ -1169,6 +1206,37 @@ public:
         return rc;
     }
 
+    /**
+     * Update a particular AD field in the scanResponse payload (based on
+     * matching type).
+     *
+     * @param[in] type
+     *              The type describing the variable length data.
+     * @param[in] data
+     *              Data bytes.
+     * @param[in] len
+     *              Length of data.
+     *
+     * @note  If advertisements are enabled, then the update will take effect immediately.
+     *
+     * @return BLE_ERROR_NONE if the scan response payload was updated based on
+     *         matching AD type; otherwise, an appropriate error.
+     */
+    ble_error_t updateScanResponse(GapAdvertisingData::DataType type, const uint8_t *data, uint8_t len) {
+        GapAdvertisingData scanResponseCopy = _scanResponse;
+        ble_error_t rc;
+        if ((rc = scanResponseCopy.updateData(type, data, len)) != BLE_ERROR_NONE) {
+            return rc;
+        }
+
+        rc = setAdvertisingData(_advPayload, scanResponseCopy);
+        if (rc == BLE_ERROR_NONE) {
+            _scanResponse = scanResponseCopy;
+        }
+
+        return rc;
+    }
+
     /**
      * Reset any scan response prepared from prior calls to
      * Gap::accumulateScanResponse().
@@ -338,7 +338,8 @@ public:
         enabledReadAuthorization(false),
         enabledWriteAuthorization(false),
         readAuthorizationCallback(),
-        writeAuthorizationCallback() {
+        writeAuthorizationCallback(),
+        writeCallback() {
         /* empty */
     }
 
@@ -387,6 +388,50 @@ public:
         enabledWriteAuthorization = true;
     }
 
+    /**
+     * Set up the callback that will be triggered when the GATT Client has
+     * written this characteristic's value. Unlike the handlers registered with
+     * GattServer::onDataWritten(), it is only called for writes to this
+     * characteristic.
+     *
+     * @param[in] callback
+     *      Event handler being registered.
+     */
+    void setWriteCallback(void (*callback)(const GattWriteCallbackParams *)) {
+        writeCallback.attach(callback);
+    }
+
+    /**
+     * Same as GattCharacteristic::setWriteCallback(), but allows the
+     * possibility to add an object reference and member function as handler
+     * for data written callbacks.
+     *
+     * @param[in] object
+     *              Pointer to the object of a class defining the member callback
+     *              function (@p member).
+     * @param[in] member
+     *              The member callback (within the context of an object) to be
+     *              invoked.
+     */
+    template <typename T>
+    void setWriteCallback(T *object, void (T::*member)(const GattWriteCallbackParams *)) {
+        writeCallback.attach(object, member);
+    }
+
+    /**
+     * Helper that calls the handler registered with setWriteCallback(), if
+     * any. This function is meant to be called from the BLE stack specific
+     * implementation when the value of this characteristic has been written.
+     *
+     * @param[in] params
+     *              The data written parameters passed to the handler.
+     */
+    void handleDataWritten(const GattWriteCallbackParams *params) {
+        if (writeCallback) {
+            writeCallback.call(params);
+        }
+    }
+
     /**
      * Set up callback that will be triggered before the GATT Client is allowed
      * to read this characteristic. The handler will determine the
@@ -609,6 +654,10 @@ private:
      * The registered callback handler for write authorization reply.
      */
     FunctionPointerWithContext<GattWriteAuthCallbackParams *> writeAuthorizationCallback;
+    /**
+     * The registered callback handler for writes to the value.
+     */
+    FunctionPointerWithContext<const GattWriteCallbackParams *> writeCallback;
 
 private:
     /* Disallow copy and assignment. */
@@ -24,6 +24,17 @@
 #include "GattCallbackParamTypes.h"
 #include "CallChainOfFunctionPointersWithContext.h"
 
+/*
+ * Capacity of the data written callchain: the callbacks are stored inline, 0
+ * allocates each of them on the heap instead. A registration past the
+ * capacity is dropped, onDataWritten().isFull() tells whether there is room
+ * left. Handlers of a single characteristic are better registered with
+ * GattCharacteristic::setWriteCallback().
+ */
+#ifndef YOTTA_CFG_BLE_GATT_SERVER_DATA_WRITTEN_CALLBACKS
+    #define YOTTA_CFG_BLE_GATT_SERVER_DATA_WRITTEN_CALLBACKS 2
+#endif
+
 class GattServer {
 public:
     /**
@@ -44,7 +55,7 @@ public:
     /**
      * Type for the data written event callchain. Refer to GattServer::onDataWritten().
      */
-    typedef CallChainOfFunctionPointersWithContext<const GattWriteCallbackParams*> DataWrittenCallbackChain_t;
+    typedef CallChainOfFunctionPointersWithContext<const GattWriteCallbackParams*, YOTTA_CFG_BLE_GATT_SERVER_DATA_WRITTEN_CALLBACKS> DataWrittenCallbackChain_t;
 
     /**
      * Type for the registered callbacks added to the data read callchain.
@@ -344,6 +355,11 @@ public:
      * some object.
      *
      * @note It is possible to unregister a callback using onDataWritten().detach(callback)
+     *
+     * @note These handlers are called for every write. A handler interested in
+     * a single characteristic should rather be registered with
+     * GattCharacteristic::setWriteCallback(), which is called before them and
+     * only for writes to that characteristic.
      */
     void onDataWritten(const DataWrittenCallback_t& callback) {
         dataWrittenCallChain.add(callback);
@@ -27,6 +27,11 @@
 */
 class BatteryService {
 public:
+    /* GATT layout: battery level, notified */
+    const static uint8_t CHARACTERISTIC_COUNT = 1;
+    const static uint8_t CCCD_COUNT = 1;
+    const static uint16_t VALUE_BYTES = 1;
+
     /**
      * @param[in] _ble
      *               BLE object for the underlying controller.
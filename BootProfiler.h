@@ -0,0 +1,106 @@
+#ifndef __BOOT_PROFILER_H__
+#define __BOOT_PROFILER_H__
+
+#include "mbed.h"
+#include "us_ticker_api.h"
+
+/* Time spent in each stage between main() and the main loop, measured with
+ * the RTC backed us_ticker. A stage ends when it is marked, its duration is
+ * the time elapsed since the previous mark (or start()). Stages are recorded
+ * in the order they complete, so the profile also shows whether the sensor
+ * was brought up before or after advertising started. Time spent before
+ * main() (startup code, static constructors) is not accounted. */
+
+enum BootStage {
+    BOOT_STAGE_STACK,       // SoftDevice and BLE stack enabled
+    BOOT_STAGE_GATT,        // services registered
+    BOOT_STAGE_ADVERTISING, // advertising set up and started
+    BOOT_STAGE_STATE,       // application state restored from flash
+    BOOT_STAGE_SENSOR,      // accelerometer configured over I2C
+    BOOT_STAGE_PERIPHERALS, // blinker, power management, first samples
+    BOOT_STAGE_COUNT
+};
+
+/* Profile record, one entry per completed stage: stage, then the duration in
+ * us on 24 bits (big endian, saturated). The 24 bytes are more than a read
+ * returns at the default ATT MTU (22), the last entry takes a Read Blob: the
+ * client has to read it as a long characteristic. */
+#define BOOT_PROFILE_ENTRY_LEN 4
+#define BOOT_PROFILE_LEN (BOOT_STAGE_COUNT * BOOT_PROFILE_ENTRY_LEN)
+#define BOOT_PROFILE_MAX_US 0xFFFFFFUL
+/* Stage of the entries not recorded yet */
+#define BOOT_STAGE_NONE 0xFF
+
+class BootProfiler {
+public:
+    BootProfiler() :
+        startUs(0),
+        lastUs(0),
+        completed(0)
+    {
+        memset(profile, BOOT_STAGE_NONE, sizeof(profile));
+    }
+
+    /* Start of the first stage. Also starts the us_ticker if needed. */
+    void start()
+    {
+        startUs = us_ticker_read();
+        lastUs = startUs;
+        completed = 0;
+        memset(profile, BOOT_STAGE_NONE, sizeof(profile));
+    }
+
+    /* The stage running since the previous mark has completed. Stages marked
+     * twice or after the profile is complete are ignored. */
+    void mark(BootStage stage)
+    {
+        if (completed >= BOOT_STAGE_COUNT || isMarked(stage))
+            return;
+
+        uint32_t nowUs = us_ticker_read();
+        uint32_t duration = nowUs - lastUs;
+        lastUs = nowUs;
+        if (duration > BOOT_PROFILE_MAX_US)
+            duration = BOOT_PROFILE_MAX_US;
+
+        uint8_t *entry = &profile[completed * BOOT_PROFILE_ENTRY_LEN];
+        entry[0] = stage;
+        entry[1] = duration >> 16;
+        entry[2] = duration >> 8;
+        entry[3] = duration;
+        completed++;
+    }
+
+    bool isMarked(BootStage stage) const
+    {
+        for (uint8_t i = 0; i < completed; i++)
+            if (profile[i * BOOT_PROFILE_ENTRY_LEN] == stage)
+                return true;
+        return false;
+    }
+
+    bool isComplete() const
+    {
+        return completed == BOOT_STAGE_COUNT;
+    }
+
+    /* BOOT_PROFILE_LEN bytes */
+    const uint8_t *getProfile() const
+    {
+        return profile;
+    }
+
+    /* From start() to the last mark */
+    uint32_t getTotalUs() const
+    {
+        return lastUs - startUs;
+    }
+
+private:
+    uint32_t startUs;
+    uint32_t lastUs;
+    uint8_t completed;
+    uint8_t profile[BOOT_PROFILE_LEN];
+};
+
+#endif /* #ifndef __BOOT_PROFILER_H__ */
@@ -0,0 +1,230 @@
+#ifndef __CONNECTION_PROFILE_MANAGER_H__
+#define __CONNECTION_PROFILE_MANAGER_H__
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "ble/Gap.h"
+#include "ble_conn_params.h"
+#include "TimerWheel.h"
+
+/* Connection interval units */
+#define CONN_INTERVAL_MS(ms) (((ms) * 4) / 5) // 1.25 ms
+#define CONN_TIMEOUT_MS(ms) ((ms) / 10) // 10 ms
+
+/* Short interval while the user authenticates */
+#define CONN_FAST_MIN_INTERVAL 15 // ms
+#define CONN_FAST_MAX_INTERVAL 30 // ms
+#define CONN_FAST_SLAVE_LATENCY 0
+#define CONN_FAST_TIMEOUT 4000 // ms
+
+/* Long interval once authenticated and idle. Max interval * (latency + 1)
+ * stays within 2 s and a third of the supervision timeout, as most centrals
+ * require. */
+#define CONN_IDLE_MIN_INTERVAL 345 // ms
+#define CONN_IDLE_MAX_INTERVAL 375 // ms
+#define CONN_IDLE_SLAVE_LATENCY 4
+#define CONN_IDLE_TIMEOUT 6000 // ms
+
+/* Time without GATT writes after which the link is idle */
+#define CONN_IDLE_TIME 2000 // ms
+
+/* Retry delays after the central rejected a request, doubled each time */
+#define CONN_RETRY_FIRST_DELAY 1000 // ms
+#define CONN_RETRY_MAX_DELAY 32000 // ms
+
+/* SDK module negotiation of the preferred parameters after connection */
+#define CONN_NEGOTIATION_DELAY 5 // s
+#define CONN_NEGOTIATION_COUNT 3
+
+/* Picks the connection parameters from the authentication state and link
+ * activity, and requests them through the SDK connection parameters module.
+ * The module reports the outcome from BLE event handling or its own timer
+ * interrupt, so the outcome is only latched there and acted upon in update(),
+ * from the main loop. */
+class ConnectionProfileManager {
+public:
+    enum Profile {
+        PROFILE_NONE,
+        PROFILE_FAST,
+        PROFILE_IDLE
+    };
+
+    ConnectionProfileManager(TimerWheel &_wheel) :
+        wheel(_wheel),
+        connected(false),
+        linkIdle(false),
+        requested(PROFILE_NONE),
+        applied(PROFILE_NONE),
+        retryDelay(CONN_RETRY_FIRST_DELAY),
+        outcomePending(false),
+        outcomeSucceeded(false),
+        idleTimer(callback(this, &ConnectionProfileManager::onIdle)),
+        retryTimer(callback(this, &ConnectionProfileManager::onRetry))
+    {
+    }
+
+    /* Initialize the SDK module, once BLE has been initialized */
+    void start(BLE &ble)
+    {
+        instance() = this;
+
+        ble_gap_conn_params_t params;
+        getParams(PROFILE_FAST, params);
+
+        ble_conn_params_init_t init;
+        memset(&init, 0, sizeof(init));
+        init.p_conn_params = &params;
+        /* Delays in 1/32768 s units without app_timer */
+        init.first_conn_params_update_delay = CONN_NEGOTIATION_DELAY * 32768UL;
+        init.next_conn_params_update_delay = CONN_NEGOTIATION_DELAY * 32768UL;
+        init.max_conn_params_update_count = CONN_NEGOTIATION_COUNT;
+        init.start_on_notify_cccd_handle = BLE_GATT_HANDLE_INVALID;
+        /* A rejected request must not cost the user the link */
+        init.disconnect_on_fail = false;
+        init.evt_handler = &ConnectionProfileManager::onConnParamsEvent;
+        init.error_handler = NULL;
+        ble_conn_params_init(&init);
+
+        ble.gap().onConnection(this, &ConnectionProfileManager::onConnection);
+        ble.gap().onDisconnection(this, &ConnectionProfileManager::onDisconnection);
+        ble.gattServer().onDataWritten(this, &ConnectionProfileManager::onDataWritten);
+    }
+
+    /* Main loop */
+    void update(bool authenticated)
+    {
+        if (!connected)
+            return;
+
+        if (outcomePending)
+        {
+            outcomePending = false;
+            if (outcomeSucceeded)
+            {
+                applied = requested;
+                retryDelay = CONN_RETRY_FIRST_DELAY;
+            }
+            else
+                retryLater();
+        }
+
+        /* One request at a time: the module checks the central's answer
+         * against the last parameters asked for, an answer to an earlier
+         * request would be taken as a refusal. The central answers every
+         * request, be it with its own parameters. */
+        Profile wanted = (authenticated && linkIdle) ? PROFILE_IDLE : PROFILE_FAST;
+        if (wanted == requested || requested != applied || retryTimer.isArmed())
+            return;
+
+        ble_gap_conn_params_t params;
+        getParams(wanted, params);
+        requested = wanted;
+        if (ble_conn_params_change_conn_params(&params) != NRF_SUCCESS)
+            retryLater();
+    }
+
+    Profile getProfile() const
+    {
+        return applied;
+    }
+
+private:
+    static void getParams(Profile profile, ble_gap_conn_params_t &params)
+    {
+        if (profile == PROFILE_IDLE)
+        {
+            params.min_conn_interval = CONN_INTERVAL_MS(CONN_IDLE_MIN_INTERVAL);
+            params.max_conn_interval = CONN_INTERVAL_MS(CONN_IDLE_MAX_INTERVAL);
+            params.slave_latency = CONN_IDLE_SLAVE_LATENCY;
+            params.conn_sup_timeout = CONN_TIMEOUT_MS(CONN_IDLE_TIMEOUT);
+        }
+        else
+        {
+            params.min_conn_interval = CONN_INTERVAL_MS(CONN_FAST_MIN_INTERVAL);
+            params.max_conn_interval = CONN_INTERVAL_MS(CONN_FAST_MAX_INTERVAL);
+            params.slave_latency = CONN_FAST_SLAVE_LATENCY;
+            params.conn_sup_timeout = CONN_TIMEOUT_MS(CONN_FAST_TIMEOUT);
+        }
+    }
+
+    /* The request will be made again by update() once the delay is over */
+    void retryLater()
+    {
+        requested = PROFILE_NONE;
+        applied = PROFILE_NONE;
+        wheel.arm(retryTimer, TIMER_WHEEL_MS(retryDelay));
+        if (retryDelay < CONN_RETRY_MAX_DELAY)
+            retryDelay *= 2;
+    }
+
+    void onIdle()
+    {
+        linkIdle = true;
+    }
+
+    void onRetry()
+    {
+        /* Nothing to do, update() checks the timer */
+    }
+
+    void onConnection(const Gap::ConnectionCallbackParams_t *params)
+    {
+        connected = true;
+        linkIdle = false;
+        requested = PROFILE_NONE;
+        applied = PROFILE_NONE;
+        retryDelay = CONN_RETRY_FIRST_DELAY;
+        outcomePending = false;
+        /* The module handled the event first and armed its negotiation
+         * timer if the central's parameters are out of range. update()
+         * requests the profile at once, the timer would only repeat that
+         * request 5 s later, whatever the central answered meanwhile. */
+        ble_conn_params_stop();
+        wheel.cancel(retryTimer);
+        wheel.arm(idleTimer, TIMER_WHEEL_MS(CONN_IDLE_TIME));
+    }
+
+    void onDisconnection(const Gap::DisconnectionCallbackParams_t *params)
+    {
+        connected = false;
+        wheel.cancel(idleTimer);
+        wheel.cancel(retryTimer);
+    }
+
+    void onDataWritten(const GattWriteCallbackParams *params)
+    {
+        linkIdle = false;
+        wheel.arm(idleTimer, TIMER_WHEEL_MS(CONN_IDLE_TIME));
+    }
+
+    /* BLE event handling or SDK module timer interrupt */
+    static void onConnParamsEvent(ble_conn_params_evt_t *evt)
+    {
+        ConnectionProfileManager *manager = instance();
+        if (manager == NULL)
+            return;
+
+        manager->outcomeSucceeded = (evt->evt_type == BLE_CONN_PARAMS_EVT_SUCCEEDED);
+        manager->outcomePending = true;
+    }
+
+    /* Manager the module events go to, see StateStore::instance() */
+    static ConnectionProfileManager *&instance()
+    {
+        static ConnectionProfileManager *manager = NULL;
+        return manager;
+    }
+
+    TimerWheel &wheel;
+    bool connected;
+    bool linkIdle;
+    Profile requested;
+    Profile applied;
+    uint32_t retryDelay;
+    volatile bool outcomePending;
+    volatile bool outcomeSucceeded;
+    WheelTimer idleTimer;
+    WheelTimer retryTimer;
+};
+
+#endif /* #ifndef __CONNECTION_PROFILE_MANAGER_H__ */
@@ -0,0 +1,49 @@
+#ifndef __GATT_LAYOUT_H__
+#define __GATT_LAYOUT_H__
+
+#include "mbed.h"
+
+/* Compile-time footprint of the GATT database. Every service describes its
+ * characteristics with CHARACTERISTIC_COUNT, CCCD_COUNT (notify or indicate)
+ * and VALUE_BYTES, and checks the count against its characteristic table.
+ *
+ * The SoftDevice does not document the layout of its attribute table, the
+ * size is estimated from 16-bit UUID attributes: an entry per attribute, the
+ * declaration values and the values stored by the stack (BLE_GATTS_VLOC_STACK)
+ * rounded up to words. The built-in GAP and GATT services come to 224 bytes
+ * with this model, BLE_GATTS_ATTR_TAB_SIZE_MIN is 216. */
+#define GATT_ATTR_ENTRY_SIZE 12
+#define GATT_SERVICE_DECLARATION_SIZE (GATT_ATTR_ENTRY_SIZE + 4)
+/* Declaration (properties, handle, UUID) and value, rounded up */
+#define GATT_CHARACTERISTIC_SIZE (GATT_ATTR_ENTRY_SIZE + 8 + GATT_ATTR_ENTRY_SIZE + 3)
+#define GATT_CCCD_SIZE (GATT_ATTR_ENTRY_SIZE + 4)
+
+/* GAP: device name (up to 31 bytes), appearance and preferred connection
+ * parameters. GATT: service changed and its CCCD. */
+#define GATT_BUILTIN_ATTR_TAB_SIZE (2 * GATT_SERVICE_DECLARATION_SIZE + \
+                                    (GATT_CHARACTERISTIC_SIZE - 3 + 32) + \
+                                    (GATT_CHARACTERISTIC_SIZE - 3 + 4) + \
+                                    (GATT_CHARACTERISTIC_SIZE - 3 + 8) + \
+                                    (GATT_CHARACTERISTIC_SIZE - 3 + 4) + GATT_CCCD_SIZE)
+
+/* Attribute table of sd_ble_enable() with BLE_GATTS_ATTR_TAB_SIZE_DEFAULT */
+#define GATT_ATTR_TAB_DEFAULT_SIZE 0x600
+
+template <typename Service>
+struct GattServiceLayout {
+    static const unsigned CHARACTERISTICS = Service::CHARACTERISTIC_COUNT;
+    static const unsigned ATTR_TAB_SIZE = GATT_SERVICE_DECLARATION_SIZE +
+                                          Service::CHARACTERISTIC_COUNT * GATT_CHARACTERISTIC_SIZE +
+                                          Service::CCCD_COUNT * GATT_CCCD_SIZE +
+                                          Service::VALUE_BYTES;
+};
+
+/* Totals over an X-macro list of service classes, SERVICES(X) expanding to
+ * X(Service) for each of them */
+#define GATT_LAYOUT_CHARACTERISTICS(Service) + GattServiceLayout<Service>::CHARACTERISTICS
+#define GATT_LAYOUT_ATTR_TAB_SIZE(Service) + GattServiceLayout<Service>::ATTR_TAB_SIZE
+
+#define GATT_TOTAL_CHARACTERISTICS(SERVICES) (0 SERVICES(GATT_LAYOUT_CHARACTERISTICS))
+#define GATT_TOTAL_ATTR_TAB_SIZE(SERVICES) (GATT_BUILTIN_ATTR_TAB_SIZE SERVICES(GATT_LAYOUT_ATTR_TAB_SIZE))
+
+#endif /* #ifndef __GATT_LAYOUT_H__ */
@@ -0,0 +1,103 @@
+#ifndef __HW_BLINKER_H__
+#define __HW_BLINKER_H__
+
+#include "mbed.h"
+#include "nrf_soc.h"
+#include "TimerWheel.h"
+
+/* Resources reserved for the blinker. RTC1 is the us_ticker counter, which
+ * uses CC[0] and CC[1], and the OutputSequencer uses CC[2]. The mbed PwmOut
+ * driver uses the first GPIOTE and PPI channels. */
+#define HW_BLINKER_RTC NRF_RTC1
+#define HW_BLINKER_RTC_CC 3
+#define HW_BLINKER_RTC_EVTEN_MSK RTC_EVTENSET_COMPARE3_Msk
+#define HW_BLINKER_GPIOTE_CHANNEL 3
+#define HW_BLINKER_PPI_CHANNEL 7
+
+/* 24-bit counter at 32768 Hz */
+#define HW_BLINKER_RTC_MASK 0xFFFFFFUL
+#define HW_BLINKER_TICKS(ms) ((uint32_t)((((uint64_t)(ms)) * 32768UL + 999) / 1000))
+
+/* Short flash on a pin, repeated from the timer wheel. Everything runs from
+ * the 32 kHz clock: the CPU turns the pin on from a wheel callback and
+ * programs an RTC compare, whose event is routed through PPI to the GPIOTE
+ * task turning it off. No timer keeps the 16 MHz clock requested, and with a
+ * period which is a multiple of the other periodic timers the flash shares
+ * their wakeup instead of adding one. */
+class HwBlinker {
+public:
+    HwBlinker(TimerWheel &_wheel, PinName _pin) :
+        wheel(_wheel),
+        pin(_pin),
+        onTicks(0),
+        periodTicks(0),
+        flashTimer(callback(this, &HwBlinker::flash))
+    {
+    }
+
+    /* Flash the pin for onMs every periodMs, starting now. The PPI channel is
+     * assigned through the SoftDevice, so this must be called once BLE has
+     * been initialized. */
+    void start(uint32_t onMs, uint32_t periodMs)
+    {
+        onTicks = HW_BLINKER_TICKS(onMs);
+        periodTicks = TIMER_WHEEL_MS(periodMs);
+
+        NRF_GPIO->DIRSET = (1UL << pin);
+        sd_ppi_channel_assign(HW_BLINKER_PPI_CHANNEL, &HW_BLINKER_RTC->EVENTS_COMPARE[HW_BLINKER_RTC_CC],
+                              &NRF_GPIOTE->TASKS_OUT[HW_BLINKER_GPIOTE_CHANNEL]);
+        sd_ppi_channel_enable_set(1UL << HW_BLINKER_PPI_CHANNEL);
+
+        flash();
+    }
+
+    /* Stop flashing, the pin is driven low */
+    void stop()
+    {
+        wheel.cancel(flashTimer);
+        sd_ppi_channel_enable_clr(1UL << HW_BLINKER_PPI_CHANNEL);
+        HW_BLINKER_RTC->EVTENCLR = HW_BLINKER_RTC_EVTEN_MSK;
+
+        NRF_GPIOTE->CONFIG[HW_BLINKER_GPIOTE_CHANNEL] = 0;
+        NRF_GPIO->OUTCLR = (1UL << pin);
+        NRF_GPIO->DIRSET = (1UL << pin);
+    }
+
+private:
+    /* Hand the pin to GPIOTE at `level`, the OUT task drives it low */
+    void configure(uint8_t level)
+    {
+        NRF_GPIOTE->CONFIG[HW_BLINKER_GPIOTE_CHANNEL] = (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos) |
+                                                        ((uint32_t)pin << GPIOTE_CONFIG_PSEL_Pos) |
+                                                        (GPIOTE_CONFIG_POLARITY_HiToLo << GPIOTE_CONFIG_POLARITY_Pos) |
+                                                        ((level ? GPIOTE_CONFIG_OUTINIT_High : GPIOTE_CONFIG_OUTINIT_Low) << GPIOTE_CONFIG_OUTINIT_Pos);
+    }
+
+    void flash()
+    {
+        wheel.arm(flashTimer, periodTicks);
+
+        /* The us_ticker rewrites EVTEN when it is (re)initialized */
+        HW_BLINKER_RTC->EVTENSET = HW_BLINKER_RTC_EVTEN_MSK;
+        configure(1);
+
+        uint32_t target = (HW_BLINKER_RTC->COUNTER + onTicks) & HW_BLINKER_RTC_MASK;
+        HW_BLINKER_RTC->EVENTS_COMPARE[HW_BLINKER_RTC_CC] = 0;
+        HW_BLINKER_RTC->CC[HW_BLINKER_RTC_CC] = target;
+
+        /* The compare only fires reliably at least 2 ticks ahead. If an
+         * interrupt delayed us past that, turn the pin off from here; a late
+         * compare only drives it low once more. */
+        uint32_t distance = (target - HW_BLINKER_RTC->COUNTER) & HW_BLINKER_RTC_MASK;
+        if ((distance < 2) || (distance > onTicks))
+            configure(0);
+    }
+
+    TimerWheel &wheel;
+    PinName pin;
+    uint32_t onTicks;
+    uint32_t periodTicks;
+    WheelTimer flashTimer;
+};
+
+#endif /* #ifndef __HW_BLINKER_H__ */
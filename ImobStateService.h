@@ -11,6 +11,18 @@
 #define PASSLEN 16
 #define KEYLEN 16
 #define MACLEN 6
+#define TAGLEN 16
+#define COMMANDLEN (1 + TAGLEN) // command, tag
+
+/* Single write commands, authenticated with command_mac() over the current
+ * challenge. */
+#define COMMAND_AUTHENTICATE 0x01
+#define COMMAND_RELAY 0x02
+#define COMMAND_ACTIVATE 0x03
+#define COMMAND_DEACTIVATE 0x04
+
+/* Scan response field carrying the challenge: service UUID, random bytes */
+#define CHALLENGE_SERVICE_DATA_LEN (2 + NONCE_RAND_BYTE_LEN)
 
 static bool authenticated = false;
 static bool activated = false;
@@ -19,6 +31,7 @@ static bool initial_activation = false;
 
 uint8_t defaultPass[PASSLEN] = {0};
 uint8_t defaultMac[MACLEN] = {0};
+uint8_t defaultCommand[COMMANDLEN] = {0};
 
 bool equal_arrays(uint8_t a1 [], const uint8_t a2 [], uint8_t n) 
 {
@@ -36,28 +49,46 @@ public:
     const static uint16_t IMOB_STATE_NONCE_UPDATED_CHARACTERISTIC_UUID = 0xA003;
     const static uint16_t IMOB_STATE_AUTHENTICATION_CHARACTERISTIC_UUID = 0xA004;
     const static uint16_t IMOB_STATE_ACTIVATION_CHARACTERISTIC_UUID = 0xA005;
+    const static uint16_t IMOB_STATE_CHALLENGE_CHARACTERISTIC_UUID = 0xA006;
+    const static uint16_t IMOB_STATE_COMMAND_CHARACTERISTIC_UUID = 0xA007;
+
+    /* GATT layout, see GattLayout.h */
+    const static uint8_t CHARACTERISTIC_COUNT = 7;
+    const static uint8_t CCCD_COUNT = 0;
+    const static uint16_t VALUE_BYTES = 3 * PASSLEN + 3 + COMMANDLEN;
     
     ImobStateService(BLEDevice &_ble) : 
         ble(_ble),
         passUpdated(false),
         nonceUpdated(false),
+        peerAuthenticated(false),
+        challengeValid(false),
+        challengePublished(false),
+        nextChallengeReady(false),
         activation(0),
         authentication(0),
         passCharacteristic(IMOB_STATE_PASS_CHARACTERISTIC_UUID, defaultPass),
         nonceCharacteristic(IMOB_STATE_NONCE_CHARACTERISTIC_UUID, defaultPass),
         nonceUpdatedCharacteristic(IMOB_STATE_NONCE_UPDATED_CHARACTERISTIC_UUID, (uint8_t*)&nonceUpdated),
         activationCharacteristic(IMOB_STATE_ACTIVATION_CHARACTERISTIC_UUID, &activation),
-        authenticationCharacteristic(IMOB_STATE_AUTHENTICATION_CHARACTERISTIC_UUID, &authentication)
+        authenticationCharacteristic(IMOB_STATE_AUTHENTICATION_CHARACTERISTIC_UUID, &authentication),
+        challengeCharacteristic(IMOB_STATE_CHALLENGE_CHARACTERISTIC_UUID, defaultPass),
+        commandCharacteristic(IMOB_STATE_COMMAND_CHARACTERISTIC_UUID, defaultCommand)
         
     {              
-        GattCharacteristic *charTable[] = {&passCharacteristic, &nonceCharacteristic, &nonceUpdatedCharacteristic, &activationCharacteristic, &authenticationCharacteristic};        
+        GattCharacteristic *charTable[] = {&passCharacteristic, &nonceCharacteristic, &nonceUpdatedCharacteristic, &activationCharacteristic, &authenticationCharacteristic, &challengeCharacteristic, &commandCharacteristic};
+        MBED_STATIC_ASSERT(sizeof(charTable) / sizeof(GattCharacteristic *) == CHARACTERISTIC_COUNT, "The GATT layout of the service is out of date");
         GattService imobStateService(IMOB_STATE_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
 
+        passCharacteristic.setWriteCallback(this, &ImobStateService::onPassWritten);
+        nonceCharacteristic.setWriteCallback(this, &ImobStateService::onNonceWritten);
+        activationCharacteristic.setWriteCallback(this, &ImobStateService::onActivationWritten);
+        commandCharacteristic.setWriteCallback(this, &ImobStateService::onCommandWritten);
+
         ble.addService(imobStateService);
 
         ble.gap().onDisconnection(this, &ImobStateService::onDisconnectionFilter);
         ble.gap().onConnection(this, &ImobStateService::onConnectionFilter);
-        ble.gattServer().onDataWritten(this, &ImobStateService::onDataWritten);
         
         resetAuthenticationValues();
     
@@ -69,7 +100,14 @@ public:
             
         for(uint8_t i = 0; i < MACLEN;i++)
             recentMac[i] = defaultMac[i];
+        
+        while (precomputeChallenge()) { }
+    }
     
+    /* Called when a COMMAND_RELAY has been verified */
+    void onRelayCommand(Callback<void()> callback)
+    {
+        relayCommand = callback;
     }
     
     void resetAuthenticationValues()
@@ -119,6 +157,8 @@ public:
         
     void updateAuthenticationValue(bool value)
     {
+        if (value)
+            peerAuthenticated = true;
         authenticated = value;
         authentication = (authenticated) ? 1: 0;
         ble.gattServer().write(authenticationCharacteristic.getValueHandle(), &authentication, 1);
@@ -142,21 +182,99 @@ public:
         for(uint8_t i = 0; i < PASSLEN;i++)
             p_ecb_key[i] = newCryptKey[i];
     }
- 
-protected:
-    virtual void onDataWritten(const GattWriteCallbackParams *params)
-    {          
-        if ((params->handle == passCharacteristic.getValueHandle()) && (params->len == PASSLEN) && (nonceUpdated))
+    
+    /* The peer authenticated during the current connection, even if a relay
+     * command has reset `authenticated` since. The main loop may never see
+     * `authenticated` set: the command resets it from the write handler. */
+    bool isPeerAuthenticated() const
+    {
+        return peerAuthenticated;
+    }
+    
+    /* Main loop, off the write handler path: draw the challenge to be used
+     * after the current one (the RNG pool may need a busy wait) and publish
+     * the current one, in the challenge characteristic and in the scan
+     * response so that a phone can send a command right after connecting.
+     * Returns true while there is work left. */
+    bool precomputeChallenge()
+    {
+        if (!nextChallengeReady)
         {
-            updateAuthenticationPassValues((params->data));
+            nonce_generate(nextChallenge);
+            nextChallengeReady = true;
+            return true;
         }
-        else if ((params->handle == nonceCharacteristic.getValueHandle()) && (params->len == PASSLEN))
+        
+        if (!challengeValid)
         {
-            updateAuthenticationNonceValues((params->data));
+            renewChallenge();
+            return true;
         }
-        else if ((params->handle == activationCharacteristic.getValueHandle()) && (params->len == 1) && authenticated)
+        
+        if (!challengePublished)
         {
-            updateActivationValue(*(params->data));
+            ble.gattServer().write(challengeCharacteristic.getValueHandle(), challenge, PASSLEN);
+            
+            uint8_t serviceData[CHALLENGE_SERVICE_DATA_LEN];
+            serviceData[0] = (uint8_t)IMOB_STATE_SERVICE_UUID;
+            serviceData[1] = (uint8_t)(IMOB_STATE_SERVICE_UUID >> 8);
+            memcpy(&serviceData[2], &challenge[COUNTER_BYTE_LEN], NONCE_RAND_BYTE_LEN);
+            
+            if (ble.gap().updateScanResponse(GapAdvertisingData::SERVICE_DATA, serviceData, CHALLENGE_SERVICE_DATA_LEN) != BLE_ERROR_NONE)
+                ble.gap().accumulateScanResponse(GapAdvertisingData::SERVICE_DATA, serviceData, CHALLENGE_SERVICE_DATA_LEN);
+            challengePublished = true;
+        }
+        
+        return false;
+    }
+    
+    /* Single write alternative to the nonce/pass/authentication exchange. The
+     * challenge is burnt by every attempt, so a tag can not be replayed. */
+    void executeCommand(const uint8_t data[COMMANDLEN])
+    {
+        uint8_t tag[TAGLEN];
+        if (!challengeValid || (command_mac(challenge, data[0], p_ecb_key, tag) != NRF_SUCCESS))
+        {
+            renewChallenge();
+            return;
+        }
+        
+        /* Compare all of the tag whatever its content */
+        uint8_t diff = 0;
+        for(uint8_t i = 0; i < TAGLEN; i++)
+            diff |= tag[i] ^ data[1 + i];
+        
+        renewChallenge();
+        
+        if (diff != 0)
+            return;
+        
+        updateAuthenticationValue(true);
+        initial_activation = true;
+        
+        switch (data[0])
+        {
+            case COMMAND_RELAY:
+                if (relayCommand)
+                    relayCommand();
+                break;
+            case COMMAND_ACTIVATE:
+                updateActivationValue(1);
+                break;
+            case COMMAND_DEACTIVATE:
+                updateActivationValue(0);
+                break;
+            default:
+                break;
+        }
+    }
+ 
+protected:
+    virtual void onPassWritten(const GattWriteCallbackParams *params)
+    {          
+        if ((params->len == PASSLEN) && (nonceUpdated))
+        {
+            updateAuthenticationPassValues((params->data));
         }
         
         if(passUpdated)
@@ -173,10 +291,35 @@ protected:
         }
     }
     
+    virtual void onNonceWritten(const GattWriteCallbackParams *params)
+    {          
+        if (params->len == PASSLEN)
+        {
+            updateAuthenticationNonceValues((params->data));
+        }
+    }
+    
+    virtual void onActivationWritten(const GattWriteCallbackParams *params)
+    {          
+        if ((params->len == 1) && authenticated)
+        {
+            updateActivationValue(*(params->data));
+        }
+    }
+    
+    virtual void onCommandWritten(const GattWriteCallbackParams *params)
+    {          
+        if (params->len == COMMANDLEN)
+        {
+            executeCommand((params->data));
+        }
+    }
+    
     void onDisconnectionFilter(const Gap::DisconnectionCallbackParams_t *params)
     {   
         resetAuthenticationValues();        
         userIsConnected = false;
+        renewChallenge();
     }
     
     void onConnectionFilter(const Gap::ConnectionCallbackParams_t* params)
@@ -198,18 +341,38 @@ protected:
             ble.updateCharacteristicValue(nonceCharacteristic.getValueHandle(), nonce, PASSLEN);
         }
         
+        peerAuthenticated = false;
         userIsConnected = true;              
     }
 
 private:
+    /* Switch to the precomputed challenge. Without one, commands are refused
+     * until precomputeChallenge() has drawn it. */
+    void renewChallenge()
+    {
+        challengeValid = nextChallengeReady;
+        if (nextChallengeReady)
+            memcpy(challenge, nextChallenge, PASSLEN);
+        nextChallengeReady = false;
+        challengePublished = false;
+    }
+    
     BLEDevice &ble;
     bool passUpdated;
     bool nonceUpdated;   
+    bool peerAuthenticated;
+    bool challengeValid;
+    bool challengePublished;
+    bool nextChallengeReady;
     
     uint8_t pass[PASSLEN];    
     uint8_t nonce[PASSLEN];
     uint8_t correctPass[PASSLEN];
     uint8_t p_ecb_key[KEYLEN];
+    uint8_t challenge[PASSLEN];
+    uint8_t nextChallenge[PASSLEN];
+    
+    Callback<void()> relayCommand;
     
     uint8_t recentMac[MACLEN];
     
@@ -222,6 +385,8 @@ private:
     ReadOnlyGattCharacteristic < uint8_t > nonceUpdatedCharacteristic;
     ReadWriteGattCharacteristic < uint8_t > activationCharacteristic;
     ReadOnlyGattCharacteristic < uint8_t > authenticationCharacteristic;
+    ReadOnlyArrayGattCharacteristic <uint8_t, sizeof(challenge)> challengeCharacteristic;
+    WriteOnlyArrayGattCharacteristic <uint8_t, COMMANDLEN> commandCharacteristic;
     
         
 };
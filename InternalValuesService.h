@@ -5,6 +5,7 @@
 #include "ble/BLE.h"
 #include "ble/Gap.h"
 #include "ImobStateService.h"
+#include "BootProfiler.h"
 
 class InternalValuesService {
 public:
@@ -15,6 +16,12 @@ public:
     const static uint16_t ID2_CHARACTERISTIC_UUID = 0xB004;
     const static uint16_t CPC_CHARACTERISTIC_UUID = 0xB005;
     const static uint16_t DPC_CHARACTERISTIC_UUID = 0xB006;
+    const static uint16_t BOOT_PROFILE_CHARACTERISTIC_UUID = 0xB007;
+
+    /* GATT layout, see GattLayout.h */
+    const static uint8_t CHARACTERISTIC_COUNT = 7;
+    const static uint8_t CCCD_COUNT = 2;
+    const static uint16_t VALUE_BYTES = 2 + 4 * 4 + BOOT_PROFILE_LEN;
 
     InternalValuesService(BLEDevice &_ble, ImobStateService * imobStateServicePtr) : 
         ble(_ble),
@@ -30,11 +37,16 @@ public:
         Id1Characteristic(ID1_CHARACTERISTIC_UUID, &id1),
         Id2Characteristic(ID2_CHARACTERISTIC_UUID, &id2),
         ChargeProgramCyclesCharacteristic(CPC_CHARACTERISTIC_UUID, &chargeProgramCycles),
-        DischargeProgramCyclesCharacteristic(DPC_CHARACTERISTIC_UUID, &dischargeProgramCycles)
+        DischargeProgramCyclesCharacteristic(DPC_CHARACTERISTIC_UUID, &dischargeProgramCycles),
+        BootProfileCharacteristic(BOOT_PROFILE_CHARACTERISTIC_UUID, bootProfile)
     {
-        GattCharacteristic *charTable[] = {&LipoChargerCharacteristic, &ContactCharacteristic, &Id1Characteristic, &Id2Characteristic, &ChargeProgramCyclesCharacteristic, &DischargeProgramCyclesCharacteristic};
+        GattCharacteristic *charTable[] = {&LipoChargerCharacteristic, &ContactCharacteristic, &Id1Characteristic, &Id2Characteristic, &ChargeProgramCyclesCharacteristic, &DischargeProgramCyclesCharacteristic, &BootProfileCharacteristic};
+        MBED_STATIC_ASSERT(sizeof(charTable) / sizeof(GattCharacteristic *) == CHARACTERISTIC_COUNT, "The GATT layout of the service is out of date");
         GattService internalValuesService(INTERNAL_VALUES_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
 
+        /* Published once the boot has completed */
+        memset(bootProfile, BOOT_STAGE_NONE, sizeof(bootProfile));
+
         ble.addService(internalValuesService);
                
         uint8_t auxPass[PASSLEN];
@@ -83,6 +95,16 @@ public:
         contactState = newContactState;
         ble.gattServer().write(ContactCharacteristic.getValueHandle(), &contactState, 1);
     }
+    
+    uint8_t getContactState()
+    {
+        return contactState;
+    }
+    
+    uint32_t getId1()
+    {
+        return id1;
+    }
         
     void updateDischargeProgramCyclesCharacteristic()
     {
@@ -95,9 +117,14 @@ public:
         dischargeProgramCycles = 0;
     }
     
-    void incrementDischargeProgramCycles()
+    void incrementDischargeProgramCycles(uint32_t cycles = 1)
+    {
+        dischargeProgramCycles += cycles;
+    }
+    
+    uint32_t getDischargeProgramCycles()
     {
-        dischargeProgramCycles++;
+        return dischargeProgramCycles;
     }
     
     void updateChargeProgramCyclesCharacteristic()
@@ -111,11 +138,30 @@ public:
         chargeProgramCycles = 0;
     }
     
-    void incrementChargeProgramCycles()
+    void incrementChargeProgramCycles(uint32_t cycles = 1)
     {
-        chargeProgramCycles++;
+        chargeProgramCycles += cycles;
     }        
     
+    uint32_t getChargeProgramCycles()
+    {
+        return chargeProgramCycles;
+    }
+    
+    /* Counts accumulated before the last reset */
+    void restoreProgramCycles(uint32_t charge, uint32_t discharge)
+    {
+        chargeProgramCycles = charge;
+        dischargeProgramCycles = discharge;
+    }
+    
+    /* Stage durations of the last boot, see BootProfiler.h */
+    void updateBootProfile(const uint8_t *profile)
+    {
+        memcpy(bootProfile, profile, BOOT_PROFILE_LEN);
+        ble.gattServer().write(BootProfileCharacteristic.getValueHandle(), bootProfile, BOOT_PROFILE_LEN);
+    }
+    
 private:
     BLEDevice &ble;
     uint8_t lipoChargerState;
@@ -130,6 +176,7 @@ private:
     uint8_t id2Array[4];
     uint8_t chargeProgramCyclesArray[4];
     uint8_t dischargeProgramCyclesArray[4];
+    uint8_t bootProfile[BOOT_PROFILE_LEN];
             
     ImobStateService * ISS;
     
@@ -140,6 +187,7 @@ private:
     ReadOnlyGattCharacteristic < uint32_t > Id2Characteristic;
     ReadOnlyGattCharacteristic < uint32_t > ChargeProgramCyclesCharacteristic;
     ReadOnlyGattCharacteristic < uint32_t > DischargeProgramCyclesCharacteristic;    
+    ReadOnlyArrayGattCharacteristic < uint8_t, BOOT_PROFILE_LEN > BootProfileCharacteristic;
     
 };
 
@@ -0,0 +1,315 @@
+#ifndef __OUTPUT_SEQUENCER_H__
+#define __OUTPUT_SEQUENCER_H__
+
+#include "mbed.h"
+#include "nrf_soc.h"
+#include "TimerWheel.h"
+
+/* Resources reserved for the sequencer. RTC1 is the us_ticker counter, which
+ * only uses the first compare channels; HwBlinker owns CC[3], GPIOTE channel 3
+ * and PPI channel 7. */
+#define SEQUENCER_RTC NRF_RTC1
+#define SEQUENCER_RTC_CC 2
+#define SEQUENCER_RTC_EVTEN_MSK RTC_EVTENSET_COMPARE2_Msk
+#define SEQUENCER_GPIOTE_FIRST_CHANNEL 1
+#define SEQUENCER_PPI_FIRST_CHANNEL 8
+#define SEQUENCER_MAX_OUTPUTS 2
+
+/* 24-bit counter at 32768 Hz, delays must stay below half its range (256 s) */
+#define SEQUENCER_RTC_MASK 0xFFFFFFUL
+#define SEQUENCER_TICKS(ms) ((uint32_t)((((uint64_t)(ms)) * 32768UL + 999) / 1000))
+
+/* One edge of a timeline: drive `pin` to `level`, `delay` ms after the
+ * previous step (after start() for the first one). Steps following another
+ * one with a 0 delay happen on the same compare event. */
+struct SequencerStep {
+    PinName pin;
+    uint8_t level;
+    uint32_t delay; // ms
+};
+
+/* Plays a constant timeline of output edges. Each edge is produced by the
+ * hardware: an RTC compare event routed through PPI to the GPIOTE task of the
+ * pin, so its timing does not depend on interrupt or main loop latency. The
+ * CPU only programs the next compare, from a timer wheel callback run in the
+ * main loop once the previous edge happened. A step due before it could be
+ * programmed (0 delay first step, late main loop) is applied by the CPU and
+ * the following ones keep their place on the timeline. */
+class OutputSequencer {
+public:
+    enum Status {
+        STATUS_IDLE,
+        STATUS_RUNNING,
+        STATUS_DONE,
+        STATUS_ABORTED
+    };
+
+    OutputSequencer(TimerWheel &_wheel) :
+        wheel(_wheel),
+        steps(NULL),
+        count(0),
+        next(0),
+        groupEnd(0),
+        outputCount(0),
+        status(STATUS_IDLE),
+        reference(0),
+        target(0),
+        stepTimer(callback(this, &OutputSequencer::onStepTimer))
+    {
+    }
+
+    /* Called from the main loop after every step, including the last one and
+     * an abort */
+    void onStep(Callback<void()> _stepCallback)
+    {
+        stepCallback = _stepCallback;
+    }
+
+    /* Play a timeline, which must stay valid until the sequencer is done. The
+     * PPI channels are assigned through the SoftDevice, so this must be called
+     * once BLE has been initialized. Returns false if a timeline is already
+     * playing or if it drives more than SEQUENCER_MAX_OUTPUTS pins. */
+    bool start(const SequencerStep *_steps, uint8_t _count)
+    {
+        if (status == STATUS_RUNNING)
+            return false;
+
+        outputCount = 0;
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            if (findOutput(_steps[i].pin) >= 0)
+                continue;
+            if (outputCount == SEQUENCER_MAX_OUTPUTS)
+                return false;
+            outputs[outputCount].pin = _steps[i].pin;
+            outputs[outputCount].level = (NRF_GPIO->OUT >> _steps[i].pin) & 1;
+            outputs[outputCount].initialLevel = outputs[outputCount].level;
+            outputCount++;
+        }
+
+        for (uint8_t i = 0; i < outputCount; i++)
+        {
+            NRF_GPIO->DIRSET = (1UL << outputs[i].pin);
+            configure(i, outputs[i].level);
+            sd_ppi_channel_assign(SEQUENCER_PPI_FIRST_CHANNEL + i, &SEQUENCER_RTC->EVENTS_COMPARE[SEQUENCER_RTC_CC],
+                                  &NRF_GPIOTE->TASKS_OUT[SEQUENCER_GPIOTE_FIRST_CHANNEL + i]);
+        }
+        SEQUENCER_RTC->EVTENSET = SEQUENCER_RTC_EVTEN_MSK;
+
+        steps = _steps;
+        count = _count;
+        next = 0;
+        status = STATUS_RUNNING;
+        reference = SEQUENCER_RTC->COUNTER;
+
+        scheduleNext();
+        return true;
+    }
+
+    /* Stop the timeline and drive the outputs back to their levels before
+     * start() */
+    void abort()
+    {
+        if (status != STATUS_RUNNING)
+            return;
+
+        disarm();
+        for (uint8_t i = 0; i < outputCount; i++)
+            setOutput(i, outputs[i].initialLevel);
+        release();
+        status = STATUS_ABORTED;
+
+        if (stepCallback)
+            stepCallback();
+    }
+
+    Status getStatus() const
+    {
+        return status;
+    }
+
+    bool isRunning() const
+    {
+        return status == STATUS_RUNNING;
+    }
+
+    /* Index of the next step to be played */
+    uint8_t getStep() const
+    {
+        return next;
+    }
+
+    /* Level last driven on a pin by the sequencer, 0 if it never drove it */
+    uint8_t getLevel(PinName pin) const
+    {
+        int index = findOutput(pin);
+        return (index < 0) ? 0 : outputs[index].level;
+    }
+
+private:
+    int findOutput(PinName pin) const
+    {
+        for (uint8_t i = 0; i < outputCount; i++)
+        {
+            if (outputs[i].pin == pin)
+                return i;
+        }
+        return -1;
+    }
+
+    /* Hand the pin to GPIOTE at its current level, the OUT task drives it to
+     * `nextLevel` */
+    void configure(uint8_t index, uint8_t nextLevel)
+    {
+        NRF_GPIOTE->CONFIG[SEQUENCER_GPIOTE_FIRST_CHANNEL + index] =
+            (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos) |
+            ((uint32_t)outputs[index].pin << GPIOTE_CONFIG_PSEL_Pos) |
+            ((nextLevel ? GPIOTE_CONFIG_POLARITY_LoToHi : GPIOTE_CONFIG_POLARITY_HiToLo) << GPIOTE_CONFIG_POLARITY_Pos) |
+            ((outputs[index].level ? GPIOTE_CONFIG_OUTINIT_High : GPIOTE_CONFIG_OUTINIT_Low) << GPIOTE_CONFIG_OUTINIT_Pos);
+    }
+
+    /* Keep the GPIO register in line with the pin, it drives it again once
+     * GPIOTE releases it */
+    void mirror(uint8_t index)
+    {
+        if (outputs[index].level)
+            NRF_GPIO->OUTSET = (1UL << outputs[index].pin);
+        else
+            NRF_GPIO->OUTCLR = (1UL << outputs[index].pin);
+    }
+
+    /* Drive an output at once, from the CPU */
+    void setOutput(uint8_t index, uint8_t level)
+    {
+        outputs[index].level = level;
+        configure(index, level);
+        mirror(index);
+    }
+
+    uint32_t ppiMask() const
+    {
+        return ((1UL << outputCount) - 1) << SEQUENCER_PPI_FIRST_CHANNEL;
+    }
+
+    void disarm()
+    {
+        wheel.cancel(stepTimer);
+        sd_ppi_channel_enable_clr(ppiMask());
+        SEQUENCER_RTC->EVENTS_COMPARE[SEQUENCER_RTC_CC] = 0;
+    }
+
+    void release()
+    {
+        SEQUENCER_RTC->EVTENCLR = SEQUENCER_RTC_EVTEN_MSK;
+        for (uint8_t i = 0; i < outputCount; i++)
+            NRF_GPIOTE->CONFIG[SEQUENCER_GPIOTE_FIRST_CHANNEL + i] = 0;
+    }
+
+    /* Program the group of steps starting at `next`, or play it now if it is
+     * already due */
+    void scheduleNext()
+    {
+        while (status == STATUS_RUNNING)
+        {
+            if (next >= count)
+            {
+                release();
+                status = STATUS_DONE;
+                return;
+            }
+
+            uint32_t delay = SEQUENCER_TICKS(steps[next].delay);
+            target = (reference + delay) & SEQUENCER_RTC_MASK;
+
+            groupEnd = next + 1;
+            while ((groupEnd < count) && (steps[groupEnd].delay == 0))
+                groupEnd++;
+
+            /* The compare only fires reliably at least 2 ticks ahead */
+            uint32_t distance = (target - SEQUENCER_RTC->COUNTER) & SEQUENCER_RTC_MASK;
+            if ((delay != 0) && (distance >= 2) && (distance <= delay))
+            {
+                uint32_t mask = 0;
+                for (uint8_t i = next; i < groupEnd; i++)
+                {
+                    int index = findOutput(steps[i].pin);
+                    configure(index, steps[i].level);
+                    mask |= (1UL << (SEQUENCER_PPI_FIRST_CHANNEL + index));
+                }
+
+                sd_ppi_channel_enable_clr(ppiMask());
+                /* The us_ticker rewrites EVTEN when it is (re)initialized */
+                SEQUENCER_RTC->EVTENSET = SEQUENCER_RTC_EVTEN_MSK;
+                SEQUENCER_RTC->EVENTS_COMPARE[SEQUENCER_RTC_CC] = 0;
+                SEQUENCER_RTC->CC[SEQUENCER_RTC_CC] = target;
+                sd_ppi_channel_enable_set(mask);
+
+                /* One more tick, the wheel may fire up to a tick early */
+                wheel.arm(stepTimer, TIMER_WHEEL_MS(steps[next].delay) + 1);
+                return;
+            }
+
+            for (uint8_t i = next; i < groupEnd; i++)
+                setOutput(findOutput(steps[i].pin), steps[i].level);
+            completeGroup();
+        }
+    }
+
+    void completeGroup()
+    {
+        reference = target;
+        next = groupEnd;
+        if (next >= count)
+        {
+            release();
+            status = STATUS_DONE;
+        }
+
+        if (stepCallback)
+            stepCallback();
+    }
+
+    void onStepTimer()
+    {
+        if (status != STATUS_RUNNING)
+            return;
+
+        if (!SEQUENCER_RTC->EVENTS_COMPARE[SEQUENCER_RTC_CC])
+        {
+            wheel.arm(stepTimer, 1);
+            return;
+        }
+
+        disarm();
+        for (uint8_t i = next; i < groupEnd; i++)
+        {
+            int index = findOutput(steps[i].pin);
+            outputs[index].level = steps[i].level;
+            mirror(index);
+        }
+        completeGroup();
+
+        scheduleNext();
+    }
+
+    struct Output {
+        PinName pin;
+        uint8_t level;
+        uint8_t initialLevel;
+    };
+
+    TimerWheel &wheel;
+    const SequencerStep *steps;
+    uint8_t count;
+    uint8_t next;
+    uint8_t groupEnd;
+    Output outputs[SEQUENCER_MAX_OUTPUTS];
+    uint8_t outputCount;
+    Status status;
+    uint32_t reference;
+    uint32_t target;
+    WheelTimer stepTimer;
+    Callback<void()> stepCallback;
+};
+
+#endif /* #ifndef __OUTPUT_SEQUENCER_H__ */
@@ -0,0 +1,69 @@
+#ifndef __POWER_MANAGER_H__
+#define __POWER_MANAGER_H__
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "nrf_soc.h"
+#include "TimerWheel.h"
+
+/* Tickless idle for the main loop. There is no periodic tick: the CPU sleeps
+ * in sd_app_evt_wait() until the next producer needs it, i.e.
+ *   - the next timer wheel event (deadlines and sensor sampling),
+ *   - pending BLE stack work, signaled by the stack itself,
+ *   - any interrupt (accelerometer, TWI) or explicit requestRun().
+ * The loop is expected to look like
+ *   while (true) { ble.processEvents(); wheel.poll(); ...; powerManager.sleep(); } */
+class PowerManager {
+public:
+    PowerManager(RtcTimerWheel &_wheel) :
+        wheel(_wheel),
+        runPending(false),
+        wakeups(0)
+    {
+    }
+
+    /* Hook the BLE stack, once it has been initialized */
+    void start(BLE &ble)
+    {
+        ble.onEventsToProcess(BLE::OnEventsToProcessCallback_t(this, &PowerManager::onEventsToProcess));
+    }
+
+    /* Have the next sleep() return at once, may be called from an ISR */
+    void requestRun()
+    {
+        runPending = true;
+    }
+
+    /* Program the next timer wakeup and sleep until then, unless work is
+     * already pending. An interrupt taken since the loop iteration started
+     * leaves the event register set, so the wait cannot miss it. */
+    void sleep()
+    {
+        wheel.schedule();
+
+        if (!runPending)
+        {
+            sd_app_evt_wait();
+            wakeups++;
+        }
+        runPending = false;
+    }
+
+    /* Number of times the CPU has been woken from sleep() */
+    uint32_t getWakeups() const
+    {
+        return wakeups;
+    }
+
+private:
+    void onEventsToProcess(BLE::OnEventsToProcessCallbackContext *context)
+    {
+        requestRun();
+    }
+
+    RtcTimerWheel &wheel;
+    volatile bool runPending;
+    uint32_t wakeups;
+};
+
+#endif /* #ifndef __POWER_MANAGER_H__ */
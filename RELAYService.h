@@ -5,35 +5,54 @@
 #include "ble/BLE.h"
 #include "ble/Gap.h"
 #include "ImobStateService.h"
+#include "OutputSequencer.h"
 
-#define RELAY_TIME 120000000 // us
-#define CTR12V_TIME 100000 // us
-
-Ticker waitTicker;
-bool activation_in_progress = false;
+#define RELAY_PIN P0_10
+#define CTR12V_PIN P0_3
 
+#define RELAY_TIME 120000 // ms
+#define CTR12V_TIME 100 // ms
 
+/* Activation: Ctr12v pre-pulse, relay hold, Ctr12v post-pulse */
+static const SequencerStep relayTimeline[] = {
+    {CTR12V_PIN, 1, 0},
+    {RELAY_PIN, 1, CTR12V_TIME},
+    {RELAY_PIN, 0, RELAY_TIME},
+    {CTR12V_PIN, 0, CTR12V_TIME}
+};
 
 class RELAYService {
 public:
     const static uint16_t RELAY_SERVICE_UUID = 0xC000;
     const static uint16_t RELAY_STATE_CHARACTERISTIC_UUID = 0xC001;
 
-    RELAYService(BLEDevice &_ble, ImobStateService * imobStateServicePtr) : 
+    /* GATT layout, see GattLayout.h */
+    const static uint8_t CHARACTERISTIC_COUNT = 1;
+    const static uint8_t CCCD_COUNT = 1;
+    const static uint16_t VALUE_BYTES = 1;
+
+    RELAYService(BLEDevice &_ble, ImobStateService * imobStateServicePtr, TimerWheel &wheel) : 
         ble(_ble),
         relayState(0),
-        actuatedRelay(P0_10,0),
-        Ctr12v(P0_3,0),        
+        sequencer(wheel),
         ISS(imobStateServicePtr),
         RelayCharacteristic(RELAY_STATE_CHARACTERISTIC_UUID, &relayState, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY)
     {
+        /* Both outputs are low until the sequencer drives them */
+        NRF_GPIO->OUTCLR = (1UL << RELAY_PIN) | (1UL << CTR12V_PIN);
+        NRF_GPIO->DIRSET = (1UL << RELAY_PIN) | (1UL << CTR12V_PIN);
+
         GattCharacteristic *charTable[] = {&RelayCharacteristic};
+        MBED_STATIC_ASSERT(sizeof(charTable) / sizeof(GattCharacteristic *) == CHARACTERISTIC_COUNT, "The GATT layout of the service is out of date");
         GattService relayService(RELAY_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
 
+        RelayCharacteristic.setWriteCallback(this, &RELAYService::onRelayWritten);
+
         ble.addService(relayService);
 
         ble.gap().onDisconnection(this, &RELAYService::onDisconnectionFilter);
-        ble.gattServer().onDataWritten(this, &RELAYService::onDataWritten);
+        ISS->onRelayCommand(callback(this, &RELAYService::onRelayCommand));
+        sequencer.onStep(callback(this, &RELAYService::onSequencerStep));
     }
 
     GattAttribute::Handle_t getValueHandle() const 
@@ -43,19 +62,19 @@ public:
     
     void updateRelayState(uint8_t newRelayState) {
         relayState = newRelayState;
-        actuatedRelay = newRelayState;
         ble.gattServer().write(RelayCharacteristic.getValueHandle(), &relayState, 1);
     }
     
-    void activate()
+    uint8_t getRelayState() const
     {
-        if(!activation_in_progress)
-        {
-            flipCtr12v();       
-            waitTicker.attach(callback(this, &RELAYService::internalUpdateRelaystate), CTR12V_TIME/1000000.0);
-        }
+        return relayState;
     }
     
+    void activate()
+    {
+        /* No-op while an activation is in progress */
+        sequencer.start(relayTimeline, sizeof(relayTimeline) / sizeof(SequencerStep));
+    }
     
 
 protected:
@@ -69,54 +88,38 @@ protected:
         }
     }
     
-    virtual void onDataWritten(const GattWriteCallbackParams *params)
+    virtual void onRelayWritten(const GattWriteCallbackParams *params)
     {          
-        if ((params->handle == RelayCharacteristic.getValueHandle()) && (params->len == 1) && authenticated)
+        if ((params->len == 1) && authenticated)
         {
-            activate();
-            ISS->resetAuthenticationValues();
-            
-            if(!activated)
-                ISS->updateActivationValue(1);
+            onRelayCommand();
         }
         //else
         //    updateRelayState(0);
     }     
+    
+    void onRelayCommand()
+    {
+        activate();
+        ISS->resetAuthenticationValues();
+        
+        if(!activated)
+            ISS->updateActivationValue(1);
+    }
 
 private:
 
-    void internalUpdateRelaystate()
-    {   
-        uint8_t aux_relayState = (relayState) ? 0: 1;
-        updateRelayState(aux_relayState);
-        
-        if(aux_relayState) 
-        {
-            waitTicker.detach();
-            waitTicker.attach(callback(this, &RELAYService::internalUpdateRelaystate), RELAY_TIME/1000000.0);
-        }
-        else
-        {
-            waitTicker.detach();
-            waitTicker.attach(callback(this, &RELAYService::flipCtr12v), CTR12V_TIME/1000000.0);
-        }
-    }
-    
-    void flipCtr12v()
+    /* Main loop context, the edges themselves are already out */
+    void onSequencerStep()
     {
-         Ctr12v = !Ctr12v;
-         if(!Ctr12v)
-         {
-             waitTicker.detach();
-             activation_in_progress = false;
-         }
-         else activation_in_progress = true;
+        uint8_t newRelayState = sequencer.getLevel(RELAY_PIN);
+        if (newRelayState != relayState)
+            updateRelayState(newRelayState);
     }
     
     BLEDevice &ble;
     uint8_t relayState;
-    DigitalOut actuatedRelay;
-    DigitalOut Ctr12v;
+    OutputSequencer sequencer;
     
     ImobStateService * ISS;
 
@@ -0,0 +1,141 @@
+#ifndef __RECONNECTION_ADVERTISER_H__
+#define __RECONNECTION_ADVERTISER_H__
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "ble/Gap.h"
+#include "TimerWheel.h"
+
+/* Time during which only the last authenticated phone may connect, once the
+ * directed advertising burst (1.28 s) is over */
+#define RECONNECT_WHITELIST_TIME 10000 // ms
+
+/* Restarts advertising after a disconnection in three stages, so that the last
+ * authenticated phone gets back in as fast as possible:
+ *   1. high duty cycle directed advertising to its address,
+ *   2. undirected advertising accepting connection requests from it only, the
+ *      status and challenge stay visible to every scanner,
+ *   3. open advertising.
+ * A phone using a resolvable private address can not be whitelisted without
+ * its IRK, the second stage is skipped for it. Runs from the main loop
+ * (BLE event handling and timer wheel). */
+class ReconnectionAdvertiser {
+public:
+    enum Stage {
+        STAGE_OPEN,
+        STAGE_DIRECTED,
+        STAGE_WHITELIST
+    };
+
+    ReconnectionAdvertiser(TimerWheel &_wheel) :
+        wheel(_wheel),
+        gap(NULL),
+        stage(STAGE_OPEN),
+        connected(false),
+        trusted(false),
+        whitelistTimer(callback(this, &ReconnectionAdvertiser::onWhitelistEnd))
+    {
+        whitelist.addresses = &trustedPeer;
+        whitelist.size = 1;
+        whitelist.capacity = 1;
+    }
+
+    void start(Gap &_gap)
+    {
+        gap = &_gap;
+        gap->onConnection(this, &ReconnectionAdvertiser::onConnection);
+        gap->onTimeout(Gap::TimeoutEventCallback_t(this, &ReconnectionAdvertiser::onTimeout));
+    }
+
+    /* The connected peer authenticated, it is the one to call back */
+    void peerAuthenticated()
+    {
+        if (!connected || (trusted && (peer.type == trustedPeer.type) &&
+            (memcmp(peer.address, trustedPeer.address, sizeof(peer.address)) == 0)))
+            return;
+
+        trustedPeer = peer;
+        trusted = true;
+    }
+
+    /* Start advertising after a disconnection */
+    void restartAdvertising()
+    {
+        connected = false;
+
+        if (trusted && (gap->startDirectedAdvertising(trustedPeer.type, trustedPeer.address) == BLE_ERROR_NONE))
+        {
+            stage = STAGE_DIRECTED;
+            return;
+        }
+
+        startWhitelisted();
+    }
+
+    Stage getStage() const
+    {
+        return stage;
+    }
+
+private:
+    void onConnection(const Gap::ConnectionCallbackParams_t *params)
+    {
+        connected = true;
+        peer.type = params->peerAddrType;
+        memcpy(peer.address, params->peerAddr, sizeof(peer.address));
+
+        wheel.cancel(whitelistTimer);
+        if (stage == STAGE_WHITELIST)
+            gap->setAdvertisingPolicyMode(Gap::ADV_POLICY_IGNORE_WHITELIST);
+        stage = STAGE_OPEN;
+    }
+
+    void onTimeout(Gap::TimeoutSource_t source)
+    {
+        /* End of the directed burst without a connection */
+        if ((source == Gap::TIMEOUT_SRC_ADVERTISING) && (stage == STAGE_DIRECTED) && !connected)
+            startWhitelisted();
+    }
+
+    void startWhitelisted()
+    {
+        if (trusted && (trustedPeer.type != BLEProtocol::AddressType::RANDOM_PRIVATE_RESOLVABLE) &&
+            (gap->setWhitelist(whitelist) == BLE_ERROR_NONE) &&
+            (gap->setAdvertisingPolicyMode(Gap::ADV_POLICY_FILTER_CONN_REQS) == BLE_ERROR_NONE))
+        {
+            if (gap->startAdvertising() == BLE_ERROR_NONE)
+            {
+                stage = STAGE_WHITELIST;
+                wheel.arm(whitelistTimer, TIMER_WHEEL_MS(RECONNECT_WHITELIST_TIME));
+                return;
+            }
+            gap->setAdvertisingPolicyMode(Gap::ADV_POLICY_IGNORE_WHITELIST);
+        }
+
+        stage = STAGE_OPEN;
+        gap->startAdvertising();
+    }
+
+    void onWhitelistEnd()
+    {
+        if (stage != STAGE_WHITELIST)
+            return;
+
+        gap->stopAdvertising();
+        gap->setAdvertisingPolicyMode(Gap::ADV_POLICY_IGNORE_WHITELIST);
+        stage = STAGE_OPEN;
+        gap->startAdvertising();
+    }
+
+    TimerWheel &wheel;
+    Gap *gap;
+    Stage stage;
+    bool connected;
+    bool trusted;
+    BLEProtocol::Address_t peer;
+    BLEProtocol::Address_t trustedPeer;
+    Gap::Whitelist_t whitelist;
+    WheelTimer whitelistTimer;
+};
+
+#endif /* #ifndef __RECONNECTION_ADVERTISER_H__ */
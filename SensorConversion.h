@@ -0,0 +1,95 @@
+#ifndef __SENSOR_CONVERSION_H__
+#define __SENSOR_CONVERSION_H__
+
+#include "mbed.h"
+
+/* Integer conversion of the analog inputs. The Cortex-M0 has no FPU, so the
+ * main loop works on AnalogIn::read_u16() values (0 - ADC_FULL_SCALE) and Q16
+ * calibration factors instead of AnalogIn::read() floats.
+ * On the nRF51 read_u16() is not scaled to 16 bits, it returns the 10-bit
+ * result of the ADC, and read() is that result / ADC_FULL_SCALE. */
+
+#define ADC_BITS 10
+#define ADC_FULL_SCALE ((1UL << ADC_BITS) - 1)
+
+/* Largest reading at or below a fraction of full scale, folded by the
+ * compiler when used with a constant: `raw > ADC_RAW(f)` is `read() > f`. */
+#define ADC_RAW(fraction) ((uint16_t)((fraction) * ADC_FULL_SCALE))
+
+#define Q16_ONE 0x10000UL
+/* Largest calibration factor (4.0), keeps adcScale() within 32 bits. */
+#define ADC_SCALE_MAX (4 * Q16_ONE)
+
+/* LiPo discharge curve, battery percentage against the calibrated reading
+ * (full scale = 4.2 V). Readings below 3/4 of full scale (3.15 V) are empty,
+ * above that the curve is sampled every 1/128 of full scale (~33 mV) and
+ * interpolated. Generated from the usual single cell 4.20 V (100%) to
+ * 3.27 V (0%) open circuit voltage curve. */
+#define LIPO_CURVE_START (3UL << (ADC_BITS - 2))
+#define LIPO_CURVE_SHIFT (ADC_BITS - 7)
+#define LIPO_CURVE_POINTS 33
+
+static const uint8_t lipoCurve[LIPO_CURVE_POINTS] = {
+      0,   0,   0,   0,   0,   1,   1,   2,
+      2,   3,   3,   4,   4,   5,   5,   7,
+      9,  14,  23,  31,  42,  50,  60,  64,
+     68,  73,  78,  81,  84,  89,  93,  97,
+    100
+};
+
+/**
+ * Apply a Q16 calibration factor (up to ADC_SCALE_MAX) to a raw ADC reading,
+ * saturating at full scale. The factor is rounded up to Q12 so that the
+ * product fits in 32 bits.
+ */
+static inline uint16_t adcScale(uint16_t raw, uint32_t scaleQ16)
+{
+    uint32_t scaled = ((uint32_t)raw * ((scaleQ16 + 15) >> 4)) >> 12;
+    return (scaled > ADC_FULL_SCALE) ? ADC_FULL_SCALE : (uint16_t)scaled;
+}
+
+/**
+ * Q16 factor which maps a raw reading to full scale, used to calibrate the
+ * battery divider when the charger reports a full battery.
+ */
+static inline uint32_t adcFullScaleFactor(uint16_t raw)
+{
+    if (raw == 0)
+        return Q16_ONE;
+    /* Rounded up, the calibration reading must scale to full scale */
+    uint32_t factor = ((ADC_FULL_SCALE << 16) + raw - 1) / raw;
+    return (factor > ADC_SCALE_MAX) ? ADC_SCALE_MAX : factor;
+}
+
+/**
+ * Battery percentage (0 - 100) proportional to the reading, full scale being
+ * 100%. Used until the divider has been calibrated, the discharge curve only
+ * applies once a full battery has given the reading of 4.2 V.
+ */
+static inline uint8_t adcPercent(uint16_t raw)
+{
+    return (uint8_t)(((uint32_t)raw * 100) / ADC_FULL_SCALE);
+}
+
+/**
+ * Battery percentage (0 - 100) for a calibrated reading.
+ */
+static inline uint8_t lipoPercent(uint16_t scaled)
+{
+    if (scaled < LIPO_CURVE_START)
+        return 0;
+
+    /* +1 so that full scale lands exactly on the last point */
+    uint32_t offset = (uint32_t)scaled + 1 - LIPO_CURVE_START;
+    uint32_t index = offset >> LIPO_CURVE_SHIFT;
+    uint32_t fraction = offset & ((1UL << LIPO_CURVE_SHIFT) - 1);
+
+    if (index >= LIPO_CURVE_POINTS - 1)
+        return lipoCurve[LIPO_CURVE_POINTS - 1];
+
+    uint32_t low = lipoCurve[index];
+    uint32_t high = lipoCurve[index + 1];
+    return (uint8_t)(low + (((high - low) * fraction) >> LIPO_CURVE_SHIFT));
+}
+
+#endif /* #ifndef __SENSOR_CONVERSION_H__ */
@@ -0,0 +1,405 @@
+#ifndef __STATE_STORE_H__
+#define __STATE_STORE_H__
+
+#include "mbed.h"
+#include "TimerWheel.h"
+
+extern "C" {
+#include "fds.h"
+}
+
+/* Application state kept across resets, on top of the SDK flash data storage
+ * (fds). Every key is one fds record of type STATE_STORE_RECORD_TYPE whose
+ * instance is the key, holding a word sized value.
+ *
+ * All the records are read back in a single pass once fds is initialized.
+ * Afterwards set() only updates the RAM copy: a value differing from the one
+ * last handed to flash is written `delay` ticks after it first changed, and
+ * no sooner than `holdoff` ticks after the previous write of the key. Changes
+ * made in between are coalesced into that one write, so the holdoff bounds
+ * the flash wear of a key whatever its update rate. The space of the
+ * superseded records is reclaimed by garbage collection when fds runs out of
+ * room. Runs from the main loop (BLE event handling and timer wheel). */
+
+#ifndef STATE_STORE_RECORD_TYPE
+#define STATE_STORE_RECORD_TYPE 0x1A0B
+#endif
+#ifndef STATE_STORE_MAX_KEYS
+#define STATE_STORE_MAX_KEYS 4
+#endif
+/* Largest value, in 4 byte words */
+#ifndef STATE_STORE_MAX_WORDS
+#define STATE_STORE_MAX_WORDS 2
+#endif
+
+class StateStore {
+public:
+    /* Flash usage, for diagnostic purpose */
+    struct Statistics {
+        uint32_t writes;       // records written
+        uint32_t words;        // flash words programmed: headers, values, clears
+        uint32_t coalesced;    // changes absorbed by a pending write
+        uint32_t collections;  // garbage collections
+        uint32_t failures;     // writes rejected or failed
+    };
+
+    StateStore(TimerWheel &_wheel) :
+        wheel(_wheel),
+        keyCount(0),
+        ready(false),
+        restored(false),
+        collecting(false),
+        collected(false),
+        flushTimer(callback(this, &StateStore::onFlushTimer))
+    {
+        memset(entries, 0, sizeof(entries));
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    /* Declare a key, before start(). T must be a multiple of 4 bytes. */
+    template <typename T>
+    bool add(uint16_t key, uint32_t delay, uint32_t holdoff)
+    {
+        MBED_STATIC_ASSERT((sizeof(T) % 4 == 0) && (sizeof(T) <= STATE_STORE_MAX_WORDS * 4),
+                           "State values must be word sized and fit STATE_STORE_MAX_WORDS");
+
+        if (keyCount == STATE_STORE_MAX_KEYS || key == FDS_INSTANCE_ID_INVALID || find(key) != NULL)
+            return false;
+
+        Entry &entry = entries[keyCount++];
+        entry.key = key;
+        entry.words = sizeof(T) / 4;
+        entry.delay = delay;
+        entry.holdoff = holdoff;
+        return true;
+    }
+
+    /* Mount the storage and restore the values, isReady() once done */
+    bool start()
+    {
+        instance() = this;
+        if (fds_register(&StateStore::fdsEventHandler) != NRF_SUCCESS || fds_init() != NRF_SUCCESS)
+        {
+            ready = true;
+            return false;
+        }
+        return true;
+    }
+
+    /* The restore pass has run, or the storage could not be mounted */
+    bool isReady() const
+    {
+        return ready;
+    }
+
+    /* The storage is mounted and the values have been read back */
+    bool isRestored() const
+    {
+        return restored;
+    }
+
+    /* Value found in flash at boot, false if the key has never been saved */
+    template <typename T>
+    bool get(uint16_t key, T &value) const
+    {
+        const Entry *entry = find(key);
+        if (entry == NULL || entry->words * 4 != sizeof(T) || !(entry->flags & FLAG_RESTORED))
+            return false;
+
+        memcpy(&value, entry->value, sizeof(T));
+        return true;
+    }
+
+    /* New value of a key, written to flash on the schedule of the key. No-op
+     * if it equals the value already stored. */
+    template <typename T>
+    void set(uint16_t key, const T &value)
+    {
+        Entry *entry = find(key);
+        if (entry == NULL || entry->words * 4 != sizeof(T))
+            return;
+
+        bool changed = (memcmp(entry->value, &value, sizeof(T)) != 0);
+        memcpy(entry->value, &value, sizeof(T));
+        if (memcmp(entry->value, entry->stored, sizeof(T)) == 0 && !(entry->flags & FLAG_RETRY))
+        {
+            /* Back to the stored value, nothing to write */
+            entry->flags &= ~FLAG_DIRTY;
+            return;
+        }
+
+        if (entry->flags & FLAG_DIRTY)
+        {
+            if (changed)
+                stats.coalesced++;
+            return;
+        }
+
+        entry->flags |= FLAG_DIRTY;
+        uint32_t now = wheel.current();
+        entry->due = now + entry->delay;
+        if ((entry->flags & FLAG_WRITTEN) && (int32_t)(entry->lastWrite + entry->holdoff - entry->due) > 0)
+            entry->due = entry->lastWrite + entry->holdoff;
+        schedule();
+    }
+
+    /* Write every pending change now, regardless of the schedule */
+    void flush()
+    {
+        for (uint8_t i = 0; i < keyCount; i++)
+            if (entries[i].flags & FLAG_DIRTY)
+                entries[i].due = wheel.current();
+        onFlushTimer();
+    }
+
+    const Statistics &getStatistics() const
+    {
+        return stats;
+    }
+
+private:
+    enum {
+        FLAG_DIRTY = (1 << 0),    // value differs from the stored one
+        FLAG_WRITING = (1 << 1),  // write in flight
+        FLAG_STORED = (1 << 2),   // a record exists, desc is valid
+        FLAG_RESTORED = (1 << 3), // value read back at boot
+        FLAG_WRITTEN = (1 << 4),  // written since boot, lastWrite is valid
+        FLAG_RETRY = (1 << 5)     // the stored value did not reach flash
+    };
+
+    struct Entry {
+        uint16_t key;
+        uint8_t words;
+        uint8_t flags;
+        uint32_t delay;
+        uint32_t holdoff;
+        uint32_t due;
+        uint32_t lastWrite;
+        fds_record_desc_t desc;
+        uint32_t value[STATE_STORE_MAX_WORDS];
+        /* Last value handed to fds, source of the write in flight */
+        uint32_t stored[STATE_STORE_MAX_WORDS];
+    };
+
+    Entry *find(uint16_t key)
+    {
+        for (uint8_t i = 0; i < keyCount; i++)
+            if (entries[i].key == key)
+                return &entries[i];
+        return NULL;
+    }
+
+    const Entry *find(uint16_t key) const
+    {
+        return const_cast<StateStore *>(this)->find(key);
+    }
+
+    /* Arm the flush timer for the earliest pending write */
+    void schedule()
+    {
+        uint32_t now = wheel.current();
+        int32_t next = -1;
+
+        for (uint8_t i = 0; i < keyCount; i++)
+        {
+            const Entry &entry = entries[i];
+            if ((entry.flags & (FLAG_DIRTY | FLAG_WRITING)) != FLAG_DIRTY)
+                continue;
+
+            int32_t ticks = (int32_t)(entry.due - now);
+            if (ticks < 1)
+                ticks = 1;
+            if (next < 0 || ticks < next)
+                next = ticks;
+        }
+
+        if (next < 0 || !restored || collecting)
+            wheel.cancel(flushTimer);
+        else
+            wheel.arm(flushTimer, next);
+    }
+
+    void onFlushTimer()
+    {
+        uint32_t now = wheel.current();
+
+        for (uint8_t i = 0; i < keyCount && !collecting; i++)
+        {
+            Entry &entry = entries[i];
+            if ((entry.flags & (FLAG_DIRTY | FLAG_WRITING)) == FLAG_DIRTY && (int32_t)(entry.due - now) <= 0)
+                write(entry);
+        }
+
+        schedule();
+    }
+
+    void write(Entry &entry)
+    {
+        if (!restored)
+            return;
+
+        memcpy(entry.stored, entry.value, entry.words * 4);
+
+        fds_record_key_t recordKey;
+        recordKey.type = STATE_STORE_RECORD_TYPE;
+        recordKey.instance = entry.key;
+        fds_record_chunk_t chunk;
+        chunk.p_data = entry.stored;
+        chunk.length_words = entry.words;
+
+        bool update = (entry.flags & FLAG_STORED) != 0;
+        /* Until the write has been accepted */
+        entry.flags |= FLAG_RETRY;
+        ret_code_t ret = update ? fds_update(&entry.desc, recordKey, 1, &chunk) :
+                                  fds_write(&entry.desc, recordKey, 1, &chunk);
+        uint32_t now = wheel.current();
+
+        switch (ret)
+        {
+            case NRF_SUCCESS:
+                entry.flags = (entry.flags & ~(FLAG_DIRTY | FLAG_RETRY)) | FLAG_WRITING | FLAG_STORED | FLAG_WRITTEN;
+                entry.lastWrite = now;
+                collected = false;
+                stats.writes++;
+                stats.words += FDS_HEADER_SIZE_WORDS + entry.words + (update ? 1 : 0);
+                break;
+
+            case NRF_ERROR_NO_MEM:
+                /* Reclaim the superseded records and retry, once */
+                if (!collected && fds_gc() == NRF_SUCCESS)
+                {
+                    collecting = true;
+                    break;
+                }
+                stats.failures++;
+                entry.due = now + entry.holdoff;
+                break;
+
+            case NRF_ERROR_BUSY:
+                /* fds queue full, retry on the next tick */
+                entry.due = now;
+                break;
+
+            default:
+                stats.failures++;
+                entry.due = now + entry.holdoff;
+                break;
+        }
+    }
+
+    /* Single pass over the records of the store. A reset between the write
+     * of a new record and the clear of the one it supersedes leaves both in
+     * flash, the newest wins and the other one is cleared. */
+    void restore()
+    {
+        fds_find_token_t token;
+        fds_record_desc_t desc;
+        memset(&token, 0, sizeof(token));
+        memset(&desc, 0, sizeof(desc));
+
+        while (fds_find_by_type(STATE_STORE_RECORD_TYPE, &desc, &token) == NRF_SUCCESS)
+        {
+            fds_record_t record;
+            if (fds_open(&desc, &record) != NRF_SUCCESS)
+                continue;
+
+            Entry *entry = find(record.header.ic.instance);
+            if (entry == NULL || record.header.tl.length_words != entry->words)
+            {
+                /* Key dropped or resized since the record was written */
+                fds_clear(&desc);
+            }
+            else if (!(entry->flags & FLAG_STORED) || record.header.id > entry->desc.record_id)
+            {
+                if (entry->flags & FLAG_STORED)
+                    fds_clear(&entry->desc);
+
+                memcpy(entry->value, record.p_data, entry->words * 4);
+                memcpy(entry->stored, record.p_data, entry->words * 4);
+                entry->desc = desc;
+                entry->flags |= FLAG_STORED | FLAG_RESTORED;
+            }
+            else
+            {
+                fds_clear(&desc);
+            }
+
+            fds_close(&desc);
+        }
+
+        restored = true;
+    }
+
+    void onFdsEvent(ret_code_t result, fds_cmd_id_t cmd, fds_record_key_t key)
+    {
+        switch (cmd)
+        {
+            case FDS_CMD_INIT:
+                if (result == NRF_SUCCESS)
+                    restore();
+                ready = true;
+                break;
+
+            case FDS_CMD_WRITE:
+            case FDS_CMD_UPDATE:
+            {
+                Entry *entry = (key.type == STATE_STORE_RECORD_TYPE) ? find(key.instance) : NULL;
+                if (entry == NULL)
+                    return;
+
+                entry->flags &= ~FLAG_WRITING;
+                if (result != NRF_SUCCESS)
+                {
+                    /* The record is not in flash, the superseded one may
+                     * have been cleared anyway: write a new one */
+                    stats.failures++;
+                    entry->flags = (entry->flags | FLAG_DIRTY | FLAG_RETRY) & ~FLAG_STORED;
+                    entry->due = wheel.current() + entry->holdoff;
+                }
+            } break;
+
+            case FDS_CMD_GC:
+                if (!collecting)
+                    return;
+                collecting = false;
+                collected = true;
+                stats.collections++;
+                break;
+
+            default:
+                return;
+        }
+
+        schedule();
+    }
+
+    static void fdsEventHandler(ret_code_t result, fds_cmd_id_t cmd, fds_record_id_t recordId, fds_record_key_t key)
+    {
+        StateStore *store = instance();
+        if (store != NULL)
+            store->onFdsEvent(result, cmd, key);
+    }
+
+    /* Record header, see fds_header_t */
+    static const uint8_t FDS_HEADER_SIZE_WORDS = sizeof(fds_header_t) / 4;
+
+    /* Store the fds events go to. A function-local static, the header is
+     * included by more than one translation unit. */
+    static StateStore *&instance()
+    {
+        static StateStore *store = NULL;
+        return store;
+    }
+
+    TimerWheel &wheel;
+    Entry entries[STATE_STORE_MAX_KEYS];
+    uint8_t keyCount;
+    bool ready;
+    bool restored;
+    bool collecting;
+    bool collected;
+    WheelTimer flushTimer;
+    Statistics stats;
+};
+
+#endif /* #ifndef __STATE_STORE_H__ */
@@ -0,0 +1,55 @@
+#ifndef __STATIC_INSTANCE_H__
+#define __STATIC_INSTANCE_H__
+
+#include <new>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Statically allocated storage for an object which can only be constructed
+ * at run time, e.g. a service once BLE has been initialized. The object
+ * counts in the RAM reported by the linker instead of taking heap. It is
+ * constructed once and never destroyed. */
+template <typename T>
+class StaticInstance {
+public:
+    StaticInstance() : instance(NULL)
+    {
+    }
+
+    template <typename A1>
+    T *construct(A1 &a1)
+    {
+        instance = new (storage.bytes) T(a1);
+        return instance;
+    }
+
+    template <typename A1, typename A2>
+    T *construct(A1 &a1, A2 &a2)
+    {
+        instance = new (storage.bytes) T(a1, a2);
+        return instance;
+    }
+
+    template <typename A1, typename A2, typename A3>
+    T *construct(A1 &a1, A2 &a2, A3 &a3)
+    {
+        instance = new (storage.bytes) T(a1, a2, a3);
+        return instance;
+    }
+
+    /* NULL until constructed */
+    T *get() const
+    {
+        return instance;
+    }
+
+private:
+    union {
+        uint8_t bytes[sizeof(T)];
+        uint64_t alignment;
+        void *pointerAlignment;
+    } storage;
+    T *instance;
+};
+
+#endif /* #ifndef __STATIC_INSTANCE_H__ */
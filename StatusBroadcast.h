@@ -0,0 +1,109 @@
+#ifndef __STATUS_BROADCAST_H__
+#define __STATUS_BROADCAST_H__
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "ble/Gap.h"
+
+/* Device status broadcast in a manufacturer specific AD field, so that a
+ * phone can show it from the advertisements without connecting.
+ *
+ * AD data, STATUS_BROADCAST_LEN bytes, multi-byte fields little endian:
+ *   [0-1] company identifier (0xFFFF, reserved by the SIG for tests)
+ *   [2]   record version, STATUS_BROADCAST_VERSION
+ *   [3]   flags: bit 0 activated, bit 1 contact, bit 2 alarm,
+ *                bits 4-5 lipo charger state (0 - 2)
+ *   [4]   battery level, %
+ *   [5-6] ID1 prefix, its two most significant bytes
+ * Decoders must ignore records with another company identifier or version.
+ * Only ID1 is announced, ID2 seeds the encryption key. */
+
+#define STATUS_BROADCAST_COMPANY_ID 0xFFFF
+#define STATUS_BROADCAST_VERSION 1
+#define STATUS_BROADCAST_LEN 7
+/* Bytes used in the advertising payload, AD length and type included */
+#define STATUS_BROADCAST_AD_LEN (STATUS_BROADCAST_LEN + 2)
+
+#define STATUS_FLAG_ACTIVATED 0x01
+#define STATUS_FLAG_CONTACT 0x02
+#define STATUS_FLAG_ALARM 0x04
+#define STATUS_CHARGER_POS 4
+#define STATUS_CHARGER_MASK 0x30
+
+struct ImobStatus {
+    bool activated;
+    bool contact;
+    bool alarm;
+    uint8_t lipoChargerState;
+    uint8_t batteryLevel;
+    uint16_t id1Prefix;
+};
+
+static inline void encodeStatus(const ImobStatus &status, uint8_t *data)
+{
+    data[0] = (uint8_t)STATUS_BROADCAST_COMPANY_ID;
+    data[1] = (uint8_t)(STATUS_BROADCAST_COMPANY_ID >> 8);
+    data[2] = STATUS_BROADCAST_VERSION;
+    data[3] = (status.activated ? STATUS_FLAG_ACTIVATED : 0) |
+              (status.contact ? STATUS_FLAG_CONTACT : 0) |
+              (status.alarm ? STATUS_FLAG_ALARM : 0) |
+              ((status.lipoChargerState << STATUS_CHARGER_POS) & STATUS_CHARGER_MASK);
+    data[4] = status.batteryLevel;
+    data[5] = (uint8_t)status.id1Prefix;
+    data[6] = (uint8_t)(status.id1Prefix >> 8);
+}
+
+/* Returns false if the data is not a status record this decoder knows */
+static inline bool decodeStatus(const uint8_t *data, uint8_t len, ImobStatus &status)
+{
+    if (len < STATUS_BROADCAST_LEN ||
+        (data[0] | (data[1] << 8)) != STATUS_BROADCAST_COMPANY_ID ||
+        data[2] != STATUS_BROADCAST_VERSION)
+        return false;
+
+    status.activated = (data[3] & STATUS_FLAG_ACTIVATED) != 0;
+    status.contact = (data[3] & STATUS_FLAG_CONTACT) != 0;
+    status.alarm = (data[3] & STATUS_FLAG_ALARM) != 0;
+    status.lipoChargerState = (data[3] & STATUS_CHARGER_MASK) >> STATUS_CHARGER_POS;
+    status.batteryLevel = data[4];
+    status.id1Prefix = data[5] | (data[6] << 8);
+    return true;
+}
+
+/* Keeps the status record of the advertising payload up to date. The
+ * payload is only rewritten when the encoded record changes. */
+class StatusBroadcast {
+public:
+    StatusBroadcast() : gap(NULL)
+    {
+        memset(record, 0, sizeof(record));
+    }
+
+    /* Add the record to the advertising payload */
+    ble_error_t start(Gap &_gap, const ImobStatus &status)
+    {
+        gap = &_gap;
+        encodeStatus(status, record);
+        return gap->accumulateAdvertisingPayload(GapAdvertisingData::MANUFACTURER_SPECIFIC_DATA, record, STATUS_BROADCAST_LEN);
+    }
+
+    ble_error_t update(const ImobStatus &status)
+    {
+        if (gap == NULL)
+            return BLE_ERROR_INVALID_STATE;
+
+        uint8_t encoded[STATUS_BROADCAST_LEN];
+        encodeStatus(status, encoded);
+        if (memcmp(encoded, record, STATUS_BROADCAST_LEN) == 0)
+            return BLE_ERROR_NONE;
+
+        memcpy(record, encoded, STATUS_BROADCAST_LEN);
+        return gap->updateAdvertisingPayload(GapAdvertisingData::MANUFACTURER_SPECIFIC_DATA, record, STATUS_BROADCAST_LEN);
+    }
+
+private:
+    Gap *gap;
+    uint8_t record[STATUS_BROADCAST_LEN];
+};
+
+#endif /* #ifndef __STATUS_BROADCAST_H__ */
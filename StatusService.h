@@ -0,0 +1,81 @@
+#ifndef __BLE_STATUS_SERVICE_H__
+#define __BLE_STATUS_SERVICE_H__
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "ble/Gap.h"
+
+/* Packed status, the single byte characteristics of the other services in
+ * one notification:
+ *   [0] layout version, PACKED_STATUS_VERSION
+ *   [1] bit 0 activated, bit 1 contact, bit 2 alarm, bit 3 relay,
+ *       bit 4 accel detection, bits 5-6 lipo charger state (0 - 2) */
+#define PACKED_STATUS_LEN 2
+#define PACKED_STATUS_VERSION 1
+
+#define PACKED_STATUS_ACTIVATED 0x01
+#define PACKED_STATUS_CONTACT 0x02
+#define PACKED_STATUS_ALARM 0x04
+#define PACKED_STATUS_RELAY 0x08
+#define PACKED_STATUS_ACCEL 0x10
+#define PACKED_STATUS_CHARGER_POS 5
+#define PACKED_STATUS_CHARGER_MASK 0x60
+
+class StatusService {
+public:
+    const static uint16_t STATUS_SERVICE_UUID = 0xF000;
+    const static uint16_t PACKED_STATUS_CHARACTERISTIC_UUID = 0xF001;
+
+    /* GATT layout, see GattLayout.h */
+    const static uint8_t CHARACTERISTIC_COUNT = 1;
+    const static uint8_t CCCD_COUNT = 1;
+    const static uint16_t VALUE_BYTES = PACKED_STATUS_LEN;
+
+    StatusService(BLEDevice &_ble) :
+        ble(_ble),
+        PackedStatusCharacteristic(PACKED_STATUS_CHARACTERISTIC_UUID, packedStatus, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY)
+    {
+        packedStatus[0] = PACKED_STATUS_VERSION;
+        packedStatus[1] = 0;
+
+        GattCharacteristic *charTable[] = {&PackedStatusCharacteristic};
+        MBED_STATIC_ASSERT(sizeof(charTable) / sizeof(GattCharacteristic *) == CHARACTERISTIC_COUNT, "The GATT layout of the service is out of date");
+        GattService statusService(STATUS_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
+
+        ble.addService(statusService);
+    }
+
+    static uint8_t packStatus(bool activated, bool contact, bool alarm, bool relay, bool accel, uint8_t lipoChargerState)
+    {
+        return (activated ? PACKED_STATUS_ACTIVATED : 0) |
+               (contact ? PACKED_STATUS_CONTACT : 0) |
+               (alarm ? PACKED_STATUS_ALARM : 0) |
+               (relay ? PACKED_STATUS_RELAY : 0) |
+               (accel ? PACKED_STATUS_ACCEL : 0) |
+               ((lipoChargerState << PACKED_STATUS_CHARGER_POS) & PACKED_STATUS_CHARGER_MASK);
+    }
+
+    /* To be called once per main loop iteration with the state at that
+     * point: whatever changed in between goes out as one notification. */
+    void updateStatus(uint8_t newStatus)
+    {
+        if (newStatus == packedStatus[1])
+            return;
+
+        packedStatus[1] = newStatus;
+        ble.gattServer().write(PackedStatusCharacteristic.getValueHandle(), packedStatus, PACKED_STATUS_LEN);
+    }
+
+    uint8_t getStatus() const
+    {
+        return packedStatus[1];
+    }
+
+private:
+    BLEDevice &ble;
+    uint8_t packedStatus[PACKED_STATUS_LEN];
+
+    ReadOnlyArrayGattCharacteristic<uint8_t, PACKED_STATUS_LEN> PackedStatusCharacteristic;
+};
+
+#endif /* #ifndef __BLE_STATUS_SERVICE_H__ */
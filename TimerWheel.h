@@ -0,0 +1,322 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include "mbed.h"
+#include "us_ticker_api.h"
+
+/* Hierarchical timer wheel, three levels of 32 slots:
+ *   level 0: 1 tick per slot      (1 s with the default tick)
+ *   level 1: 32 ticks per slot    (32 s)
+ *   level 2: 1024 ticks per slot  (~17 min)
+ * Deadlines further away are parked in the last level 2 slot and re-filed
+ * when it is cascaded. Arming and cancelling are O(1); expired timers are
+ * run from advance(), i.e. from the caller's context, not from an ISR. */
+
+#define TIMER_WHEEL_SLOT_BITS 5
+#define TIMER_WHEEL_SLOTS (1UL << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 3
+#define TIMER_WHEEL_RANGE (1UL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+/* Default tick, 1024 RTC (32768 Hz) periods */
+#define TIMER_WHEEL_TICK_US 31250UL
+#define TIMER_WHEEL_MS(ms) ((((uint32_t)(ms)) * 1000UL + TIMER_WHEEL_TICK_US - 1) / TIMER_WHEEL_TICK_US)
+
+class WheelTimer {
+public:
+    WheelTimer(Callback<void()> _callback) :
+        callback(_callback),
+        next(NULL),
+        prev(NULL),
+        expiry(0),
+        level(0),
+        slot(0),
+        armed(false)
+    {
+    }
+
+    bool isArmed() const
+    {
+        return armed;
+    }
+
+private:
+    friend class TimerWheel;
+
+    Callback<void()> callback;
+    WheelTimer *next;
+    WheelTimer *prev;
+    uint32_t expiry;
+    uint8_t level;
+    uint8_t slot;
+    bool armed;
+};
+
+class TimerWheel {
+public:
+    TimerWheel() : now(0)
+    {
+        memset(slots, 0, sizeof(slots));
+        memset(occupied, 0, sizeof(occupied));
+    }
+
+    /* Tick about to be processed */
+    uint32_t current() const
+    {
+        return now;
+    }
+
+    /* (Re)arm a timer to expire once `ticks` ticks (at least one) have
+     * elapsed, i.e. when tick current() + ticks - 1 is processed */
+    void arm(WheelTimer &timer, uint32_t ticks)
+    {
+        if (timer.armed)
+            unlink(timer);
+
+        timer.expiry = now + ((ticks == 0) ? 0 : ticks - 1);
+        insert(timer);
+    }
+
+    void cancel(WheelTimer &timer)
+    {
+        if (timer.armed)
+            unlink(timer);
+    }
+
+    /* Ticks left before an armed timer expires, 0 if it is not armed */
+    uint32_t remaining(const WheelTimer &timer) const
+    {
+        if (!timer.armed || (int32_t)(timer.expiry - now) < 0)
+            return 0;
+        return timer.expiry - now + 1;
+    }
+
+    /* Run every timer expiring before tick `target` */
+    void advance(uint32_t target)
+    {
+        while ((int32_t)(target - now) > 0)
+        {
+            if (empty())
+            {
+                now = target;
+                break;
+            }
+            runTick();
+        }
+    }
+
+    /* Number of ticks before the next timer expires, capped to
+     * TIMER_WHEEL_RANGE, -1 if no timer is armed. Cascades need no wakeup of
+     * their own: advance() walks every tick and re-files the higher levels on
+     * the way. */
+    int32_t ticksToNextEvent() const
+    {
+        if (empty())
+            return -1;
+
+        uint32_t index = now & TIMER_WHEEL_SLOT_MASK;
+        int32_t next = TIMER_WHEEL_RANGE;
+
+        /* Few timers live in the higher levels, their lists are short */
+        for (uint8_t level = 1; level < TIMER_WHEEL_LEVELS; level++)
+        {
+            for (uint8_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+            {
+                for (const WheelTimer *timer = slots[level][slot]; timer; timer = timer->next)
+                {
+                    int32_t delta = (int32_t)(timer->expiry - now);
+                    if (delta < next)
+                        next = (delta < 0) ? 0 : delta;
+                }
+            }
+        }
+
+        if (occupied[0])
+        {
+            /* Rotate so that bit 0 is the current slot */
+            uint32_t rotated = (occupied[0] >> index) | ((index == 0) ? 0 : (occupied[0] << (TIMER_WHEEL_SLOTS - index)));
+            int32_t delta = 0;
+            while (!(rotated & 1))
+            {
+                rotated >>= 1;
+                delta++;
+            }
+            if (delta < next)
+                next = delta;
+        }
+
+        return next;
+    }
+
+private:
+    bool empty() const
+    {
+        return !(occupied[0] | occupied[1] | occupied[2]);
+    }
+
+    void insert(WheelTimer &timer)
+    {
+        uint32_t delta = timer.expiry - now;
+        uint32_t expiry = timer.expiry;
+        uint8_t level;
+
+        if ((int32_t)delta < 0)
+        {
+            /* Already due, run on the next tick */
+            expiry = now;
+            level = 0;
+        }
+        else if (delta >= TIMER_WHEEL_RANGE)
+        {
+            expiry = now + TIMER_WHEEL_RANGE - 1;
+            level = TIMER_WHEEL_LEVELS - 1;
+        }
+        else
+        {
+            level = 0;
+            while (delta >= (1UL << (TIMER_WHEEL_SLOT_BITS * (level + 1))))
+                level++;
+        }
+
+        uint8_t slot = (expiry >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+
+        timer.level = level;
+        timer.slot = slot;
+        timer.prev = NULL;
+        timer.next = slots[level][slot];
+        if (timer.next)
+            timer.next->prev = &timer;
+        slots[level][slot] = &timer;
+        occupied[level] |= (1UL << slot);
+        timer.armed = true;
+    }
+
+    void unlink(WheelTimer &timer)
+    {
+        if (timer.prev)
+            timer.prev->next = timer.next;
+        else
+            slots[timer.level][timer.slot] = timer.next;
+
+        if (timer.next)
+            timer.next->prev = timer.prev;
+
+        if (slots[timer.level][timer.slot] == NULL)
+            occupied[timer.level] &= ~(1UL << timer.slot);
+
+        timer.next = NULL;
+        timer.prev = NULL;
+        timer.armed = false;
+    }
+
+    /* Detach a slot and return its list */
+    WheelTimer *take(uint8_t level, uint8_t slot)
+    {
+        WheelTimer *list = slots[level][slot];
+        slots[level][slot] = NULL;
+        occupied[level] &= ~(1UL << slot);
+        return list;
+    }
+
+    /* Re-file the timers of a higher level slot, returns the slot index */
+    uint8_t cascade(uint8_t level)
+    {
+        uint8_t slot = (now >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+        WheelTimer *timer = take(level, slot);
+        while (timer)
+        {
+            WheelTimer *next = timer->next;
+            insert(*timer);
+            timer = next;
+        }
+        return slot;
+    }
+
+    void runTick()
+    {
+        uint8_t index = now & TIMER_WHEEL_SLOT_MASK;
+
+        if (index == 0 && cascade(1) == 0)
+            cascade(2);
+
+        WheelTimer *timer = take(0, index);
+        now++;
+
+        while (timer)
+        {
+            WheelTimer *next = timer->next;
+            timer->next = NULL;
+            timer->prev = NULL;
+            timer->armed = false;
+            /* The callback may re-arm this or any other timer */
+            timer->callback();
+            timer = next;
+        }
+    }
+
+    WheelTimer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint32_t occupied[TIMER_WHEEL_LEVELS];
+    uint32_t now;
+};
+
+/* TimerWheel clocked by the RTC backed us_ticker. A single Timeout is armed
+ * for the next event so the CPU is only woken when there is work to do;
+ * the callbacks themselves run from poll(), in the main loop. */
+class RtcTimerWheel : public TimerWheel {
+public:
+    RtcTimerWheel() :
+        TimerWheel(),
+        lastUs(0),
+        elapsedUs(0)
+    {
+    }
+
+    void start()
+    {
+        lastUs = us_ticker_read();
+        elapsedUs = 0;
+    }
+
+    /* Run the timers that are due, then program the next wakeup */
+    void poll()
+    {
+        uint32_t nowUs = us_ticker_read();
+        elapsedUs += nowUs - lastUs;
+        lastUs = nowUs;
+
+        uint32_t ticks = elapsedUs / TIMER_WHEEL_TICK_US;
+        elapsedUs -= ticks * TIMER_WHEEL_TICK_US;
+        advance(current() + ticks);
+
+        schedule();
+    }
+
+    /* Program the wakeup for the next event, to be called after arming or
+     * cancelling timers outside of poll() */
+    void schedule()
+    {
+        int32_t ticks = ticksToNextEvent();
+        if (ticks < 0)
+        {
+            wakeup.detach();
+            return;
+        }
+
+        uint32_t us = (uint32_t)ticks * TIMER_WHEEL_TICK_US;
+        us = (us > elapsedUs) ? (us - elapsedUs) : 0;
+        /* The tick is only reached once a full tick period has elapsed */
+        wakeup.attach_us(callback(this, &RtcTimerWheel::onWakeup), us + TIMER_WHEEL_TICK_US);
+    }
+
+private:
+    void onWakeup()
+    {
+        /* Nothing to do, the interrupt alone makes waitForEvent() return */
+    }
+
+    Timeout wakeup;
+    uint32_t lastUs;
+    uint32_t elapsedUs;
+};
+
+#endif /* #ifndef __TIMER_WHEEL_H__ */
@@ -5,6 +5,8 @@
 #define ECB_KEY_LEN            (16UL)
 #define COUNTER_BYTE_LEN       (4UL)
 #define NONCE_RAND_BYTE_LEN    (12UL)
+// Keystream blocks kept ahead of use, from counter value 0.
+#define CTR_CACHE_BLOCKS       (2UL)
 
 // The RNG wait values are typical and not guaranteed. See Product Specifications for more info.
 #ifdef NRF51
@@ -59,6 +61,14 @@ static bool m_initialized = false;
 // NOTE: The ECB data must be located in RAM or a HardFault will be triggered.
 static nrf_ecb_hal_data_t m_ecb_data;
 
+// Keystream for the counter values 0 to m_cache_ready - 1 of the current
+// nonce and key, filled by ctr_precompute().
+static nrf_ecb_hal_data_t m_cache_ecb_data;
+static uint8_t  m_cache[CTR_CACHE_BLOCKS][ECB_KEY_LEN];
+static uint8_t  m_cache_ready = 0;
+static uint32_t m_cache_hits = 0;
+static uint32_t m_cache_misses = 0;
+
 /**
  * @brief Initializes the module with the given nonce and key
  * @details The nonce will be copied to an internal buffer so it does not need to
@@ -73,6 +83,14 @@ static nrf_ecb_hal_data_t m_ecb_data;
  */
 void ctr_init(const uint8_t * p_nonce, const uint8_t * p_ecb_key)
 {
+    // The cached keystream survives a restart with the same nonce and key.
+    if (!m_initialized ||
+        (memcmp(&m_ecb_data.key[0], p_ecb_key, ECB_KEY_LEN) != 0) ||
+        (memcmp(&m_ecb_data.cleartext[COUNTER_BYTE_LEN], &p_nonce[COUNTER_BYTE_LEN], NONCE_RAND_BYTE_LEN) != 0))
+    {
+        m_cache_ready = 0;
+    }
+
     m_initialized = true;
 
     // Save the key.
@@ -92,20 +110,34 @@ static uint32_t crypt(uint8_t * buf)
     uint8_t  i;
     uint32_t err_code;
 
+    uint32_t counter;
+    const uint8_t * p_keystream;
+
     if (!m_initialized)
     {
         return NRF_ERROR_INVALID_STATE;
     }
 
-    err_code = sd_ecb_block_encrypt(&m_ecb_data);
-    if (NRF_SUCCESS != err_code)
+    counter = *((uint32_t*) m_ecb_data.cleartext);
+    if (counter < m_cache_ready)
     {
-        return err_code;
+        p_keystream = m_cache[counter];
+        m_cache_hits++;
+    }
+    else
+    {
+        err_code = sd_ecb_block_encrypt(&m_ecb_data);
+        if (NRF_SUCCESS != err_code)
+        {
+            return err_code;
+        }
+        p_keystream = m_ecb_data.ciphertext;
+        m_cache_misses++;
     }
 
     for (i=0; i < ECB_KEY_LEN; i++)
     {
-        buf[i] ^= m_ecb_data.ciphertext[i];
+        buf[i] ^= p_keystream[i];
     }
 
     // Increment the counter.
@@ -148,3 +180,91 @@ uint32_t ctr_decrypt(uint8_t * p_cipher_text)
     return crypt(p_cipher_text);
 }
 
+/**
+ * @brief Computes the next missing block of the keystream cache
+ * @details Meant to be called when idle, so that ctr_encrypt() and ctr_decrypt()
+ *          are a plain XOR on the first CTR_CACHE_BLOCKS blocks after ctr_init().
+ *          The cache is dropped when ctr_init() is given another nonce or key.
+ *
+ * @retval    true     A block has been computed, there may be more to do
+ * @retval    false    Nothing to do, or the SoftDevice refused the request
+ */
+bool ctr_precompute(void)
+{
+    if (!m_initialized || (m_cache_ready >= CTR_CACHE_BLOCKS))
+    {
+        return false;
+    }
+
+    memcpy(&m_cache_ecb_data.key[0], &m_ecb_data.key[0], ECB_KEY_LEN);
+    memcpy(&m_cache_ecb_data.cleartext[COUNTER_BYTE_LEN],
+              &m_ecb_data.cleartext[COUNTER_BYTE_LEN],
+              NONCE_RAND_BYTE_LEN);
+    *((uint32_t*) m_cache_ecb_data.cleartext) = m_cache_ready;
+
+    if (NRF_SUCCESS != sd_ecb_block_encrypt(&m_cache_ecb_data))
+    {
+        return false;
+    }
+
+    memcpy(m_cache[m_cache_ready], &m_cache_ecb_data.ciphertext[0], ECB_KEY_LEN);
+    m_cache_ready++;
+    return true;
+}
+
+/**
+ * @brief Reports how the ctr_encrypt() and ctr_decrypt() blocks were obtained
+ *
+ * @param[out]   p_hits      Blocks taken from the cache (XOR only)
+ * @param[out]   p_misses    Blocks computed on the spot (one blocking ECB each)
+ */
+void ctr_cache_statistics(uint32_t * p_hits, uint32_t * p_misses)
+{
+    *p_hits   = m_cache_hits;
+    *p_misses = m_cache_misses;
+}
+
+#define MAC_DOMAIN_BYTE        (0x80)
+
+/**
+ * @brief Computes the authentication tag of a one byte command
+ * @details The tag is the ECB encryption of the nonce with the command in its
+ *          counter bytes: {command, 0, 0, MAC_DOMAIN_BYTE, nonce[4..15]}. The
+ *          domain byte keeps these blocks apart from the CTR keystream blocks,
+ *          whose counter never gets that large. Each nonce must be used for a
+ *          single command.
+ *
+ * @param[in]    p_nonce    An array of length 16 containing 12 random bytes
+ *                          starting at index 4
+ * @param[in]    command    The command to authenticate
+ * @param[in]    p_ecb_key  An array of length 16 containing the ECB key
+ * @param[out]   p_mac      An array of length 16 receiving the tag
+ *
+ * @retval    NRF_SUCCESS                         Success
+ * @retval    NRF_ERROR_SOFTDEVICE_NOT_ENABLED    SoftDevice is present, but not enabled
+ */
+uint32_t command_mac(const uint8_t * p_nonce, uint8_t command, const uint8_t * p_ecb_key, uint8_t * p_mac)
+{
+    // On the stack, i.e. in RAM as required by the ECB.
+    nrf_ecb_hal_data_t ecb_data;
+    uint32_t err_code;
+
+    memcpy(&ecb_data.key[0], p_ecb_key, ECB_KEY_LEN);
+    memcpy(&ecb_data.cleartext[COUNTER_BYTE_LEN],
+              &p_nonce[COUNTER_BYTE_LEN],
+              NONCE_RAND_BYTE_LEN);
+    ecb_data.cleartext[0] = command;
+    ecb_data.cleartext[1] = 0x00;
+    ecb_data.cleartext[2] = 0x00;
+    ecb_data.cleartext[3] = MAC_DOMAIN_BYTE;
+
+    err_code = sd_ecb_block_encrypt(&ecb_data);
+    if (NRF_SUCCESS != err_code)
+    {
+        return err_code;
+    }
+
+    memcpy(p_mac, &ecb_data.ciphertext[0], ECB_KEY_LEN);
+    return NRF_SUCCESS;
+}
+
@@ -6,15 +6,64 @@
 #include "InternalValuesService.h"
 #include "ImobStateService.h"
 #include "AccelSensorService.h"
+#include "SensorConversion.h"
+#include "TimerWheel.h"
+#include "PowerManager.h"
+#include "HwBlinker.h"
+#include "AdvertisingScheduler.h"
+#include "StatusBroadcast.h"
+#include "StatusService.h"
+#include "ConnectionProfileManager.h"
+#include "ReconnectionAdvertiser.h"
+#include "GattLayout.h"
+#include "StaticInstance.h"
+#include "BootProfiler.h"
+#include "StateStore.h"
+#include "nRF5xGattServer.h"
 
 #define TIME_CICLE 80.0 //ms
-#define ANALOGIN 3
-#define DISCONNECTION_TIME (1000.0/TIME_CICLE)*10.0 // seg
-#define AUTHENTICATION_TIME (1000.0/TIME_CICLE)*25.0 // seg
+#define DISCONNECTION_TIME 10000 // ms
+#define AUTHENTICATION_TIME 25000 // ms
 
+/* Sensor sampling periods. Multiples of each other so that the samples share
+ * wakeups. */
+#define CONTACT_SAMPLE_TIME 1000 // ms
+#define LIPO_SAMPLE_TIME 2000 // ms
+#define BATTERY_SAMPLE_TIME 10000 // ms
+#define ACCEL_SAMPLE_TIME 250 // ms, only without ACCEL_MOTION_INTERRUPT
+#define ALIVENESS_PERIOD 1000 // ms, LED flash
+
+/* Advertising back-off after vehicle activity: interval (ms), time spent at
+ * that interval (ms, 0 for the last step) */
+#ifndef ADVERTISING_BACKOFF
+#define ADVERTISING_BACKOFF { \
+    { (uint16_t)TIME_CICLE, 30000 }, \
+    { 418, 120000 }, \
+    { 1022, 600000 }, \
+    { 2000, 0 } \
+}
+#endif
+
+/* Start advertising as soon as the GATT database is registered and bring
+ * the accelerometer up afterwards. Clear it to configure the sensor before
+ * the first advertisement. */
+#ifndef BOOT_DEFERRED_SENSOR_INIT
+#define BOOT_DEFERRED_SENSOR_INIT 1
+#endif
+
+/* Flash write schedule of the saved state: delay after the first change,
+ * minimum time between two writes (ms). Bounds the writes to about 24 a day
+ * for the counters and the calibration. */
+#define STATE_ACTIVATION_DELAY 1000
+#define STATE_ACTIVATION_HOLDOFF 5000
+#define STATE_CALIBRATION_DELAY 10000
+#define STATE_CALIBRATION_HOLDOFF 3600000
+#define STATE_CYCLES_DELAY 60000
+#define STATE_CYCLES_HOLDOFF 3600000
+
+/* Program cycles are counted in TIME_CICLE units */
+#define LIPO_SAMPLE_CICLES ((uint32_t)(LIPO_SAMPLE_TIME / TIME_CICLE))
 
-/* LED aliveness indicator system  */
-DigitalOut alivenessLED(P0_18, 0); // P0_25
 
 /* battery charge level, Pin P0_1 */
 AnalogIn batteryCharge(P0_1);
@@ -28,6 +77,38 @@ AnalogIn contact(P0_6);
 const static char     DEVICE_NAME[] = "I-Mob";
 static const uint16_t uuid16_list[] = {ImobStateService::IMOB_STATE_SERVICE_UUID, RELAYService::RELAY_SERVICE_UUID, ALARMService::ALARM_SERVICE_UUID,  InternalValuesService::INTERNAL_VALUES_SERVICE_UUID, AccelSensorService::ACCEL_SENSOR_SERVICE_UUID, GattService::UUID_BATTERY_SERVICE};
 
+/* Advertising payload: flags, service list and status record. The name goes
+ * in the scan response. */
+MBED_STATIC_ASSERT((2 + 1) + (2 + sizeof(uuid16_list)) + STATUS_BROADCAST_AD_LEN <= GAP_ADVERTISING_DATA_MAX_PAYLOAD,
+                   "The advertising payload does not fit in an advertising packet");
+/* Scan response: authentication challenge and name */
+MBED_STATIC_ASSERT((2 + CHALLENGE_SERVICE_DATA_LEN) + (2 + sizeof(DEVICE_NAME)) <= GAP_ADVERTISING_DATA_MAX_PAYLOAD,
+                   "The scan response does not fit in a scan response packet");
+
+
+/* GATT database, in registration order */
+#define GATT_SERVICES(SERVICE) \
+    SERVICE(ImobStateService) \
+    SERVICE(InternalValuesService) \
+    SERVICE(RELAYService) \
+    SERVICE(ALARMService) \
+    SERVICE(AccelSensorService) \
+    SERVICE(BatteryService) \
+    SERVICE(StatusService)
+
+MBED_STATIC_ASSERT(GATT_TOTAL_CHARACTERISTICS(GATT_SERVICES) <= YOTTA_CFG_BLE_GATT_TOTAL_CHARACTERISTICS,
+                   "The GATT server can not hold all the characteristics");
+MBED_STATIC_ASSERT(GATT_TOTAL_ATTR_TAB_SIZE(GATT_SERVICES) <= GATT_ATTR_TAB_DEFAULT_SIZE,
+                   "The GATT database does not fit in the SoftDevice attribute table");
+
+/* Services, constructed once BLE has been initialized */
+StaticInstance<ImobStateService> imobStateService;
+StaticInstance<InternalValuesService> internalValuesService;
+StaticInstance<RELAYService> relayService;
+StaticInstance<ALARMService> alarmService;
+StaticInstance<AccelSensorService> accelSensorService;
+StaticInstance<BatteryService> batteryService;
+StaticInstance<StatusService> statusService;
 
 ImobStateService * imobStateServicePtr;
 
@@ -36,34 +117,246 @@ RELAYService * relayServicePtr;
 ALARMService * alarmServicePtr;
 AccelSensorService * accelSensorServicePtr;
 BatteryService * batteryServicePtr;
+StatusService * statusServicePtr;
 
-float lipochargerState = 0;
-float contactState = -1;
+uint16_t lipochargerState = 0;
+uint16_t contactState = 0;
 uint8_t batteryLevel = 0;
+uint16_t batteryRaw = 0;
+
+void forceDisconnection(void);
+void forceActivation(void);
+void sampleBattery(void);
+void sampleLipoCharger(void);
+void sampleContact(void);
+#if !ACCEL_MOTION_INTERRUPT
+void sampleAccel(void);
+#endif
+
+/* Deadlines, run from the main loop */
+RtcTimerWheel timerWheel;
+WheelTimer forceDisconnectionTimer(forceDisconnection);
+WheelTimer forceActivationTimer(forceActivation);
+/* Activation time accumulates over the periods without a connected user */
+uint32_t forceActivationRemaining = TIMER_WHEEL_MS(AUTHENTICATION_TIME);
+
+/* Sensor sampling, run from the main loop */
+WheelTimer sampleBatteryTimer(sampleBattery);
+WheelTimer sampleLipoChargerTimer(sampleLipoCharger);
+WheelTimer sampleContactTimer(sampleContact);
+#if !ACCEL_MOTION_INTERRUPT
+WheelTimer sampleAccelTimer(sampleAccel);
+#endif
+
+PowerManager powerManager(timerWheel);
 
-uint8_t selectedAnalogIn = 0;
+/* LED aliveness indicator system, flashed by hardware for TIME_CICLE every
+ * ALIVENESS_PERIOD */
+HwBlinker alivenessLED(timerWheel, P0_18); // P0_25
 
-uint32_t forceDisconnectionCounter = 0;
-uint32_t forceActivationCounter = 0;
+static const AdvertisingStep advertisingSteps[] = ADVERTISING_BACKOFF;
+AdvertisingScheduler advertisingScheduler(timerWheel, advertisingSteps, sizeof(advertisingSteps) / sizeof(AdvertisingStep));
 
-/* Calibration variables */
+StatusBroadcast statusBroadcast;
+
+ConnectionProfileManager connectionProfiles(timerWheel);
+
+ReconnectionAdvertiser reconnectionAdvertiser(timerWheel);
+
+/* Reset to main loop, published in the internal values service */
+BootProfiler bootProfiler;
+
+/* Application state kept across resets */
+enum StateKey {
+    STATE_KEY_ACTIVATION = 1,
+    STATE_KEY_CALIBRATION,
+    STATE_KEY_CYCLES
+};
+
+struct ActivationState {
+    uint8_t activated;
+    uint8_t initialActivation;
+    uint8_t reserved[2];
+};
+
+struct CalibrationState {
+    uint32_t batteryLevelConstant; // Q16
+    uint8_t calibrated;
+    uint8_t reserved[3];
+};
+
+struct CycleState {
+    uint32_t chargeProgramCycles;
+    uint32_t dischargeProgramCycles;
+};
+
+StateStore stateStore(timerWheel);
+
+/* Calibration variables (read_u16() scale) */
 bool batteryLevelCalibration = false;
-float batteryLevelConstant = 100.0f;
-float contactStateThreshold = 0.21f;
+uint32_t batteryLevelConstant = Q16_ONE; // Q16
+uint16_t contactStateThreshold = ADC_RAW(0.21f);
 /* ----- */
 
-Ticker ticker;
+/* Lipo charger status thresholds */
+#define LIPO_STAT_THRESHOLD_LOW ADC_RAW(0.4f)
+#define LIPO_STAT_THRESHOLD_HIGH ADC_RAW(0.9f)
 
 void disconnectionCallback(const Gap::DisconnectionCallbackParams_t *params)
 {
-    /* Re-enable advertisements after a connection teardown */
-    BLE::Instance().gap().startAdvertising();
+    /* Re-enable advertisements after a connection teardown, fast and directed
+     * to the last authenticated phone so that the user can reconnect at once */
+    advertisingScheduler.trigger();
+    reconnectionAdvertiser.restartAdvertising();
+}
+
+/* An unauthenticated user has been connected for DISCONNECTION_TIME */
+void forceDisconnection(void)
+{
+    Gap::DisconnectionReason_t res=Gap::LOCAL_HOST_TERMINATED_CONNECTION;
+    BLE::Instance().disconnect(res);
+}
+
+/* No user authenticated after AUTHENTICATION_TIME without a connection since boot */
+void forceActivation(void)
+{
+    imobStateServicePtr->updateActivationValue(1);
+    initial_activation = true;
+}
+
+/* Update battery charge level */
+void sampleBattery(void)
+{
+    timerWheel.arm(sampleBatteryTimer, TIMER_WHEEL_MS(BATTERY_SAMPLE_TIME));
+
+    batteryRaw = batteryCharge.read_u16();
+    if (batteryLevelCalibration)
+        batteryLevel = lipoPercent(adcScale(batteryRaw, batteryLevelConstant));
+    else
+        batteryLevel = adcPercent(batteryRaw);
+    batteryServicePtr->updateBatteryLevel(batteryLevel);
+}
+
+/* Update lipo charger state */
+void sampleLipoCharger(void)
+{
+    timerWheel.arm(sampleLipoChargerTimer, TIMER_WHEEL_MS(LIPO_SAMPLE_TIME));
+
+    lipochargerState = lcStat.read_u16();
+    uint8_t aux_lipochargerState;
+                
+    uint8_t pass_lipochargerState = internalValuesServicePtr->getLipoChargerState();
+    
+    if (lipochargerState > LIPO_STAT_THRESHOLD_LOW)
+    {                   
+        if (lipochargerState > LIPO_STAT_THRESHOLD_HIGH)
+        {                       
+            aux_lipochargerState = 1;                    
+            if (pass_lipochargerState == 0) internalValuesServicePtr->updateChargeProgramCyclesCharacteristic();
+        }
+        else
+            aux_lipochargerState = 2;
+    }
+    else
+    {
+        aux_lipochargerState = 0;
+        if (pass_lipochargerState == 1) internalValuesServicePtr->updateDischargeProgramCyclesCharacteristic();
+    }
+        
+    if(!batteryLevelCalibration && aux_lipochargerState == 1)
+    {
+        batteryLevelConstant = adcFullScaleFactor(batteryRaw);
+        batteryLevelCalibration = true;
+    }
+        
+    internalValuesServicePtr->updateLipoChargerState(aux_lipochargerState);
+    
+    /* The state is assumed to hold until the next sample */
+    if (aux_lipochargerState == 0) internalValuesServicePtr->incrementChargeProgramCycles(LIPO_SAMPLE_CICLES);
+    else if (aux_lipochargerState == 1) internalValuesServicePtr->incrementDischargeProgramCycles(LIPO_SAMPLE_CICLES);
+}
+
+/* Update contact state */
+void sampleContact(void)
+{
+    timerWheel.arm(sampleContactTimer, TIMER_WHEEL_MS(CONTACT_SAMPLE_TIME));
+
+    contactState = contact.read_u16();
+    uint8_t aux_contactState;                                   
+    
+    if (contactState > contactStateThreshold)
+    {
+        aux_contactState = 1;
+        
+        if (internalValuesServicePtr->getContactState() == 0)
+            advertisingScheduler.trigger();
+        
+        if (!authenticated && activated)
+            relayServicePtr->activate();                
+    }
+    else
+        aux_contactState = 0;
+                        
+    internalValuesServicePtr->updateContactState(aux_contactState);
+}
+
+#if !ACCEL_MOTION_INTERRUPT
+void sampleAccel(void)
+{
+    timerWheel.arm(sampleAccelTimer, TIMER_WHEEL_MS(ACCEL_SAMPLE_TIME));
+    accelSensorServicePtr->requestSample();
+}
+#endif
+
+/* Apply the state saved before the last reset. An immobilizer which had
+ * already been activated skips the AUTHENTICATION_TIME window. */
+void restoreState(void)
+{
+    ActivationState activation;
+    if (stateStore.get(STATE_KEY_ACTIVATION, activation))
+    {
+        imobStateServicePtr->updateActivationValue(activation.activated);
+        initial_activation = (activation.initialActivation != 0);
+    }
+    
+    CalibrationState calibration;
+    if (stateStore.get(STATE_KEY_CALIBRATION, calibration) && calibration.calibrated)
+    {
+        batteryLevelConstant = calibration.batteryLevelConstant;
+        batteryLevelCalibration = true;
+    }
+    
+    CycleState cycles;
+    if (stateStore.get(STATE_KEY_CYCLES, cycles))
+        internalValuesServicePtr->restoreProgramCycles(cycles.chargeProgramCycles, cycles.dischargeProgramCycles);
+}
+
+/* Hand the current state to the store, which only writes what changed */
+void saveState(void)
+{
+    ActivationState activation = { activated, initial_activation, { 0, 0 } };
+    stateStore.set(STATE_KEY_ACTIVATION, activation);
+    
+    if (batteryLevelCalibration)
+    {
+        CalibrationState calibration = { batteryLevelConstant, 1, { 0, 0, 0 } };
+        stateStore.set(STATE_KEY_CALIBRATION, calibration);
+    }
+    
+    CycleState cycles = { internalValuesServicePtr->getChargeProgramCycles(), internalValuesServicePtr->getDischargeProgramCycles() };
+    stateStore.set(STATE_KEY_CYCLES, cycles);
 }
 
-void periodicCallback(void)
+ImobStatus currentStatus(void)
 {
-    /* Do blinky on LED1 to indicate system aliveness. */
-    alivenessLED = !alivenessLED;
+    ImobStatus status;
+    status.activated = activated;
+    status.contact = internalValuesServicePtr->getContactState() != 0;
+    status.alarm = alarmServicePtr->getAlarmState() != 0;
+    status.lipoChargerState = internalValuesServicePtr->getLipoChargerState();
+    status.batteryLevel = batteryLevel;
+    status.id1Prefix = internalValuesServicePtr->getId1() >> 16;
+    return status;
 }
 
 /**
@@ -94,16 +387,25 @@ void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
     {
         return;
     }
+    bootProfiler.mark(BOOT_STAGE_STACK);
  
     ble.gap().onDisconnection(disconnectionCallback);
+    connectionProfiles.start(ble);
         
-    imobStateServicePtr = new ImobStateService(ble);
+    imobStateServicePtr = imobStateService.construct(ble);
+    
+    internalValuesServicePtr = internalValuesService.construct(ble, imobStateServicePtr);
+    relayServicePtr = relayService.construct(ble, imobStateServicePtr, timerWheel);
+    alarmServicePtr = alarmService.construct(ble);
+    accelSensorServicePtr = accelSensorService.construct(ble);
+    batteryServicePtr = batteryService.construct(ble, batteryLevel);
+    statusServicePtr = statusService.construct(ble);
+    bootProfiler.mark(BOOT_STAGE_GATT);
     
-    internalValuesServicePtr = new InternalValuesService(ble, imobStateServicePtr);
-    relayServicePtr = new RELAYService(ble, imobStateServicePtr);
-    alarmServicePtr = new ALARMService(ble);
-    accelSensorServicePtr = new AccelSensorService(ble);
-    batteryServicePtr = new BatteryService(ble, batteryLevel);
+#if !BOOT_DEFERRED_SENSOR_INIT
+    accelSensorServicePtr->start();
+    bootProfiler.mark(BOOT_STAGE_SENSOR);
+#endif
     
     /* setup advertising */
     
@@ -113,22 +415,24 @@ void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
     ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::BREDR_NOT_SUPPORTED | GapAdvertisingData::LE_GENERAL_DISCOVERABLE);
     /* Adding the RELAY service UUID to the advertising payload*/
     ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::COMPLETE_LIST_16BIT_SERVICE_IDS, (uint8_t *)uuid16_list, sizeof(uuid16_list));
-    /* This is where we're collecting the device name into the advertisement payload. */
-    ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::COMPLETE_LOCAL_NAME, (uint8_t *)DEVICE_NAME, sizeof(DEVICE_NAME));
+    /* Device status, readable without connecting */
+    statusBroadcast.start(ble.gap(), currentStatus());
+    /* This is where we're collecting the device name into the scan response, the advertisement payload is full. */
+    ble.gap().accumulateScanResponse(GapAdvertisingData::COMPLETE_LOCAL_NAME, (uint8_t *)DEVICE_NAME, sizeof(DEVICE_NAME));
     /* We'd like for this BLE peripheral to be connectable. */
     ble.gap().setAdvertisingType(GapAdvertisingParams::ADV_CONNECTABLE_UNDIRECTED);
-    /* set the interval at which advertisements are sent out, 1000ms. */
-    ble.gap().setAdvertisingInterval(TIME_CICLE);
+    /* the interval at which advertisements are sent out follows the vehicle activity. */
+    advertisingScheduler.start(ble.gap(), &reconnectionAdvertiser);
+    reconnectionAdvertiser.start(ble.gap());
     /* we're finally good to go with advertisements. */
     ble.gap().startAdvertising(); 
-    
+    bootProfiler.mark(BOOT_STAGE_ADVERTISING);
 }
 
 int main(void)
 {    
-    /* Setting up a callback to go at an interval of 1s. */
-    ticker.attach(periodicCallback, TIME_CICLE/1000.0);
-
+    bootProfiler.start();
+    
     /*  initialize the BLE stack and controller. */
     BLE &ble = BLE::Instance();
     ble.init(bleInitComplete);
@@ -147,104 +451,101 @@ int main(void)
      * BLE object is used in the main loop below. */
     while (ble.hasInitialized()  == false) { /* spin loop */ }       
 
+    /* Read the saved state back, the flash events are delivered by the
+     * stack event processing */
+    stateStore.add<ActivationState>(STATE_KEY_ACTIVATION, TIMER_WHEEL_MS(STATE_ACTIVATION_DELAY), TIMER_WHEEL_MS(STATE_ACTIVATION_HOLDOFF));
+    stateStore.add<CalibrationState>(STATE_KEY_CALIBRATION, TIMER_WHEEL_MS(STATE_CALIBRATION_DELAY), TIMER_WHEEL_MS(STATE_CALIBRATION_HOLDOFF));
+    stateStore.add<CycleState>(STATE_KEY_CYCLES, TIMER_WHEEL_MS(STATE_CYCLES_DELAY), TIMER_WHEEL_MS(STATE_CYCLES_HOLDOFF));
+    stateStore.start();
+    while (!stateStore.isReady())
+        ble.processEvents();
+    restoreState();
+    bootProfiler.mark(BOOT_STAGE_STATE);
+
+#if BOOT_DEFERRED_SENSOR_INIT
+    /* Already advertising, the phone can connect meanwhile */
+    accelSensorServicePtr->start();
+    bootProfiler.mark(BOOT_STAGE_SENSOR);
+#endif
+
+    powerManager.start(ble);
+    timerWheel.start();
+
+    /* First flash and samples, the callbacks then re-arm their timers on the
+     * same tick. The PPI channel of the blinker is owned by the SoftDevice. */
+    alivenessLED.start((uint32_t)TIME_CICLE, ALIVENESS_PERIOD);
+    sampleBattery();
+    sampleLipoCharger();
+    sampleContact();
+#if !ACCEL_MOTION_INTERRUPT
+    sampleAccel();
+#endif
+    bootProfiler.mark(BOOT_STAGE_PERIPHERALS);
+    internalValuesServicePtr->updateBootProfile(bootProfiler.getProfile());
+
     while (true)
     {
-        /* this will return upon any system event (such as an interrupt or a ticker wakeup) */
-        ble.waitForEvent();
+        /* Run the BLE callbacks and the timers that are due */
+        ble.processEvents();
+        timerWheel.poll();
         bool accel = accelSensorServicePtr->updateAccelDetection();
-                      
-        /* Update battery charge level */        
-        if (selectedAnalogIn == 0)
-        {
-            batteryLevel = (uint8_t)(batteryCharge.read()*batteryLevelConstant);
-            batteryServicePtr->updateBatteryLevel(batteryLevel);           
-        }
-        /* Update lipo charger state */
-        if (selectedAnalogIn == 1)
-        {
-            lipochargerState = lcStat.read();
-            uint8_t aux_lipochargerState;
-                        
-            uint8_t pass_lipochargerState = internalValuesServicePtr->getLipoChargerState();
-            
-            if (lipochargerState > 0.4)
-            {                   
-                if (lipochargerState > 0.9)
-                {                       
-                    aux_lipochargerState = 1;                    
-                    if (pass_lipochargerState == 0) internalValuesServicePtr->updateChargeProgramCyclesCharacteristic();
-                }
-                else
-                {
-                    aux_lipochargerState = 2;
-                    if (activated && accel) alarmServicePtr->updateAlarmState(1);
-                }
-            }
-            else
-            {
-                aux_lipochargerState = 0;
-                if (pass_lipochargerState == 1) internalValuesServicePtr->updateDischargeProgramCyclesCharacteristic();
-            }
-                
-            if(!batteryLevelCalibration && aux_lipochargerState == 1)
-            {
-                batteryLevelConstant *= 100.0f/batteryLevel;
-                batteryLevelCalibration = true;
-            }
-                
-            internalValuesServicePtr->updateLipoChargerState(aux_lipochargerState);
-        }
         
-        if (internalValuesServicePtr->getLipoChargerState() == 0) internalValuesServicePtr->incrementChargeProgramCycles();
-        else if (internalValuesServicePtr->getLipoChargerState() == 1) internalValuesServicePtr->incrementDischargeProgramCycles();
+        if (accel)
+            advertisingScheduler.trigger();
         
-        /* Update contact state */
-        if (selectedAnalogIn == 2)
-        {
-            contactState = contact.read();
-            uint8_t aux_contactState;                                   
-            
-            if (contactState > contactStateThreshold)
-            {
-                aux_contactState = 1;
-                
-                if (!authenticated && activated)
-                    relayServicePtr->activate();                
-            }
-            else
-                aux_contactState = 0;
-                                
-            internalValuesServicePtr->updateContactState(aux_contactState);
-        }       
-        
-        selectedAnalogIn++;
-            
-        if (selectedAnalogIn == ANALOGIN) selectedAnalogIn = 0;
+        /* Motion while running on battery */
+        if (activated && accel && internalValuesServicePtr->getLipoChargerState() == 2)
+            alarmServicePtr->updateAlarmState(1);
         
+        /* The disconnection deadline restarts from scratch once its
+         * condition has been interrupted, the activation one is paused */
         if (!authenticated && userIsConnected)
         {
-            if (forceDisconnectionCounter > DISCONNECTION_TIME)
-            {
-                forceDisconnectionCounter = 0;
-                Gap::DisconnectionReason_t res=Gap::LOCAL_HOST_TERMINATED_CONNECTION;
-                ble.disconnect(res);
-            }
-            else
-                forceDisconnectionCounter++;
+            if (!forceDisconnectionTimer.isArmed())
+                timerWheel.arm(forceDisconnectionTimer, TIMER_WHEEL_MS(DISCONNECTION_TIME));
         }
         else
-            forceDisconnectionCounter = 0;
+            timerWheel.cancel(forceDisconnectionTimer);
         
         if ( !initial_activation  && !userIsConnected)
-            if (forceActivationCounter > AUTHENTICATION_TIME)
-            {
-                forceActivationCounter = 0;
-                imobStateServicePtr->updateActivationValue(1);
-                initial_activation = true;
-            }
-            else
-                forceActivationCounter++;
-            
+        {
+            if (!forceActivationTimer.isArmed())
+                timerWheel.arm(forceActivationTimer, forceActivationRemaining);
+        }
+        else if (forceActivationTimer.isArmed())
+        {
+            forceActivationRemaining = timerWheel.remaining(forceActivationTimer);
+            timerWheel.cancel(forceActivationTimer);
+        }
+        
+        /* No-op unless a field of the record changed */
+        statusBroadcast.update(currentStatus());
+        
+        /* Coalesced in RAM, written on the schedule of each value */
+        saveState();
+        
+        /* Everything that changed during this iteration, in one notification */
+        statusServicePtr->updateStatus(StatusService::packStatus(activated,
+                                                                 internalValuesServicePtr->getContactState() != 0,
+                                                                 alarmServicePtr->getAlarmState() != 0,
+                                                                 relayServicePtr->getRelayState() != 0,
+                                                                 accelSensorServicePtr->getAccelDetection() != 0,
+                                                                 internalValuesServicePtr->getLipoChargerState()));
+        
+        /* Fast connection interval until authenticated, slow once idle */
+        bool peerAuthenticated = imobStateServicePtr->isPeerAuthenticated();
+        connectionProfiles.update(peerAuthenticated);
+        
+        /* Phone to call back after a disconnection */
+        if (peerAuthenticated)
+            reconnectionAdvertiser.peerAuthenticated();
+        
+        /* Keystream for the next pass write and next command challenge, off
+         * the write handler path */
+        while (ctr_precompute()) { }
+        while (imobStateServicePtr->precomputeChallenge()) { }
         
+        /* this will return upon any system event (such as an interrupt or a timer wakeup) */
+        powerManager.sleep();
     }
 }
\ No newline at end of file
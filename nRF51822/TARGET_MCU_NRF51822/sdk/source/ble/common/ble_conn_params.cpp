@@ -59,6 +59,7 @@ static Ticker                 m_conn_params_timer;
 #endif
 
 static bool m_change_param = false;
+static bool m_initialized  = false;                     /**< Set once ble_conn_params_init() has been called. */
 
 static bool is_conn_params_ok(ble_gap_conn_params_t * p_conn_params)
 {
@@ -163,6 +164,7 @@ uint32_t ble_conn_params_init(const ble_conn_params_init_t * p_init)
 
     m_conn_handle  = BLE_CONN_HANDLE_INVALID;
     m_update_count = 0;
+    m_initialized  = true;
 
 #ifdef USE_APP_TIMER
     return app_timer_create(&m_conn_params_timer_id,
@@ -329,6 +331,12 @@ static void on_conn_params_update(ble_evt_t * p_ble_evt)
 
 void ble_conn_params_on_ble_evt(ble_evt_t * p_ble_evt)
 {
+    // The module is optional, events are ignored until it is initialized
+    if (!m_initialized)
+    {
+        return;
+    }
+
     switch (p_ble_evt->header.evt_id)
     {
         case BLE_GAP_EVT_CONNECTED:
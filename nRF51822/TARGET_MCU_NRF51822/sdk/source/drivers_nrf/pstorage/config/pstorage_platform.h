@@ -92,6 +92,9 @@ typedef uint16_t pstorage_size_t;      /** Size of length and offset fields. */
 /**@brief Handles Flash Access Result Events. To be called in the system event dispatcher of the application. */
 void pstorage_sys_event_handler (uint32_t sys_evt);
 
+/**@brief Completes the operations which needed no flash access, posted by pending SD_EVT_IRQn. To be called in the same context as pstorage_sys_event_handler, after the events have been pulled. */
+void pstorage_posted_event_handler (void);
+
 #endif // PSTORAGE_PL_H__
 
 /** @} */
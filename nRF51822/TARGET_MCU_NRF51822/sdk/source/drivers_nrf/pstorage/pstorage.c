@@ -56,6 +56,7 @@
 #define MASK_SINGLE_PAGE_OPERATION (1 << 1)                            /**< Flag for checking if command is a single flash page operation. */
 #define MASK_MODULE_INITIALIZED    (1 << 2)                            /**< Flag for checking if the module has been initialized. */
 #define MASK_FLASH_API_ERR_BUSY    (1 << 3)                            /**< Flag for checking if flash API returned NRF_ERROR_BUSY. */
+#define MASK_COMPLETION_POSTED     (1 << 4)                            /**< Flag for checking if the completion of the current command has been posted to the SoC event path. */
 
 /**
  * @defgroup api_param_check API Parameters check macros.
@@ -166,6 +167,7 @@ typedef enum
     STATE_STORE,                                                       /**< State for storing data when using store/update API. */
     STATE_DATA_ERASE_WITH_SWAP,                                        /**< State for erasing the data page when using update/clear API when use of swap page is required. */
     STATE_DATA_ERASE,                                                  /**< State for erasing the data page when using update/clear API without the need to use the swap page. */
+    STATE_UPDATE_IN_PLACE,                                             /**< State for writing the changed words when using update API without the need to erase the data page. */
     STATE_ERROR                                                        /**< State entered when command processing is terminated abnormally. */
 } pstorage_state_t;  
 
@@ -218,6 +220,7 @@ typedef struct
     pstorage_size_t   offset;                                          /**< Offset requested by the application for the access operation. */
     pstorage_handle_t storage_addr;                                    /**< Address/Identifier for persistent memory. */
     uint8_t *         p_data_addr;                                     /**< Address/Identifier for data memory. This is assumed to be resident memory. */
+    uint8_t *         p_merged_data_addr;                              /**< Address/Identifier for data memory of an update replaced by this one, NULL if none. */
 } cmd_queue_element_t;
 
 
@@ -249,6 +252,7 @@ static pstorage_module_table_t m_app_table[PSTORAGE_NUM_OF_PAGES];     /**< Regi
 static uint32_t                m_num_of_bytes_written;                 /**< Variable for tracking the number of bytes written by the store operation. */
 static uint32_t                m_app_data_size;                        /**< Variable for storing the application command size parameter internally. */
 static uint32_t                m_flags = 0;                            /**< Storage for boolean flags for state tracking. */
+static pstorage_statistics_t   m_statistics;                           /**< Flash access statistics. */
 
 #ifdef PSTORAGE_RAW_MODE_ENABLE
 static pstorage_raw_module_table_t m_raw_app_table;                    /**< Registered application information table for raw mode. */
@@ -358,6 +362,9 @@ static void flash_write(uint32_t * const       p_dst,
                         uint32_t const * const p_src, 
                         uint32_t               size_in_words)
 {
+    ++m_statistics.write_count;
+    m_statistics.word_write_count += size_in_words;
+
     flash_api_err_code_process(sd_flash_write(p_dst, p_src, size_in_words));    
 }
 
@@ -454,6 +461,8 @@ static void state_data_erase_swap_entry_run(void)
  */
 static void flash_page_erase(uint32_t page_number)
 {
+    ++m_statistics.page_erase_count;
+
     flash_api_err_code_process(sd_flash_page_erase(page_number));
 }
 
@@ -468,6 +477,47 @@ static void state_data_erase_entry_run(void)
 }
 
 
+/**@brief Function for update in place state entry action.
+ *
+ * @details Function for update in place state entry action, which includes writing the first run 
+ *          of words that differ between flash and the data to be written. The runs already written
+ *          now match the data, so a self transition continues with the next run, or ends the 
+ *          command when all words match. Rejected or failed writes are reissued the same way.
+ */
+static void state_update_in_place_entry_run(void)
+{
+    const cmd_queue_element_t * p_cmd   = &m_cmd_queue.cmd[m_cmd_queue.rp];
+    uint32_t * const            p_dst   = (uint32_t *)(p_cmd->storage_addr.block_id + 
+                                                       p_cmd->offset);
+    const uint32_t * const      p_src   = (uint32_t *)p_cmd->p_data_addr;
+    const uint32_t              n_words = p_cmd->size / sizeof(uint32_t);
+    uint32_t                    start   = 0;
+    uint32_t                    end;
+
+    while ((start < n_words) && (p_dst[start] == p_src[start]))
+    {
+        ++start;
+    }
+
+    if (start == n_words)
+    {
+        // Nothing left to write, so no flash event will follow. Post the completion to the SoC 
+        // event path rather than notifying the application from the caller's context.
+        m_flags |= MASK_COMPLETION_POSTED;
+        (void)sd_nvic_SetPendingIRQ(SD_EVT_IRQn);
+        return;
+    }
+
+    end = start + 1;
+    while ((end < n_words) && (p_dst[end] != p_src[end]))
+    {
+        ++end;
+    }
+
+    flash_write(&p_dst[start], &p_src[start], end - start);
+}
+
+
 /**@brief Function for dispatching the correct application main state entry action.
  */
 static void state_entry_action_run(void)
@@ -489,6 +539,10 @@ static void state_entry_action_run(void)
         case STATE_DATA_ERASE:
             state_data_erase_entry_run();        
             break;
+
+        case STATE_UPDATE_IN_PLACE:
+            state_update_in_place_entry_run();
+            break;
                         
         default:
             // No action needed.
@@ -618,6 +672,7 @@ static void cmd_queue_element_init(uint32_t index)
     m_cmd_queue.cmd[index].storage_addr.module_id = PSTORAGE_NUM_OF_PAGES;
     m_cmd_queue.cmd[index].storage_addr.block_id  = 0;
     m_cmd_queue.cmd[index].p_data_addr            = NULL;
+    m_cmd_queue.cmd[index].p_merged_data_addr     = NULL;
     m_cmd_queue.cmd[index].offset                 = 0;
 }
 
@@ -636,6 +691,65 @@ static void cmd_queue_init(void)
 }
 
 
+/**@brief Function for merging an update into the last command in the queue.
+ *
+ * @details Function for merging an update into the last command in the queue if that command is an 
+ *          update of the same area which has not been started. Only the newest data needs to be 
+ *          written, so the queued command takes it over and keeps the replaced data address to 
+ *          notify its application as well. Merging into the last command only keeps the order of 
+ *          the commands, and a command is merged into once at most.
+ *
+ * @param[in] p_storage_addr Identifies the module and flash address of the update.
+ * @param[in] p_data_addr    Identifies the data address of the update.
+ * @param[in] size           Size in bytes of data of the update.
+ * @param[in] offset         Offset within the flash memory block of the update.
+ *
+ * @retval    true  If the update has been merged.
+ * @retval    false If the update needs its own command queue element.
+ */
+static bool cmd_queue_update_merge(pstorage_handle_t * p_storage_addr,
+                                   uint8_t           * p_data_addr,
+                                   pstorage_size_t     size,
+                                   pstorage_size_t     offset)
+{
+    if (m_cmd_queue.count == 0)
+    {
+        return false;
+    }
+
+    uint32_t last_index = m_cmd_queue.rp + m_cmd_queue.count - 1;
+
+    if (last_index >= PSTORAGE_CMD_QUEUE_SIZE)
+    {
+        last_index -= PSTORAGE_CMD_QUEUE_SIZE;
+    }
+
+    cmd_queue_element_t * p_last = &m_cmd_queue.cmd[last_index];
+
+    // The command in progress, or stalled in error state, can't take over new data.
+    if ((last_index == m_cmd_queue.rp) && (m_state != STATE_IDLE))
+    {
+        return false;
+    }
+
+    if ((p_last->op_code != PSTORAGE_UPDATE_OP_CODE)                     ||
+        (p_last->p_merged_data_addr != NULL)                             ||
+        (p_last->storage_addr.module_id != p_storage_addr->module_id)    ||
+        (p_last->storage_addr.block_id != p_storage_addr->block_id)      ||
+        (p_last->size != size) || (p_last->offset != offset))
+    {
+        return false;
+    }
+
+    p_last->p_merged_data_addr = p_last->p_data_addr;
+    p_last->p_data_addr        = p_data_addr;
+
+    ++m_statistics.update_merge_count;
+
+    return true;
+}
+
+
 /**@brief Function for enqueuing, and possibly dispatching, a flash access operation.
  *
  * @param[in] opcode         Identifies the operation requested to be enqueued.
@@ -656,7 +770,12 @@ static uint32_t cmd_queue_enqueue(uint8_t             opcode,
 {
     uint32_t err_code;
 
-    if (m_cmd_queue.count != PSTORAGE_CMD_QUEUE_SIZE)
+    if ((opcode == PSTORAGE_UPDATE_OP_CODE) && 
+        cmd_queue_update_merge(p_storage_addr, p_data_addr, size, offset))
+    {
+        err_code = NRF_SUCCESS;
+    }
+    else if (m_cmd_queue.count != PSTORAGE_CMD_QUEUE_SIZE)
     {
         // Enqueue the command if it the queue is not full.
         uint32_t write_index = m_cmd_queue.rp + m_cmd_queue.count;
@@ -722,6 +841,12 @@ static void app_notify(uint32_t result, cmd_queue_element_t * p_elem)
         ntf_cb = m_app_table[p_elem->storage_addr.module_id].cb;
     }
 
+    if (p_elem->p_merged_data_addr != NULL)
+    {
+        // The replaced update is notified first, as it was requested first.
+        ntf_cb(&p_elem->storage_addr, op_code, result, p_elem->p_merged_data_addr, m_app_data_size);
+    }
+
     ntf_cb(&p_elem->storage_addr, op_code, result, p_elem->p_data_addr, m_app_data_size);
 }
 
@@ -1070,6 +1195,23 @@ static void store_sub_state_sm_run(void)
 }
 
 
+/**@brief Function for doing update in place state action upon flash operation success event.
+ */
+static void update_in_place_sub_state_sm_run(void)
+{
+    if (!(m_flags & MASK_FLASH_API_ERR_BUSY))
+    {        
+        // Write the next run of changed words, if any, by doing a self transit.
+        sm_state_change(m_state);
+    }
+    else
+    {
+        // As operation request was rejected by the flash API reissue the request.
+        main_state_err_busy_process();
+    }
+}
+
+
 /**@brief Function for doing action upon flash operation success event.
  */
 static void flash_operation_success_run(void)
@@ -1087,6 +1229,10 @@ static void flash_operation_success_run(void)
         case STATE_DATA_ERASE_WITH_SWAP:
             swap_sub_state_sm_run();                        
             break;                        
+
+        case STATE_UPDATE_IN_PLACE:
+            update_in_place_sub_state_sm_run();
+            break;
             
         default:
             // No implementation needed.
@@ -1135,7 +1281,8 @@ static void flash_operation_failure_run(void)
  */
 void pstorage_sys_event_handler(uint32_t sys_evt)
 {  
-    if (m_state != STATE_IDLE && m_state != STATE_ERROR)
+    // While a completion is posted no flash operation of the module is in progress.
+    if (m_state != STATE_IDLE && m_state != STATE_ERROR && !(m_flags & MASK_COMPLETION_POSTED))
     {        
         switch (sys_evt)
         {
@@ -1166,6 +1313,16 @@ void pstorage_sys_event_handler(uint32_t sys_evt)
 }
 
 
+void pstorage_posted_event_handler(void)
+{
+    if (m_flags & MASK_COMPLETION_POSTED)
+    {
+        m_flags &= ~MASK_COMPLETION_POSTED;
+        command_end_procedure_run();
+    }
+}
+
+
 /**@brief Function for calculating the tail area size in number of 32-bit words.
  *
  * @param[in] cmd_end_of_storage_address End of storage area within the scope of the command.
@@ -1266,11 +1423,48 @@ static void store_operation_execute(void)
 }
  
 
+/**@brief Function for evaluating if the update can be written without erasing the data page.
+ *
+ * @details The words that differ from the data to be written must be erased in flash. Words which 
+ *          are already written are not written again, even if only bits would be cleared, as the 
+ *          number of writes to a word between erases is limited and can't be tracked.
+ *
+ * @retval true  If the update can be written in place.
+ * @retval false If the update requires the data page to be erased.
+ */
+static bool is_update_in_place_possible(void)
+{
+    const cmd_queue_element_t * p_cmd   = &m_cmd_queue.cmd[m_cmd_queue.rp];
+    const uint32_t * const      p_dst   = (uint32_t *)(p_cmd->storage_addr.block_id + 
+                                                       p_cmd->offset);
+    const uint32_t * const      p_src   = (uint32_t *)p_cmd->p_data_addr;
+    const uint32_t              n_words = p_cmd->size / sizeof(uint32_t);
+
+    for (uint32_t index = 0; index < n_words; ++index)
+    {
+        if ((p_dst[index] != p_src[index]) && (p_dst[index] != PSTORAGE_FLASH_EMPTY_MASK))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
 /**@brief Function for executing the update operation.
  */ 
 static void update_operation_execute(void)
 {
-    clear_operation_execute();
+    if (is_update_in_place_possible())
+    {
+        ++m_statistics.update_in_place_count;
+        sm_state_change(STATE_UPDATE_IN_PLACE);
+    }
+    else
+    {
+        clear_operation_execute();
+    }
 }
 
 
@@ -1326,6 +1520,8 @@ uint32_t pstorage_init(void)
     m_flags                     = 0;
     m_num_of_bytes_written      = 0;
     m_flags                    |= MASK_MODULE_INITIALIZED;
+
+    memset(&m_statistics, 0, sizeof(m_statistics));
        
     return NRF_SUCCESS;
 }
@@ -1525,6 +1721,17 @@ uint32_t pstorage_access_status_get(uint32_t * p_count)
     return NRF_SUCCESS;
 }
 
+
+uint32_t pstorage_statistics_get(pstorage_statistics_t * p_statistics)
+{
+    VERIFY_MODULE_INITIALIZED();
+    NULL_PARAM_CHECK(p_statistics);
+
+    (*p_statistics) = m_statistics;
+
+    return NRF_SUCCESS;
+}
+
 #ifdef PSTORAGE_RAW_MODE_ENABLE
 
 uint32_t pstorage_raw_register(pstorage_module_param_t * p_module_param,
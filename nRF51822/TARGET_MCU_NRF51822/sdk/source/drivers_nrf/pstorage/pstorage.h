@@ -111,6 +111,16 @@ typedef struct
     pstorage_size_t   block_count;    /** Number of blocks requested by the module; minimum values is 1. */
 } pstorage_module_param_t;
 
+/**@brief Struct containing flash access statistics of the module. */
+typedef struct
+{
+    uint32_t page_erase_count;        /**< Number of flash page erases requested, including the swap page. */
+    uint32_t write_count;             /**< Number of flash writes requested. */
+    uint32_t word_write_count;        /**< Number of 32-bit words written to flash. */
+    uint32_t update_in_place_count;   /**< Number of updates written without erasing the flash page. */
+    uint32_t update_merge_count;      /**< Number of updates that replaced the data of a queued update. */
+} pstorage_statistics_t;
+
 /**@} */
 
 /**@defgroup pstorage_routines Persistent Storage Access Routines
@@ -240,6 +250,14 @@ uint32_t pstorage_store(pstorage_handle_t * p_dest,
  * @retval     NRF_ERROR_INVALID_ADDR  Operation failure. Parameter is not aligned.
  * @retval     NRF_ERROR_NO_MEM        Operation failure. No storage space available.
  *
+ * @note       An update that only writes to erased words of the block is written in place, without 
+ *             erasing the flash page, and an update that does not change the stored data completes 
+ *             without flash access. In the latter case, the notification callback is still called 
+ *             from the system event path, never before this function returns. An update of the 
+ *             same area as the last queued update, if that one has not been started, takes over its 
+ *             place in the command queue; both sources are reported in the notification callback 
+ *             once the newest data is written.
+ *
  * @warning    No copy of the data is made, meaning memory provided for the data source that is to 
  *             be written to flash cannot be freed or reused by the application until this procedure
  *             is complete. The application is notified when the procedure is finished using the
@@ -313,6 +331,20 @@ uint32_t pstorage_clear(pstorage_handle_t * p_base_id, pstorage_size_t size);
  */
 uint32_t pstorage_access_status_get(uint32_t * p_count);
 
+/**@brief Function for getting the flash access statistics of the module.
+ *
+ * @details The statistics are counted from the last call to @ref pstorage_init and can be used to 
+ *          evaluate the flash wear caused by a workload.
+ *
+ * @param[out] p_statistics Flash access statistics.
+ *
+ * @retval     NRF_SUCCESS             Operation success. 
+ * @retval     NRF_ERROR_INVALID_STATE Operation failure. API is called without module 
+ *                                     initialization.
+ * @retval     NRF_ERROR_NULL          Operation failure. NULL parameter has been passed.
+ */
+uint32_t pstorage_statistics_get(pstorage_statistics_t * p_statistics);
+
 #ifdef PSTORAGE_RAW_MODE_ENABLE
 
 /**@brief Function for registering with the persistent storage interface.
@@ -76,9 +76,24 @@ static bool                       m_swap_page_avail = false;
 static fds_gc_data_t              m_gc;
 static uint16_t                   m_gc_runs;
 
+static fds_batch_t                m_batch;
+
+#if (FDS_INDEX_SIZE > 0)
+/**@brief Location of the valid records. Built by pages_init(), kept up to date by the commands. */
+static fds_index_t                m_index;
+#endif
+
 static uint8_t          volatile  m_counter;
 
 
+/** The GC queues itself again when it gives way to other commands. */
+static ret_code_t queue_reserve(uint8_t               num_cmd,
+                                uint8_t               num_chunks,
+                                fds_cmd_t          ** pp_cmd,
+                                fds_record_chunk_t ** pp_chunk);
+static ret_code_t cmd_queue_process(void);
+
+
 static void app_notify(ret_code_t       result,
                        fds_cmd_id_t     cmd,
                        fds_record_id_t  record_id,
@@ -150,10 +165,26 @@ static bool flag_is_set(fds_flags_t flag)
 static __INLINE bool header_is_valid(fds_header_t const * const p_header)
 {
     return ((p_header->tl.type     != FDS_TYPE_ID_INVALID) &&
+            (p_header->tl.type     != FDS_TYPE_ID_BATCH)   &&
             (p_header->ic.instance != FDS_INSTANCE_ID_INVALID));
 }
 
 
+/**@brief Returns the distance from a header to the next one, in 4 byte words. The records of a
+ *        committed batch are its data: walk into it. A batch whose IC has not been written yet
+ *        is skipped altogether, together with its records. */
+static __INLINE uint16_t header_skip_words(fds_header_t const * const p_header)
+{
+    if ((p_header->tl.type     == FDS_TYPE_ID_BATCH) &&
+        (p_header->ic.instance != FDS_INSTANCE_ID_INVALID))
+    {
+        return FDS_HEADER_SIZE;
+    }
+
+    return (FDS_HEADER_SIZE + p_header->tl.length_words);
+}
+
+
 static bool address_within_page_bounds(uint32_t const * const p_addr)
 {
     return (p_addr >= fs_config.p_start_addr) &&
@@ -227,6 +258,215 @@ static uint16_t page_by_addr(uint32_t const * const p_addr)
 }
 
 
+#if (FDS_INDEX_SIZE > 0)
+
+static __INLINE uint8_t index_id_bucket(fds_record_id_t record_id)
+{
+    return (record_id & (FDS_INDEX_BUCKETS - 1));
+}
+
+
+static __INLINE uint8_t index_key_bucket(uint16_t type, uint16_t instance)
+{
+    return ((type ^ (instance * 31)) & (FDS_INDEX_BUCKETS - 1));
+}
+
+
+/**@brief Position of a record in storage order, i.e., by virtual page then by address. */
+static __INLINE uint32_t index_position(uint16_t page, uint16_t offset)
+{
+    return ((uint32_t)m_pages[page].vpage_id << 16) | offset;
+}
+
+
+static void index_reset(void)
+{
+    memset(&m_index, 0, sizeof(fds_index_t));
+    memset(m_index.id_head,  FDS_INDEX_NONE, sizeof(m_index.id_head));
+    memset(m_index.key_head, FDS_INDEX_NONE, sizeof(m_index.key_head));
+
+    // Chain all entries in the free list.
+    for (uint8_t i = 0; i < FDS_INDEX_SIZE; i++)
+    {
+        m_index.entry[i].id_next = (i + 1 < FDS_INDEX_SIZE) ? (i + 1) : FDS_INDEX_NONE;
+    }
+
+    m_index.free_head = 0;
+    m_index.complete  = true;
+}
+
+
+/**@brief Adds a valid record to the index. If the index is full, the index is flagged as not
+ *        complete and the record will only be found by scanning the pages. */
+static void index_insert(uint16_t page, uint32_t const * const p_addr)
+{
+    fds_header_t const * const p_header = (fds_header_t*)p_addr;
+    fds_index_entry_t  *       p_entry;
+    uint8_t                    slot;
+    uint8_t                    bucket;
+
+    if (m_index.free_head == FDS_INDEX_NONE)
+    {
+        m_index.complete = false;
+        return;
+    }
+
+    slot              = m_index.free_head;
+    p_entry           = &m_index.entry[slot];
+    m_index.free_head = p_entry->id_next;
+
+    p_entry->record_id = p_header->id;
+    p_entry->type      = p_header->tl.type;
+    p_entry->instance  = p_header->ic.instance;
+    p_entry->page      = page;
+    p_entry->offset    = (uint16_t)(p_addr - m_pages[page].start_addr);
+
+    bucket                   = index_id_bucket(p_entry->record_id);
+    p_entry->id_next         = m_index.id_head[bucket];
+    m_index.id_head[bucket]  = slot;
+
+    bucket                   = index_key_bucket(p_entry->type, p_entry->instance);
+    p_entry->key_next        = m_index.key_head[bucket];
+    m_index.key_head[bucket] = slot;
+}
+
+
+/**@brief Removes a record from the index, if it is tracked. */
+static void index_remove(fds_record_id_t record_id)
+{
+    uint8_t * p_slot = &m_index.id_head[index_id_bucket(record_id)];
+    uint8_t   slot;
+
+    // Unlink the entry from its record ID bucket.
+    while ((*p_slot != FDS_INDEX_NONE) && (m_index.entry[*p_slot].record_id != record_id))
+    {
+        p_slot = &m_index.entry[*p_slot].id_next;
+    }
+
+    if (*p_slot == FDS_INDEX_NONE)
+    {
+        return;
+    }
+
+    slot    = *p_slot;
+    *p_slot = m_index.entry[slot].id_next;
+
+    // Unlink it from its key bucket.
+    p_slot = &m_index.key_head[index_key_bucket(m_index.entry[slot].type,
+                                                m_index.entry[slot].instance)];
+    while (*p_slot != slot)
+    {
+        p_slot = &m_index.entry[*p_slot].key_next;
+    }
+    *p_slot = m_index.entry[slot].key_next;
+
+    // Return the entry to the free list.
+    m_index.entry[slot].record_id = 0;
+    m_index.entry[slot].id_next   = m_index.free_head;
+    m_index.free_head             = slot;
+}
+
+
+/**@brief Removes all the records stored on a physical page from the index. */
+static void index_page_remove(uint16_t page)
+{
+    for (uint8_t i = 0; i < FDS_INDEX_SIZE; i++)
+    {
+        if ((m_index.entry[i].record_id != 0) && (m_index.entry[i].page == page))
+        {
+            index_remove(m_index.entry[i].record_id);
+        }
+    }
+}
+
+
+static fds_index_entry_t const * index_find_id(fds_record_id_t record_id)
+{
+    uint8_t slot = m_index.id_head[index_id_bucket(record_id)];
+
+    while (slot != FDS_INDEX_NONE)
+    {
+        if (m_index.entry[slot].record_id == record_id)
+        {
+            return &m_index.entry[slot];
+        }
+        slot = m_index.entry[slot].id_next;
+    }
+
+    return NULL;
+}
+
+
+/**@brief Finds the first record matching the given keys which comes after the record found last
+ *        with the same token, in storage order. Behaves like the page scan in find_record(). */
+static ret_code_t index_find(fds_type_id_t     const * const p_type,
+                             fds_instance_id_t const * const p_inst,
+                             fds_record_desc_t       * const p_desc,
+                             fds_find_token_t        * const p_token)
+{
+    fds_index_entry_t const * p_found = NULL;
+    uint32_t                  found_pos = 0;
+    uint32_t                  last_pos  = 0;
+    uint8_t                   slot;
+    bool                      walk_all;
+
+    if ((p_token->magic == FDS_MAGIC_WORD) &&
+        (p_token->p_addr != NULL) &&
+        address_within_page_bounds(p_token->p_addr))
+    {
+        // Resume after the record found last.
+        uint16_t const page = page_by_addr(p_token->p_addr);
+        last_pos = index_position(page, (uint16_t)(p_token->p_addr - m_pages[page].start_addr));
+    }
+
+    /** If both keys are given, only the entries in their bucket can match.
+     *  Otherwise, go through all the entries. */
+    walk_all = (p_type == NULL) || (p_inst == NULL);
+    slot     = walk_all ? 0 : m_index.key_head[index_key_bucket(*p_type, *p_inst)];
+
+    while (walk_all ? (slot < FDS_INDEX_SIZE) : (slot != FDS_INDEX_NONE))
+    {
+        fds_index_entry_t const * const p_entry = &m_index.entry[slot];
+
+        if ((p_entry->record_id != 0) &&
+            ((p_type == NULL) || (p_entry->type     == *p_type)) &&
+            ((p_inst == NULL) || (p_entry->instance == *p_inst)))
+        {
+            uint32_t const pos = index_position(p_entry->page, p_entry->offset);
+
+            if ((pos > last_pos) && ((p_found == NULL) || (pos < found_pos)))
+            {
+                p_found   = p_entry;
+                found_pos = pos;
+            }
+        }
+
+        slot = walk_all ? (slot + 1) : p_entry->key_next;
+    }
+
+    if (p_found == NULL)
+    {
+        // Zero the token, so that it can be reused.
+        p_token->magic = 0x00;
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    p_token->magic    = FDS_MAGIC_WORD;
+    p_token->vpage_id = m_pages[p_found->page].vpage_id;
+    p_token->p_addr   = m_pages[p_found->page].start_addr + p_found->offset;
+
+    p_desc->vpage_id  = p_token->vpage_id;
+    p_desc->record_id = p_found->record_id;
+    p_desc->p_rec     = p_token->p_addr;
+    p_desc->ptr_magic = FDS_MAGIC_HWORD;
+    p_desc->gc_magic  = m_gc_runs;
+
+    return NRF_SUCCESS;
+}
+
+#endif // FDS_INDEX_SIZE
+
+
 // NOTE: depends on m_pages.write_offset to function.
 static bool page_has_space(uint16_t page, fds_length_t length_words)
 {
@@ -247,13 +487,16 @@ static bool page_has_space(uint16_t page, fds_length_t length_words)
 /**@brief This function scans a page to determine how many words have
  *        been written to it. This information is used to set the page
  *        write offset during initialization (mount). Additionally, this
- *        function will update the last known record ID as it proceeds.
+ *        function will update the last known record ID, count the words
+ *        taken by cleared records and add the valid records to the index
+ *        as it proceeds.
  */
 static void page_scan(uint16_t page, uint16_t volatile * words_written)
 {
     uint32_t const * p_addr = (m_pages[page].start_addr + FDS_PAGE_TAG_SIZE);
 
-    *words_written = FDS_PAGE_TAG_SIZE;
+    *words_written            = FDS_PAGE_TAG_SIZE;
+    m_pages[page].words_dirty = 0;
 
     // A corrupt TL might cause problems.
     while ((p_addr < m_pages[page].start_addr + FS_PAGE_SIZE_WORDS) &&
@@ -272,13 +515,58 @@ static void page_scan(uint16_t page, uint16_t volatile * words_written)
             m_last_rec_id = p_header->id;
          }
 
+         if (!header_is_valid(p_header))
+         {
+            // The record was cleared, or its write was interrupted, or this is a batch header.
+            m_pages[page].words_dirty += header_skip_words(p_header);
+         }
+#if (FDS_INDEX_SIZE > 0)
+         else
+         {
+            index_insert(page, p_addr);
+         }
+#endif
+
          // Jump to the next record.
-         p_addr         += (FDS_HEADER_SIZE + p_header->tl.length_words);
-         *words_written += (FDS_HEADER_SIZE + p_header->tl.length_words);
+         *words_written += header_skip_words(p_header);
+         p_addr         += header_skip_words(p_header);
     }
 }
 
 
+/**@brief Scans a page again to refresh its count of cleared words and add its records to the
+ *        index, without touching its write offset. */
+static void page_rescan(uint16_t page)
+{
+    uint16_t volatile words_written;
+    page_scan(page, &words_written);
+}
+
+
+#if (FDS_INDEX_SIZE > 0)
+
+/**@brief Rebuilds the index from scratch, if it has ever run out of entries. */
+static void index_rebuild(void)
+{
+    if (m_index.complete)
+    {
+        return;
+    }
+
+    index_reset();
+
+    for (uint16_t i = 0; i < FDS_MAX_PAGES; i++)
+    {
+        if (m_pages[i].page_type == FDS_PAGE_VALID)
+        {
+            page_rescan(i);
+        }
+    }
+}
+
+#endif // FDS_INDEX_SIZE
+
+
 static bool page_is_empty(uint16_t page)
 {
     uint32_t const * const p_addr = m_pages[page].start_addr;
@@ -351,6 +639,18 @@ static ret_code_t page_tag_write_valid(uint16_t page)
 }
 
 
+/**@brief Tags a swap page as valid. The two tags differ in their first word only: writing
+ *        the others again would be their second write since the erase, and the GC tag
+ *        their third. */
+static ret_code_t page_tag_write_swap_valid(uint16_t page)
+{
+    return fs_store(&fs_config,
+                    m_pages[page].start_addr,
+                    (uint32_t const *)&fds_page_tag_valid,
+                    1);
+}
+
+
 /**@brief Tags a valid page as being garbage collected. */
 static ret_code_t page_tag_write_gc(uint16_t page)
 {
@@ -374,7 +674,7 @@ static ret_code_t scan_next_valid(uint16_t page, uint32_t const ** p_record)
     else
     {
         // Jump to the next record.
-        p_next_rec += (FDS_HEADER_SIZE + ((fds_header_t*)(*p_record))->tl.length_words);
+        p_next_rec += header_skip_words((fds_header_t*)(*p_record));
     }
 
     // Scan until we find a valid record or until the end of the page.
@@ -395,7 +695,7 @@ static ret_code_t scan_next_valid(uint16_t page, uint32_t const ** p_record)
         else
         {
             // The item is not valid, jump to the next.
-            p_next_rec += (FDS_HEADER_SIZE + (p_header->tl.length_words));
+            p_next_rec += header_skip_words(p_header);
         }
     }
 
@@ -420,6 +720,25 @@ static ret_code_t seek_record(fds_record_desc_t * const p_desc)
      *  has been run since the last time it was retrieved.
      *  We must seek the record again. */
 
+#if (FDS_INDEX_SIZE > 0)
+    if (m_index.complete)
+    {
+        fds_index_entry_t const * const p_entry = index_find_id(p_desc->record_id);
+
+        if (p_entry == NULL)
+        {
+            return NRF_ERROR_NOT_FOUND;
+        }
+
+        p_desc->p_rec     = m_pages[p_entry->page].start_addr + p_entry->offset;
+        p_desc->vpage_id  = m_pages[p_entry->page].vpage_id;
+        p_desc->ptr_magic = FDS_MAGIC_HWORD;
+        p_desc->gc_magic  = m_gc_runs;
+
+        return NRF_SUCCESS;
+    }
+#endif
+
     // Obtain the physical page ID.
     if (page_id_from_virtual_id(p_desc->vpage_id, &page) != NRF_SUCCESS)
     {
@@ -443,19 +762,20 @@ static ret_code_t seek_record(fds_record_desc_t * const p_desc)
                 (!header_is_valid(p_header)))
             {
                 // ID doesnt't match or the record has been cleared. Jump to the next record.
-                p_record += FDS_HEADER_SIZE + p_header->tl.length_words;
+                p_record += header_skip_words(p_header);
             }
             else
             {
                 // Update the pointer in the descriptor.
                 p_desc->p_rec     = p_record;
+                p_desc->vpage_id  = m_pages[page].vpage_id;
                 p_desc->ptr_magic = FDS_MAGIC_HWORD;
                 p_desc->gc_magic  = m_gc_runs;
 
                 return NRF_SUCCESS;
             }
         }
-    } while (seek_all_pages ? page++ < FDS_MAX_PAGES : 0);
+    } while (seek_all_pages ? ++page < FDS_MAX_PAGES : 0);
 
     return NRF_ERROR_NOT_FOUND;
 }
@@ -471,6 +791,13 @@ static ret_code_t find_record(fds_type_id_t     const * const p_type,
         return NRF_ERROR_INVALID_STATE;
     }
 
+#if (FDS_INDEX_SIZE > 0)
+    if (m_index.complete)
+    {
+        return index_find(p_type, p_inst, p_desc, p_token);
+    }
+#endif
+
     // Here we distinguish between the first invocation and the and the others.
     if ((p_token->magic != FDS_MAGIC_WORD) ||
         !address_within_page_bounds(p_token->p_addr)) // Is the address is really okay?
@@ -551,7 +878,7 @@ static ret_code_t find_record(fds_type_id_t     const * const p_type,
                 }
             }
             // Jump to the next record.
-            p_token->p_addr += (FDS_HEADER_SIZE + (p_header->tl.length_words));
+            p_token->p_addr += header_skip_words(p_header);
         }
 
         /** We have seeked an entire page. Set the address in the token to NULL
@@ -569,10 +896,11 @@ static ret_code_t find_record(fds_type_id_t     const * const p_type,
 
 static void gc_init()
 {
-    // Set which pages to GC.
+    // Set which pages to GC. Pages without cleared records have nothing to reclaim.
     for (uint16_t i = 0; i < FDS_MAX_PAGES; i++)
     {
-        m_gc.do_gc_page[i] = (m_pages[i].page_type == FDS_PAGE_VALID);
+        m_gc.do_gc_page[i] = (m_pages[i].page_type   == FDS_PAGE_VALID) &&
+                             (m_pages[i].words_dirty != 0);
     }
 }
 
@@ -630,6 +958,11 @@ static ret_code_t gc_page()
     {    
         gc_reset();
 
+#if (FDS_INDEX_SIZE > 0)
+        // Space might have been freed for the records which did not fit in the index.
+        index_rebuild();
+#endif
+
         return COMMAND_COMPLETED;
     }
 
@@ -672,6 +1005,8 @@ static ret_code_t gc_copy_record()
     // Remember to update the swap page write offset.
     m_pages[m_gc.swap_page].write_offset += (FDS_HEADER_SIZE + p_record->header.tl.length_words);
 
+    m_gc.step_records++;
+
     return COMMAND_EXECUTING;
 }
 
@@ -684,7 +1019,7 @@ static ret_code_t gc_ready_swap_page()
      *  The swap page can now be flagged as a valid page. */
     gc_set_state(READY_SWAP);
 
-    fs_ret = page_tag_write_valid(m_gc.swap_page);
+    fs_ret = page_tag_write_swap_valid(m_gc.swap_page);
     if (fs_ret != NRF_SUCCESS)
     {
         return fs_ret;
@@ -714,12 +1049,49 @@ static ret_code_t gc_seek_record()
 }
 
 
-static ret_code_t gc_new_swap_page()
+/**@brief Checks whether a record has already been copied to swap by the GC in progress. */
+static bool gc_record_copied(uint32_t const * const p_rec)
 {
-    ret_code_t fs_ret;
-    uint16_t   vpage_id;
+    return (m_gc.queued)                           &&
+           (m_gc.state == COPY_RECORD)             &&
+           (page_by_addr(p_rec) == m_gc.cur_page)  &&
+           (p_rec <= m_gc.p_scan_addr);
+}
 
-    gc_set_state(NEW_SWAP);
+
+/**@brief Clears the copy of a record which was cleared after the GC had copied it. */
+static ret_code_t gc_clear_copy()
+{
+    uint32_t        const * p_rec     = NULL;
+    fds_record_id_t const   record_id = m_gc.copy_record_id;
+
+    m_gc.copy_record_id = 0;
+
+    while (scan_next_valid(m_gc.swap_page, &p_rec) == NRF_SUCCESS)
+    {
+        if (((fds_header_t*)p_rec)->id == record_id)
+        {
+            m_pages[m_gc.swap_page].words_dirty +=
+                (FDS_HEADER_SIZE + ((fds_header_t*)p_rec)->tl.length_words);
+
+            return fs_store(&fs_config,
+                            p_rec,
+                            (uint32_t*)&m_fds_tl_invalid,
+                            FDS_HEADER_SIZE_TL);
+        }
+    }
+
+    return NRF_ERROR_NOT_FOUND;
+}
+
+
+/**@brief Swaps the page being collected with the swap page, which holds its records now that it
+ *        has been flagged as valid in flash. Only the page data in RAM is updated. */
+static void gc_swap_pages()
+{
+    uint16_t vpage_id;
+
+    gc_set_state(SWAPPED);
 
     // Save the swap page virtual page ID.
     vpage_id = m_pages[m_gc.swap_page].vpage_id;
@@ -730,6 +1102,12 @@ static ret_code_t gc_new_swap_page()
     m_pages[m_gc.swap_page].vpage_id       = m_pages[m_gc.cur_page].vpage_id;
     m_pages[m_gc.swap_page].words_reserved = m_pages[m_gc.cur_page].words_reserved;
 
+#if (FDS_INDEX_SIZE > 0)
+    // The records of the page we just GC now live in the swap page.
+    index_page_remove(m_gc.cur_page);
+#endif
+    page_rescan(m_gc.swap_page);
+
     // The new swap page is now the page we just GC.
     m_gc.swap_page = m_gc.cur_page;
 
@@ -738,6 +1116,22 @@ static ret_code_t gc_new_swap_page()
     m_pages[m_gc.swap_page].vpage_id       = vpage_id;
     m_pages[m_gc.swap_page].write_offset   = FDS_PAGE_TAG_SIZE;
     m_pages[m_gc.swap_page].words_reserved = 0;
+    m_pages[m_gc.swap_page].words_dirty    = 0;
+
+    // Not until it has been erased and flagged.
+    m_swap_page_avail = false;
+
+    /** Descriptors retrieved while the page was being collected point to it.
+     *  Have the records seeked again. */
+    m_gc_runs++;
+}
+
+
+static ret_code_t gc_new_swap_page()
+{
+    ret_code_t fs_ret;
+
+    gc_set_state(NEW_SWAP);
 
     /** Finally, erase the new swap page. Remember we still have to flag this
      *  new page as swap, but we'll wait the callback for this operation to do so. */
@@ -770,6 +1164,118 @@ static ret_code_t gc_new_swap_page_init()
 }
 
 
+/**@brief Gives way to the commands queued while the GC is running, by queuing the GC again behind
+ *        them. This is only done once a step has completed, when the pages are consistent:
+ *        after FDS_GC_STEP_RECORDS records have been copied, once the pages have been swapped
+ *        (before the long erase), and before collecting another page.
+ *
+ * @retval true  The GC was queued again and must not go any further for now.
+ */
+static bool gc_yield()
+{
+    fds_cmd_t * p_cmd;
+    bool        step_done;
+
+    if (m_gc.yielded)
+    {
+        // The GC has just resumed, make some progress first.
+        m_gc.yielded = false;
+        return false;
+    }
+
+    switch (m_gc.state)
+    {
+        case COPY_RECORD:
+            step_done = (m_gc.step_records >= FDS_GC_STEP_RECORDS);
+            break;
+
+        case SWAPPED:
+        case INIT_SWAP:
+            step_done = true;
+            break;
+
+        default:
+            step_done = false;
+            break;
+    }
+
+    // Only give way if other commands are waiting.
+    if (!step_done || (m_cmd_queue.count <= 1))
+    {
+        return false;
+    }
+
+    if (queue_reserve(FDS_CMD_QUEUE_SIZE_GC, 0, &p_cmd, NULL) != NRF_SUCCESS)
+    {
+        // The queue is full, carry on.
+        return false;
+    }
+
+    p_cmd->id         = FDS_CMD_GC;
+    m_gc.yielded      = true;
+    m_gc.step_records = 0;
+
+    return true;
+}
+
+
+/**@brief Queues a GC command, unless one is queued already. */
+static ret_code_t gc_cmd_enqueue()
+{
+    ret_code_t  ret;
+    fds_cmd_t * p_cmd;
+
+    if (m_gc.queued)
+    {
+        // Completion will be reported when the GC already queued has finished.
+        return NRF_SUCCESS;
+    }
+
+    ret = queue_reserve(FDS_CMD_QUEUE_SIZE_GC, 0, &p_cmd, NULL);
+    if (ret != NRF_SUCCESS)
+    {
+        return ret;
+    }
+
+    p_cmd->id = FDS_CMD_GC;
+
+    // Set compression parameters.
+    m_gc.state          = BEGIN;
+    m_gc.queued         = true;
+    m_gc.yielded        = false;
+    m_gc.step_records   = 0;
+    m_gc.copy_record_id = 0;
+
+    return NRF_SUCCESS;
+}
+
+
+/**@brief Queues a GC if a page is filling up (FDS_GC_FILL_THRESHOLD) with a good share of cleared
+ *        records (FDS_GC_DIRTY_THRESHOLD), so that it runs before writes fail for lack of space. */
+static void gc_trigger()
+{
+#if (FDS_GC_DIRTY_THRESHOLD > 0)
+    if (m_gc.queued || !m_swap_page_avail)
+    {
+        return;
+    }
+
+    for (uint16_t i = 0; i < FDS_MAX_PAGES; i++)
+    {
+        uint32_t const words_written = m_pages[i].write_offset - FDS_PAGE_TAG_SIZE;
+
+        if ((m_pages[i].page_type == FDS_PAGE_VALID) &&
+            (words_written * 100 >= (FS_PAGE_SIZE_WORDS - FDS_PAGE_TAG_SIZE) * FDS_GC_FILL_THRESHOLD) &&
+            ((uint32_t)m_pages[i].words_dirty * 100 >= words_written * FDS_GC_DIRTY_THRESHOLD))
+        {
+            (void)gc_cmd_enqueue();
+            return;
+        }
+    }
+#endif
+}
+
+
 static ret_code_t gc_execute(uint32_t result)
 {
     // TODO: Handle resuming GC.
@@ -782,6 +1288,23 @@ static ret_code_t gc_execute(uint32_t result)
         return result;
     }
 
+    if (m_gc.state == READY_SWAP)
+    {
+        /** The swap page has been flagged as 'valid' (ready). Swap the pages in RAM right
+         *  away, so that the commands which run before the GC resumes use the new page. */
+        gc_swap_pages();
+    }
+    else if (m_gc.state == INIT_SWAP)
+    {
+        // The new swap page has been erased and flagged as swap in flash.
+        m_swap_page_avail = true;
+    }
+
+    if (gc_yield())
+    {
+        return COMMAND_YIELDED;
+    }
+
     switch (m_gc.state)
     {
         case BEGIN:
@@ -806,8 +1329,8 @@ static ret_code_t gc_execute(uint32_t result)
             ret = gc_seek_record();
             break;
 
-        case READY_SWAP:
-            /** The swap page has been flagged as 'valid' (ready).
+        case SWAPPED:
+            /** The pages have been swapped.
              *  Let's prepare a new swap page. */
             ret = gc_new_swap_page();
             break;
@@ -997,6 +1520,11 @@ static void pages_init(uint16_t * const p_pages_avail,
     *p_write_page_tag = false;
     *p_resume_comp    = false;
 
+#if (FDS_INDEX_SIZE > 0)
+    // The index is filled by page_scan().
+    index_reset();
+#endif
+
     /** Scan pages and setup page data.
      *  This function does NOT perform write operations in flash. */
     for (uint16_t i = 0; i < FDS_MAX_PAGES; i++)
@@ -1007,6 +1535,7 @@ static void pages_init(uint16_t * const p_pages_avail,
         m_pages[i].vpage_id       = i;
         m_pages[i].records_open   = 0;
         m_pages[i].words_reserved = 0;
+        m_pages[i].words_dirty    = 0;
 
         m_pages[i].page_type      = page_identify(i);
 
@@ -1026,7 +1555,8 @@ static void pages_init(uint16_t * const p_pages_avail,
             case FDS_PAGE_VALID:
             {
                 /** If a page is valid, we update its write offset.
-                 *  Additionally, page_scan will update the last known record ID. */
+                 *  Additionally, page_scan will update the last known record ID
+                 *  and index the records found. */
                 page_scan(i, &m_pages[i].write_offset);
                 (*p_pages_avail)++;
             } break;
@@ -1190,6 +1720,7 @@ static ret_code_t store_execute(uint32_t result, fds_cmd_t * const p_cmd)
         // The previous operation has failed, update the page data.
         p_page->write_offset   += (FDS_HEADER_SIZE + (p_cmd->chunk_offset - FDS_WRITE_OFFSET_DATA));
         p_page->words_reserved -= (FDS_HEADER_SIZE + (p_cmd->chunk_offset - FDS_WRITE_OFFSET_DATA));
+        p_page->words_dirty    += (FDS_HEADER_SIZE + (p_cmd->chunk_offset - FDS_WRITE_OFFSET_DATA));
 
         return result;
     }
@@ -1263,6 +1794,23 @@ static ret_code_t store_execute(uint32_t result, fds_cmd_t * const p_cmd)
         case FDS_OP_DONE:
         {
             // We have successfully written down the IC. The command has completed successfully.
+            if (p_cmd->id == FDS_CMD_WRITE_BATCH)
+            {
+                // The batch header is not a record of its own, its space is reclaimed by GC.
+                p_page->words_dirty += FDS_HEADER_SIZE;
+            }
+#if (FDS_INDEX_SIZE > 0)
+            // Index the record, or the records of the batch.
+            for (uint32_t const * p_rec = p_write_addr;
+                 p_rec < p_write_addr + FDS_HEADER_SIZE + p_cmd->record_header.tl.length_words;
+                 p_rec += header_skip_words((fds_header_t*)p_rec))
+            {
+                if (header_is_valid((fds_header_t*)p_rec))
+                {
+                    index_insert((uint16_t)(p_page - m_pages), p_rec);
+                }
+            }
+#endif
             p_page->write_offset   += (FDS_HEADER_SIZE + (p_cmd->chunk_offset - FDS_WRITE_OFFSET_DATA));
             p_page->words_reserved -= (FDS_HEADER_SIZE + (p_cmd->chunk_offset - FDS_WRITE_OFFSET_DATA));
 
@@ -1282,6 +1830,7 @@ static ret_code_t store_execute(uint32_t result, fds_cmd_t * const p_cmd)
          *  so we update the page data right away. */
         p_page->write_offset   += (FDS_HEADER_SIZE + (p_cmd->chunk_offset - FDS_WRITE_OFFSET_DATA));
         p_page->words_reserved -= (FDS_HEADER_SIZE + (p_cmd->chunk_offset - FDS_WRITE_OFFSET_DATA));
+        p_page->words_dirty    += (FDS_HEADER_SIZE + (p_cmd->chunk_offset - FDS_WRITE_OFFSET_DATA));
 
         // We should propagate the error from fstorage.
         return fs_ret;
@@ -1292,6 +1841,24 @@ static ret_code_t store_execute(uint32_t result, fds_cmd_t * const p_cmd)
 }
 
 
+/**@brief Updates the page data and the index once the clear of a record has been issued. */
+static void clear_issued(fds_record_desc_t const * const p_desc)
+{
+    m_pages[page_by_addr(p_desc->p_rec)].words_dirty +=
+        (FDS_HEADER_SIZE + ((fds_header_t*)p_desc->p_rec)->tl.length_words);
+
+#if (FDS_INDEX_SIZE > 0)
+    index_remove(p_desc->record_id);
+#endif
+
+    if (gc_record_copied(p_desc->p_rec))
+    {
+        // Clear the copy too on the next step, or it would be back once the pages are swapped.
+        m_gc.copy_record_id = p_desc->record_id;
+    }
+}
+
+
 static ret_code_t clear_execute(ret_code_t result, fds_cmd_t * const p_cmd)
 {
     ret_code_t        ret;
@@ -1306,6 +1873,17 @@ static ret_code_t clear_execute(ret_code_t result, fds_cmd_t * const p_cmd)
         return result;
     }
 
+    if (m_gc.copy_record_id != 0)
+    {
+        /** The record cleared last had been copied by the GC, which gave way to this command.
+         *  Clear its copy before going any further. */
+        ret = gc_clear_copy();
+        if (ret != NRF_ERROR_NOT_FOUND)
+        {
+            return ret;
+        }
+    }
+
     switch (p_cmd->op_code)
     {
         case FDS_OP_CLEAR_TL:
@@ -1313,6 +1891,8 @@ static ret_code_t clear_execute(ret_code_t result, fds_cmd_t * const p_cmd)
             // We were provided a descriptor for the record.
             desc.vpage_id  = p_cmd->vpage_id;
             desc.record_id = p_cmd->record_header.id;
+            // The descriptor is on the stack, do not trust a stale pointer.
+            desc.ptr_magic = 0;
 
             /** Unfortunately, we always seek the record in this case,
              *  because we don't buffer an entire record descriptor in the
@@ -1333,6 +1913,11 @@ static ret_code_t clear_execute(ret_code_t result, fds_cmd_t * const p_cmd)
                                desc.p_rec,
                                (uint32_t*)&m_fds_tl_invalid,
                                FDS_HEADER_SIZE_TL);
+
+                if (ret == NRF_SUCCESS)
+                {
+                    clear_issued(&desc);
+                }
             }
 
             p_cmd->op_code = FDS_OP_DONE;
@@ -1360,6 +1945,11 @@ static ret_code_t clear_execute(ret_code_t result, fds_cmd_t * const p_cmd)
                                desc.p_rec,
                                (uint32_t*)&m_fds_tl_invalid,
                                FDS_HEADER_SIZE_TL);
+
+                if (ret == NRF_SUCCESS)
+                {
+                    clear_issued(&desc);
+                }
             }
         } break;
 
@@ -1380,6 +1970,83 @@ static ret_code_t clear_execute(ret_code_t result, fds_cmd_t * const p_cmd)
 }
 
 
+/**@brief Ends the command being executed, unless it is still running (COMMAND_EXECUTING).
+ *        Notifies the application and processes the next command in the queue, if any. */
+static void cmd_queue_finish(ret_code_t ret, fds_cmd_t * const p_cmd)
+{
+    fds_record_key_t record_key;
+
+    if (ret == COMMAND_EXECUTING /*=NRF_SUCCESS*/)
+    {
+        /** The current command is still being processed.
+         *  The command queue does not need to advance. */
+        return;
+    }
+
+    if (ret != COMMAND_YIELDED)
+    {
+        if (p_cmd->id == FDS_CMD_GC)
+        {
+            // Let the application request another GC from its callback.
+            m_gc.queued = false;
+        }
+        else if (p_cmd->id == FDS_CMD_WRITE_BATCH)
+        {
+            // Report the last record of the batch, rather than the batch header.
+            p_cmd->record_header = m_batch.header[m_batch.num_records - 1];
+            m_batch.queued       = false;
+        }
+
+        // Initialize the fds_record_key_t structure needed for the callback.
+        record_key.type     = p_cmd->record_header.tl.type;
+        record_key.instance = p_cmd->record_header.ic.instance;
+
+        // The command has either completed or an operation (and thus the command) has failed.
+        if (ret == COMMAND_COMPLETED)
+        {
+            // The command has completed successfully. Notify the application.
+            app_notify(NRF_SUCCESS, p_cmd->id, p_cmd->record_header.id, record_key);
+
+            if ((p_cmd->id == FDS_CMD_CLEAR) || (p_cmd->id == FDS_CMD_CLEAR_INST))
+            {
+                // Collect the page in the background if it is mostly taken by cleared records.
+                gc_trigger();
+            }
+        }
+        else
+        {
+            /** An operation has failed. This is fatal for the execution of a command.
+             *  Skip other operations associated with the current command.
+             *  Notify the user of the failure.  */
+            chunk_queue_skip(p_cmd->num_chunks);
+            app_notify(ret /*=result*/, p_cmd->id, p_cmd->record_header.id, record_key);
+        }
+    }
+
+    // Advance the command queue, and if there is still something in the queue, process it.
+    if (cmd_queue_advance())
+    {
+        /** Only process the queue if there are no pending commands being queued, since they
+         *  will begin to process the queue on their own. Be sure to clear
+         *  the flag FDS_FLAG_PROCESSING though ! */
+        if (atomic_counter_is_zero())
+        {
+            cmd_queue_process();
+        }
+        else
+        {
+            flag_clear(FDS_FLAG_PROCESSING);
+        }
+    }
+    else
+    {
+        /** No more elements in the queue. Clear the FDS_FLAG_PROCESSING flag,
+         *  so that new commands can start the queue processing. */
+        flag_clear(FDS_FLAG_PROCESSING);
+    }
+}
+
+
 static ret_code_t cmd_queue_process(void)
 {
     ret_code_t        ret;
@@ -1393,6 +2060,7 @@ static ret_code_t cmd_queue_process(void)
 
         case FDS_CMD_WRITE:
         case FDS_CMD_UPDATE:
+        case FDS_CMD_WRITE_BATCH:
             ret = store_execute(NRF_SUCCESS, p_cmd);
             break;
 
@@ -1410,12 +2078,15 @@ static ret_code_t cmd_queue_process(void)
             break;
     }
 
-    if ((ret == COMMAND_EXECUTING) || (ret == COMMAND_COMPLETED))
+    if ((ret == COMMAND_COMPLETED) || (ret == COMMAND_YIELDED))
     {
+        /** The command did not need a flash operation to finish, or gave way to the
+         *  others. No callback will come from fstorage, move on to the next command. */
+        cmd_queue_finish(ret, p_cmd);
         return NRF_SUCCESS;
     }
 
-    // This is an error.
+    // This is either COMMAND_EXECUTING (=NRF_SUCCESS) or an error.
     return ret;
 }
 
@@ -1447,7 +2118,6 @@ static void fs_callback(uint8_t           op_code,
 {
     ret_code_t         ret;
     fds_cmd_t        * p_cmd = &m_cmd_queue.cmd[m_cmd_queue.rp];
-    fds_record_key_t   record_key;
 
     switch (p_cmd->id)
     {
@@ -1457,6 +2127,7 @@ static void fs_callback(uint8_t           op_code,
 
         case FDS_CMD_WRITE:
         case FDS_CMD_UPDATE:
+        case FDS_CMD_WRITE_BATCH:
             ret = store_execute(result, p_cmd);
             break;
 
@@ -1475,53 +2146,7 @@ static void fs_callback(uint8_t           op_code,
             break;
     }
 
-    if (ret == COMMAND_EXECUTING /*=NRF_SUCCESS*/)
-    {
-        /** The current command is still being processed.
-         *  The command queue does not need to advance. */
-        return;
-    }
-
-    // Initialize the fds_record_key_t structure needed for the callback.
-    record_key.type     = p_cmd->record_header.tl.type;
-    record_key.instance = p_cmd->record_header.ic.instance;
-
-    // The command has either completed or an operation (and thus the command) has failed.
-    if (ret == COMMAND_COMPLETED)
-    {
-        // The command has completed successfully. Notify the application.
-        app_notify(NRF_SUCCESS, p_cmd->id, p_cmd->record_header.id, record_key);
-    }
-    else
-    {
-        /** An operation has failed. This is fatal for the execution of a command.
-         *  Skip other operations associated with the current command.
-         *  Notify the user of the failure.  */
-        chunk_queue_skip(p_cmd->num_chunks);
-        app_notify(ret /*=result*/, p_cmd->id, p_cmd->record_header.id, record_key);
-    }
-
-    // Advance the command queue, and if there is still something in the queue, process it.
-    if (cmd_queue_advance())
-    {
-        /** Only process the queue if there are no pending commands being queued, since they
-         *  will begin to process the queue on their own. Be sure to clear
-         *  the flag FDS_FLAG_PROCESSING though ! */
-        if (atomic_counter_is_zero())
-        {
-            cmd_queue_process();
-        }
-        else
-        {
-            flag_clear(FDS_FLAG_PROCESSING);
-        }
-    }
-    else
-    {
-        /** No more elements in the queue. Clear the FDS_FLAG_PROCESSING flag,
-         *  so that new commands can start the queue processing. */
-        flag_clear(FDS_FLAG_PROCESSING);
-    }
+    cmd_queue_finish(ret, p_cmd);
 }
 
 
@@ -1614,15 +2239,15 @@ ret_code_t fds_open(fds_record_desc_t * const p_desc,
         return NRF_ERROR_NULL;
     }
 
-    if (page_id_from_virtual_id(p_desc->vpage_id, &page) != NRF_SUCCESS)
-    {
-        // Should not happen.
-        return NRF_ERROR_INVALID_DATA;
-    }
-
-    // Seek the record if necessary.
+    // Seek the record if necessary. This also sets the page of a descriptor built from an ID.
     if (seek_record(p_desc) == NRF_SUCCESS)
     {
+        if (page_id_from_virtual_id(p_desc->vpage_id, &page) != NRF_SUCCESS)
+        {
+            // Should not happen.
+            return NRF_ERROR_INVALID_DATA;
+        }
+
         if (header_is_valid((fds_header_t*)p_desc->p_rec))
         {
             CRITICAL_SECTION_ENTER();
@@ -1677,6 +2302,7 @@ static ret_code_t write_enqueue(fds_record_desc_t        * const p_desc,
     uint16_t             vpage_id;
     uint16_t             length_words = 0;
     uint8_t              cmd_queue_elems;
+    fds_record_id_t      record_id;
 
     if (!flag_is_set(FDS_FLAG_INITIALIZED))
     {
@@ -1684,6 +2310,7 @@ static ret_code_t write_enqueue(fds_record_desc_t        * const p_desc,
     }
 
     if ((key.type     == FDS_TYPE_ID_INVALID) ||
+        (key.type     == FDS_TYPE_ID_BATCH)   ||
         (key.instance == FDS_INSTANCE_ID_INVALID))
     {
         return NRF_ERROR_INVALID_DATA;
@@ -1740,7 +2367,8 @@ static ret_code_t write_enqueue(fds_record_desc_t        * const p_desc,
     p_cmd->vpage_id     = vpage_id;
 
     // Fill in the header information.
-    p_cmd->record_header.id              = record_id_new();
+    record_id                            = record_id_new();
+    p_cmd->record_header.id              = record_id;
     p_cmd->record_header.tl.type         = key.type;
     p_cmd->record_header.tl.length_words = length_words;
     p_cmd->record_header.ic.instance     = key.instance;
@@ -1769,8 +2397,10 @@ static ret_code_t write_enqueue(fds_record_desc_t        * const p_desc,
     if (p_desc != NULL)
     {
         p_desc->vpage_id  = vpage_id;
-        // Don't invoke record_id_new() again.
-        p_desc->record_id = p_cmd->record_header.id;
+        /** Don't invoke record_id_new() again. Neither read it back from p_cmd,
+         *  which points to the clear command in case of an update. */
+        p_desc->record_id = record_id;
+        p_desc->ptr_magic = 0;
     }
 
     return cmd_queue_process_start();
@@ -1869,6 +2499,147 @@ ret_code_t fds_write_reserved(fds_write_token_t  const * const p_tok,
 }
 
 
+static ret_code_t batch_enqueue(fds_record_desc_t        p_descs[],
+                                fds_batch_record_t const records[],
+                                uint8_t                  num_records)
+{
+    ret_code_t           ret;
+    fds_cmd_t          * p_cmd;
+    fds_record_chunk_t * p_chunk = NULL;
+    uint16_t             vpage_id;
+    uint32_t             length_words = 0;
+    uint16_t             num_chunks   = 0;
+
+    if (!flag_is_set(FDS_FLAG_INITIALIZED))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    if (records == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    if ((num_records == 0) || (num_records > FDS_BATCH_MAX_RECORDS))
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    for (uint8_t i = 0; i < num_records; i++)
+    {
+        if ((records[i].key.type     == FDS_TYPE_ID_INVALID) ||
+            (records[i].key.type     == FDS_TYPE_ID_BATCH)   ||
+            (records[i].key.instance == FDS_INSTANCE_ID_INVALID))
+        {
+            return NRF_ERROR_INVALID_DATA;
+        }
+
+        if (!chunk_is_aligned(records[i].p_chunks, records[i].num_chunks))
+        {
+            return NRF_ERROR_INVALID_ADDR;
+        }
+
+        // Each record is written as its header followed by its chunks.
+        length_words += FDS_HEADER_SIZE;
+        num_chunks   += 1 + records[i].num_chunks;
+
+        for (uint8_t j = 0; j < records[i].num_chunks; j++)
+        {
+            length_words += records[i].p_chunks[j].length_words;
+        }
+    }
+
+    if ((num_chunks > FDS_CHUNK_QUEUE_SIZE) || (length_words >= FS_PAGE_SIZE_WORDS))
+    {
+        // It would never fit.
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    if (m_batch.queued)
+    {
+        // The record headers are buffered for one batch only.
+        return NRF_ERROR_BUSY;
+    }
+
+    ret = queue_reserve(FDS_CMD_QUEUE_SIZE_BATCH, num_chunks, &p_cmd, &p_chunk);
+    if (ret != NRF_SUCCESS)
+    {
+        return ret;
+    }
+
+    // The whole batch goes on one page. Reserve space for the batch header as well.
+    ret = write_space_reserve(length_words, &vpage_id);
+    if (ret != NRF_SUCCESS)
+    {
+        queue_reserve_cancel(FDS_CMD_QUEUE_SIZE_BATCH, num_chunks);
+        return ret;
+    }
+
+    m_batch.queued      = true;
+    m_batch.num_records = num_records;
+
+    // Buffer the record headers and chunks in the queue, to be written as the batch data.
+    for (uint8_t i = 0; i < num_records; i++)
+    {
+        fds_header_t * const p_header = &m_batch.header[i];
+
+        p_header->id              = record_id_new();
+        p_header->tl.type         = records[i].key.type;
+        p_header->tl.length_words = 0;
+        p_header->ic.instance     = records[i].key.instance;
+        p_header->ic.checksum     = 0;
+
+        p_chunk->p_data       = p_header;
+        p_chunk->length_words = FDS_HEADER_SIZE;
+        chunk_queue_next(&p_chunk);
+
+        for (uint8_t j = 0; j < records[i].num_chunks; j++)
+        {
+            p_header->tl.length_words += records[i].p_chunks[j].length_words;
+
+            p_chunk->p_data       = records[i].p_chunks[j].p_data;
+            p_chunk->length_words = records[i].p_chunks[j].length_words;
+            chunk_queue_next(&p_chunk);
+        }
+
+        if (p_descs != NULL)
+        {
+            p_descs[i].vpage_id  = vpage_id;
+            p_descs[i].record_id = p_header->id;
+            p_descs[i].ptr_magic = 0;
+        }
+    }
+
+    /** The batch header is written like the header of a record, its IC last. The instance
+     *  holds the number of records, so that the IC differs from an erased word. */
+    p_cmd->id           = FDS_CMD_WRITE_BATCH;
+    p_cmd->op_code      = FDS_OP_WRITE_TL;
+    p_cmd->num_chunks   = (uint8_t)num_chunks;
+    p_cmd->chunk_offset = FDS_WRITE_OFFSET_DATA;
+    p_cmd->vpage_id     = vpage_id;
+
+    p_cmd->record_header.id              = record_id_new();
+    p_cmd->record_header.tl.type         = FDS_TYPE_ID_BATCH;
+    p_cmd->record_header.tl.length_words = (fds_length_t)length_words;
+    p_cmd->record_header.ic.instance     = num_records;
+    p_cmd->record_header.ic.checksum     = 0;
+
+    return cmd_queue_process_start();
+}
+
+
+ret_code_t fds_write_batch(fds_record_desc_t        p_descs[],
+                           fds_batch_record_t const records[],
+                           uint8_t                  num_records)
+{
+    ret_code_t ret;
+    atomic_counter_inc();
+    ret = batch_enqueue(p_descs, records, num_records);
+    atomic_counter_dec();
+    return ret;
+}
+
+
 static ret_code_t clear_enqueue(fds_record_desc_t * const p_desc)
 {
     ret_code_t   ret;
@@ -1962,25 +2733,19 @@ ret_code_t fds_update(fds_record_desc_t  * const p_desc,
 
 static ret_code_t gc_enqueue()
 {
-    ret_code_t  ret;
-    fds_cmd_t * p_cmd;
+    ret_code_t ret;
 
     if (!flag_is_set(FDS_FLAG_INITIALIZED))
     {
         return NRF_ERROR_INVALID_STATE;
     }
 
-    ret = queue_reserve(FDS_CMD_QUEUE_SIZE_GC, 0, &p_cmd, NULL);
+    ret = gc_cmd_enqueue();
     if (ret != NRF_SUCCESS)
     {
         return ret;
     }
 
-    p_cmd->id = FDS_CMD_GC;
-
-    // Set compression parameters.
-    m_gc.state = BEGIN;
-
     return cmd_queue_process_start();
 }
 
@@ -2069,8 +2834,11 @@ ret_code_t fds_descriptor_from_rec_id(fds_record_desc_t * const p_desc,
         return NRF_ERROR_NULL;
     }
 
+    // The record must be sought: the descriptor may hold the pointer of another record.
     p_desc->record_id = record_id;
+    p_desc->p_rec     = NULL;
     p_desc->vpage_id  = FDS_VPAGE_ID_UNKNOWN;
+    p_desc->ptr_magic = 0;
 
     return NRF_SUCCESS;
 }
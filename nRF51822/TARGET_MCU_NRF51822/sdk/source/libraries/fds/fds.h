@@ -58,6 +58,9 @@
 /**@brief Reserved instance key used to check for missing or corrupted metadata.
  *        May not be used as a record key by the application. */
 #define FDS_INSTANCE_ID_INVALID (0xFFFF)
+/**@brief Reserved type key used to flag the header of a batch of records written by
+ *        @ref fds_write_batch. May not be used as a record key by the application. */
+#define FDS_TYPE_ID_BATCH       (0xFFFF)
 
 
 typedef uint32_t fds_record_id_t;
@@ -141,6 +144,15 @@ typedef struct
 } fds_record_chunk_t;
 
 
+/**@brief A record to be written by @ref fds_write_batch. */
+typedef struct
+{
+    fds_record_key_t     key;           /**< The record key pair. */
+    uint8_t              num_chunks;    /**< The number of elements in the chunks array. */
+    fds_record_chunk_t * p_chunks;      /**< An array of chunks making up the record data. */
+} fds_batch_record_t;
+
+
 /**@brief A token to a reserved space in flash, created by @ref fds_reserve.
  *        Use @ref fds_write_reserved to write the record in the reserved space,
  *        or @ref fds_reserve_cancel to cancel the reservation.
@@ -175,7 +187,8 @@ typedef enum
     FDS_CMD_UPDATE,     /**< Update command. Used in @ref fds_update. */
     FDS_CMD_CLEAR,      /**< Clear record command. Used in @ref fds_clear and @ref fds_update. */
     FDS_CMD_CLEAR_INST, /**< Clear instance command. Used in @ref fds_clear_by_instance. */
-    FDS_CMD_GC          /**< Garbage collection. Used in @ref fds_gc. */
+    FDS_CMD_GC,         /**< Garbage collection. Used in @ref fds_gc. */
+    FDS_CMD_WRITE_BATCH /**< Write a batch of records. Used in @ref fds_write_batch. */
 } fds_cmd_id_t;
 
  
@@ -318,6 +331,45 @@ ret_code_t fds_write_reserved(fds_write_token_t  const * const p_tok,
                               fds_record_chunk_t               chunks[]);
 
 
+/**@brief Function to write several records to flash at once.
+ *
+ * @details The records are written back to back on the same page, behind a batch header whose
+ *          metadata is written last. Until then none of the records can be found, neither after
+ *          a reset: either all the records of the batch are stored, or none of them is. This
+ *          also takes fewer flash operations than writing the records one by one.
+ *          Only one batch can be queued at any time. Each record of a batch takes one more
+ *          element of the chunk queue than its chunks, for its header.
+ *
+ * @note This function is asynchronous, therefore, completion is reported with a callback
+ *       through the registered event handler. Only one callback will be issued for the whole
+ *       batch. The record ID and key passed to the callback are those of the last record.
+ *
+ * @note The record data must be aligned on a 4 byte boundary, and because it is not buffered
+ *       internally, it must be kept in memory by the application until the callback for the
+ *       command has been received, i.e., the command completed.
+ *
+ * @param[out] p_descs     An array of num_records descriptors, one for each record. It may be NULL.
+ * @param[in]  records     An array of records to write.
+ * @param[in]  num_records The number of elements in the records array, at most
+ *                         FDS_BATCH_MAX_RECORDS.
+ *
+ * @retval NRF_SUCCESS               Success. The command was queued.
+ * @retval NRF_ERROR_INVALID_STATE   Error. The module is not initialized.
+ * @retval NRF_ERROR_NULL            Error. records is NULL.
+ * @retval NRF_ERROR_INVALID_DATA    Error. A key contains an invalid type or instance.
+ * @retval NRF_ERROR_INVALID_ADDR    Error. The data of a record is not aligned on a 4 byte
+ *                                   boundary.
+ * @retval NRF_ERROR_INVALID_LENGTH  Error. There are too many records or chunks, or the batch
+ *                                   does not fit in a flash page.
+ * @retval NRF_ERROR_BUSY            Error. Insufficient internal resources to queue the operation,
+ *                                   or another batch is queued.
+ * @retval NRF_ERROR_NO_MEM          Error. No flash space available to store the batch.
+ */
+ret_code_t fds_write_batch(fds_record_desc_t        p_descs[],
+                           fds_batch_record_t const records[],
+                           uint8_t                  num_records);
+
+
 /**@brief Function to clear a record.
  *
  * @details Clearing a record has the effect of preventing the system from retrieving the record
@@ -505,10 +557,15 @@ ret_code_t fds_close(fds_record_desc_t const * const p_desc);
 /**@brief Function to perform a garbage collection.
  *
  * @details Garbage collection reclaims the flash space occupied by records which have been cleared
- *          using @ref fds_clear.
+ *          using @ref fds_clear. Only pages holding cleared records are collected. Commands queued
+ *          while it runs are not held until it completes: the collection gives way to them every
+ *          FDS_GC_STEP_RECORDS records copied, and before erasing the page it has just compressed.
+ *          A collection is also started automatically once a page fills up with cleared records,
+ *          see FDS_GC_FILL_THRESHOLD and FDS_GC_DIRTY_THRESHOLD.
  *
  * @note    This function is asynchronous, therefore, completion is reported with a callback
- *          through the registered event handler.
+ *          through the registered event handler. If a collection is already queued, no other
+ *          one is queued and its completion is reported instead.
  */
 ret_code_t fds_gc(void);
 
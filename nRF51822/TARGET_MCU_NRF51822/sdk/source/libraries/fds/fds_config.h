@@ -45,6 +45,11 @@
 /**@brief Determines how many @ref fds_record_chunk_t structures can be buffered at any time. */
 #define FDS_CHUNK_QUEUE_SIZE        (8)
 
+/**@brief Configures the maximum number of records in a batch written by @ref fds_write_batch.
+ *        The headers of the records of the batch being written are buffered in RAM, 12 bytes
+ *        each. */
+#define FDS_BATCH_MAX_RECORDS       (4)
+
 /**@brief Configures the number of physical flash pages to use. Out of the total, one is reserved
  *        for garbage collection, hence, two pages is the minimum: one for the application data
  *        and one for the system. */
@@ -52,6 +57,25 @@
 /**@brief Configures the maximum number of callbacks which can be registred. */
 #define FDS_MAX_USERS               (10)
 
+/**@brief Configures the number of records tracked by the RAM index, at most 254. Each entry costs
+ *        16 bytes of RAM. If more valid records are found in flash, lookups fall back to scanning
+ *        the pages until garbage collection makes room in the index. Set to zero to disable the
+ *        index altogether. */
+#define FDS_INDEX_SIZE              (16)
+/**@brief Configures the number of hash buckets of the RAM index. Must be a power of two.
+ *        Each bucket costs 2 bytes of RAM. */
+#define FDS_INDEX_BUCKETS           (8)
+
+/**@brief Configures how many records garbage collection copies before it lets the commands
+ *        queued in the meantime be executed. Bounds the time a write waits behind a collection. */
+#define FDS_GC_STEP_RECORDS         (4)
+/**@brief Configures when garbage collection is started on its own, once a clear completes: when a
+ *        page is at least FDS_GC_FILL_THRESHOLD percent full, and at least FDS_GC_DIRTY_THRESHOLD
+ *        percent of what has been written to it are cleared records. Set the latter to zero to
+ *        only collect when @ref fds_gc is called. */
+#define FDS_GC_FILL_THRESHOLD       (75)
+#define FDS_GC_DIRTY_THRESHOLD      (25)
+
 /** Page tag definitions. */
 #define FDS_PAGE_TAG_WORD_0_SWAP    (0xA5A5A5A5)
 #define FDS_PAGE_TAG_WORD_0_VALID   (0xA4A4A4A4)
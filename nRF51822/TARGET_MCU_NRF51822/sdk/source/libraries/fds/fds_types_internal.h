@@ -41,6 +41,7 @@
 
 #define COMMAND_EXECUTING           (NRF_SUCCESS)
 #define COMMAND_COMPLETED           (0x1234)
+#define COMMAND_YIELDED             (0x1235) /**< The command was queued again, behind the others. */
 //#define COMMAND_FAILED            (0x1236)
 
 #define FDS_MAGIC_HWORD             (0xF11E)
@@ -66,6 +67,7 @@
 #define FDS_CMD_QUEUE_SIZE_CLEAR    (1)
 #define FDS_CMD_QUEUE_SIZE_UPDATE   (2)
 #define FDS_CMD_QUEUE_SIZE_GC       (1)
+#define FDS_CMD_QUEUE_SIZE_BATCH    (1)
 
 
 static uint8_t m_nested_critical;
@@ -113,6 +115,7 @@ typedef struct
     uint16_t            vpage_id;             /**< The page logical ID. */
     uint16_t volatile   write_offset;         /**< The page write offset, in 4 bytes words. */
     uint16_t volatile   words_reserved;       /**< The amount of words reserved by fds_write_reserve() on this page. */
+    uint16_t volatile   words_dirty;          /**< The amount of words taken by cleared records, reclaimed by GC. */
     uint16_t volatile   records_open;
     fds_page_type_t     page_type        : 4; /**< The page type. */
 } fds_page_t;
@@ -161,6 +164,7 @@ typedef enum
     GC_PAGE,
     COPY_RECORD,
     READY_SWAP,
+    SWAPPED,
     NEW_SWAP,
     INIT_SWAP
 } fds_gc_state_t;
@@ -173,6 +177,55 @@ typedef struct
     uint32_t const * p_scan_addr;
     fds_gc_state_t   state;
     bool             do_gc_page[FDS_MAX_PAGES];
+    bool             queued;          /**< A GC command is in the queue. */
+    bool             yielded;         /**< The GC gave way to other commands and has not resumed yet. */
+    uint8_t          step_records;    /**< Records copied since the GC last gave way. */
+    fds_record_id_t  copy_record_id;  /**< A record cleared after it was copied, its copy must be cleared too. */
 } fds_gc_data_t;
 
+
+/**@brief The batch of records being written. Its records are written as the data of a record of
+ *        type FDS_TYPE_ID_BATCH, whose IC commits them all at once. */
+typedef struct
+{
+    fds_header_t header[FDS_BATCH_MAX_RECORDS];  /**< Headers of the records, written as chunks. */
+    uint8_t      num_records;
+    bool         queued;                         /**< A batch command is in the queue. */
+} fds_batch_t;
+
+
+#if (FDS_INDEX_SIZE > 0)
+
+#define FDS_INDEX_NONE              (0xFF) /**< Marks the end of a bucket chain or of the free list. */
+
+/**@brief Location of a valid record, as kept by the RAM index. */
+typedef struct
+{
+    fds_record_id_t record_id;  /**< The record ID, zero if the entry is free. */
+    uint16_t        type;       /**< The record type ID. */
+    uint16_t        instance;   /**< The record instance ID. */
+    uint16_t        page;       /**< The physical page where the record is stored. */
+    uint16_t        offset;     /**< Offset of the record from the page start, in 4 byte words. */
+    uint8_t         id_next;    /**< Next entry in the same record ID bucket, or in the free list. */
+    uint8_t         key_next;   /**< Next entry in the same key bucket. */
+} fds_index_entry_t;
+
+
+/**@brief RAM index of the valid records, hashed both by record ID and by key.
+ *
+ * @details Entries are chained through their bucket heads and never move. The index is said to
+ *          be complete when it tracks every valid record in flash; if it ran out of entries, it
+ *          is not complete and lookups must scan the pages instead.
+ */
+typedef struct
+{
+    fds_index_entry_t entry[FDS_INDEX_SIZE];
+    uint8_t           id_head[FDS_INDEX_BUCKETS];   /**< First entry of each record ID bucket. */
+    uint8_t           key_head[FDS_INDEX_BUCKETS];  /**< First entry of each key bucket. */
+    uint8_t           free_head;                    /**< First free entry. */
+    bool              complete;
+} fds_index_t;
+
+#endif
+
 #endif // FDS_TYPES_INTERNAL__
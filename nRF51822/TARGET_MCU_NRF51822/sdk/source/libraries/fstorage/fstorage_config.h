@@ -75,6 +75,15 @@
 #define FS_PAGE_SIZE_WORDS  (FS_PAGE_SIZE/4)
 
 
+/**@brief Macro for the number of pages below the bootloader (or the end of the flash) which
+ *        are left to pstorage, its data page and its swap page. fstorage allocates its pages
+ *        below them.
+ */
+#ifndef FS_RESERVED_PAGES
+    #define FS_RESERVED_PAGES   (2)
+#endif
+
+
 /**@brief Static inline function that provides last page address
  *
  * @note    If there is a bootloader present the bootloader address read from UICR
@@ -84,7 +93,7 @@ static __INLINE uint32_t fs_flash_page_end_addr()
 {
     uint32_t const bootloader_addr = NRF_UICR->NRFFW[0];
     return  ((bootloader_addr != FS_EMPTY_MASK) ?
-             bootloader_addr : NRF_FICR->CODESIZE * FS_PAGE_SIZE);
+             bootloader_addr : NRF_FICR->CODESIZE * FS_PAGE_SIZE) - (FS_RESERVED_PAGES * FS_PAGE_SIZE);
 }
 
 
@@ -31,6 +31,7 @@
 
 extern "C" {
 #include "pstorage.h"
+#include "fstorage.h"
 #include "device_manager.h"
 #include "softdevice_handler.h"
 #include "ble_stack_handler_types.h"
@@ -53,6 +54,7 @@ static void btle_handler(ble_evt_t *p_ble_evt);
 static void sys_evt_dispatch(uint32_t sys_evt)
 {
     pstorage_sys_event_handler(sys_evt);
+    fs_sys_event_handler(sys_evt);
 }
 
 /**
@@ -125,10 +127,9 @@ error_t btle_init(void)
 
 static void btle_handler(ble_evt_t *p_ble_evt)
 {
-    /* Library service handlers */
-#if SDK_CONN_PARAMS_MODULE_ENABLE
+    /* Library service handlers. The connection parameters module may also be
+     * initialized by the application, it ignores events until then. */
     ble_conn_params_on_ble_evt(p_ble_evt);
-#endif
 
     dm_ble_evt_handler(p_ble_evt);
 
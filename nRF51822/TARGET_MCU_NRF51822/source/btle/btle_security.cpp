@@ -123,6 +123,8 @@ btle_purgeAllBondingState(void)
 {
     ret_code_t rc;
     if ((rc = dm_device_delete_all(&applicationInstance)) == NRF_SUCCESS) {
+        /* The IRKs of the advertising whitelist are gone */
+        ((nRF5xGap &) nRF5xn::Instance(BLE::DEFAULT_INSTANCE).getGap()).invalidateStackWhitelist();
         return BLE_ERROR_NONE;
     }
 
@@ -261,8 +263,13 @@ dm_handler(dm_handle_t const *p_handle, dm_event_t const *p_event, ret_code_t ev
             break;
         }
         case DM_EVT_DEVICE_CONTEXT_STORED:
+            /* A new bond may bring the IRK of a whitelisted address */
+            ((nRF5xGap &) ble.getGap()).invalidateStackWhitelist();
             securityManager.processSecurityContextStoredEvent(p_event->event_param.p_gap_param->conn_handle);
             break;
+        case DM_EVT_DEVICE_CONTEXT_DELETED:
+            ((nRF5xGap &) ble.getGap()).invalidateStackWhitelist();
+            break;
         default:
             break;
     }
@@ -95,7 +95,13 @@ ble_error_t nRF5xGap::setAdvertisingData(const GapAdvertisingData &advData, cons
     //    }
     //}
 
+    /* Nothing to do if the stack already holds this content */
+    if (isAdvertisingDataApplied(advData, scanResponse)) {
+        return BLE_ERROR_NONE;
+    }
+
     /* Send advertising data! */
+    advDataApplied = false;
     ASSERT(ERROR_NONE ==
            sd_ble_gap_adv_data_set(advData.getPayload(),
                                    advData.getPayloadLen(),
@@ -108,12 +114,35 @@ ble_error_t nRF5xGap::setAdvertisingData(const GapAdvertisingData &advData, cons
     ASSERT(ERROR_NONE == sd_ble_gap_appearance_set(advData.getAppearance()),
            BLE_ERROR_PARAM_OUT_OF_RANGE);
 
+    appliedAdvDataLen      = advData.getPayloadLen();
+    memcpy(appliedAdvData, advData.getPayload(), appliedAdvDataLen);
+    appliedScanResponseLen = scanResponse.getPayloadLen();
+    memcpy(appliedScanResponse, scanResponse.getPayload(), appliedScanResponseLen);
+    appliedAppearance      = advData.getAppearance();
+    advDataApplied         = true;
+
     /* ToDo: Perform some checks on the payload, for example the Scan Response can't */
     /* contains a flags AD type, etc. */
 
     return BLE_ERROR_NONE;
 }
 
+/**************************************************************************/
+/*!
+    @brief  Checks whether the given payloads are the ones last handed to
+            the SoftDevice by setAdvertisingData()
+*/
+/**************************************************************************/
+bool nRF5xGap::isAdvertisingDataApplied(const GapAdvertisingData &advData, const GapAdvertisingData &scanResponse) const
+{
+    return advDataApplied &&
+           (advData.getPayloadLen() == appliedAdvDataLen) &&
+           (scanResponse.getPayloadLen() == appliedScanResponseLen) &&
+           (advData.getAppearance() == appliedAppearance) &&
+           (memcmp(advData.getPayload(), appliedAdvData, appliedAdvDataLen) == 0) &&
+           (memcmp(scanResponse.getPayload(), appliedScanResponse, appliedScanResponseLen) == 0);
+}
+
 /**************************************************************************/
 /*!
     @brief  Starts the BLE HW, initialising any services that were
@@ -168,31 +197,29 @@ ble_error_t nRF5xGap::startAdvertising(const GapAdvertisingParams &params)
         return BLE_ERROR_PARAM_OUT_OF_RANGE;
     }
 
-    /* Allocate the stack's whitelist statically */
-    ble_gap_whitelist_t  whitelist;
-    ble_gap_addr_t      *whitelistAddressPtrs[YOTTA_CFG_WHITELIST_MAX_SIZE];
-    ble_gap_irk_t       *whitelistIrkPtrs[YOTTA_CFG_IRK_TABLE_MAX_SIZE];
-    /* Initialize the whitelist */
-    whitelist.pp_addrs   = whitelistAddressPtrs;
-    whitelist.pp_irks    = whitelistIrkPtrs;
-    whitelist.addr_count = 0;
-    whitelist.irk_count  = 0;
+    /* Add missing IRKs to whitelist from the bond table held by the SoftDevice,
+     * unless the whitelist built for a previous start is still valid */
+    if ((advertisingPolicyMode != Gap::ADV_POLICY_IGNORE_WHITELIST) && !stackWhitelistValid) {
+        stackWhitelist.pp_addrs   = stackWhitelistAddressPtrs;
+        stackWhitelist.pp_irks    = stackWhitelistIrkPtrs;
+        stackWhitelist.addr_count = 0;
+        stackWhitelist.irk_count  = 0;
 
-    /* Add missing IRKs to whitelist from the bond table held by the SoftDevice */
-    if (advertisingPolicyMode != Gap::ADV_POLICY_IGNORE_WHITELIST) {
-        ble_error_t error = generateStackWhitelist(whitelist);
+        ble_error_t error = generateStackWhitelist(stackWhitelist);
         if (error != BLE_ERROR_NONE) {
             return error;
         }
+        stackWhitelistValid = true;
     }
 
     /* Start Advertising */
     ble_gap_adv_params_t adv_para = {0};
+    ble_gap_whitelist_t  emptyWhitelist = {0};
 
     adv_para.type        = params.getAdvertisingType();
     adv_para.p_peer_addr = NULL;                           // Undirected advertisement
     adv_para.fp          = advertisingPolicyMode;
-    adv_para.p_whitelist = &whitelist;
+    adv_para.p_whitelist = (advertisingPolicyMode != Gap::ADV_POLICY_IGNORE_WHITELIST) ? &stackWhitelist : &emptyWhitelist;
     adv_para.interval    = params.getIntervalInADVUnits(); // advertising interval (in units of 0.625 ms)
     adv_para.timeout     = params.getTimeout();
 
@@ -201,6 +228,41 @@ ble_error_t nRF5xGap::startAdvertising(const GapAdvertisingParams &params)
     return BLE_ERROR_NONE;
 }
 
+/**************************************************************************/
+/*!
+    @brief  Starts high duty cycle directed advertising to a known peer
+
+    @returns    ble_error_t
+
+    @retval     BLE_ERROR_NONE
+                Everything executed properly
+
+    @retval     BLE_ERROR_PARAM_OUT_OF_RANGE
+                The stack refused to start advertising
+*/
+/**************************************************************************/
+ble_error_t nRF5xGap::startDirectedAdvertising(BLEProtocol::AddressType_t peerAddrType, const BLEProtocol::AddressBytes_t peerAddr)
+{
+    ble_gap_addr_t peer;
+    peer.addr_type = peerAddrType;
+    memcpy(peer.addr, peerAddr, Gap::ADDR_LEN);
+
+    ble_gap_adv_params_t adv_para = {0};
+
+    adv_para.type        = BLE_GAP_ADV_TYPE_ADV_DIRECT_IND;
+    adv_para.p_peer_addr = &peer;
+    adv_para.fp          = BLE_GAP_ADV_FP_ANY;
+    adv_para.p_whitelist = NULL;
+    adv_para.interval    = 0;                              // high duty cycle, stopped by the stack after 1.28 s
+    adv_para.timeout     = 0;
+
+    ASSERT(ERROR_NONE == sd_ble_gap_adv_start(&adv_para), BLE_ERROR_PARAM_OUT_OF_RANGE);
+
+    state.advertising = 1;
+
+    return BLE_ERROR_NONE;
+}
+
 /* Observer role is not supported by S110, return BLE_ERROR_NOT_IMPLEMENTED */
 #if !defined(TARGET_MCU_NRF51_16K_S110) && !defined(TARGET_MCU_NRF51_32K_S110)
 ble_error_t nRF5xGap::startRadioScan(const GapScanningParams &scanningParams)
@@ -442,6 +504,12 @@ ble_error_t nRF5xGap::reset(void)
     /* Clear the internal whitelist */
     whitelistAddressesSize = 0;
 
+    /* The stack may not hold the advertising data anymore */
+    advDataApplied = false;
+
+    /* Rebuild the stack whitelist on the next start */
+    stackWhitelistValid = false;
+
     return BLE_ERROR_NONE;
 }
 
@@ -693,6 +761,8 @@ ble_error_t nRF5xGap::setWhitelist(const Gap::Whitelist_t &whitelistIn)
         whitelistAddressesSize++;
     }
 
+    stackWhitelistValid = false;
+
     return BLE_ERROR_NONE;
 }
 
@@ -92,6 +92,14 @@ public:
 
     virtual ble_error_t reset(void);
 
+    virtual ble_error_t startDirectedAdvertising(BLEProtocol::AddressType_t peerAddrType, const BLEProtocol::AddressBytes_t peerAddr);
+
+    /* To be called when the bond table changes, the IRKs of the stack
+     * whitelist are taken from it */
+    void invalidateStackWhitelist(void) {
+        stackWhitelistValid = false;
+    }
+
     /*
      * The following functions are part of the whitelisting experimental API.
      * Therefore, this functionality can change in the near future.
@@ -224,6 +232,30 @@ private:
     }
     friend void radioNotificationStaticCallback(bool param); /* allow invocations of processRadioNotificationEvent() */
 
+private:
+    bool isAdvertisingDataApplied(const GapAdvertisingData &advData, const GapAdvertisingData &scanResponse) const;
+
+    /*
+     * Stack whitelist used for advertising, built by generateStackWhitelist()
+     * on the first start and reused until the whitelist or the bond table
+     * changes.
+     */
+    bool                stackWhitelistValid;
+    ble_gap_whitelist_t stackWhitelist;
+    ble_gap_addr_t     *stackWhitelistAddressPtrs[YOTTA_CFG_WHITELIST_MAX_SIZE];
+    ble_gap_irk_t      *stackWhitelistIrkPtrs[YOTTA_CFG_IRK_TABLE_MAX_SIZE];
+
+    /*
+     * Copy of the payloads last handed to the SoftDevice, so that refreshing
+     * the advertising data with unchanged content costs no SoftDevice call.
+     */
+    bool     advDataApplied;
+    uint8_t  appliedAdvDataLen;
+    uint8_t  appliedAdvData[GAP_ADVERTISING_DATA_MAX_PAYLOAD];
+    uint8_t  appliedScanResponseLen;
+    uint8_t  appliedScanResponse[GAP_ADVERTISING_DATA_MAX_PAYLOAD];
+    uint16_t appliedAppearance;
+
 private:
     uint16_t m_connectionHandle;
 
@@ -235,7 +267,9 @@ private:
     nRF5xGap() :
         advertisingPolicyMode(Gap::ADV_POLICY_IGNORE_WHITELIST),
         scanningPolicyMode(Gap::SCAN_POLICY_IGNORE_WHITELIST),
-        whitelistAddressesSize(0) {
+        whitelistAddressesSize(0),
+        stackWhitelistValid(false),
+        advDataApplied(false) {
         m_connectionHandle = BLE_CONN_HANDLE_INVALID;
     }
 
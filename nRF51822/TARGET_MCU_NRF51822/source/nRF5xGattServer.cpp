@@ -107,6 +107,10 @@ ble_error_t nRF5xGattServer::addService(GattService &service)
         /* Update the characteristic handle */
         p_characteristics[characteristicCount] = p_char;
         p_char->getValueAttribute().setHandle(nrfCharacteristicHandles[characteristicCount].value_handle);
+        mapCharacteristicHandles(characteristicCount);
+        valueShadow.seed(characteristicCount,
+                         p_char->getValueAttribute().getValuePtr(),
+                         p_char->getValueAttribute().getLength());
         characteristicCount++;
 
         /* Add optional descriptors if any */
@@ -219,15 +223,21 @@ ble_error_t nRF5xGattServer::write(Gap::Handle_t connectionHandle, GattAttribute
         .p_value = const_cast<uint8_t *>(buffer),
     };
 
+    /* Skip the SoftDevice entirely if the stack already holds this value. */
+    int characteristicIndex = resolveValueHandleToCharIndex(attributeHandle);
+    if ((characteristicIndex != -1) && valueShadow.suppress(characteristicIndex, buffer, len)) {
+        return BLE_ERROR_NONE;
+    }
+
     if (localOnly) {
         /* Only update locally regardless of notify/indicate */
         ASSERT_INT( ERROR_NONE,
                     sd_ble_gatts_value_set(connectionHandle, attributeHandle, &value),
                     BLE_ERROR_PARAM_OUT_OF_RANGE );
+        valueShadow.commit(characteristicIndex, buffer, len);
         return BLE_ERROR_NONE;
     }
 
-    int characteristicIndex = resolveValueHandleToCharIndex(attributeHandle);
     if ((characteristicIndex != -1) &&
         (p_characteristics[characteristicIndex]->getProperties() & (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY))) {
         /* HVX update for the characteristic value */
@@ -249,11 +259,15 @@ ble_error_t nRF5xGattServer::write(Gap::Handle_t connectionHandle, GattAttribute
             switch (error) {
                 case ERROR_BLE_NO_TX_BUFFERS: /*  Notifications consume application buffers. The return value can be used for resending notifications. */
                 case ERROR_BUSY:
+                    /* Let the caller resend the same value. */
+                    valueShadow.invalidate(characteristicIndex);
                     returnValue = BLE_STACK_BUSY;
                     break;
 
                 case ERROR_INVALID_STATE:
                 case ERROR_BLEGATTS_SYS_ATTR_MISSING:
+                    /* The local value has been updated, only the notification is missing. */
+                    valueShadow.commit(characteristicIndex, buffer, len);
                     returnValue = BLE_ERROR_INVALID_STATE;
                     break;
 
@@ -261,15 +275,24 @@ ble_error_t nRF5xGattServer::write(Gap::Handle_t connectionHandle, GattAttribute
                     ASSERT_INT( ERROR_NONE,
                                 sd_ble_gatts_value_set(connectionHandle, attributeHandle, &value),
                                 BLE_ERROR_PARAM_OUT_OF_RANGE );
+                    valueShadow.commit(characteristicIndex, buffer, len);
 
                     /* Notifications consume application buffers. The return value can
                      * be used for resending notifications. */
                     returnValue = BLE_STACK_BUSY;
                     break;
             }
+        } else {
+            valueShadow.commit(characteristicIndex, buffer, len);
         }
     } else {
         uint32_t err = sd_ble_gatts_value_set(connectionHandle, attributeHandle, &value);
+        if (err == NRF_SUCCESS) {
+            valueShadow.commit(characteristicIndex, buffer, len);
+        } else {
+            valueShadow.invalidate(characteristicIndex);
+        }
+
         switch(err) {
             case NRF_SUCCESS:
                 returnValue = BLE_ERROR_NONE;
@@ -352,7 +375,9 @@ ble_error_t nRF5xGattServer::reset(void)
     memset(p_descriptors,            0, sizeof(p_descriptors));
     memset(nrfCharacteristicHandles, 0, sizeof(ble_gatts_char_handles_t));
     memset(nrfDescriptorHandles,     0, sizeof(nrfDescriptorHandles));
+    memset(handleTable,              0, sizeof(handleTable));
     descriptorCount = 0;
+    valueShadow.reset();
 
     return BLE_ERROR_NONE;
 }
@@ -394,6 +419,9 @@ void nRF5xGattServer::hwCallback(ble_evt_t *p_ble_evt)
 
                 /* 2.) Changes to the characteristic value will be handled with other events below */
                 eventType = GattServerEvents::GATT_EVENT_DATA_WRITTEN;
+
+                /* The peer changed the value behind the application's back. */
+                valueShadow.forget(resolveValueHandleToCharIndex(handle_value));
             }
             break;
 
@@ -447,6 +475,9 @@ void nRF5xGattServer::hwCallback(ble_evt_t *p_ble_evt)
                 .len        = gattsEventP->params.write.len,
                 .data       = gattsEventP->params.write.data
             };
+            /* Owner of the attribute first, then the handlers interested in
+             * every write */
+            p_characteristics[characteristicIndex]->handleDataWritten(&cbParams);
             handleDataWrittenEvent(&cbParams);
             break;
         }
@@ -479,6 +510,8 @@ void nRF5xGattServer::hwCallback(ble_evt_t *p_ble_evt)
              * have done if write-authorization had not been enabled.
              */
             if (reply.params.write.gatt_status == BLE_GATT_STATUS_SUCCESS) {
+                valueShadow.forget(characteristicIndex);
+
                 GattWriteCallbackParams cbParams = {
                     .connHandle = gattsEventP->conn_handle,
                     .handle     = handle_value,
@@ -487,6 +520,7 @@ void nRF5xGattServer::hwCallback(ble_evt_t *p_ble_evt)
                     .len        = gattsEventP->params.authorize_request.request.write.len,
                     .data       = gattsEventP->params.authorize_request.request.write.data,
                 };
+                p_characteristics[characteristicIndex]->handleDataWritten(&cbParams);
                 handleDataWrittenEvent(&cbParams);
             }
             break;
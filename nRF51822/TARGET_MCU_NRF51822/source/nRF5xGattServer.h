@@ -23,6 +23,23 @@
 #include "nrf_ble.h" /* nordic ble */
 #include "ble/Gap.h"
 #include "ble/GattServer.h"
+#include "nRF5xGattValueShadow.h"
+
+#ifndef YOTTA_CFG_BLE_GATT_TOTAL_CHARACTERISTICS
+    #define YOTTA_CFG_BLE_GATT_TOTAL_CHARACTERISTICS 20
+#elif YOTTA_CFG_BLE_GATT_TOTAL_CHARACTERISTICS > 127
+    #error "The handle table stores characteristic indexes on 7 bits"
+#endif
+#ifndef YOTTA_CFG_BLE_GATT_TOTAL_DESCRIPTORS
+    #define YOTTA_CFG_BLE_GATT_TOTAL_DESCRIPTORS 8
+#endif
+/* Attribute handles covered by the handle table. The SoftDevice allocates
+ * handles densely from 1, at most declaration, value and CCCD for every
+ * characteristic plus the descriptors, services and the built-in GAP/GATT
+ * services. Higher handles fall back to a linear search. */
+#ifndef YOTTA_CFG_BLE_GATT_HANDLE_TABLE_SIZE
+    #define YOTTA_CFG_BLE_GATT_HANDLE_TABLE_SIZE (3 * YOTTA_CFG_BLE_GATT_TOTAL_CHARACTERISTICS + YOTTA_CFG_BLE_GATT_TOTAL_DESCRIPTORS + 24)
+#endif
 
 class nRF5xGattServer : public GattServer
 {
@@ -41,10 +58,26 @@ public:
     void eventCallback(void);
     void hwCallback(ble_evt_t *p_ble_evt);
 
-
 private:
-    const static unsigned BLE_TOTAL_CHARACTERISTICS = 20;
-    const static unsigned BLE_TOTAL_DESCRIPTORS     = 8;
+    const static unsigned BLE_TOTAL_CHARACTERISTICS = YOTTA_CFG_BLE_GATT_TOTAL_CHARACTERISTICS;
+    const static unsigned BLE_TOTAL_DESCRIPTORS     = YOTTA_CFG_BLE_GATT_TOTAL_DESCRIPTORS;
+    const static unsigned BLE_HANDLE_TABLE_SIZE     = YOTTA_CFG_BLE_GATT_HANDLE_TABLE_SIZE;
+
+    /* Handle table entries: characteristic index + 1, 0 if the handle is not
+     * a characteristic value or CCCD */
+    const static uint8_t HANDLE_ENTRY_CCCD       = 0x80;
+    const static uint8_t HANDLE_ENTRY_INDEX_MASK = 0x7F;
+
+public:
+    typedef nRF5xGattValueShadow<BLE_TOTAL_CHARACTERISTICS> ValueShadow_t;
+
+    /**
+     * Counters of characteristic updates forwarded to, or kept away from, the
+     * SoftDevice by the value shadow.
+     */
+    const ValueShadow_t::Statistics_t &getValueShadowStatistics(void) const {
+        return valueShadow.getStatistics();
+    }
 
 private:
     /**
@@ -53,6 +86,11 @@ private:
      * @return             characteristic index if a resolution is found, else -1.
      */
     int resolveValueHandleToCharIndex(GattAttribute::Handle_t valueHandle) const {
+        if (valueHandle < BLE_HANDLE_TABLE_SIZE) {
+            uint8_t entry = handleTable[valueHandle];
+            return ((entry == 0) || (entry & HANDLE_ENTRY_CCCD)) ? -1 : (entry - 1);
+        }
+
         unsigned charIndex;
         for (charIndex = 0; charIndex < characteristicCount; charIndex++) {
             if (nrfCharacteristicHandles[charIndex].value_handle == valueHandle) {
@@ -69,6 +107,11 @@ private:
      * @return             characteristic index if a resolution is found, else -1.
      */
     int resolveCCCDHandleToCharIndex(GattAttribute::Handle_t cccdHandle) const {
+        if (cccdHandle < BLE_HANDLE_TABLE_SIZE) {
+            uint8_t entry = handleTable[cccdHandle];
+            return (entry & HANDLE_ENTRY_CCCD) ? ((entry & HANDLE_ENTRY_INDEX_MASK) - 1) : -1;
+        }
+
         unsigned charIndex;
         for (charIndex = 0; charIndex < characteristicCount; charIndex++) {
             if (nrfCharacteristicHandles[charIndex].cccd_handle == cccdHandle) {
@@ -79,19 +122,37 @@ private:
         return -1;
     }
 
+    /**
+     * Record the handles of a newly added characteristic in the handle table.
+     * @param charIndex index of the characteristic.
+     */
+    void mapCharacteristicHandles(unsigned charIndex) {
+        GattAttribute::Handle_t valueHandle = nrfCharacteristicHandles[charIndex].value_handle;
+        GattAttribute::Handle_t cccdHandle  = nrfCharacteristicHandles[charIndex].cccd_handle;
+
+        if (valueHandle < BLE_HANDLE_TABLE_SIZE) {
+            handleTable[valueHandle] = charIndex + 1;
+        }
+        if ((cccdHandle != BLE_GATT_HANDLE_INVALID) && (cccdHandle < BLE_HANDLE_TABLE_SIZE)) {
+            handleTable[cccdHandle] = HANDLE_ENTRY_CCCD | (charIndex + 1);
+        }
+    }
+
 private:
     GattCharacteristic       *p_characteristics[BLE_TOTAL_CHARACTERISTICS];
     ble_gatts_char_handles_t  nrfCharacteristicHandles[BLE_TOTAL_CHARACTERISTICS];
     GattAttribute            *p_descriptors[BLE_TOTAL_DESCRIPTORS];
     uint8_t                   descriptorCount;
     uint16_t                  nrfDescriptorHandles[BLE_TOTAL_DESCRIPTORS];
+    uint8_t                   handleTable[BLE_HANDLE_TABLE_SIZE];
+    ValueShadow_t             valueShadow;
 
     /*
      * Allow instantiation from nRF5xn when required.
      */
     friend class nRF5xn;
 
-    nRF5xGattServer() : GattServer(), p_characteristics(), nrfCharacteristicHandles(), p_descriptors(), descriptorCount(0), nrfDescriptorHandles() {
+    nRF5xGattServer() : GattServer(), p_characteristics(), nrfCharacteristicHandles(), p_descriptors(), descriptorCount(0), nrfDescriptorHandles(), handleTable(), valueShadow() {
         /* empty */
     }
 
@@ -0,0 +1,149 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NRF_GATT_VALUE_SHADOW_H__
+#define __NRF_GATT_VALUE_SHADOW_H__
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Last committed value of every characteristic owned by the GATT server.
+ * @details The services refresh their characteristics from the main loop on
+ * every wakeup, most of the time with the value already stored in the
+ * SoftDevice. The shadow keeps a copy of what was last handed to the stack so
+ * that nRF5xGattServer::write() can drop those updates before they turn into
+ * sd_ble_gatts_hvx()/sd_ble_gatts_value_set() calls.
+ *
+ * Slots are indexed like nRF5xGattServer::p_characteristics. Values longer
+ * than MAX_VALUE_LEN are never shadowed and always reach the stack.
+ *
+ * This class has no dependency on the SoftDevice so it can be exercised on
+ * its own.
+ */
+template<unsigned TOTAL_SLOTS>
+class nRF5xGattValueShadow
+{
+public:
+    /**
+     * Largest value, in bytes, kept in the shadow.
+     */
+    static const uint16_t MAX_VALUE_LEN = 4;
+
+    /**
+     * Update counters, for diagnostic purpose.
+     */
+    struct Statistics_t {
+        uint32_t issued;     /**< Updates forwarded to the SoftDevice. */
+        uint32_t suppressed; /**< Updates dropped because the value did not change. */
+    };
+
+    nRF5xGattValueShadow() : slots(), stats() {
+        /* empty */
+    }
+
+    /**
+     * @brief Check whether an update would leave the attribute unchanged.
+     * @param index Index of the characteristic.
+     * @param value New value.
+     * @param len   Length of the new value.
+     * @return true if the value equals the last committed one, in which case
+     *         the update is accounted as suppressed.
+     */
+    bool suppress(unsigned index, const uint8_t *value, uint16_t len) {
+        if ((index >= TOTAL_SLOTS) || !slots[index].valid ||
+            (slots[index].len != len) || (memcmp(slots[index].value, value, len) != 0)) {
+            return false;
+        }
+
+        stats.suppressed++;
+        return true;
+    }
+
+    /**
+     * @brief Record a value which has been handed to the SoftDevice.
+     * @param index Index of the characteristic.
+     * @param value Value stored by the stack.
+     * @param len   Length of the value.
+     */
+    void commit(unsigned index, const uint8_t *value, uint16_t len) {
+        stats.issued++;
+        if (index >= TOTAL_SLOTS) {
+            return;
+        }
+
+        if ((value == NULL) || (len > MAX_VALUE_LEN)) {
+            slots[index].valid = false;
+            return;
+        }
+
+        memcpy(slots[index].value, value, len);
+        slots[index].len   = len;
+        slots[index].valid = true;
+    }
+
+    /**
+     * @brief Account an update which reached the SoftDevice without leaving a
+     * known value behind (stack busy, unknown attribute, ...).
+     * @param index Index of the characteristic, ignored if out of range.
+     */
+    void invalidate(unsigned index) {
+        stats.issued++;
+        forget(index);
+    }
+
+    /**
+     * @brief Drop the shadow of a characteristic whose value has been changed
+     * outside of the application (e.g. written by the peer).
+     * @param index Index of the characteristic, ignored if out of range.
+     */
+    void forget(unsigned index) {
+        if (index < TOTAL_SLOTS) {
+            slots[index].valid = false;
+        }
+    }
+
+    /**
+     * @brief Seed the shadow with the initial value of a characteristic, as
+     * registered in the attribute table. Not accounted in the statistics.
+     */
+    void seed(unsigned index, const uint8_t *value, uint16_t len) {
+        Statistics_t saved = stats;
+        commit(index, value, len);
+        stats = saved;
+    }
+
+    const Statistics_t &getStatistics(void) const {
+        return stats;
+    }
+
+    void reset(void) {
+        memset(slots, 0, sizeof(slots));
+        memset(&stats, 0, sizeof(stats));
+    }
+
+private:
+    struct Slot_t {
+        bool     valid;
+        uint8_t  len;
+        uint8_t  value[MAX_VALUE_LEN];
+    };
+
+    Slot_t       slots[TOTAL_SLOTS];
+    Statistics_t stats;
+};
+
+#endif /*__NRF_GATT_VALUE_SHADOW_H__*/
@@ -27,6 +27,7 @@
 #include "nrf_delay.h"
 
 extern "C" {
+#include "pstorage.h"
 #include "softdevice_handler.h"
 }
 
@@ -213,5 +214,7 @@ void nRF5xn::processEvents() {
     if (isEventsSignaled) {
         isEventsSignaled = false;
         intern_softdevice_events_execute();
+        /* Storage operations completed without a flash event */
+        pstorage_posted_event_handler();
     }
 }
@@ -0,0 +1,46 @@
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+/* Minimal test harness: every test file is one executable whose main() runs
+ * its cases with RUN_TEST() and returns TEST_RESULT(). Measurements are
+ * printed with REPORT() so that a run doubles as a benchmark log. */
+
+#include <stdio.h>
+
+static int host_test_failures;
+static int host_test_checks;
+
+#define CHECK(condition) \
+    do { \
+        host_test_checks++; \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+    do { \
+        long long expected_ = (long long)(expected); \
+        long long actual_ = (long long)(actual); \
+        host_test_checks++; \
+        if (expected_ != actual_) { \
+            printf("%s:%d: CHECK_EQUAL(%s, %s) failed: %lld != %lld\n", \
+                   __FILE__, __LINE__, #expected, #actual, expected_, actual_); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) \
+    do { \
+        printf("-- %s\n", #test); \
+        test(); \
+    } while (0)
+
+#define REPORT(...) printf("   " __VA_ARGS__)
+
+#define TEST_RESULT() \
+    (printf("%s: %d checks, %d failed\n", host_test_failures ? "FAIL" : "OK", \
+            host_test_checks, host_test_failures), host_test_failures != 0)
+
+#endif /* #ifndef __HOST_TEST_H__ */
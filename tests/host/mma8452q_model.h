@@ -0,0 +1,180 @@
+#ifndef __MMA8452Q_MODEL_H__
+#define __MMA8452Q_MODEL_H__
+
+/* Register level model of the MMA8452Q on the host I2C bus: auto-increment
+ * with the F_READ skip, configuration writes refused outside of standby, and
+ * a latched motion event holding INT1 low until its source register is read.
+ * Register names come from AccelSensor.h. */
+
+#include "mbed.h"
+#include "AccelSensor.h"
+
+#include <utility>
+#include <vector>
+
+class Mma8452qModel : public HostI2CDevice {
+public:
+    explicit Mma8452qModel(int intPin = -1) : intPin(intPin)
+    {
+        reset();
+    }
+
+    void reset(void)
+    {
+        memset(regs, 0, sizeof(regs));
+        regs[WHO_AM_I] = 0x2A;
+        pointer = 0;
+        addressed = false;
+        pointerPending = false;
+        latched = false;
+        nackAddress = 0;
+        writes.clear();
+        refusedWrites.clear();
+        sourceReads = 0;
+        onSourceRead = NULL;
+        onRead = NULL;
+        updateInt();
+    }
+
+    /* Sample returned by the output registers, 12-bit left aligned */
+    void setSample(int16_t x, int16_t y, int16_t z)
+    {
+        int16_t axes[3] = {x, y, z};
+        for (int i = 0; i < 3; i++) {
+            regs[OUT_X_MSB + 2 * i] = (uint8_t)((axes[i] << 4) >> 8);
+            regs[OUT_X_MSB + 2 * i + 1] = (uint8_t)(axes[i] << 4);
+        }
+    }
+
+    /* Motion above threshold, latched by the engine routed to INT1 */
+    void motion(void)
+    {
+        if (!active() || !(regs[CTRL_REG4] & regs[CTRL_REG5] & (INT_TRANS | INT_FF_MT))) {
+            return;
+        }
+        latched = true;
+        updateInt();
+    }
+
+    bool active(void) const
+    {
+        return (regs[CTRL_REG1] & CTRL_REG1_ACTIVE) != 0;
+    }
+
+    bool intAsserted(void) const
+    {
+        return latched;
+    }
+
+    /* HostI2CDevice */
+    virtual bool start(uint8_t address, bool read)
+    {
+        addressed = (address == ADDRESS);
+        if (!addressed) {
+            return false;
+        }
+        if (nackAddress > 0) {
+            nackAddress--;
+            addressed = false;
+            return false;
+        }
+        pointerPending = !read;
+        return true;
+    }
+
+    virtual bool write(uint8_t data)
+    {
+        if (!addressed) {
+            return false;
+        }
+        if (pointerPending) {
+            pointerPending = false;
+            pointer = data;
+            return true;
+        }
+        writeRegister(pointer, data);
+        pointer = next(pointer);
+        return true;
+    }
+
+    virtual uint8_t read(void)
+    {
+        uint8_t reg = pointer;
+        uint8_t value = regs[reg];
+        pointer = next(pointer);
+        if ((reg == source()) && (reg != 0)) {
+            value = latched ? SRC_EA : 0;
+            latched = false;
+            sourceReads++;
+            updateInt();
+            if (onSourceRead != NULL) {
+                void (*hook)(void) = onSourceRead;
+                onSourceRead = NULL;
+                hook();
+            }
+        }
+        if (onRead != NULL) {
+            onRead(reg);
+        }
+        return value;
+    }
+
+    uint8_t regs[256];
+    /* Address NACKs to give before answering again */
+    int nackAddress;
+    std::vector<std::pair<uint8_t, uint8_t> > writes;
+    std::vector<std::pair<uint8_t, uint8_t> > refusedWrites;
+    int sourceReads;
+    /* Runs once, right after the next read of the source register */
+    void (*onSourceRead)(void);
+    /* Runs after every register read, with the register */
+    void (*onRead)(uint8_t reg);
+
+private:
+    uint8_t source(void) const
+    {
+        if (regs[CTRL_REG4] & INT_TRANS) {
+            return TRANSIENT_SRC;
+        }
+        if (regs[CTRL_REG4] & INT_FF_MT) {
+            return FF_MT_SRC;
+        }
+        return 0;
+    }
+
+    uint8_t next(uint8_t reg) const
+    {
+        /* F_READ: the burst skips the LSB registers */
+        if ((regs[CTRL_REG1] & CTRL_REG1_F_READ) && (reg >= OUT_X_MSB) && (reg <= OUT_X_MSB + 4)) {
+            return (reg == OUT_X_MSB + 4) ? 0x00 : reg + 2;
+        }
+        return reg + 1;
+    }
+
+    void writeRegister(uint8_t reg, uint8_t value)
+    {
+        /* Only CTRL_REG1 ACTIVE may change while active */
+        if (active() && ((reg != CTRL_REG1) || ((value ^ regs[CTRL_REG1]) & ~CTRL_REG1_ACTIVE))) {
+            refusedWrites.push_back(std::make_pair(reg, value));
+            return;
+        }
+        writes.push_back(std::make_pair(reg, value));
+        regs[reg] = value;
+        updateInt();
+    }
+
+    void updateInt(void)
+    {
+        if (intPin >= 0) {
+            host_set_input(intPin, latched ? 0 : 1);
+        }
+    }
+
+    int intPin;
+    uint8_t pointer;
+    bool addressed;
+    bool pointerPending;
+    bool latched;
+};
+
+#endif /* #ifndef __MMA8452Q_MODEL_H__ */
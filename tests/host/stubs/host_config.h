@@ -0,0 +1,15 @@
+#ifndef __HOST_CONFIG_H__
+#define __HOST_CONFIG_H__
+
+/* Included ahead of every host translation unit.
+ *
+ * SoftDevice calls become plain functions with C linkage, implemented by
+ * softdevice.cpp, so that the C modules of the SDK and the C++ port reach
+ * the same stub. */
+#ifdef __cplusplus
+#define SVCALL(number, return_type, signature) extern "C" return_type signature
+#else
+#define SVCALL(number, return_type, signature) return_type signature
+#endif
+
+#endif /* #ifndef __HOST_CONFIG_H__ */
@@ -0,0 +1,741 @@
+#include "mbed.h"
+#include "us_ticker_api.h"
+
+#include <stdarg.h>
+#include <algorithm>
+
+NRF_FICR_Type host_ficr = {1024, 256, {0x12345678, 0x9ABCDEF0}};
+NRF_UICR_Type host_uicr = {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF,
+                           {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF,
+                            0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF,
+                            0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}};
+NRF_RTC_Type host_rtc1;
+NRF_GPIO_Type host_gpio;
+NRF_GPIOTE_Type host_gpiote;
+NRF_TWI_Type host_twi[2];
+
+std::vector<HostEdge> host_edges;
+HostPpiChannel host_ppi[HOST_PPI_CHANNELS];
+uint32_t host_ppi_enabled;
+unsigned host_critical_sections;
+HostI2CDevice *host_i2c_device;
+HostI2CStats host_i2c_stats;
+
+#define RTC_MASK      0xFFFFFF
+#define GPIOTE_COUNT  4
+#define TWI_IRQ_MASK  (TWI_INTENSET_STOPPED_Msk | TWI_INTENSET_RXDREADY_Msk | TWI_INTENSET_TXDSENT_Msk | TWI_INTENSET_ERROR_Msk)
+
+static uint64_t nowUs;
+static uint32_t vectors[SWI5_IRQn + 1];
+static uint32_t pendingIrqs;
+static int criticalNesting;
+static bool inIrq;
+static bool eventRegister;
+
+/* Inputs are pulled up until a test drives them, stored inverted so that
+ * the power-on state is the zero initialised one */
+static int inputLow[32];
+static int analogValue[32];
+static int pinLow[32];
+static int gpioteLevel[GPIOTE_COUNT];
+
+/* Function statics, drivers may be constructed before this file's globals */
+static std::vector<Timeout *> &timeoutList(void)
+{
+    static std::vector<Timeout *> list;
+    return list;
+}
+
+static std::vector<InterruptIn *> &interruptList(void)
+{
+    static std::vector<InterruptIn *> list;
+    return list;
+}
+
+enum TwiState {
+    TWI_IDLE,
+    TWI_TX,
+    TWI_RX
+};
+static TwiState twiState[2];
+static bool twiSuspended[2];
+
+/* Bus activity started by a task runs on the next step of host_run_irqs(),
+ * not within the register write, so that the events of a byte never show up
+ * before the handler that asked for it has returned */
+enum TwiStep {
+    TWI_STEP_NONE,
+    TWI_STEP_START_TX,
+    TWI_STEP_START_RX,
+    TWI_STEP_SEND,
+    TWI_STEP_RECEIVE
+};
+static TwiStep twiStep[2];
+static bool twiRunStep(int index);
+
+static uint64_t ticksAt(uint64_t us)
+{
+    return us * HOST_RTC_HZ / 1000000;
+}
+
+static uint64_t usAtTick(uint64_t tick)
+{
+    return (tick * 1000000 + HOST_RTC_HZ - 1) / HOST_RTC_HZ;
+}
+
+static void syncCounter(void)
+{
+    host_rtc1.COUNTER.value = ticksAt(nowUs) & RTC_MASK;
+}
+
+uint64_t host_now_us(void)
+{
+    return nowUs;
+}
+
+uint32_t host_rtc_ticks(void)
+{
+    return ticksAt(nowUs);
+}
+
+extern "C" uint32_t us_ticker_read(void)
+{
+    return (uint32_t)nowUs;
+}
+
+/* Pins */
+
+static int computeLevel(int pin)
+{
+    for (int i = 0; i < GPIOTE_COUNT; i++) {
+        uint32_t config = host_gpiote.CONFIG[i].value;
+        if (((config & GPIOTE_CONFIG_MODE_Msk) >> GPIOTE_CONFIG_MODE_Pos) == GPIOTE_CONFIG_MODE_Task &&
+            (int)((config & GPIOTE_CONFIG_PSEL_Msk) >> GPIOTE_CONFIG_PSEL_Pos) == pin) {
+            return gpioteLevel[i];
+        }
+    }
+    if (host_gpio.DIR.value & (1UL << pin)) {
+        return (host_gpio.OUT.value >> pin) & 1;
+    }
+    return !inputLow[pin];
+}
+
+static void updatePins(void)
+{
+    for (int pin = 0; pin < 32; pin++) {
+        int level = computeLevel(pin);
+        if (level == pinLow[pin]) {
+            pinLow[pin] = !level;
+            HostEdge edge = {pin, level, ticksAt(nowUs)};
+            host_edges.push_back(edge);
+        }
+    }
+}
+
+int host_pin_level(int pin)
+{
+    return !pinLow[pin];
+}
+
+void host_set_input(int pin, int level)
+{
+    int previous = !inputLow[pin];
+    inputLow[pin] = !level;
+    updatePins();
+    if (previous == level) {
+        return;
+    }
+
+    std::vector<InterruptIn *> list = interruptList();
+    for (size_t i = 0; i < list.size(); i++) {
+        if (list[i]->pin != pin) {
+            continue;
+        }
+        Callback<void()> &handler = level ? list[i]->riseHandler : list[i]->fallHandler;
+        if (handler) {
+            handler();
+        }
+    }
+}
+
+void host_set_analog(int pin, uint16_t value)
+{
+    analogValue[pin] = value;
+}
+
+/* Interrupts */
+
+extern "C" void NVIC_SetVector(IRQn_Type irq, uint32_t vector)
+{
+    vectors[irq] = vector;
+}
+
+extern "C" void NVIC_SetPendingIRQ(IRQn_Type irq)
+{
+    pendingIrqs |= 1UL << irq;
+}
+
+static bool twiIrqPending(int index)
+{
+    NRF_TWI_Type *twi = &host_twi[index];
+    uint32_t events = (twi->EVENTS_STOPPED.value ? TWI_INTENSET_STOPPED_Msk : 0) |
+                      (twi->EVENTS_RXDREADY.value ? TWI_INTENSET_RXDREADY_Msk : 0) |
+                      (twi->EVENTS_TXDSENT.value ? TWI_INTENSET_TXDSENT_Msk : 0) |
+                      (twi->EVENTS_ERROR.value ? TWI_INTENSET_ERROR_Msk : 0);
+    return (events & twi->INTENSET.value & TWI_IRQ_MASK) != 0;
+}
+
+void host_run_irqs(void)
+{
+    if (inIrq || criticalNesting > 0) {
+        return;
+    }
+
+    inIrq = true;
+    for (int guard = 0; guard < 100000; guard++) {
+        IRQn_Type irq;
+        if (twiIrqPending(0)) {
+            irq = SPI0_TWI0_IRQn;
+        } else if (twiIrqPending(1)) {
+            irq = SPI1_TWI1_IRQn;
+        } else if (pendingIrqs) {
+            irq = (IRQn_Type)__builtin_ctz(pendingIrqs);
+            pendingIrqs &= ~(1UL << irq);
+        } else if (twiRunStep(0) || twiRunStep(1)) {
+            continue;
+        } else {
+            break;
+        }
+
+        if (vectors[irq] == 0) {
+            break;
+        }
+        eventRegister = true;
+        ((void (*)(void))(uintptr_t)vectors[irq])();
+    }
+    inIrq = false;
+}
+
+extern "C" void core_util_critical_section_enter(void)
+{
+    criticalNesting++;
+    host_critical_sections++;
+}
+
+extern "C" void core_util_critical_section_exit(void)
+{
+    if (--criticalNesting == 0) {
+        host_run_irqs();
+    }
+}
+
+/* TWI */
+
+static void twiError(NRF_TWI_Type *twi, uint32_t source)
+{
+    twi->ERRORSRC.value |= source;
+    twi->EVENTS_ERROR.value = 1;
+}
+
+static void twiSend(int index)
+{
+    NRF_TWI_Type *twi = &host_twi[index];
+    host_i2c_stats.bytes++;
+    if (host_i2c_device->write((uint8_t)twi->TXD.value)) {
+        twi->EVENTS_TXDSENT.value = 1;
+    } else {
+        twiError(twi, TWI_ERRORSRC_DNACK_Msk);
+    }
+}
+
+static void twiStop(int index)
+{
+    NRF_TWI_Type *twi = &host_twi[index];
+    if (twiState[index] == TWI_IDLE) {
+        return;
+    }
+    if (host_i2c_device != NULL) {
+        host_i2c_device->stop();
+    }
+    twiState[index] = TWI_IDLE;
+    twiSuspended[index] = false;
+    twi->EVENTS_STOPPED.value = 1;
+}
+
+static void twiReceive(int index)
+{
+    NRF_TWI_Type *twi = &host_twi[index];
+    host_i2c_stats.bytes++;
+    twi->RXD.value = host_i2c_device->read();
+    twi->EVENTS_RXDREADY.value = 1;
+    if (twi->SHORTS.value & TWI_SHORTS_BB_STOP_Msk) {
+        twiStop(index);
+    } else if (twi->SHORTS.value & TWI_SHORTS_BB_SUSPEND_Msk) {
+        twiSuspended[index] = true;
+    }
+}
+
+static bool twiStart(int index, bool read)
+{
+    NRF_TWI_Type *twi = &host_twi[index];
+    host_i2c_stats.transactions++;
+    host_i2c_stats.bytes++;
+    twiState[index] = read ? TWI_RX : TWI_TX;
+    twiSuspended[index] = false;
+    if ((host_i2c_device == NULL) || !host_i2c_device->start((uint8_t)twi->ADDRESS.value, read)) {
+        twiError(twi, TWI_ERRORSRC_ANACK_Msk);
+        return false;
+    }
+    return true;
+}
+
+static bool twiRunStep(int index)
+{
+    TwiStep step = twiStep[index];
+    twiStep[index] = TWI_STEP_NONE;
+    switch (step) {
+    case TWI_STEP_START_TX:
+        if (twiStart(index, false)) {
+            twiSend(index);
+        }
+        return true;
+    case TWI_STEP_START_RX:
+        if (twiStart(index, true)) {
+            twiReceive(index);
+        }
+        return true;
+    case TWI_STEP_SEND:
+        if ((twiState[index] == TWI_TX) && !host_twi[index].EVENTS_ERROR.value) {
+            twiSend(index);
+        }
+        return true;
+    case TWI_STEP_RECEIVE:
+        if ((twiState[index] == TWI_RX) && twiSuspended[index]) {
+            twiSuspended[index] = false;
+            twiReceive(index);
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void twiWrite(int index, HostReg *reg, uint32_t value)
+{
+    NRF_TWI_Type *twi = &host_twi[index];
+
+    if (reg == &twi->TASKS_STARTTX) {
+        twiStep[index] = TWI_STEP_START_TX;
+    } else if (reg == &twi->TASKS_STARTRX) {
+        twiStep[index] = TWI_STEP_START_RX;
+    } else if (reg == &twi->TASKS_RESUME) {
+        if (twiState[index] == TWI_RX) {
+            twiStep[index] = TWI_STEP_RECEIVE;
+        }
+    } else if (reg == &twi->TASKS_STOP) {
+        twiStep[index] = TWI_STEP_NONE;
+        twiStop(index);
+    } else if (reg == &twi->TXD) {
+        reg->value = value;
+        if (twiState[index] == TWI_TX) {
+            twiStep[index] = TWI_STEP_SEND;
+        }
+    } else if (reg == &twi->INTENSET) {
+        twi->INTENSET.value |= value;
+        twi->INTENCLR.value = twi->INTENSET.value;
+    } else if (reg == &twi->INTENCLR) {
+        twi->INTENSET.value &= ~value;
+        twi->INTENCLR.value = twi->INTENSET.value;
+    } else if (reg == &twi->ERRORSRC) {
+        reg->value &= ~value;
+    } else {
+        reg->value = value;
+    }
+}
+
+/* Register writes */
+
+template <typename T>
+static bool within(const HostReg *reg, const T &peripheral)
+{
+    const char *p = (const char *)reg;
+    return (p >= (const char *)&peripheral) && (p < (const char *)&peripheral + sizeof(T));
+}
+
+static void rtcWrite(HostReg *reg, uint32_t value)
+{
+    if (reg == &host_rtc1.EVTENSET) {
+        host_rtc1.EVTEN.value |= value;
+        host_rtc1.EVTENCLR.value = host_rtc1.EVTENSET.value = host_rtc1.EVTEN.value;
+    } else if (reg == &host_rtc1.EVTENCLR) {
+        host_rtc1.EVTEN.value &= ~value;
+        host_rtc1.EVTENCLR.value = host_rtc1.EVTENSET.value = host_rtc1.EVTEN.value;
+    } else if (reg == &host_rtc1.COUNTER) {
+        /* read only */
+    } else {
+        reg->value = value;
+    }
+}
+
+static void gpioWrite(HostReg *reg, uint32_t value)
+{
+    if (reg == &host_gpio.OUTSET) {
+        host_gpio.OUT.value |= value;
+    } else if (reg == &host_gpio.OUTCLR) {
+        host_gpio.OUT.value &= ~value;
+    } else if (reg == &host_gpio.DIRSET) {
+        host_gpio.DIR.value |= value;
+    } else if (reg == &host_gpio.DIRCLR) {
+        host_gpio.DIR.value &= ~value;
+    } else {
+        reg->value = value;
+    }
+    host_gpio.OUTSET.value = host_gpio.OUTCLR.value = host_gpio.OUT.value;
+    host_gpio.DIRSET.value = host_gpio.DIRCLR.value = host_gpio.DIR.value;
+    updatePins();
+}
+
+static void gpioteWrite(HostReg *reg, uint32_t value)
+{
+    for (int i = 0; i < GPIOTE_COUNT; i++) {
+        if (reg == &host_gpiote.CONFIG[i]) {
+            reg->value = value;
+            /* Every write in task mode drives the pin to OUTINIT */
+            if (((value & GPIOTE_CONFIG_MODE_Msk) >> GPIOTE_CONFIG_MODE_Pos) == GPIOTE_CONFIG_MODE_Task) {
+                gpioteLevel[i] = (value & GPIOTE_CONFIG_OUTINIT_Msk) ? 1 : 0;
+            }
+            updatePins();
+            return;
+        }
+        if ((reg == &host_gpiote.TASKS_OUT[i]) && value) {
+            switch ((host_gpiote.CONFIG[i].value & GPIOTE_CONFIG_POLARITY_Msk) >> GPIOTE_CONFIG_POLARITY_Pos) {
+                case GPIOTE_CONFIG_POLARITY_LoToHi:
+                    gpioteLevel[i] = 1;
+                    break;
+                case GPIOTE_CONFIG_POLARITY_HiToLo:
+                    gpioteLevel[i] = 0;
+                    break;
+                case GPIOTE_CONFIG_POLARITY_Toggle:
+                    gpioteLevel[i] ^= 1;
+                    break;
+            }
+            updatePins();
+            return;
+        }
+    }
+    reg->value = value;
+}
+
+void host_reg_write(HostReg *reg, uint32_t value)
+{
+    if (within(reg, host_rtc1)) {
+        rtcWrite(reg, value);
+    } else if (within(reg, host_gpio)) {
+        gpioWrite(reg, value);
+    } else if (within(reg, host_gpiote)) {
+        gpioteWrite(reg, value);
+    } else if (within(reg, host_twi[0])) {
+        twiWrite(0, reg, value);
+    } else if (within(reg, host_twi[1])) {
+        twiWrite(1, reg, value);
+    } else {
+        reg->value = value;
+    }
+}
+
+/* Clock */
+
+static void fireCompare(int cc)
+{
+    host_rtc1.EVENTS_COMPARE[cc].value = 1;
+    for (int ch = 0; ch < HOST_PPI_CHANNELS; ch++) {
+        if ((host_ppi_enabled & (1UL << ch)) && (host_ppi[ch].event == &host_rtc1.EVENTS_COMPARE[cc]) && host_ppi[ch].task) {
+            host_reg_write((HostReg *)host_ppi[ch].task, 1);
+        }
+    }
+}
+
+/* First tick after `tick` at which compare `cc` matches, 0 if disabled */
+static uint64_t nextCompareTick(int cc, uint64_t tick)
+{
+    if (!(host_rtc1.EVTEN.value & (RTC_EVTEN_COMPARE0_Msk << cc))) {
+        return 0;
+    }
+    uint64_t target = (tick & ~(uint64_t)RTC_MASK) | (host_rtc1.CC[cc].value & RTC_MASK);
+    if (target <= tick) {
+        target += RTC_MASK + 1;
+    }
+    return target;
+}
+
+/* Time of the next timer or compare event after now, UINT64_MAX if none */
+static uint64_t nextEventUs(void)
+{
+    uint64_t next = UINT64_MAX;
+    std::vector<Timeout *> &timeouts = timeoutList();
+    for (size_t i = 0; i < timeouts.size(); i++) {
+        if (timeouts[i]->armed) {
+            next = std::min(next, std::max(timeouts[i]->deadline, nowUs));
+        }
+    }
+    uint64_t tick = ticksAt(nowUs);
+    for (int cc = 0; cc < 4; cc++) {
+        uint64_t target = nextCompareTick(cc, tick);
+        if (target) {
+            next = std::min(next, usAtTick(target));
+        }
+    }
+    return next;
+}
+
+/* Run whatever is due at the current time */
+static void runDue(uint64_t fromTick)
+{
+    uint64_t tick = ticksAt(nowUs);
+    for (uint64_t t = fromTick; t < tick; ) {
+        uint64_t first = 0;
+        int which = -1;
+        for (int cc = 0; cc < 4; cc++) {
+            uint64_t target = nextCompareTick(cc, t);
+            if (target && (target <= tick) && (!first || target < first)) {
+                first = target;
+                which = cc;
+            }
+        }
+        if (which < 0) {
+            break;
+        }
+        fireCompare(which);
+        t = first;
+    }
+
+    for (bool fired = true; fired; ) {
+        fired = false;
+        std::vector<Timeout *> list = timeoutList();
+        for (size_t i = 0; i < list.size(); i++) {
+            if (list[i]->armed && (list[i]->deadline <= nowUs)) {
+                list[i]->armed = (list[i]->period != 0);
+                list[i]->deadline += list[i]->period;
+                eventRegister = true;
+                list[i]->handler();
+                fired = true;
+            }
+        }
+    }
+    host_run_irqs();
+}
+
+bool host_advance_to_next(uint64_t max_us)
+{
+    uint64_t next = nextEventUs();
+    uint64_t limit = nowUs + max_us;
+    bool due = next <= limit;
+    uint64_t fromTick = ticksAt(nowUs);
+    nowUs = due ? next : limit;
+    syncCounter();
+    runDue(fromTick);
+    return due;
+}
+
+void host_advance_us(uint64_t us)
+{
+    uint64_t target = nowUs + us;
+    while (nowUs < target) {
+        host_advance_to_next(target - nowUs);
+    }
+    runDue(ticksAt(nowUs));
+}
+
+void host_sev(void)
+{
+    eventRegister = true;
+}
+
+void host_wait_for_event(void)
+{
+    uint64_t start = nowUs;
+    while (!eventRegister && (nowUs - start < HOST_MAX_SLEEP_US)) {
+        host_advance_to_next(HOST_MAX_SLEEP_US - (nowUs - start));
+    }
+    eventRegister = false;
+}
+
+void host_hw_reset(void)
+{
+    nowUs = 0;
+    memset(&host_rtc1, 0, sizeof(host_rtc1));
+    memset(&host_gpio, 0, sizeof(host_gpio));
+    memset(&host_gpiote, 0, sizeof(host_gpiote));
+    memset(host_twi, 0, sizeof(host_twi));
+    memset(host_ppi, 0, sizeof(host_ppi));
+    host_ppi_enabled = 0;
+    pendingIrqs = 0;
+    eventRegister = false;
+    memset(inputLow, 0, sizeof(inputLow));
+    memset(pinLow, 0, sizeof(pinLow));
+    memset(analogValue, 0, sizeof(analogValue));
+    memset(gpioteLevel, 0, sizeof(gpioteLevel));
+    twiState[0] = twiState[1] = TWI_IDLE;
+    twiStep[0] = twiStep[1] = TWI_STEP_NONE;
+    host_edges.clear();
+    memset(&host_i2c_stats, 0, sizeof(host_i2c_stats));
+    std::vector<Timeout *> &timeouts = timeoutList();
+    for (size_t i = 0; i < timeouts.size(); i++) {
+        timeouts[i]->armed = false;
+    }
+}
+
+/* mbed drivers */
+
+I2C::I2C(PinName sda, PinName scl) : addressPending(false)
+{
+    (void)sda;
+    (void)scl;
+    _i2c.i2c = NRF_TWI0;
+}
+
+void I2C::start(void)
+{
+    host_i2c_stats.transactions++;
+    addressPending = true;
+}
+
+void I2C::stop(void)
+{
+    addressPending = false;
+    if (host_i2c_device != NULL) {
+        host_i2c_device->stop();
+    }
+}
+
+int I2C::write(int data)
+{
+    host_i2c_stats.bytes++;
+    if (host_i2c_device == NULL) {
+        return 0;
+    }
+    if (addressPending) {
+        addressPending = false;
+        return host_i2c_device->start((uint8_t)(data >> 1), data & 1) ? 1 : 0;
+    }
+    return host_i2c_device->write((uint8_t)data) ? 1 : 0;
+}
+
+int I2C::read(int ack)
+{
+    (void)ack;
+    host_i2c_stats.bytes++;
+    return (host_i2c_device != NULL) ? host_i2c_device->read() : 0xFF;
+}
+
+int I2C::write(int address, const char *data, int length, bool repeated)
+{
+    start();
+    if (!write(address & ~1)) {
+        stop();
+        return 1;
+    }
+    for (int i = 0; i < length; i++) {
+        if (!write(data[i])) {
+            stop();
+            return 1;
+        }
+    }
+    if (!repeated) {
+        stop();
+    }
+    return 0;
+}
+
+int I2C::read(int address, char *data, int length, bool repeated)
+{
+    start();
+    if (!write(address | 1)) {
+        stop();
+        return 1;
+    }
+    for (int i = 0; i < length; i++) {
+        data[i] = (char)read(i < length - 1);
+    }
+    if (!repeated) {
+        stop();
+    }
+    return 0;
+}
+
+InterruptIn::InterruptIn(PinName pin) : pin(pin)
+{
+    interruptList().push_back(this);
+}
+
+InterruptIn::~InterruptIn()
+{
+    std::vector<InterruptIn *> &list = interruptList();
+    list.erase(std::remove(list.begin(), list.end(), this), list.end());
+}
+
+int InterruptIn::read(void)
+{
+    return !inputLow[pin];
+}
+
+unsigned short AnalogIn::read_u16(void)
+{
+    return (unsigned short)analogValue[pin];
+}
+
+Timeout::Timeout() : deadline(0), period(0), armed(false)
+{
+    timeoutList().push_back(this);
+}
+
+Timeout::~Timeout()
+{
+    std::vector<Timeout *> &list = timeoutList();
+    list.erase(std::remove(list.begin(), list.end(), this), list.end());
+}
+
+void Timeout::attach_us(Callback<void()> func, uint32_t us)
+{
+    handler = func;
+    deadline = nowUs + us;
+    period = 0;
+    armed = true;
+}
+
+void Timeout::detach(void)
+{
+    armed = false;
+}
+
+void wait(float s)
+{
+    host_advance_us((uint64_t)(s * 1000000.0f));
+}
+
+void wait_ms(int ms)
+{
+    host_advance_us((uint64_t)ms * 1000);
+}
+
+void wait_us(int us)
+{
+    host_advance_us((uint64_t)us);
+}
+
+/* mbed platform */
+
+extern "C" void mbed_assert_internal(const char *expr, const char *file, int line)
+{
+    fprintf(stderr, "assertion failed: %s, %s:%d\n", expr, file, line);
+    abort();
+}
+
+extern "C" void error(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    abort();
+}
@@ -0,0 +1,173 @@
+#ifndef __HOST_HW_H__
+#define __HOST_HW_H__
+
+/* Models of the nRF51 peripherals and mbed drivers the application uses, all
+ * running on one virtual clock. Time only moves when a test, or the
+ * application through sd_app_evt_wait(), asks for it:
+ *
+ * - RTC1 counts at 32768 Hz, its compare events fire when enabled in EVTEN
+ *   and are routed through the PPI channels assigned with sd_ppi_*.
+ * - GPIOTE tasks drive their pin, every change of a pin level is logged.
+ * - Timeout runs its callback once the clock reaches the deadline.
+ * - TWI0/1 talk to a HostI2CDevice; the TWI interrupt is run when the
+ *   application leaves its critical section or the clock moves.
+ * - InterruptIn and AnalogIn read the per-pin tables set by the test. */
+
+#include <stdint.h>
+#include <vector>
+
+#include "platform/Callback.h"
+
+/* Virtual clock */
+uint64_t host_now_us(void);
+/* Move the clock forward, running every timer, RTC compare and interrupt
+ * that falls due on the way */
+void host_advance_us(uint64_t us);
+/* Move the clock to the next timer, or by at most max_us. Returns false if
+ * nothing was due in that window */
+bool host_advance_to_next(uint64_t max_us);
+/* Run the pending peripheral interrupts */
+void host_run_irqs(void);
+/* Event register of the CPU, set by every interrupt and timer */
+void host_sev(void);
+/* WFE: returns at once if the event register is set, else moves the clock
+ * to the next timer or interrupt. Gives up after HOST_MAX_SLEEP_US with
+ * nothing scheduled, so that a missing wakeup shows up as a stalled test
+ * rather than a hang */
+#define HOST_MAX_SLEEP_US (3600ULL * 1000000)
+void host_wait_for_event(void);
+/* Back to power-on state: clock, registers, PPI, pins and timers */
+void host_hw_reset(void);
+
+/* RTC1 */
+#define HOST_RTC_HZ 32768
+uint32_t host_rtc_ticks(void);
+
+/* Pin levels as seen outside the chip, GPIOTE owned pins included */
+int host_pin_level(int pin);
+
+struct HostEdge {
+    int pin;
+    int level;
+    uint64_t tick; /* RTC ticks since reset, not wrapped */
+};
+extern std::vector<HostEdge> host_edges;
+
+/* PPI channels assigned through the SoftDevice */
+struct HostPpiChannel {
+    const volatile void *event;
+    const volatile void *task;
+};
+#define HOST_PPI_CHANNELS 16
+extern HostPpiChannel host_ppi[HOST_PPI_CHANNELS];
+extern uint32_t host_ppi_enabled;
+
+/* Number of mbed critical sections entered, nesting included */
+extern unsigned host_critical_sections;
+
+/* Level driven on an input pin, runs the InterruptIn callbacks on edges */
+void host_set_input(int pin, int level);
+/* Conversion result of the analog input on a pin, 0 - 1023: the nRF51 mbed
+ * port returns the 10-bit result from read_u16() without scaling it */
+void host_set_analog(int pin, uint16_t value);
+
+/* I2C slave on the bus, the blocking mbed I2C calls and the TWI model both
+ * end up here */
+class HostI2CDevice {
+public:
+    virtual ~HostI2CDevice() {}
+    /* START or repeated START with the address byte, false to NACK */
+    virtual bool start(uint8_t address, bool read) = 0;
+    /* false to NACK */
+    virtual bool write(uint8_t data) = 0;
+    virtual uint8_t read(void) = 0;
+    virtual void stop(void) {}
+};
+
+struct HostI2CStats {
+    unsigned transactions; /* START conditions, repeated ones included */
+    unsigned bytes;        /* address and data bytes on the wire */
+};
+extern HostI2CDevice *host_i2c_device;
+extern HostI2CStats host_i2c_stats;
+
+/* mbed drivers */
+typedef struct {
+    NRF_TWI_Type *i2c;
+} i2c_t;
+
+class I2C {
+public:
+    I2C(PinName sda, PinName scl);
+    void frequency(int hz) { (void)hz; }
+    void start(void);
+    void stop(void);
+    int read(int ack);
+    int write(int data);
+    int read(int address, char *data, int length, bool repeated = false);
+    int write(int address, const char *data, int length, bool repeated = false);
+
+protected:
+    i2c_t _i2c;
+
+private:
+    bool addressPending;
+};
+
+class InterruptIn {
+public:
+    InterruptIn(PinName pin);
+    ~InterruptIn();
+    int read(void);
+    void rise(Callback<void()> func) { riseHandler = func; }
+    void fall(Callback<void()> func) { fallHandler = func; }
+
+    PinName pin;
+    Callback<void()> riseHandler;
+    Callback<void()> fallHandler;
+};
+
+class AnalogIn {
+public:
+    AnalogIn(PinName pin) : pin(pin) {}
+    unsigned short read_u16(void);
+    /* analogin_read(): the result times the float constant 1/1023 */
+    float read(void) { return read_u16() * (1.0f / 1023); }
+    operator float() { return read(); }
+
+private:
+    PinName pin;
+};
+
+class Timeout {
+public:
+    Timeout();
+    ~Timeout();
+    void attach_us(Callback<void()> func, uint32_t us);
+    void attach(Callback<void()> func, float s) { attach_us(func, (uint32_t)(s * 1000000.0f)); }
+    template <typename T, typename M>
+    void attach_us(T *obj, M method, uint32_t us) { attach_us(Callback<void()>(obj, method), us); }
+    void detach(void);
+
+    Callback<void()> handler;
+    uint64_t deadline;
+    uint32_t period; /* Ticker only */
+    bool armed;
+};
+
+/* Timeout re-armed every period from its previous deadline */
+class Ticker : public Timeout {
+public:
+    void attach_us(Callback<void()> func, uint32_t us)
+    {
+        Timeout::attach_us(func, us);
+        period = us;
+    }
+    void attach(Callback<void()> func, float s) { attach_us(func, (uint32_t)(s * 1000000.0f)); }
+};
+
+void wait(float s);
+void wait_ms(int ms);
+void wait_us(int us);
+
+#endif /* #ifndef __HOST_HW_H__ */
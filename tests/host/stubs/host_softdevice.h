@@ -0,0 +1,121 @@
+#ifndef __HOST_SOFTDEVICE_H__
+#define __HOST_SOFTDEVICE_H__
+
+/* Test side of stubs/softdevice.cpp: the SoftDevice calls made by the code
+ * under test are counted by name, the GATT table is kept so that values and
+ * handles behave as on the target, and the GAP requests are recorded. */
+
+#include <stdint.h>
+#include <vector>
+
+#include "nrf_ble.h"
+#include "ble_gap.h"
+#include "ble_gatts.h"
+
+/* Calls of one SoftDevice function, e.g. "sd_ble_gatts_value_set" */
+unsigned host_sd_count(const char *function);
+/* Calls of every SoftDevice function */
+unsigned host_sd_total(void);
+void host_sd_reset_counts(void);
+
+/* Forget the GATT table and the recorded GAP state as well */
+void host_sd_reset(void);
+
+/* Value of an attribute as held by the stack */
+std::vector<uint8_t> host_sd_value(uint16_t handle);
+
+/* Value written by a peer, without counting a call */
+void host_sd_set_value(uint16_t handle, const uint8_t *data, uint16_t len);
+/* Value handle of the first characteristic with a 16-bit UUID, or
+ * BLE_GATT_HANDLE_INVALID */
+uint16_t host_sd_value_handle(uint16_t uuid);
+
+/* Result of the next sd_ble_gatts_hvx() calls, NRF_SUCCESS by default */
+extern uint32_t host_sd_hvx_result;
+
+struct HostHvx {
+    uint16_t handle;
+    uint8_t type;
+    std::vector<uint8_t> data;
+};
+extern std::vector<HostHvx> host_sd_notifications;
+
+/* Attributes registered since host_sd_reset(), the value bytes count the
+ * values held by the stack (BLE_GATTS_VLOC_STACK) at their maximum length */
+struct HostGattTable {
+    HostGattTable() : services(0), characteristics(0), cccds(0), valueBytes(0) {}
+    unsigned services;
+    unsigned characteristics;
+    unsigned cccds;
+    unsigned valueBytes;
+};
+extern HostGattTable host_sd_gatt;
+
+/* GAP */
+struct HostAdvertising {
+    bool running;
+    /* p_peer_addr points to peer, for directed advertising */
+    ble_gap_adv_params_t params;
+    ble_gap_addr_t peer;
+    uint64_t startedUs;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> scanResponse;
+};
+extern HostAdvertising host_sd_adv;
+
+extern std::vector<ble_gap_conn_params_t> host_sd_conn_param_updates;
+
+/* SoC: the RNG pool refills by one byte every HOST_RAND_BYTE_US (typical
+ * nRF51 figure of crypt.h), sd_ecb_block_encrypt() takes HOST_ECB_BLOCK_US */
+#define HOST_RAND_POOL_BYTES 64
+#define HOST_RAND_BYTE_US 677
+#define HOST_ECB_BLOCK_US 17
+/* Empty the RNG pool, as after drawing it dry */
+void host_sd_rand_drain(void);
+
+/* Flash: the top of the code area, where fstorage and pstorage keep their
+ * pages, is mapped at its nRF51 address so that the SDK modules read it
+ * through their own pointers. It survives host_sd_reset(), as flash survives
+ * a reset. sd_flash_write() and sd_flash_page_erase() run one at a time, take
+ * the nRF51 maximum times and end with NRF_EVT_FLASH_OPERATION_SUCCESS. A
+ * write ANDs the words into the cells, as programming does. */
+#define HOST_FLASH_START 0x30000
+#define HOST_FLASH_END 0x40000
+#define HOST_FLASH_PAGE_SIZE 1024
+#define HOST_FLASH_WORD_US 46
+#define HOST_FLASH_ERASE_US 22300
+
+struct HostFlash {
+    HostFlash() : words(0), erases(0), maxWordWrites(0) {}
+    unsigned words;         /* words programmed */
+    unsigned erases;        /* pages erased */
+    unsigned maxWordWrites; /* most writes of one word between two erases */
+};
+extern HostFlash host_sd_flash;
+/* Erases of one page, by page number */
+unsigned host_flash_page_erases(uint32_t page);
+/* Blank device: every page erased, the counters cleared */
+void host_flash_erase_all(void);
+/* Power cut: the write in flight keeps the words programmed so far, an
+ * erase in flight leaves its page as it was, and no event is delivered.
+ * The cells are shared with forked processes, which can mount them as the
+ * next boot. */
+void host_flash_power_cut(void);
+
+/* Signal SoftDevice events as the SWI2 handler does. The nRF5x port
+ * overrides it to have them handled in the next BLE::processEvents(). */
+void host_sd_signal_events(void);
+
+/* Shut the BLE instance down, forget the GATT table and initialise again */
+void host_ble_reset(void);
+
+/* Queue a SoftDevice event and signal it as the SWI2 handler does, the nRF5x
+ * port handles it in the next BLE::processEvents() */
+void host_ble_post(const ble_evt_t &event);
+/* Hand an event to the nRF5x port at once */
+void host_ble_event(ble_evt_t *event);
+/* A central writes a value: stored as the stack does, then handed to the
+ * port as BLE_GATTS_EVT_WRITE */
+void host_ble_peer_write(uint16_t handle, const uint8_t *data, uint16_t len);
+
+#endif /* #ifndef __HOST_SOFTDEVICE_H__ */
@@ -0,0 +1,39 @@
+#ifndef __HOST_MBED_H__
+#define __HOST_MBED_H__
+
+/* Host stand-in for the mbed 2 library: the platform headers which build on
+ * the host (Callback, toolchain and assert macros) are the real ones, the
+ * drivers are replaced by the models of host_hw.h. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "platform/mbed_toolchain.h"
+#include "platform/mbed_assert.h"
+#include "platform/Callback.h"
+
+#include "nrf.h"
+#include "platform/mbed_error.h"
+
+using namespace mbed;
+
+typedef enum {
+    P0_0 = 0, P0_1, P0_2, P0_3, P0_4, P0_5, P0_6, P0_7,
+    P0_8, P0_9, P0_10, P0_11, P0_12, P0_13, P0_14, P0_15,
+    P0_16, P0_17, P0_18, P0_19, P0_20, P0_21, P0_22, P0_23,
+    P0_24, P0_25, P0_26, P0_27, P0_28, P0_29, P0_30, P0_31,
+    NC = (int)0xFFFFFFFF
+} PinName;
+
+extern "C" {
+void core_util_critical_section_enter(void);
+void core_util_critical_section_exit(void);
+}
+
+#include "host_hw.h"
+
+#endif /* #ifndef __HOST_MBED_H__ */
@@ -0,0 +1,181 @@
+#ifndef __HOST_NRF_H__
+#define __HOST_NRF_H__
+
+/* Host stand-in for the nRF51 device header. The register maps only carry the
+ * fields the application and the SDK modules under test touch; FICR and UICR
+ * are read from C, the peripherals the application drives are modelled by
+ * host_hw.cpp through the write hook of HostReg. */
+
+#include <stdint.h>
+#include "nrf51_bitfields.h"
+
+/* From compiler_abstraction.h, whose GCC part reads the ARM stack pointer */
+#ifndef __INLINE
+#define __INLINE inline
+#endif
+
+typedef enum {
+    POWER_CLOCK_IRQn = 0,
+    RADIO_IRQn,
+    UART0_IRQn,
+    SPI0_TWI0_IRQn,
+    SPI1_TWI1_IRQn,
+    GPIOTE_IRQn = 6,
+    ADC_IRQn,
+    TIMER0_IRQn,
+    TIMER1_IRQn,
+    TIMER2_IRQn,
+    RTC0_IRQn,
+    TEMP_IRQn,
+    RNG_IRQn,
+    ECB_IRQn,
+    CCM_AAR_IRQn,
+    WDT_IRQn,
+    RTC1_IRQn,
+    QDEC_IRQn,
+    LPCOMP_IRQn,
+    SWI0_IRQn,
+    SWI1_IRQn,
+    SWI2_IRQn,
+    SWI3_IRQn,
+    SWI4_IRQn,
+    SWI5_IRQn
+} IRQn_Type;
+
+typedef struct {
+    uint32_t CODEPAGESIZE;
+    uint32_t CODESIZE;
+    uint32_t DEVICEID[2];
+} NRF_FICR_Type;
+
+typedef struct {
+    uint32_t CLENR0;
+    uint32_t RBPCONF;
+    uint32_t XTALFREQ;
+    uint32_t FWID;
+    uint32_t BOOTLOADERADDR;
+    uint32_t NRFFW[15];
+} NRF_UICR_Type;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern NRF_FICR_Type host_ficr;
+extern NRF_UICR_Type host_uicr;
+
+static inline void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) { (void)irq; (void)priority; }
+static inline void NVIC_EnableIRQ(IRQn_Type irq) { (void)irq; }
+static inline void NVIC_DisableIRQ(IRQn_Type irq) { (void)irq; }
+static inline void NVIC_ClearPendingIRQ(IRQn_Type irq) { (void)irq; }
+/* The vector table is kept by host_hw.cpp. Handlers are stored on 32 bits
+ * as on the target, the host build links without PIE for that. */
+void NVIC_SetPendingIRQ(IRQn_Type irq);
+void NVIC_SetVector(IRQn_Type irq, uint32_t vector);
+static inline void __WFE(void) {}
+static inline void __SEV(void) {}
+static inline void __NOP(void) {}
+
+#ifdef __cplusplus
+}
+#endif
+
+#define NRF_FICR (&host_ficr)
+#define NRF_UICR (&host_uicr)
+
+#ifdef __cplusplus
+
+/* A peripheral register: reads return the latched value, writes go through
+ * host_reg_write() so that task, set and clear registers act like hardware. */
+struct HostReg {
+    uint32_t value;
+
+    HostReg &operator=(uint32_t v);
+    HostReg &operator=(const HostReg &other) { return *this = other.value; }
+    operator uint32_t() const { return value; }
+};
+
+void host_reg_write(HostReg *reg, uint32_t value);
+
+inline HostReg &HostReg::operator=(uint32_t v)
+{
+    host_reg_write(this, v);
+    return *this;
+}
+
+typedef struct {
+    HostReg TASKS_START;
+    HostReg TASKS_STOP;
+    HostReg TASKS_CLEAR;
+    HostReg EVENTS_TICK;
+    HostReg EVENTS_OVRFLW;
+    HostReg EVENTS_COMPARE[4];
+    HostReg INTENSET;
+    HostReg INTENCLR;
+    HostReg EVTEN;
+    HostReg EVTENSET;
+    HostReg EVTENCLR;
+    HostReg COUNTER;
+    HostReg PRESCALER;
+    HostReg CC[4];
+} NRF_RTC_Type;
+
+typedef struct {
+    HostReg OUT;
+    HostReg OUTSET;
+    HostReg OUTCLR;
+    HostReg IN;
+    HostReg DIR;
+    HostReg DIRSET;
+    HostReg DIRCLR;
+    HostReg PIN_CNF[32];
+} NRF_GPIO_Type;
+
+typedef struct {
+    HostReg TASKS_OUT[4];
+    HostReg EVENTS_IN[4];
+    HostReg EVENTS_PORT;
+    HostReg INTENSET;
+    HostReg INTENCLR;
+    HostReg CONFIG[4];
+} NRF_GPIOTE_Type;
+
+typedef struct {
+    HostReg TASKS_STARTRX;
+    HostReg TASKS_STARTTX;
+    HostReg TASKS_STOP;
+    HostReg TASKS_SUSPEND;
+    HostReg TASKS_RESUME;
+    HostReg EVENTS_STOPPED;
+    HostReg EVENTS_RXDREADY;
+    HostReg EVENTS_TXDSENT;
+    HostReg EVENTS_ERROR;
+    HostReg EVENTS_BB;
+    HostReg EVENTS_SUSPENDED;
+    HostReg SHORTS;
+    HostReg INTENSET;
+    HostReg INTENCLR;
+    HostReg ERRORSRC;
+    HostReg ENABLE;
+    HostReg PSELSCL;
+    HostReg PSELSDA;
+    HostReg RXD;
+    HostReg TXD;
+    HostReg FREQUENCY;
+    HostReg ADDRESS;
+} NRF_TWI_Type;
+
+extern NRF_RTC_Type host_rtc1;
+extern NRF_GPIO_Type host_gpio;
+extern NRF_GPIOTE_Type host_gpiote;
+extern NRF_TWI_Type host_twi[2];
+
+#define NRF_RTC1   (&host_rtc1)
+#define NRF_GPIO   (&host_gpio)
+#define NRF_GPIOTE (&host_gpiote)
+#define NRF_TWI0   (&host_twi[0])
+#define NRF_TWI1   (&host_twi[1])
+
+#endif /* #ifdef __cplusplus */
+
+#endif /* #ifndef __HOST_NRF_H__ */
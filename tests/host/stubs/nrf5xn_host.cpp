@@ -0,0 +1,255 @@
+/* Host replacement of nRF5xn.cpp and btle.cpp: the SoftDevice is not
+ * enabled, events come from host_ble_post() and are dispatched from
+ * processEvents() in the same way as btle_handler() does on the target.
+ * SoC events go first to the flash modules linked in, as sys_evt_dispatch()
+ * does. */
+
+#include "mbed.h"
+#include "nRF5xn.h"
+#include "ble/blecommon.h"
+#include "btle_security.h"
+#include "ble_radio_notification.h"
+#include "ble_conn_params.h"
+#include "host_softdevice.h"
+
+#include <deque>
+
+/* Linked by the tests using the flash modules only */
+extern "C" void fs_sys_event_handler(uint32_t sys_evt) __attribute__((weak));
+extern "C" void pstorage_sys_event_handler(uint32_t sys_evt) __attribute__((weak));
+extern "C" void pstorage_posted_event_handler(void) __attribute__((weak));
+
+static nRF5xn deviceInstance;
+static std::deque<ble_evt_t> pendingEvents;
+bool isEventsSignaled = false;
+
+BLEInstanceBase *
+createBLEInstance(void)
+{
+    return &nRF5xn::Instance(BLE::DEFAULT_INSTANCE);
+}
+
+nRF5xn& nRF5xn::Instance(BLE::InstanceID_t instanceId)
+{
+    return deviceInstance;
+}
+
+nRF5xn::nRF5xn(void) :
+    initialized(false),
+    instanceID(BLE::DEFAULT_INSTANCE),
+    gapInstance(),
+    gattServerInstance(NULL),
+    gattClientInstance(NULL),
+    securityManagerInstance(NULL)
+{
+}
+
+nRF5xn::~nRF5xn(void)
+{
+}
+
+const char *nRF5xn::getVersion(void)
+{
+    return "host";
+}
+
+ble_error_t nRF5xn::init(BLE::InstanceID_t instanceID, FunctionPointerWithContext<BLE::InitializationCompleteCallbackContext *> callback)
+{
+    if (!initialized) {
+        ble_enable_params_t enableParams;
+        memset(&enableParams, 0, sizeof(enableParams));
+        sd_ble_enable(&enableParams);
+        initialized = true;
+    }
+
+    BLE::InitializationCompleteCallbackContext context = {
+        BLE::Instance(instanceID),
+        BLE_ERROR_NONE
+    };
+    callback.call(&context);
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t nRF5xn::shutdown(void)
+{
+    if (gattServerInstance != NULL) {
+        gattServerInstance->reset();
+    }
+    gapInstance.reset();
+    pendingEvents.clear();
+    isEventsSignaled = false;
+    initialized = false;
+    return BLE_ERROR_NONE;
+}
+
+void nRF5xn::waitForEvent(void)
+{
+    processEvents();
+    sd_app_evt_wait();
+}
+
+void nRF5xn::processEvents()
+{
+    if (isEventsSignaled) {
+        isEventsSignaled = false;
+        uint32_t sysEvent;
+        while (sd_evt_get(&sysEvent) == NRF_SUCCESS) {
+            if (pstorage_sys_event_handler) {
+                pstorage_sys_event_handler(sysEvent);
+            }
+            if (fs_sys_event_handler) {
+                fs_sys_event_handler(sysEvent);
+            }
+        }
+        while (!pendingEvents.empty()) {
+            ble_evt_t event = pendingEvents.front();
+            pendingEvents.pop_front();
+            host_ble_event(&event);
+        }
+        if (pstorage_posted_event_handler) {
+            pstorage_posted_event_handler();
+        }
+    }
+}
+
+/* The target resets, a test can not go on */
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+    fprintf(stderr, "app_error_handler: error 0x%lx at %s:%lu\n", (unsigned long)error_code,
+            p_file_name ? (const char *)p_file_name : "?", (unsigned long)line_num);
+    abort();
+}
+
+void host_ble_reset(void)
+{
+    BLE &ble = BLE::Instance();
+    ble.shutdown();
+    host_sd_reset();
+    ble.init();
+}
+
+void host_ble_post(const ble_evt_t &event)
+{
+    pendingEvents.push_back(event);
+    host_sd_signal_events();
+}
+
+void host_sd_signal_events(void)
+{
+    if (!isEventsSignaled) {
+        isEventsSignaled = true;
+        deviceInstance.signalEventsToProcess(BLE::DEFAULT_INSTANCE);
+    }
+    host_sev();
+}
+
+void host_ble_event(ble_evt_t *p_ble_evt)
+{
+    nRF5xGap        &gap        = (nRF5xGap &) deviceInstance.getGap();
+    nRF5xGattServer &gattServer = (nRF5xGattServer &) deviceInstance.getGattServer();
+
+    /* Library service handlers, as btle_handler() */
+    ble_conn_params_on_ble_evt(p_ble_evt);
+
+    switch (p_ble_evt->header.evt_id) {
+        case BLE_GAP_EVT_CONNECTED: {
+            Gap::Handle_t handle = p_ble_evt->evt.gap_evt.conn_handle;
+            Gap::Role_t role = static_cast<Gap::Role_t>(p_ble_evt->evt.gap_evt.params.connected.role);
+            gap.setConnectionHandle(handle);
+            const Gap::ConnectionParams_t *params = reinterpret_cast<Gap::ConnectionParams_t *>(&(p_ble_evt->evt.gap_evt.params.connected.conn_params));
+            const ble_gap_addr_t *peer = &p_ble_evt->evt.gap_evt.params.connected.peer_addr;
+            const ble_gap_addr_t *own  = &p_ble_evt->evt.gap_evt.params.connected.own_addr;
+            /* Advertising stops with the connection */
+            host_sd_adv.running = false;
+            gap.processConnectionEvent(handle,
+                                       role,
+                                       static_cast<BLEProtocol::AddressType_t>(peer->addr_type), peer->addr,
+                                       static_cast<BLEProtocol::AddressType_t>(own->addr_type),  own->addr,
+                                       params);
+            break;
+        }
+
+        case BLE_GAP_EVT_DISCONNECTED: {
+            Gap::Handle_t handle = p_ble_evt->evt.gap_evt.conn_handle;
+            gap.setConnectionHandle(BLE_CONN_HANDLE_INVALID);
+            gap.processDisconnectionEvent(handle, static_cast<Gap::DisconnectionReason_t>(p_ble_evt->evt.gap_evt.params.disconnected.reason));
+            break;
+        }
+
+        case BLE_GAP_EVT_TIMEOUT:
+            if (p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_ADVERTISING) {
+                host_sd_adv.running = false;
+            }
+            gap.processTimeoutEvent(static_cast<Gap::TimeoutSource_t>(p_ble_evt->evt.gap_evt.params.timeout.src));
+            break;
+
+        default:
+            break;
+    }
+
+    gattServer.hwCallback(p_ble_evt);
+}
+
+void host_ble_peer_write(uint16_t handle, const uint8_t *data, uint16_t len)
+{
+    /* The written bytes follow the event */
+    union {
+        ble_evt_t event;
+        uint8_t bytes[sizeof(ble_evt_t) + BLE_GATTS_VAR_ATTR_LEN_MAX];
+    } buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    ble_evt_t &event = buffer.event;
+    event.header.evt_id = BLE_GATTS_EVT_WRITE;
+    event.evt.gatts_evt.conn_handle = ((nRF5xGap &) deviceInstance.getGap()).getConnectionHandle();
+    event.evt.gatts_evt.params.write.handle = handle;
+    event.evt.gatts_evt.params.write.op = BLE_GATTS_OP_WRITE_REQ;
+    event.evt.gatts_evt.params.write.len = len;
+    memcpy(event.evt.gatts_evt.params.write.data, data, len);
+    host_sd_set_value(handle, data, len);
+    host_ble_event(&event);
+}
+
+/* btle_security.cpp, bonding is not modelled */
+
+ble_error_t btle_initializeSecurity(bool enableBonding, bool requireMITM, SecurityManager::SecurityIOCapabilities_t iocaps, const SecurityManager::Passkey_t passkey)
+{
+    return BLE_ERROR_NOT_IMPLEMENTED;
+}
+
+bool btle_hasInitializedSecurity(void)
+{
+    return false;
+}
+
+ble_error_t btle_getLinkSecurity(Gap::Handle_t connectionHandle, SecurityManager::LinkSecurityStatus_t *securityStatusP)
+{
+    *securityStatusP = SecurityManager::NOT_ENCRYPTED;
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t btle_setLinkSecurity(Gap::Handle_t connectionHandle, SecurityManager::SecurityMode_t securityMode)
+{
+    return BLE_ERROR_NOT_IMPLEMENTED;
+}
+
+ble_error_t btle_purgeAllBondingState(void)
+{
+    return BLE_ERROR_NONE;
+}
+
+bool btle_matchAddressAndIrk(ble_gap_addr_t const * p_addr, ble_gap_irk_t const * p_irk)
+{
+    return false;
+}
+
+ble_error_t btle_createWhitelistFromBondTable(ble_gap_whitelist_t *p_whitelist)
+{
+    p_whitelist->addr_count = 0;
+    p_whitelist->irk_count = 0;
+    return BLE_ERROR_NONE;
+}
+
+extern "C" uint32_t ble_radio_notification_init(nrf_app_irq_priority_t irq_priority, nrf_radio_notification_distance_t distance, ble_radio_notification_evt_handler_t evt_handler)
+{
+    return NRF_SUCCESS;
+}
@@ -0,0 +1,19 @@
+#ifndef _NRF_DELAY_H
+#define _NRF_DELAY_H
+
+/* Busy waits of the SDK, spent on the virtual clock */
+
+#include <stdint.h>
+#include "host_hw.h"
+
+static inline void nrf_delay_us(uint32_t number_of_us)
+{
+    host_advance_us(number_of_us);
+}
+
+static inline void nrf_delay_ms(uint32_t number_of_ms)
+{
+    host_advance_us((uint64_t)number_of_ms * 1000);
+}
+
+#endif /* _NRF_DELAY_H */
@@ -0,0 +1,711 @@
+#include "mbed.h"
+#include "host_softdevice.h"
+
+#include "nrf_ble.h"
+#include "ble_gap.h"
+#include "ble_gatts.h"
+#include "nrf_soc.h"
+#include "nrf_error.h"
+#include "mbedtls/aes.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <sys/mman.h>
+
+#define COUNT_CALL() countCall(__func__)
+
+/* The GAP and GATT services of the stack own the first handles */
+#define FIRST_APPLICATION_HANDLE 12
+
+struct Attribute {
+    std::vector<uint8_t> value;
+    uint16_t maxLength;
+    uint16_t uuid; /* characteristic values only */
+};
+
+static std::map<std::string, unsigned> &callCounts(void)
+{
+    static std::map<std::string, unsigned> counts;
+    return counts;
+}
+
+static std::map<uint16_t, Attribute> attributes;
+static uint16_t nextHandle = FIRST_APPLICATION_HANDLE;
+static uint8_t vendorUuidCount;
+
+struct RandPool {
+    uint8_t available;
+    uint64_t filledAt;
+    uint32_t state;
+};
+static RandPool randPool;
+
+#define FLASH_WORDS ((HOST_FLASH_END - HOST_FLASH_START) / 4)
+#define FLASH_PAGES ((HOST_FLASH_END - HOST_FLASH_START) / HOST_FLASH_PAGE_SIZE)
+
+/* Operation in flight: the source is read once it is over, as the
+ * SoftDevice reads it while programming */
+struct FlashOperation {
+    bool busy;
+    bool erase;
+    uint32_t *dst;
+    const uint32_t *src;
+    uint32_t size;
+    uint32_t page;
+    uint64_t startedUs;
+};
+static FlashOperation flashOperation;
+static std::deque<uint32_t> sysEvents;
+/* Writes of every word since the erase of its page, erases of every page */
+static uint8_t flashWordWrites[FLASH_WORDS];
+static unsigned flashPageErases[FLASH_PAGES];
+
+uint32_t host_sd_hvx_result = NRF_SUCCESS;
+std::vector<HostHvx> host_sd_notifications;
+HostAdvertising host_sd_adv;
+HostGattTable host_sd_gatt;
+HostFlash host_sd_flash;
+std::vector<ble_gap_conn_params_t> host_sd_conn_param_updates;
+
+static void countCall(const char *function)
+{
+    callCounts()[function]++;
+}
+
+unsigned host_sd_count(const char *function)
+{
+    std::map<std::string, unsigned>::const_iterator it = callCounts().find(function);
+    return (it == callCounts().end()) ? 0 : it->second;
+}
+
+unsigned host_sd_total(void)
+{
+    unsigned total = 0;
+    for (std::map<std::string, unsigned>::const_iterator it = callCounts().begin(); it != callCounts().end(); ++it) {
+        total += it->second;
+    }
+    return total;
+}
+
+void host_sd_reset_counts(void)
+{
+    callCounts().clear();
+    host_sd_notifications.clear();
+    host_sd_conn_param_updates.clear();
+}
+
+void host_sd_reset(void)
+{
+    host_sd_reset_counts();
+    attributes.clear();
+    nextHandle = FIRST_APPLICATION_HANDLE;
+    vendorUuidCount = 0;
+    host_sd_hvx_result = NRF_SUCCESS;
+    host_sd_adv = HostAdvertising();
+    host_sd_gatt = HostGattTable();
+    randPool.available = HOST_RAND_POOL_BYTES;
+    randPool.filledAt = host_now_us();
+    randPool.state = 0x2545F491;
+    flashOperation.busy = false;
+    sysEvents.clear();
+}
+
+void host_sd_rand_drain(void)
+{
+    randPool.available = 0;
+    randPool.filledAt = host_now_us();
+}
+
+std::vector<uint8_t> host_sd_value(uint16_t handle)
+{
+    return attributes[handle].value;
+}
+
+void host_sd_set_value(uint16_t handle, const uint8_t *data, uint16_t len)
+{
+    attributes[handle].value.assign(data, data + len);
+}
+
+uint16_t host_sd_value_handle(uint16_t uuid)
+{
+    for (std::map<uint16_t, Attribute>::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+        if (it->second.uuid == uuid) {
+            return it->first;
+        }
+    }
+    return BLE_GATT_HANDLE_INVALID;
+}
+
+static uint16_t addAttribute(const uint8_t *value, uint16_t length, uint16_t maxLength)
+{
+    uint16_t handle = nextHandle++;
+    Attribute &attribute = attributes[handle];
+    attribute.value.assign(value, value + (value ? length : 0));
+    if (!value) {
+        attribute.value.assign(length, 0);
+    }
+    attribute.maxLength = maxLength;
+    attribute.uuid = 0;
+    return handle;
+}
+
+/* BLE common */
+
+uint32_t sd_ble_enable(ble_enable_params_t *p_ble_enable_params)
+{
+    COUNT_CALL();
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const *p_vs_uuid, uint8_t *p_uuid_type)
+{
+    COUNT_CALL();
+    *p_uuid_type = BLE_UUID_TYPE_VENDOR_BEGIN + vendorUuidCount++;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_uuid_decode(uint8_t uuid_le_len, uint8_t const *p_uuid_le, ble_uuid_t *p_uuid)
+{
+    COUNT_CALL();
+    p_uuid->uuid = p_uuid_le[(uuid_le_len == 16) ? 12 : 0] | (p_uuid_le[(uuid_le_len == 16) ? 13 : 1] << 8);
+    p_uuid->type = (uuid_le_len == 16) ? BLE_UUID_TYPE_VENDOR_BEGIN : BLE_UUID_TYPE_BLE;
+    return NRF_SUCCESS;
+}
+
+/* GATT server */
+
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const *p_uuid, uint16_t *p_handle)
+{
+    COUNT_CALL();
+    *p_handle = addAttribute(NULL, 0, 0);
+    host_sd_gatt.services++;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_characteristic_add(uint16_t service_handle, ble_gatts_char_md_t const *p_char_md, ble_gatts_attr_t const *p_attr_char_value, ble_gatts_char_handles_t *p_handles)
+{
+    COUNT_CALL();
+    addAttribute(NULL, 0, 0); /* declaration */
+    p_handles->value_handle = addAttribute(p_attr_char_value->p_value, p_attr_char_value->init_len, p_attr_char_value->max_len);
+    attributes[p_handles->value_handle].uuid = p_attr_char_value->p_uuid->uuid;
+    p_handles->user_desc_handle = p_char_md->p_char_user_desc ? addAttribute(p_char_md->p_char_user_desc, p_char_md->char_user_desc_size, p_char_md->char_user_desc_max_size) : BLE_GATT_HANDLE_INVALID;
+    p_handles->cccd_handle = (p_char_md->char_props.notify || p_char_md->char_props.indicate) ? addAttribute(NULL, 2, 2) : BLE_GATT_HANDLE_INVALID;
+    p_handles->sccd_handle = BLE_GATT_HANDLE_INVALID;
+    host_sd_gatt.characteristics++;
+    host_sd_gatt.cccds += (p_handles->cccd_handle != BLE_GATT_HANDLE_INVALID);
+    if (p_attr_char_value->p_attr_md->vloc == BLE_GATTS_VLOC_STACK) {
+        host_sd_gatt.valueBytes += p_attr_char_value->max_len;
+    }
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_descriptor_add(uint16_t char_handle, ble_gatts_attr_t const *p_attr, uint16_t *p_handle)
+{
+    COUNT_CALL();
+    *p_handle = addAttribute(p_attr->p_value, p_attr->init_len, p_attr->max_len);
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value)
+{
+    COUNT_CALL();
+    std::map<uint16_t, Attribute>::iterator it = attributes.find(handle);
+    if (it == attributes.end()) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+    if (p_value->offset + p_value->len > it->second.maxLength) {
+        return NRF_ERROR_DATA_SIZE;
+    }
+    std::vector<uint8_t> &value = it->second.value;
+    value.resize(p_value->offset);
+    value.insert(value.end(), p_value->p_value, p_value->p_value + p_value->len);
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_value_get(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value)
+{
+    COUNT_CALL();
+    std::map<uint16_t, Attribute>::iterator it = attributes.find(handle);
+    if (it == attributes.end()) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+    const std::vector<uint8_t> &value = it->second.value;
+    uint16_t length = (value.size() > p_value->offset) ? (uint16_t)(value.size() - p_value->offset) : 0;
+    if (p_value->p_value != NULL) {
+        length = (length < p_value->len) ? length : p_value->len;
+        memcpy(p_value->p_value, &value[0] + p_value->offset, length);
+    }
+    p_value->len = length;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const *p_hvx_params)
+{
+    COUNT_CALL();
+    if (host_sd_hvx_result != NRF_SUCCESS) {
+        return host_sd_hvx_result;
+    }
+
+    HostHvx hvx;
+    hvx.handle = p_hvx_params->handle;
+    hvx.type = p_hvx_params->type;
+    if (p_hvx_params->p_data != NULL) {
+        hvx.data.assign(p_hvx_params->p_data, p_hvx_params->p_data + *p_hvx_params->p_len);
+        ble_gatts_value_t value = {*p_hvx_params->p_len, p_hvx_params->offset, p_hvx_params->p_data};
+        std::vector<uint8_t> &stored = attributes[p_hvx_params->handle].value;
+        stored.resize(value.offset);
+        stored.insert(stored.end(), value.p_value, value.p_value + value.len);
+    }
+    host_sd_notifications.push_back(hvx);
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_rw_authorize_reply(uint16_t conn_handle, ble_gatts_rw_authorize_reply_params_t const *p_rw_authorize_reply_params)
+{
+    COUNT_CALL();
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_sys_attr_set(uint16_t conn_handle, uint8_t const *p_sys_attr_data, uint16_t len, uint32_t flags)
+{
+    COUNT_CALL();
+    return NRF_SUCCESS;
+}
+
+/* GATT client, the device only acts as a server */
+
+uint32_t sd_ble_gattc_primary_services_discover(uint16_t conn_handle, uint16_t start_handle, ble_uuid_t const *p_srvc_uuid)
+{
+    COUNT_CALL();
+    return NRF_ERROR_NOT_SUPPORTED;
+}
+
+uint32_t sd_ble_gattc_characteristics_discover(uint16_t conn_handle, ble_gattc_handle_range_t const *p_handle_range)
+{
+    COUNT_CALL();
+    return NRF_ERROR_NOT_SUPPORTED;
+}
+
+uint32_t sd_ble_gattc_descriptors_discover(uint16_t conn_handle, ble_gattc_handle_range_t const *p_handle_range)
+{
+    COUNT_CALL();
+    return NRF_ERROR_NOT_SUPPORTED;
+}
+
+uint32_t sd_ble_gattc_char_value_by_uuid_read(uint16_t conn_handle, ble_uuid_t const *p_uuid, ble_gattc_handle_range_t const *p_handle_range)
+{
+    COUNT_CALL();
+    return NRF_ERROR_NOT_SUPPORTED;
+}
+
+uint32_t sd_ble_gattc_read(uint16_t conn_handle, uint16_t handle, uint16_t offset)
+{
+    COUNT_CALL();
+    return NRF_ERROR_NOT_SUPPORTED;
+}
+
+uint32_t sd_ble_gattc_write(uint16_t conn_handle, ble_gattc_write_params_t const *p_write_params)
+{
+    COUNT_CALL();
+    return NRF_ERROR_NOT_SUPPORTED;
+}
+
+/* GAP */
+
+uint32_t sd_ble_gap_address_set(uint8_t addr_cycle_mode, const ble_gap_addr_t *p_addr)
+{
+    COUNT_CALL();
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_address_get(ble_gap_addr_t *p_addr)
+{
+    COUNT_CALL();
+    static const uint8_t address[BLE_GAP_ADDR_LEN] = {0x01, 0x02, 0x03, 0x04, 0x05, 0xC6};
+    p_addr->addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+    memcpy(p_addr->addr, address, sizeof(address));
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_data_set(uint8_t const *p_data, uint8_t dlen, uint8_t const *p_sr_data, uint8_t srdlen)
+{
+    COUNT_CALL();
+    if ((dlen > BLE_GAP_ADV_MAX_SIZE) || (srdlen > BLE_GAP_ADV_MAX_SIZE)) {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (p_data != NULL) {
+        host_sd_adv.data.assign(p_data, p_data + dlen);
+    }
+    if (p_sr_data != NULL) {
+        host_sd_adv.scanResponse.assign(p_sr_data, p_sr_data + srdlen);
+    }
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_start(ble_gap_adv_params_t const *p_adv_params)
+{
+    COUNT_CALL();
+    if (host_sd_adv.running) {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    host_sd_adv.running = true;
+    host_sd_adv.params = *p_adv_params;
+    if (p_adv_params->p_peer_addr != NULL) {
+        host_sd_adv.peer = *p_adv_params->p_peer_addr;
+        host_sd_adv.params.p_peer_addr = &host_sd_adv.peer;
+    }
+    host_sd_adv.startedUs = host_now_us();
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_stop(void)
+{
+    COUNT_CALL();
+    if (!host_sd_adv.running) {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    host_sd_adv.running = false;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_conn_param_update(uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params)
+{
+    COUNT_CALL();
+    host_sd_conn_param_updates.push_back(*p_conn_params);
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code)
+{
+    COUNT_CALL();
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_tx_power_set(int8_t tx_power)
+{
+    COUNT_CALL();
+    return NRF_SUCCESS;
+}
+
+static uint16_t appearance;
+
+uint32_t sd_ble_gap_appearance_set(uint16_t value)
+{
+    COUNT_CALL();
+    appearance = value;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_appearance_get(uint16_t *p_appearance)
+{
+    COUNT_CALL();
+    *p_appearance = appearance;
+    return NRF_SUCCESS;
+}
+
+static ble_gap_conn_params_t preferredConnectionParams;
+
+uint32_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params)
+{
+    COUNT_CALL();
+    preferredConnectionParams = *p_conn_params;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_ppcp_get(ble_gap_conn_params_t *p_conn_params)
+{
+    COUNT_CALL();
+    *p_conn_params = preferredConnectionParams;
+    return NRF_SUCCESS;
+}
+
+static std::vector<uint8_t> deviceName;
+
+uint32_t sd_ble_gap_device_name_set(ble_gap_conn_sec_mode_t const *p_write_perm, uint8_t const *p_dev_name, uint16_t len)
+{
+    COUNT_CALL();
+    deviceName.assign(p_dev_name, p_dev_name + len);
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_device_name_get(uint8_t *p_dev_name, uint16_t *p_len)
+{
+    COUNT_CALL();
+    uint16_t length = (deviceName.size() < *p_len) ? (uint16_t)deviceName.size() : *p_len;
+    if (length) {
+        memcpy(p_dev_name, &deviceName[0], length);
+    }
+    *p_len = length;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_scan_start(ble_gap_scan_params_t const *p_scan_params)
+{
+    COUNT_CALL();
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_scan_stop(void)
+{
+    COUNT_CALL();
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_connect(ble_gap_addr_t const *p_peer_addr, ble_gap_scan_params_t const *p_scan_params, ble_gap_conn_params_t const *p_conn_params)
+{
+    COUNT_CALL();
+    return NRF_SUCCESS;
+}
+
+/* SoC */
+
+uint32_t sd_ppi_channel_assign(uint8_t channel_num, const volatile void *evt_endpoint, const volatile void *task_endpoint)
+{
+    COUNT_CALL();
+    host_ppi[channel_num].event = evt_endpoint;
+    host_ppi[channel_num].task = task_endpoint;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ppi_channel_enable_set(uint32_t channel_enable_set_msk)
+{
+    COUNT_CALL();
+    host_ppi_enabled |= channel_enable_set_msk;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ppi_channel_enable_clr(uint32_t channel_enable_clr_msk)
+{
+    COUNT_CALL();
+    host_ppi_enabled &= ~channel_enable_clr_msk;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_app_evt_wait(void)
+{
+    COUNT_CALL();
+    host_wait_for_event();
+    return NRF_SUCCESS;
+}
+
+/* The RNG fills the pool in the background, one byte every
+ * HOST_RAND_BYTE_US. The bytes are a fixed xorshift sequence. */
+static void fillRandPool(void)
+{
+    uint64_t now = host_now_us();
+    if (now < randPool.filledAt) {
+        randPool.filledAt = now;
+    }
+    uint64_t bytes = (now - randPool.filledAt) / HOST_RAND_BYTE_US;
+    if (randPool.available + bytes >= HOST_RAND_POOL_BYTES) {
+        randPool.available = HOST_RAND_POOL_BYTES;
+        randPool.filledAt = now;
+    } else {
+        randPool.available += bytes;
+        randPool.filledAt += bytes * HOST_RAND_BYTE_US;
+    }
+}
+
+uint32_t sd_rand_application_pool_capacity_get(uint8_t *p_pool_capacity)
+{
+    COUNT_CALL();
+    *p_pool_capacity = HOST_RAND_POOL_BYTES;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_rand_application_bytes_available_get(uint8_t *p_bytes_available)
+{
+    COUNT_CALL();
+    fillRandPool();
+    *p_bytes_available = randPool.available;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_rand_application_vector_get(uint8_t *p_buff, uint8_t length)
+{
+    COUNT_CALL();
+    fillRandPool();
+    if (length > randPool.available) {
+        return NRF_ERROR_SOC_RAND_NOT_ENOUGH_VALUES;
+    }
+    if (randPool.available == HOST_RAND_POOL_BYTES) {
+        randPool.filledAt = host_now_us();
+    }
+    randPool.available -= length;
+    for (uint8_t i = 0; i < length; i++) {
+        randPool.state ^= randPool.state << 13;
+        randPool.state ^= randPool.state >> 17;
+        randPool.state ^= randPool.state << 5;
+        p_buff[i] = (uint8_t)randPool.state;
+    }
+    return NRF_SUCCESS;
+}
+
+/* AES-128 of the ECB peripheral */
+uint32_t sd_ecb_block_encrypt(nrf_ecb_hal_data_t *p_ecb_data)
+{
+    COUNT_CALL();
+    mbedtls_aes_context aes;
+    mbedtls_aes_init(&aes);
+    mbedtls_aes_setkey_enc(&aes, p_ecb_data->key, 128);
+    mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, p_ecb_data->cleartext, p_ecb_data->ciphertext);
+    mbedtls_aes_free(&aes);
+    host_advance_us(HOST_ECB_BLOCK_US);
+    return NRF_SUCCESS;
+}
+
+/* Flash */
+
+/* Shared, so that a forked process sees the same cells */
+static uint32_t *mapFlash(void)
+{
+    void *flash = mmap((void *)HOST_FLASH_START, HOST_FLASH_END - HOST_FLASH_START, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (flash != (void *)HOST_FLASH_START) {
+        fprintf(stderr, "flash: can not map 0x%x-0x%x\n", HOST_FLASH_START, HOST_FLASH_END);
+        abort();
+    }
+    memset(flash, 0xFF, HOST_FLASH_END - HOST_FLASH_START);
+    return (uint32_t *)flash;
+}
+
+static uint32_t *const flashCells = mapFlash();
+
+static void onFlashDone(void);
+static Timeout flashTimer;
+
+void host_sd_signal_events(void) __attribute__((weak));
+void host_sd_signal_events(void)
+{
+    host_sev();
+}
+
+/* Pending SD_EVT_IRQn runs the SWI2 handler, as a SoftDevice event does */
+uint32_t sd_nvic_SetPendingIRQ(IRQn_Type IRQn)
+{
+    COUNT_CALL();
+    if (IRQn == SD_EVT_IRQn) {
+        host_sd_signal_events();
+    } else {
+        NVIC_SetPendingIRQ(IRQn);
+    }
+    return NRF_SUCCESS;
+}
+
+static bool isFlashAddress(uintptr_t address, uint32_t bytes)
+{
+    return address >= HOST_FLASH_START && address + bytes <= HOST_FLASH_END;
+}
+
+uint32_t sd_flash_write(uint32_t *const p_dst, uint32_t const *const p_src, uint32_t size)
+{
+    COUNT_CALL();
+    if (((uintptr_t)p_dst & 3) || ((uintptr_t)p_src & 3)) {
+        return NRF_ERROR_INVALID_ADDR;
+    }
+    if (size == 0 || size > HOST_FLASH_PAGE_SIZE / 4) {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (!isFlashAddress((uintptr_t)p_dst, size * 4)) {
+        return NRF_ERROR_FORBIDDEN;
+    }
+    if (flashOperation.busy) {
+        return NRF_ERROR_BUSY;
+    }
+    flashOperation.busy = true;
+    flashOperation.erase = false;
+    flashOperation.dst = p_dst;
+    flashOperation.src = p_src;
+    flashOperation.size = size;
+    flashOperation.startedUs = host_now_us();
+    flashTimer.attach_us(callback(onFlashDone), size * HOST_FLASH_WORD_US);
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_flash_page_erase(uint32_t page_number)
+{
+    COUNT_CALL();
+    if (!isFlashAddress(page_number * HOST_FLASH_PAGE_SIZE, HOST_FLASH_PAGE_SIZE)) {
+        return NRF_ERROR_FORBIDDEN;
+    }
+    if (flashOperation.busy) {
+        return NRF_ERROR_BUSY;
+    }
+    flashOperation.busy = true;
+    flashOperation.erase = true;
+    flashOperation.page = page_number;
+    flashOperation.startedUs = host_now_us();
+    flashTimer.attach_us(callback(onFlashDone), HOST_FLASH_ERASE_US);
+    return NRF_SUCCESS;
+}
+
+/* Words [first, first + count) of the write in flight */
+static void programWords(uint32_t first, uint32_t count)
+{
+    size_t cell = flashOperation.dst - flashCells;
+    for (uint32_t i = first; i < first + count; i++) {
+        flashCells[cell + i] &= flashOperation.src[i];
+        if (++flashWordWrites[cell + i] > host_sd_flash.maxWordWrites) {
+            host_sd_flash.maxWordWrites = flashWordWrites[cell + i];
+        }
+    }
+    host_sd_flash.words += count;
+}
+
+static void onFlashDone(void)
+{
+    if (!flashOperation.busy) {
+        return;
+    }
+    flashOperation.busy = false;
+    if (flashOperation.erase) {
+        uint32_t first = flashOperation.page * HOST_FLASH_PAGE_SIZE - HOST_FLASH_START;
+        memset((uint8_t *)flashCells + first, 0xFF, HOST_FLASH_PAGE_SIZE);
+        memset(flashWordWrites + first / 4, 0, HOST_FLASH_PAGE_SIZE / 4);
+        flashPageErases[first / HOST_FLASH_PAGE_SIZE]++;
+        host_sd_flash.erases++;
+    } else {
+        programWords(0, flashOperation.size);
+    }
+    sysEvents.push_back(NRF_EVT_FLASH_OPERATION_SUCCESS);
+    host_sd_signal_events();
+}
+
+/* Polled by the port on every signal, not counted */
+uint32_t sd_evt_get(uint32_t *p_evt_id)
+{
+    if (sysEvents.empty()) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+    *p_evt_id = sysEvents.front();
+    sysEvents.pop_front();
+    return NRF_SUCCESS;
+}
+
+unsigned host_flash_page_erases(uint32_t page)
+{
+    uint32_t first = HOST_FLASH_START / HOST_FLASH_PAGE_SIZE;
+    return (page >= first && page - first < FLASH_PAGES) ? flashPageErases[page - first] : 0;
+}
+
+void host_flash_erase_all(void)
+{
+    flashOperation.busy = false;
+    flashTimer.detach();
+    memset(flashCells, 0xFF, HOST_FLASH_END - HOST_FLASH_START);
+    memset(flashWordWrites, 0, sizeof(flashWordWrites));
+    memset(flashPageErases, 0, sizeof(flashPageErases));
+    host_sd_flash = HostFlash();
+}
+
+void host_flash_power_cut(void)
+{
+    if (flashOperation.busy && !flashOperation.erase) {
+        uint64_t words = (host_now_us() - flashOperation.startedUs) / HOST_FLASH_WORD_US;
+        programWords(0, (words < flashOperation.size) ? (uint32_t)words : flashOperation.size);
+    }
+    flashOperation.busy = false;
+    flashTimer.detach();
+    sysEvents.clear();
+}
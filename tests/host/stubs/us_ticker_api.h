@@ -0,0 +1,13 @@
+#ifndef __HOST_US_TICKER_API_H__
+#define __HOST_US_TICKER_API_H__
+
+#include <stdint.h>
+
+/* Microseconds of the virtual clock of host_hw.h, wrapping like the RTC
+ * backed ticker of the target */
+#ifdef __cplusplus
+extern "C"
+#endif
+uint32_t us_ticker_read(void);
+
+#endif /* #ifndef __HOST_US_TICKER_API_H__ */
@@ -0,0 +1,185 @@
+/* AccelSensorService in interrupt mode against a simulated MMA8452Q: the
+ * motion engine programming and the INT1 acknowledge on the TWI interrupt. */
+
+#define ACCEL_MOTION_INTERRUPT 1
+#define ACCEL_INT_PIN P0_23
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "AccelSensorService.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+#include "mma8452q_model.h"
+
+static Mma8452qModel chip(ACCEL_INT_PIN);
+
+static void setUp(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+    chip.reset();
+    host_i2c_device = &chip;
+}
+
+static bool wrote(uint8_t reg, uint8_t value)
+{
+    for (size_t i = 0; i < chip.writes.size(); i++) {
+        if ((chip.writes[i].first == reg) && (chip.writes[i].second == value)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* TRANSIENT engine set up in standby, routed to INT1, then back to active */
+static void test_start_programs_the_transient_engine(void)
+{
+    setUp();
+    AccelSensorService service(BLE::Instance());
+    service.start();
+
+    CHECK(chip.refusedWrites.empty());
+    CHECK(chip.active());
+    CHECK_EQUAL(TRANSIENT_CFG_ANY, chip.regs[TRANSIENT_CFG]);
+    CHECK_EQUAL(ACCEL_MOTION_THRESHOLD, chip.regs[TRANSIENT_THS]);
+    CHECK_EQUAL(ACCEL_MOTION_DEBOUNCE, chip.regs[TRANSIENT_COUNT]);
+    CHECK_EQUAL(INT_TRANS, chip.regs[CTRL_REG4]);
+    CHECK_EQUAL(INT_TRANS, chip.regs[CTRL_REG5]);
+    CHECK(chip.regs[CTRL_REG1] & CTRL_REG1_F_READ);
+    CHECK(wrote(TRANSIENT_CFG, TRANSIENT_CFG_ANY));
+
+    /* The engine registers are written between a standby and an active */
+    size_t standby = chip.writes.size(), config = 0, active = 0;
+    for (size_t i = 0; i < chip.writes.size(); i++) {
+        if (chip.writes[i].first == TRANSIENT_CFG) {
+            config = i;
+        }
+    }
+    for (size_t i = 0; i < config; i++) {
+        if ((chip.writes[i].first == CTRL_REG1) && !(chip.writes[i].second & CTRL_REG1_ACTIVE)) {
+            standby = i;
+        }
+    }
+    for (size_t i = config; i < chip.writes.size(); i++) {
+        if ((chip.writes[i].first == CTRL_REG1) && (chip.writes[i].second & CTRL_REG1_ACTIVE)) {
+            active = i;
+            break;
+        }
+    }
+    CHECK(standby < config);
+    CHECK(config < active);
+
+    /* Nothing latched: INT1 high, no report */
+    CHECK_EQUAL(1, host_pin_level(ACCEL_INT_PIN));
+    CHECK(!service.updateAccelDetection());
+}
+
+/* INT1 falls, the TWI interrupt reads the source register and releases it */
+static void test_motion_is_acknowledged_from_the_twi_interrupt(void)
+{
+    setUp();
+    AccelSensorService service(BLE::Instance());
+    service.start();
+
+    int sourceReads = chip.sourceReads;
+    host_i2c_stats.transactions = 0;
+    chip.motion();
+    host_run_irqs();
+
+    CHECK(!chip.intAsserted());
+    CHECK_EQUAL(1, host_pin_level(ACCEL_INT_PIN));
+    CHECK_EQUAL(sourceReads + 1, chip.sourceReads);
+    /* One register read: write phase and repeated start */
+    CHECK_EQUAL(2, host_i2c_stats.transactions);
+
+    CHECK(service.updateAccelDetection());
+    CHECK_EQUAL(1, service.getAccelDetection());
+    CHECK(!service.updateAccelDetection());
+
+    /* A second event is reported again */
+    chip.motion();
+    host_run_irqs();
+    CHECK(service.updateAccelDetection());
+}
+
+static void latchAgain(void)
+{
+    chip.motion();
+}
+
+/* An event latched right after the clearing read of enableMotionDetection()
+ * sends its edge before the handler is attached, start() services it */
+static void test_event_latched_before_attach_is_serviced(void)
+{
+    setUp();
+    AccelSensorService service(BLE::Instance());
+    chip.onSourceRead = latchAgain;
+    service.start();
+    CHECK(chip.onSourceRead == NULL);
+    host_run_irqs();
+
+    CHECK(!chip.intAsserted());
+    CHECK_EQUAL(1, host_pin_level(ACCEL_INT_PIN));
+    CHECK(service.updateAccelDetection());
+}
+
+/* INT1 left low by failed acknowledge reads is picked up by the main loop */
+static void test_failed_acknowledge_is_retried(void)
+{
+    setUp();
+    AccelSensorService service(BLE::Instance());
+    service.start();
+
+    /* The first read and every retry from the interrupt are NACKed */
+    chip.nackAddress = 1 + ACCEL_ACK_RETRIES;
+    chip.motion();
+    host_run_irqs();
+    CHECK(chip.intAsserted());
+    CHECK(!service.updateAccelDetection());
+
+    /* The level check in updateAccelDetection() queued a new read */
+    host_run_irqs();
+    CHECK(!chip.intAsserted());
+    CHECK(service.updateAccelDetection());
+}
+
+/* The FF_MT engine through the blocking API */
+static void test_ff_mt_engine_blocking(void)
+{
+    setUp();
+    AccelSensor sensor(P0_22, P0_20);
+    sensor.init();
+    CHECK(!sensor.readMotionEvent());
+
+    sensor.enableMotionDetection(AccelSensor::MOTION_FF_MT, 0xFF, 2);
+    CHECK(chip.refusedWrites.empty());
+    CHECK(chip.active());
+    CHECK_EQUAL(FF_MT_CFG_MOTION, chip.regs[FF_MT_CFG]);
+    CHECK_EQUAL(THS_MASK, chip.regs[FF_MT_THS]);
+    CHECK_EQUAL(2, chip.regs[FF_MT_COUNT]);
+    CHECK_EQUAL(INT_FF_MT, chip.regs[CTRL_REG4]);
+    CHECK_EQUAL(INT_FF_MT, chip.regs[CTRL_REG5]);
+
+    chip.motion();
+    CHECK_EQUAL(0, host_pin_level(ACCEL_INT_PIN));
+    CHECK(sensor.readMotionEvent());
+    CHECK_EQUAL(1, host_pin_level(ACCEL_INT_PIN));
+    CHECK(!sensor.readMotionEvent());
+
+    /* Disabled: events no longer reach INT1 */
+    sensor.disableMotionDetection();
+    CHECK(chip.refusedWrites.empty());
+    chip.motion();
+    CHECK_EQUAL(1, host_pin_level(ACCEL_INT_PIN));
+    CHECK(!sensor.readMotionEvent());
+}
+
+int main(void)
+{
+    RUN_TEST(test_start_programs_the_transient_engine);
+    RUN_TEST(test_motion_is_acknowledged_from_the_twi_interrupt);
+    RUN_TEST(test_event_latched_before_attach_is_serviced);
+    RUN_TEST(test_failed_acknowledge_is_retried);
+    RUN_TEST(test_ff_mt_engine_blocking);
+    return TEST_RESULT();
+}
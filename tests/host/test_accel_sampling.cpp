@@ -0,0 +1,234 @@
+/* AccelSensor and AccelSensorService in sampling mode against a simulated
+ * MMA8452Q: bus cost of the two acquisition paths and the TWI queue. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "AccelSensorService.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+#include "mma8452q_model.h"
+
+/* Standard mode, 9 clocks per byte */
+#define I2C_HZ 100000
+
+static Mma8452qModel chip;
+
+static void setUp(void)
+{
+    host_hw_reset();
+    chip.reset();
+    host_i2c_device = &chip;
+}
+
+static void resetStats(void)
+{
+    host_i2c_stats.transactions = 0;
+    host_i2c_stats.bytes = 0;
+}
+
+static void reportSample(const char *path)
+{
+    REPORT("%-15s %u transactions, %u bytes, %u us on the bus at %d kHz\n", path,
+           host_i2c_stats.transactions, host_i2c_stats.bytes,
+           host_i2c_stats.bytes * 9 * 1000000 / I2C_HZ, I2C_HZ / 1000);
+}
+
+/* readData() bursts the six OUT registers, readData8() only the MSBs */
+static void test_fast_read_halves_the_data_bytes(void)
+{
+    setUp();
+    AccelSensor sensor(P0_22, P0_20);
+    sensor.init();
+    chip.setSample(-1000, 5, 2047);
+
+    resetStats();
+    int full[3];
+    sensor.readData(full);
+    reportSample("readData");
+    CHECK_EQUAL(2, host_i2c_stats.transactions);
+    CHECK_EQUAL(3 + 6, host_i2c_stats.bytes);
+    CHECK_EQUAL(-1000, full[0]);
+    CHECK_EQUAL(5, full[1]);
+    CHECK_EQUAL(2047, full[2]);
+
+    sensor.setFastRead(true);
+    CHECK(chip.refusedWrites.empty());
+    CHECK(chip.active());
+
+    resetStats();
+    int8_t fast[3];
+    sensor.readData8(fast);
+    reportSample("readData8");
+    CHECK_EQUAL(2, host_i2c_stats.transactions);
+    CHECK_EQUAL(3 + 3, host_i2c_stats.bytes);
+    CHECK_EQUAL(-1000 >> 4, fast[0]);
+    CHECK_EQUAL(5 >> 4, fast[1]);
+    CHECK_EQUAL(2047 >> 4, fast[2]);
+
+    /* Same burst from the TWI interrupt */
+    TwiTransaction transfer;
+    char raw[3];
+    resetStats();
+    CHECK(sensor.readData8Async(transfer, raw, NULL));
+    host_run_irqs();
+    reportSample("readData8Async");
+    CHECK_EQUAL(TwiTransaction::DONE, transfer.status);
+    CHECK_EQUAL(2, host_i2c_stats.transactions);
+    CHECK_EQUAL(3 + 3, host_i2c_stats.bytes);
+    CHECK_EQUAL(-1000 >> 4, (int8_t)raw[0]);
+    CHECK_EQUAL(2047 >> 4, (int8_t)raw[2]);
+
+    /* Back to full reads */
+    sensor.setFastRead(false);
+    sensor.readData(full);
+    CHECK_EQUAL(-1000, full[0]);
+}
+
+struct Completion {
+    TwiTransaction *transfer[8];
+    int count;
+};
+static Completion completed;
+
+static void onDone(TwiTransaction *transfer)
+{
+    completed.transfer[completed.count++] = transfer;
+}
+
+/* Queued transactions run one after the other from the TWI interrupt, in
+ * submission order, each completed with its callback */
+static void test_queue_runs_transactions_in_order(void)
+{
+    setUp();
+    AccelSensor sensor(P0_22, P0_20);
+    sensor.init();
+    sensor.setFastRead(true);
+    chip.setSample(160, -160, 320);
+    completed.count = 0;
+
+    TwiTransaction write, read, sample;
+    char threshold = 0x55, out, raw[3];
+    core_util_critical_section_enter();
+    CHECK(sensor.bus().busy() == false);
+    CHECK(sensor.writeRegisterAsync(write, TRANSIENT_THS, &threshold, onDone));
+    CHECK(sensor.readRegistersAsync(read, TRANSIENT_THS, 1, &out, onDone));
+    CHECK(sensor.readData8Async(sample, raw, onDone));
+    /* Already queued */
+    CHECK(!sensor.readData8Async(sample, raw, onDone));
+    CHECK(sensor.bus().busy());
+    CHECK_EQUAL(0, completed.count);
+    core_util_critical_section_exit();
+
+    CHECK(!sensor.bus().busy());
+    CHECK_EQUAL(3, completed.count);
+    CHECK(completed.transfer[0] == &write);
+    CHECK(completed.transfer[1] == &read);
+    CHECK(completed.transfer[2] == &sample);
+    CHECK_EQUAL(TwiTransaction::DONE, write.status);
+    CHECK_EQUAL(TwiTransaction::DONE, read.status);
+    CHECK_EQUAL(TwiTransaction::DONE, sample.status);
+    /* Written in active mode: refused by the chip but acknowledged */
+    CHECK_EQUAL(1, chip.refusedWrites.size());
+    CHECK_EQUAL(0, out);
+    CHECK_EQUAL(10, (int8_t)raw[0]);
+    CHECK_EQUAL(-10, (int8_t)raw[1]);
+    CHECK_EQUAL(20, (int8_t)raw[2]);
+
+    /* The TWI interrupt is left disabled for the blocking calls */
+    CHECK_EQUAL(0, host_twi[0].INTENSET.value);
+    int8_t blocking[3];
+    sensor.readData8(blocking);
+    CHECK_EQUAL(20, blocking[2]);
+}
+
+static TwiTransaction chained;
+static char chainedRaw[3];
+static AccelSensor *chainSensor;
+
+static void onDoneResubmit(TwiTransaction *transfer)
+{
+    onDone(transfer);
+    if (completed.count < 3) {
+        chainSensor->readData8Async(chained, chainedRaw, onDoneResubmit);
+    }
+}
+
+/* A NACKed transaction fails without holding up the queue, and callbacks
+ * may queue the next transfer */
+static void test_queue_survives_nack_and_chains(void)
+{
+    setUp();
+    AccelSensor sensor(P0_22, P0_20);
+    sensor.init();
+    sensor.setFastRead(true);
+    chip.setSample(16, 32, 48);
+    completed.count = 0;
+
+    TwiTransaction nacked;
+    char raw[3];
+    chip.nackAddress = 1;
+    core_util_critical_section_enter();
+    sensor.readData8Async(nacked, raw, onDone);
+    chainSensor = &sensor;
+    sensor.readData8Async(chained, chainedRaw, onDoneResubmit);
+    core_util_critical_section_exit();
+
+    CHECK(!sensor.bus().busy());
+    CHECK_EQUAL(TwiTransaction::FAILED, nacked.status);
+    CHECK_EQUAL(TwiTransaction::DONE, chained.status);
+    CHECK_EQUAL(3, completed.count);
+    CHECK(completed.transfer[0] == &nacked);
+    CHECK(completed.transfer[2] == &chained);
+    CHECK_EQUAL(3, chainedRaw[2]);
+}
+
+static AccelSensorService *sampler;
+static bool detectedMidTransfer;
+
+static void consumeMidTransfer(uint8_t reg)
+{
+    /* The main loop runs between two bytes of the next sample, X already
+     * stored by the TWI interrupt */
+    if (reg == OUT_X_MSB + 2) {
+        chip.onRead = NULL;
+        detectedMidTransfer = sampler->updateAccelDetection();
+    }
+}
+
+/* A sample is consumed from its own copy, not from the buffer the next
+ * transfer is filling */
+static void test_sample_is_consumed_from_a_completed_transfer(void)
+{
+    setUp();
+    host_ble_reset();
+    AccelSensorService service(BLE::Instance());
+    sampler = &service;
+    chip.setSample(0, 0, 0);
+    service.start();
+
+    /* Still at rest */
+    service.requestSample();
+    CHECK(!service.updateAccelDetection());
+
+    /* Completed but not consumed, then the next one starts with motion */
+    service.requestSample();
+    chip.setSample(1000, 1000, 1000);
+    chip.onRead = consumeMidTransfer;
+    detectedMidTransfer = true;
+    service.requestSample();
+    CHECK(chip.onRead == NULL);
+    CHECK(!detectedMidTransfer);
+
+    /* The motion sample once complete */
+    CHECK(service.updateAccelDetection());
+    CHECK(!service.updateAccelDetection());
+}
+
+int main(void)
+{
+    RUN_TEST(test_fast_read_halves_the_data_bytes);
+    RUN_TEST(test_queue_runs_transactions_in_order);
+    RUN_TEST(test_queue_survives_nack_and_chains);
+    RUN_TEST(test_sample_is_consumed_from_a_completed_transfer);
+    return TEST_RESULT();
+}
@@ -0,0 +1,437 @@
+/* AdvertisingScheduler on the virtual clock against the SoftDevice stub:
+ * advertising events sent per hour and what reaches the stack, then the
+ * time a phone takes to reconnect with and without ReconnectionAdvertiser. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "TimerWheel.h"
+#include "AdvertisingScheduler.h"
+#include "ReconnectionAdvertiser.h"
+#include "host_softdevice.h"
+#include "ble_hci.h"
+#include "host_test.h"
+
+/* Default table of main.cpp */
+static const AdvertisingStep backoff[] = {
+    { 80, 30000 },
+    { 418, 120000 },
+    { 1022, 600000 },
+    { 2000, 0 }
+};
+#define BACKOFF_STEPS (sizeof(backoff) / sizeof(backoff[0]))
+
+#define MINUTE_US (60ULL * 1000000)
+#define HOUR_US (60 * MINUTE_US)
+/* advDelay, 0 - 10 ms of pseudo-random delay added to every event */
+#define ADV_DELAY_MEAN_US 5000
+
+/* Advertising events sent by the stack so far, the interval being the one
+ * given to the last sd_ble_gap_adv_start() */
+struct Radio {
+    Radio() : events(0), lastUs(host_now_us()) {}
+
+    void account()
+    {
+        uint64_t now = host_now_us();
+        if (host_sd_adv.running) {
+            uint64_t periodUs = host_sd_adv.params.interval * 625ULL + ADV_DELAY_MEAN_US;
+            events += (double)(now - lastUs) / periodUs;
+        }
+        lastUs = now;
+    }
+
+    double events;
+    uint64_t lastUs;
+};
+
+static void setUp(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+}
+
+static void startAdvertising(void)
+{
+    Gap &gap = BLE::Instance().gap();
+    gap.setAdvertisingType(GapAdvertisingParams::ADV_CONNECTABLE_UNDIRECTED);
+    gap.startAdvertising();
+}
+
+/* Main loop: timers, then sleep until the next one */
+static void run(RtcTimerWheel &wheel, Radio &radio, uint64_t us)
+{
+    uint64_t end = host_now_us() + us;
+    while (host_now_us() < end) {
+        wheel.poll();
+        radio.account();
+        host_advance_to_next(end - host_now_us());
+        radio.account();
+    }
+    wheel.poll();
+}
+
+static const uint8_t phoneAddress[BLE_GAP_ADDR_LEN] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+static void connect(void)
+{
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id = BLE_GAP_EVT_CONNECTED;
+    event.evt.gap_evt.conn_handle = 1;
+    event.evt.gap_evt.params.connected.role = BLE_GAP_ROLE_PERIPH;
+    event.evt.gap_evt.params.connected.peer_addr.addr_type = BLE_GAP_ADDR_TYPE_PUBLIC;
+    memcpy(event.evt.gap_evt.params.connected.peer_addr.addr, phoneAddress, BLE_GAP_ADDR_LEN);
+    host_ble_event(&event);
+}
+
+static void disconnect(void)
+{
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id = BLE_GAP_EVT_DISCONNECTED;
+    event.evt.gap_evt.conn_handle = 1;
+    event.evt.gap_evt.params.disconnected.reason = BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION;
+    host_ble_event(&event);
+}
+
+/* Parked for an hour: the table is walked down once */
+static void test_parked_hour(void)
+{
+    setUp();
+    RtcTimerWheel wheel;
+    wheel.start();
+    AdvertisingScheduler scheduler(wheel, backoff, BACKOFF_STEPS);
+    scheduler.start(BLE::Instance().gap());
+    startAdvertising();
+    CHECK_EQUAL(80 * 1000 / 625, host_sd_adv.params.interval);
+
+    host_sd_reset_counts();
+    Radio radio;
+    run(wheel, radio, HOUR_US);
+
+    /* Fixed 80 ms, as before the scheduler */
+    double fixed = (double)HOUR_US / (80000 + ADV_DELAY_MEAN_US);
+    /* 30 s at 80 ms, 2 min at 418 ms, 10 min at 1022 ms, the rest at 2 s */
+    double expected = 30e6 / (80000 + ADV_DELAY_MEAN_US) + 120e6 / (418125 + ADV_DELAY_MEAN_US) +
+                      600e6 / (1021875 + ADV_DELAY_MEAN_US) + (3600e6 - 750e6) / (2000000 + ADV_DELAY_MEAN_US);
+    REPORT("parked hour: %.0f advertising events (%.0f at a fixed 80 ms, %.1f%%)\n",
+           radio.events, fixed, 100.0 * radio.events / fixed);
+    CHECK_EQUAL(BACKOFF_STEPS - 1, scheduler.getStep());
+    CHECK_EQUAL(2000 * 1000 / 625, host_sd_adv.params.interval);
+    CHECK(host_sd_adv.running);
+    /* One restart per step change */
+    CHECK_EQUAL(BACKOFF_STEPS - 1, host_sd_count("sd_ble_gap_adv_stop"));
+    CHECK_EQUAL(BACKOFF_STEPS - 1, host_sd_count("sd_ble_gap_adv_start"));
+    /* Step changes land on 31.25 ms ticks */
+    CHECK(radio.events > expected * 0.995);
+    CHECK(radio.events < expected * 1.005);
+}
+
+/* Activity every 10 minutes keeps the first steps in use */
+static void test_hour_with_activity(void)
+{
+    setUp();
+    RtcTimerWheel wheel;
+    wheel.start();
+    AdvertisingScheduler scheduler(wheel, backoff, BACKOFF_STEPS);
+    scheduler.start(BLE::Instance().gap());
+    startAdvertising();
+
+    Radio radio;
+    for (int i = 0; i < 6; i++) {
+        run(wheel, radio, 10 * MINUTE_US);
+        CHECK_EQUAL(2, scheduler.getStep());
+        scheduler.trigger();
+        CHECK_EQUAL(0, scheduler.getStep());
+        CHECK_EQUAL(80 * 1000 / 625, host_sd_adv.params.interval);
+    }
+    REPORT("hour with activity every 10 min: %.0f advertising events\n", radio.events);
+
+    /* Triggering again within the fast step only extends it */
+    host_sd_reset_counts();
+    scheduler.trigger();
+    CHECK_EQUAL(0, host_sd_count("sd_ble_gap_adv_start"));
+}
+
+/* While connected only the interval changes, the restart on disconnection
+ * picks it up */
+static void test_connected_steps_do_not_advertise(void)
+{
+    setUp();
+    RtcTimerWheel wheel;
+    wheel.start();
+    AdvertisingScheduler scheduler(wheel, backoff, BACKOFF_STEPS);
+    scheduler.start(BLE::Instance().gap());
+    startAdvertising();
+
+    connect();
+    CHECK(!host_sd_adv.running);
+    host_sd_reset_counts();
+    Radio radio;
+    run(wheel, radio, 15 * MINUTE_US);
+    CHECK_EQUAL(BACKOFF_STEPS - 1, scheduler.getStep());
+    CHECK_EQUAL(0, host_sd_count("sd_ble_gap_adv_start"));
+    CHECK_EQUAL(0, host_sd_count("sd_ble_gap_adv_stop"));
+    CHECK(radio.events == 0);
+
+    disconnect();
+    scheduler.trigger();
+    startAdvertising();
+    CHECK(host_sd_adv.running);
+    CHECK_EQUAL(80 * 1000 / 625, host_sd_adv.params.interval);
+}
+
+/* Phone calling back after a disconnection, scanning as Android does in its
+ * balanced mode. It sends a connection request on the first advertising
+ * packet it receives. */
+#define PHONE_SCAN_WINDOW_US 1024000ULL
+#define PHONE_SCAN_INTERVAL_US 4096000ULL
+#define PHONE_PHASES 32
+/* High duty cycle directed advertising, stopped by the stack after 1.28 s */
+#define DIRECTED_PERIOD_US 3750ULL
+#define DIRECTED_BURST_US 1280000ULL
+
+struct Phone {
+    Phone(uint64_t _phaseUs) : phaseUs(_phaseUs) {}
+
+    bool scanning(uint64_t us) const
+    {
+        return (us + phaseUs) % PHONE_SCAN_INTERVAL_US < PHONE_SCAN_WINDOW_US;
+    }
+
+    /* First instant at or after us the phone scans */
+    uint64_t scanStartUs(uint64_t us) const
+    {
+        if (scanning(us)) {
+            return us;
+        }
+        return us + PHONE_SCAN_INTERVAL_US - (us + phaseUs) % PHONE_SCAN_INTERVAL_US;
+    }
+
+    uint64_t phaseUs;
+};
+
+static bool directed(void)
+{
+    return host_sd_adv.running && (host_sd_adv.params.type == BLE_GAP_ADV_TYPE_ADV_DIRECT_IND);
+}
+
+/* First advertising packet sent at or after now */
+static uint64_t nextPacketUs(void)
+{
+    uint64_t periodUs = directed() ? DIRECTED_PERIOD_US : host_sd_adv.params.interval * 625ULL + ADV_DELAY_MEAN_US;
+    uint64_t elapsed = host_now_us() - host_sd_adv.startedUs;
+    return host_sd_adv.startedUs + (elapsed + periodUs - 1) / periodUs * periodUs;
+}
+
+static void advertisingTimeout(void)
+{
+    host_sd_adv.running = false;
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id = BLE_GAP_EVT_TIMEOUT;
+    event.evt.gap_evt.params.timeout.src = BLE_GAP_TIMEOUT_SRC_ADVERTISING;
+    host_ble_event(&event);
+}
+
+/* Time from the disconnection to the connection request, and from the
+ * phone starting to scan to the connection request */
+struct Reconnection {
+    Reconnection() : connected(false), latencyUs(0), waitUs(0), duringBurst(false) {}
+
+    bool connected;
+    uint64_t latencyUs;
+    uint64_t waitUs;
+    bool duringBurst;
+};
+
+/* Disconnection callback of main.cpp, then the main loop until the phone
+ * connects */
+static Reconnection reconnect(RtcTimerWheel &wheel, AdvertisingScheduler &scheduler, ReconnectionAdvertiser *reconnection,
+                              const Phone &phone)
+{
+    disconnect();
+    scheduler.trigger();
+    if (reconnection != NULL) {
+        reconnection->restartAdvertising();
+    } else {
+        startAdvertising();
+    }
+
+    Reconnection result;
+    uint64_t start = host_now_us();
+    while (host_now_us() - start < 10 * PHONE_SCAN_INTERVAL_US) {
+        wheel.poll();
+        wheel.schedule();
+        if (directed() && host_now_us() >= host_sd_adv.startedUs + DIRECTED_BURST_US) {
+            advertisingTimeout();
+            continue;
+        }
+        if (!host_sd_adv.running) {
+            host_advance_to_next(10 * PHONE_SCAN_INTERVAL_US);
+            continue;
+        }
+        uint64_t packet = nextPacketUs();
+        if (packet == host_now_us() && phone.scanning(packet)) {
+            result.connected = true;
+            result.duringBurst = directed();
+            result.latencyUs = host_now_us() - start;
+            result.waitUs = host_now_us() - phone.scanStartUs(start);
+            connect();
+            break;
+        }
+        host_advance_to_next((packet > host_now_us()) ? packet - host_now_us() : 1);
+    }
+    return result;
+}
+
+struct Latency {
+    Latency() : failures(0), totalUs(0), worstUs(0), burstConnections(0), worstBurstWaitUs(0), worstWaitUs(0) {}
+
+    void add(const Reconnection &reconnection)
+    {
+        if (!reconnection.connected) {
+            failures++;
+            return;
+        }
+        totalUs += reconnection.latencyUs;
+        worstUs = (reconnection.latencyUs > worstUs) ? reconnection.latencyUs : worstUs;
+        worstWaitUs = (reconnection.waitUs > worstWaitUs) ? reconnection.waitUs : worstWaitUs;
+        if (reconnection.duringBurst) {
+            burstConnections++;
+            worstBurstWaitUs = (reconnection.waitUs > worstBurstWaitUs) ? reconnection.waitUs : worstBurstWaitUs;
+        }
+    }
+
+    uint64_t meanUs() const
+    {
+        return totalUs / PHONE_PHASES;
+    }
+
+    unsigned failures;
+    uint64_t totalUs;
+    uint64_t worstUs;
+    unsigned burstConnections;
+    uint64_t worstBurstWaitUs;
+    uint64_t worstWaitUs;
+};
+
+/* Reconnection over the phases of the phone's scan against the moment of
+ * the disconnection, from the fast step of the table */
+static Latency reconnectionLatency(bool withReconnectionAdvertiser)
+{
+    Latency latency;
+    for (unsigned i = 0; i < PHONE_PHASES; i++) {
+        setUp();
+        RtcTimerWheel wheel;
+        wheel.start();
+        ReconnectionAdvertiser reconnection(wheel);
+        AdvertisingScheduler scheduler(wheel, backoff, BACKOFF_STEPS);
+        reconnection.start(BLE::Instance().gap());
+        scheduler.start(BLE::Instance().gap(), withReconnectionAdvertiser ? &reconnection : NULL);
+        startAdvertising();
+        connect();
+        reconnection.peerAuthenticated();
+
+        /* Scan phase at the disconnection, spread over the scan interval */
+        uint64_t now = host_now_us() % PHONE_SCAN_INTERVAL_US;
+        Phone phone((i * (PHONE_SCAN_INTERVAL_US / PHONE_PHASES) + PHONE_SCAN_INTERVAL_US - now) % PHONE_SCAN_INTERVAL_US);
+        latency.add(reconnect(wheel, scheduler, withReconnectionAdvertiser ? &reconnection : NULL, phone));
+    }
+    return latency;
+}
+
+static void reportLatency(const char *name, const Latency &latency)
+{
+    REPORT("%-22s mean %4llu ms, worst %4llu ms, worst %3llu ms once the phone scans, %2u of %d in the burst\n",
+           name, (unsigned long long)latency.meanUs() / 1000, (unsigned long long)latency.worstUs / 1000,
+           (unsigned long long)latency.worstWaitUs / 1000, latency.burstConnections, PHONE_PHASES);
+}
+
+static void test_reconnection_latency(void)
+{
+    Latency plain = reconnectionLatency(false);
+    Latency callBack = reconnectionLatency(true);
+    REPORT("reconnection over %d phases of a %llu/%llu ms scan:\n", PHONE_PHASES,
+           PHONE_SCAN_WINDOW_US / 1000, PHONE_SCAN_INTERVAL_US / 1000);
+    reportLatency("undirected at 80 ms", plain);
+    reportLatency("directed burst first", callBack);
+    CHECK_EQUAL(0, plain.failures);
+    CHECK_EQUAL(0, callBack.failures);
+    CHECK_EQUAL(0, plain.burstConnections);
+    /* The phone scanning within 1.28 s gets in on one of the burst packets,
+     * at 80 ms one packet may come and go before it scans */
+    CHECK(callBack.burstConnections > 0);
+    CHECK(callBack.worstBurstWaitUs <= DIRECTED_PERIOD_US);
+    CHECK(plain.worstWaitUs <= 80000 + ADV_DELAY_MEAN_US);
+    CHECK(callBack.totalUs <= plain.totalUs);
+    /* Once the burst is over advertising restarts at 80 ms, out of step with
+     * the undirected advertising by up to one interval */
+    CHECK(callBack.worstUs <= plain.worstUs + 80000 + ADV_DELAY_MEAN_US);
+}
+
+/* A step change during the directed burst or the whitelisted stage only
+ * changes the interval, the stages run their course and the open
+ * advertising uses the new interval */
+static void test_step_change_keeps_the_directed_burst(void)
+{
+    static const AdvertisingStep shortFirst[] = {
+        { 80, 500 },
+        { 418, 5000 },
+        { 1022, 0 }
+    };
+    setUp();
+    RtcTimerWheel wheel;
+    wheel.start();
+    ReconnectionAdvertiser reconnection(wheel);
+    AdvertisingScheduler scheduler(wheel, shortFirst, sizeof(shortFirst) / sizeof(shortFirst[0]));
+    reconnection.start(BLE::Instance().gap());
+    scheduler.start(BLE::Instance().gap(), &reconnection);
+    startAdvertising();
+    connect();
+    reconnection.peerAuthenticated();
+    disconnect();
+    scheduler.trigger();
+    reconnection.restartAdvertising();
+    CHECK(directed());
+    CHECK(memcmp(phoneAddress, host_sd_adv.peer.addr, BLE_GAP_ADDR_LEN) == 0);
+
+    /* Through the first step change, the burst goes on */
+    host_sd_reset_counts();
+    Radio radio;
+    run(wheel, radio, DIRECTED_BURST_US - 1);
+    CHECK_EQUAL(1, scheduler.getStep());
+    CHECK(directed());
+    CHECK_EQUAL(0, host_sd_count("sd_ble_gap_adv_stop"));
+    CHECK_EQUAL(0, host_sd_count("sd_ble_gap_adv_start"));
+
+    /* Whitelisted stage at the interval of the current step, the next step
+     * change leaves it alone */
+    host_advance_us(1);
+    advertisingTimeout();
+    CHECK_EQUAL(ReconnectionAdvertiser::STAGE_WHITELIST, reconnection.getStage());
+    CHECK_EQUAL(418 * 1000 / 625, host_sd_adv.params.interval);
+    CHECK_EQUAL(BLE_GAP_ADV_FP_FILTER_CONNREQ, host_sd_adv.params.fp);
+    run(wheel, radio, 6000000);
+    CHECK_EQUAL(2, scheduler.getStep());
+    CHECK_EQUAL(ReconnectionAdvertiser::STAGE_WHITELIST, reconnection.getStage());
+    CHECK_EQUAL(1, host_sd_count("sd_ble_gap_adv_start"));
+
+    /* Open advertising at the interval of the last step */
+    run(wheel, radio, RECONNECT_WHITELIST_TIME * 1000ULL);
+    CHECK_EQUAL(ReconnectionAdvertiser::STAGE_OPEN, reconnection.getStage());
+    CHECK(host_sd_adv.running);
+    CHECK_EQUAL(BLE_GAP_ADV_FP_ANY, host_sd_adv.params.fp);
+    CHECK_EQUAL(1022 * 1000 / 625, host_sd_adv.params.interval);
+    CHECK_EQUAL(2, host_sd_count("sd_ble_gap_adv_start"));
+}
+
+int main(void)
+{
+    RUN_TEST(test_parked_hour);
+    RUN_TEST(test_hour_with_activity);
+    RUN_TEST(test_connected_steps_do_not_advertise);
+    RUN_TEST(test_reconnection_latency);
+    RUN_TEST(test_step_change_keeps_the_directed_burst);
+    return TEST_RESULT();
+}
@@ -0,0 +1,289 @@
+/* Registration of the GATT database as bleInitComplete() does it: the
+ * compile-time layout of GattLayout.h against what reaches the stack, the
+ * RAM the static instances save over the heap, and what comes before the
+ * first advertisement with the sensor brought up before or after it. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "TimerWheel.h"
+#include "RELAYService.h"
+#include "ALARMService.h"
+#include "ble/services/BatteryService.h"
+#include "InternalValuesService.h"
+#include "ImobStateService.h"
+#include "AccelSensorService.h"
+#include "StatusService.h"
+#include "GattLayout.h"
+#include "StaticInstance.h"
+#include "BootProfiler.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+#include "mma8452q_model.h"
+
+#include <vector>
+
+/* As main.cpp */
+#define GATT_SERVICES(SERVICE) \
+    SERVICE(ImobStateService) \
+    SERVICE(InternalValuesService) \
+    SERVICE(RELAYService) \
+    SERVICE(ALARMService) \
+    SERVICE(AccelSensorService) \
+    SERVICE(BatteryService) \
+    SERVICE(StatusService)
+
+#define LAYOUT_SERVICES(Service) + 1
+#define LAYOUT_CCCDS(Service) + Service::CCCD_COUNT
+#define LAYOUT_VALUE_BYTES(Service) + Service::VALUE_BYTES
+
+static const char DEVICE_NAME[] = "I-Mob";
+static const uint16_t uuid16_list[] = {ImobStateService::IMOB_STATE_SERVICE_UUID, RELAYService::RELAY_SERVICE_UUID, ALARMService::ALARM_SERVICE_UUID, InternalValuesService::INTERNAL_VALUES_SERVICE_UUID, AccelSensorService::ACCEL_SENSOR_SERVICE_UUID, GattService::UUID_BATTERY_SERVICE};
+
+/* mbed I2C default, 9 clocks per byte with the acknowledge */
+#define I2C_HZ 100000
+#define I2C_BYTE_US(bytes) ((bytes) * 9ULL * 1000000 / I2C_HZ)
+
+static Mma8452qModel chip;
+static uint8_t batteryLevel;
+
+static void setUp(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+    chip.reset();
+    host_i2c_device = &chip;
+    host_i2c_stats = HostI2CStats();
+    host_sd_reset_counts();
+}
+
+/* The services of main.cpp, in static storage */
+struct StaticServices {
+    void construct(BLE &ble, TimerWheel &wheel)
+    {
+        imobPtr = imob.construct(ble);
+        internalValuesPtr = internalValues.construct(ble, imobPtr);
+        relay.construct(ble, imobPtr, wheel);
+        alarm.construct(ble);
+        accelPtr = accel.construct(ble);
+        battery.construct(ble, batteryLevel);
+        status.construct(ble);
+    }
+
+    StaticInstance<ImobStateService> imob;
+    StaticInstance<InternalValuesService> internalValues;
+    StaticInstance<RELAYService> relay;
+    StaticInstance<ALARMService> alarm;
+    StaticInstance<AccelSensorService> accel;
+    StaticInstance<BatteryService> battery;
+    StaticInstance<StatusService> status;
+    ImobStateService *imobPtr;
+    InternalValuesService *internalValuesPtr;
+    AccelSensorService *accelPtr;
+};
+
+/* The database described at compile time is the one registered */
+static void test_layout_matches_the_stack(void)
+{
+    setUp();
+    RtcTimerWheel wheel;
+    StaticServices services;
+    services.construct(BLE::Instance(), wheel);
+
+    CHECK_EQUAL(0 GATT_SERVICES(LAYOUT_SERVICES), host_sd_gatt.services);
+    CHECK_EQUAL(GATT_TOTAL_CHARACTERISTICS(GATT_SERVICES), host_sd_gatt.characteristics);
+    CHECK_EQUAL(0 GATT_SERVICES(LAYOUT_CCCDS), host_sd_gatt.cccds);
+    CHECK_EQUAL(0 GATT_SERVICES(LAYOUT_VALUE_BYTES), host_sd_gatt.valueBytes);
+    REPORT("%u services, %u characteristics, %u CCCDs, %u value bytes: %u of %u attribute table bytes\n",
+           host_sd_gatt.services, host_sd_gatt.characteristics, host_sd_gatt.cccds, host_sd_gatt.valueBytes,
+           (unsigned)GATT_TOTAL_ATTR_TAB_SIZE(GATT_SERVICES), (unsigned)GATT_ATTR_TAB_DEFAULT_SIZE);
+}
+
+/* newlib-nano malloc: a 4 byte size header, chunks of 8 bytes, 16 at least */
+static size_t mallocChunk(size_t size)
+{
+    size_t chunk = (size + 4 + 7) & ~(size_t)7;
+    return (chunk < 16) ? 16 : chunk;
+}
+
+#define SERVICE_SIZE(Service) + sizeof(Service)
+#define SERVICE_CHUNK(Service) + mallocChunk(sizeof(Service))
+#define SERVICE_STATIC(Service) + sizeof(StaticInstance<Service>)
+
+/* The same services with new, as before, took a heap chunk each: the
+ * static instances hold the object and a pointer instead */
+static void test_static_against_heap(void)
+{
+    size_t serviceBytes = 0 GATT_SERVICES(SERVICE_SIZE);
+    size_t chunkBytes = 0 GATT_SERVICES(SERVICE_CHUNK);
+    size_t staticBytes = 0 GATT_SERVICES(SERVICE_STATIC);
+    REPORT("7 services, %u bytes of objects on this host\n", (unsigned)serviceBytes);
+    REPORT("heap: %u bytes of newlib-nano chunks, static: %u bytes of .bss\n", (unsigned)chunkBytes,
+           (unsigned)staticBytes);
+    /* Alignment and the pointer at most, per instance */
+    CHECK(staticBytes - serviceBytes <= 7 * 2 * sizeof(uint64_t));
+    CHECK(chunkBytes - serviceBytes <= 7 * 2 * sizeof(uint64_t));
+}
+
+struct Boot {
+    uint64_t advertisingUs;
+    unsigned sdCalls;
+    unsigned i2cBytes;
+    std::vector<uint8_t> profile;
+};
+
+/* The blocking I2C sequence of the sensor, the clock moved by its bus time */
+static void startSensor(AccelSensorService *accel)
+{
+    unsigned before = host_i2c_stats.bytes;
+    accel->start();
+    host_advance_us(I2C_BYTE_US(host_i2c_stats.bytes - before));
+}
+
+/* bleInitComplete() and main() up to the main loop, the sensor started
+ * before advertising or after it, the profile published as main() does */
+static Boot boot(bool sensorFirst)
+{
+    setUp();
+    RtcTimerWheel wheel;
+    StaticServices services;
+    BLE &ble = BLE::Instance();
+    BootProfiler profiler;
+    profiler.start();
+    uint64_t startUs = host_now_us();
+    profiler.mark(BOOT_STAGE_STACK);
+    services.construct(ble, wheel);
+    profiler.mark(BOOT_STAGE_GATT);
+    if (sensorFirst) {
+        startSensor(services.accelPtr);
+        profiler.mark(BOOT_STAGE_SENSOR);
+    }
+    ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::BREDR_NOT_SUPPORTED | GapAdvertisingData::LE_GENERAL_DISCOVERABLE);
+    ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::COMPLETE_LIST_16BIT_SERVICE_IDS, (uint8_t *)uuid16_list, sizeof(uuid16_list));
+    ble.gap().accumulateScanResponse(GapAdvertisingData::COMPLETE_LOCAL_NAME, (uint8_t *)DEVICE_NAME, sizeof(DEVICE_NAME));
+    ble.gap().setAdvertisingType(GapAdvertisingParams::ADV_CONNECTABLE_UNDIRECTED);
+    ble.gap().startAdvertising();
+    profiler.mark(BOOT_STAGE_ADVERTISING);
+
+    Boot result;
+    result.advertisingUs = host_sd_adv.startedUs - startUs;
+    result.sdCalls = host_sd_total();
+    result.i2cBytes = host_i2c_stats.bytes;
+    CHECK(host_sd_adv.running);
+
+    profiler.mark(BOOT_STAGE_STATE);
+    if (!sensorFirst) {
+        startSensor(services.accelPtr);
+        profiler.mark(BOOT_STAGE_SENSOR);
+    }
+    profiler.mark(BOOT_STAGE_PERIPHERALS);
+    CHECK(profiler.isComplete());
+    services.internalValuesPtr->updateBootProfile(profiler.getProfile());
+    result.profile = host_sd_value(host_sd_value_handle(InternalValuesService::BOOT_PROFILE_CHARACTERISTIC_UUID));
+    return result;
+}
+
+/* Entries of a profile that are out of order, against the stages expected */
+static int wrongStages(const std::vector<uint8_t> &profile, const BootStage expected[BOOT_STAGE_COUNT])
+{
+    int wrong = 0;
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        wrong += profile[i * BOOT_PROFILE_ENTRY_LEN] != expected[i];
+    }
+    return wrong;
+}
+
+static uint32_t durationOf(const std::vector<uint8_t> &profile, BootStage stage)
+{
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        const uint8_t *entry = &profile[i * BOOT_PROFILE_ENTRY_LEN];
+        if (entry[0] == stage) {
+            return (entry[1] << 16) | (entry[2] << 8) | entry[3];
+        }
+    }
+    return BOOT_PROFILE_MAX_US + 1;
+}
+
+/* Deferring the sensor keeps the I2C traffic out of the way to the first
+ * advertisement. The stub stack takes no time, the bus time is counted at
+ * the mbed I2C default. */
+static void test_boot_to_first_advertisement(void)
+{
+    Boot deferred = boot(false);
+    Boot sensorFirst = boot(true);
+    REPORT("deferred sensor: %u SoftDevice calls, %u I2C bytes, %llu us to the first advertisement\n",
+           deferred.sdCalls, deferred.i2cBytes, (unsigned long long)deferred.advertisingUs);
+    REPORT("sensor first: %u SoftDevice calls, %u I2C bytes, %llu us to the first advertisement\n",
+           sensorFirst.sdCalls, sensorFirst.i2cBytes,
+           (unsigned long long)sensorFirst.advertisingUs);
+    CHECK_EQUAL(0, deferred.i2cBytes);
+    CHECK_EQUAL(0, deferred.advertisingUs);
+    CHECK_EQUAL(I2C_BYTE_US(sensorFirst.i2cBytes), sensorFirst.advertisingUs);
+    CHECK(sensorFirst.i2cBytes > 0);
+    CHECK_EQUAL(deferred.sdCalls, sensorFirst.sdCalls);
+}
+
+/* Stages recorded in the order they complete, with their duration, and
+ * published in the boot profile characteristic */
+static void test_stage_ordering(void)
+{
+    static const BootStage deferredOrder[BOOT_STAGE_COUNT] = {
+        BOOT_STAGE_STACK, BOOT_STAGE_GATT, BOOT_STAGE_ADVERTISING,
+        BOOT_STAGE_STATE, BOOT_STAGE_SENSOR, BOOT_STAGE_PERIPHERALS
+    };
+    static const BootStage sensorFirstOrder[BOOT_STAGE_COUNT] = {
+        BOOT_STAGE_STACK, BOOT_STAGE_GATT, BOOT_STAGE_SENSOR,
+        BOOT_STAGE_ADVERTISING, BOOT_STAGE_STATE, BOOT_STAGE_PERIPHERALS
+    };
+    Boot deferred = boot(false);
+    Boot sensorFirst = boot(true);
+    CHECK_EQUAL(BOOT_PROFILE_LEN, deferred.profile.size());
+    CHECK_EQUAL(0, wrongStages(deferred.profile, deferredOrder));
+    CHECK_EQUAL(0, wrongStages(sensorFirst.profile, sensorFirstOrder));
+    CHECK_EQUAL(I2C_BYTE_US(sensorFirst.i2cBytes), durationOf(deferred.profile, BOOT_STAGE_SENSOR));
+    CHECK_EQUAL(I2C_BYTE_US(sensorFirst.i2cBytes), durationOf(sensorFirst.profile, BOOT_STAGE_SENSOR));
+    CHECK_EQUAL(0, durationOf(deferred.profile, BOOT_STAGE_ADVERTISING));
+
+    /* A read at the default ATT MTU returns 22 bytes, five whole entries:
+     * the last one comes with the Read Blob at offset 22 */
+    const unsigned readBytes = BLE_GATT_MTU_SIZE_DEFAULT - 1;
+    CHECK(BOOT_PROFILE_LEN > readBytes);
+    CHECK_EQUAL(5, readBytes / BOOT_PROFILE_ENTRY_LEN);
+    REPORT("profile of %u bytes: %u in the first read, %u with a Read Blob\n", (unsigned)BOOT_PROFILE_LEN,
+           readBytes, (unsigned)BOOT_PROFILE_LEN - readBytes);
+}
+
+/* Marks after the first of a stage are ignored, a stage longer than 24 bits
+ * of us saturates, and the us_ticker wrapping is harmless */
+static void test_profiler_marks(void)
+{
+    host_hw_reset();
+    /* Just before the 32-bit us_ticker wraps */
+    host_advance_us(0xFFFFFFFFULL - 1000);
+    BootProfiler profiler;
+    profiler.start();
+    host_advance_us(3000);
+    profiler.mark(BOOT_STAGE_STACK);
+    host_advance_us(500);
+    profiler.mark(BOOT_STAGE_STACK);
+    CHECK(profiler.isMarked(BOOT_STAGE_STACK));
+    CHECK(!profiler.isMarked(BOOT_STAGE_GATT));
+    host_advance_us(20000000);
+    profiler.mark(BOOT_STAGE_GATT);
+
+    std::vector<uint8_t> profile(profiler.getProfile(), profiler.getProfile() + BOOT_PROFILE_LEN);
+    CHECK_EQUAL(3000, durationOf(profile, BOOT_STAGE_STACK));
+    CHECK_EQUAL(BOOT_PROFILE_MAX_US, durationOf(profile, BOOT_STAGE_GATT));
+    CHECK_EQUAL(BOOT_STAGE_NONE, profile[2 * BOOT_PROFILE_ENTRY_LEN]);
+    CHECK(!profiler.isComplete());
+    CHECK_EQUAL(20003500, profiler.getTotalUs());
+}
+
+int main(void)
+{
+    RUN_TEST(test_layout_matches_the_stack);
+    RUN_TEST(test_static_against_heap);
+    RUN_TEST(test_boot_to_first_advertisement);
+    RUN_TEST(test_stage_ordering);
+    RUN_TEST(test_profiler_marks);
+    return TEST_RESULT();
+}
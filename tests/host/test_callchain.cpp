@@ -0,0 +1,235 @@
+/* CallChainOfFunctionPointersWithContext with inline storage against the heap
+ * allocated list: same call order, same behaviour when callbacks detach
+ * during call(), no allocation, dispatch time and the full chain query. */
+
+#include "mbed.h"
+#include "ble/Gap.h"
+#include "ble/GattServer.h"
+#include "host_test.h"
+
+#include <chrono>
+#include <new>
+#include <stdlib.h>
+#include <vector>
+
+/* Allocations made by the process, for the heap comparison */
+static unsigned allocations;
+static size_t allocatedBytes;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    allocatedBytes += size;
+    void *p = malloc(size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) throw()
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) throw()
+{
+    free(p);
+}
+
+/* Callback recording its id, detaching `target` (possibly itself) or adding
+ * `added` on its first call */
+template <typename Chain>
+struct Node {
+    Node() : id(0), sequence(NULL), chain(NULL), target(NULL), added(NULL) {}
+
+    void onEvent(int context)
+    {
+        sequence->push_back(id);
+        if (target != NULL) {
+            chain->detach(FunctionPointerWithContext<int>(target, &Node::onEvent));
+            target = NULL;
+        }
+        if (added != NULL) {
+            chain->add(added, &Node::onEvent);
+            added = NULL;
+        }
+    }
+
+    int id;
+    std::vector<int> *sequence;
+    Chain *chain;
+    Node *target;
+    Node *added;
+};
+
+#define NODES 5
+
+typedef CallChainOfFunctionPointersWithContext<int> HeapChain;
+typedef CallChainOfFunctionPointersWithContext<int, NODES> InlineChain;
+
+/* Nodes 0 to 3 added in order, so called 3, 2, 1, 0. `actor` detaches
+ * `target` in the first pass, or adds node 4 if target is -1. Returns both
+ * passes. */
+template <typename Chain>
+static std::vector<int> detachDuringCall(int actor, int target)
+{
+    Chain chain;
+    Node<Chain> nodes[NODES];
+    std::vector<int> sequence;
+    for (int i = 0; i < NODES; i++) {
+        nodes[i].id = i;
+        nodes[i].sequence = &sequence;
+        nodes[i].chain = &chain;
+    }
+    for (int i = 0; i < NODES - 1; i++) {
+        chain.add(&nodes[i], &Node<Chain>::onEvent);
+    }
+    if (target >= 0) {
+        nodes[actor].target = &nodes[target];
+    } else {
+        nodes[actor].added = &nodes[NODES - 1];
+    }
+    chain.call(0);
+    sequence.push_back(-1);
+    chain.call(0);
+    return sequence;
+}
+
+static std::vector<int> passes(const int *ids, size_t count)
+{
+    return std::vector<int>(ids, ids + count);
+}
+
+static void test_detach_during_call(void)
+{
+    struct Case {
+        const char *name;
+        int actor;
+        int target;
+        int expected[10];
+        size_t count;
+    };
+    static const Case cases[] = {
+        /* 3 2 1 0, then without the detached one */
+        { "head detaches itself", 3, 3, { 3, 2, 1, 0, -1, 2, 1, 0 }, 8 },
+        { "middle detaches itself", 2, 2, { 3, 2, 1, 0, -1, 3, 1, 0 }, 8 },
+        { "last detaches itself", 0, 0, { 3, 2, 1, 0, -1, 3, 2, 1 }, 8 },
+        { "detaches the next one", 2, 1, { 3, 2, 0, -1, 3, 2, 0 }, 7 },
+        { "detaches a called one", 1, 3, { 3, 2, 1, 0, -1, 2, 1, 0 }, 8 },
+        { "detaches the last one", 3, 0, { 3, 2, 1, -1, 3, 2, 1 }, 7 },
+        /* Added during the pass: called from the next one, first */
+        { "adds one", 2, -1, { 3, 2, 1, 0, -1, 4, 3, 2, 1, 0 }, 10 },
+    };
+    int heapWrong = 0, inlineWrong = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        std::vector<int> expected = passes(cases[i].expected, cases[i].count);
+        bool heap = detachDuringCall<HeapChain>(cases[i].actor, cases[i].target) == expected;
+        bool inlined = detachDuringCall<InlineChain>(cases[i].actor, cases[i].target) == expected;
+        if (!heap || !inlined) {
+            REPORT("%s: heap %s, inline %s\n", cases[i].name, heap ? "ok" : "wrong", inlined ? "ok" : "wrong");
+        }
+        heapWrong += !heap;
+        inlineWrong += !inlined;
+    }
+    CHECK_EQUAL(0, heapWrong);
+    CHECK_EQUAL(0, inlineWrong);
+}
+
+/* The chains of Gap and GattServer refuse what does not fit, and say so */
+static void test_full_chain(void)
+{
+    Gap::TimeoutEventCallbackChain_t chain;
+    CHECK(!chain.isFull());
+    struct Counter {
+        Counter() : calls(0) {}
+        void onTimeout(Gap::TimeoutSource_t) { calls++; }
+        int calls;
+    } counters[YOTTA_CFG_BLE_GAP_TIMEOUT_CALLBACKS + 1];
+    for (int i = 0; i < YOTTA_CFG_BLE_GAP_TIMEOUT_CALLBACKS; i++) {
+        CHECK(chain.add(&counters[i], &Counter::onTimeout) != NULL);
+    }
+    CHECK(chain.isFull());
+    CHECK(chain.add(&counters[YOTTA_CFG_BLE_GAP_TIMEOUT_CALLBACKS], &Counter::onTimeout) == NULL);
+    chain.call(Gap::TIMEOUT_SRC_ADVERTISING);
+    CHECK_EQUAL(1, counters[0].calls);
+    CHECK_EQUAL(0, counters[YOTTA_CFG_BLE_GAP_TIMEOUT_CALLBACKS].calls);
+
+    /* Room again once one is detached */
+    CHECK(chain.detach(Gap::TimeoutEventCallback_t(&counters[0], &Counter::onTimeout)));
+    CHECK(!chain.isFull());
+
+    HeapChain heap;
+    CHECK(!heap.isFull());
+}
+
+/* Disconnection event as the firmware registers it: four member callbacks */
+struct Handler {
+    Handler() : calls(0) {}
+    void onDisconnection(const Gap::DisconnectionCallbackParams_t *params)
+    {
+        calls += (params != NULL);
+    }
+    unsigned calls;
+};
+
+#define HANDLERS 4
+#define DISPATCHES 1000000
+
+template <typename Chain>
+static double dispatchNs(Chain &chain, Handler handlers[HANDLERS], unsigned &addAllocations, size_t &addBytes)
+{
+    unsigned before = allocations;
+    size_t beforeBytes = allocatedBytes;
+    for (int i = 0; i < HANDLERS; i++) {
+        chain.add(&handlers[i], &Handler::onDisconnection);
+    }
+    addAllocations = allocations - before;
+    addBytes = allocatedBytes - beforeBytes;
+
+    Gap::DisconnectionCallbackParams_t params(1, Gap::REMOTE_USER_TERMINATED_CONNECTION);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < DISPATCHES; i++) {
+        chain.call(&params);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / DISPATCHES;
+}
+
+static void test_dispatch_and_heap(void)
+{
+    CallChainOfFunctionPointersWithContext<const Gap::DisconnectionCallbackParams_t *> heap;
+    Gap::DisconnectionEventCallbackChain_t inlined;
+    Handler heapHandlers[HANDLERS], inlineHandlers[HANDLERS];
+    unsigned heapAllocations, inlineAllocations;
+    size_t heapBytes, inlineBytes;
+
+    /* Warm up */
+    dispatchNs(heap, heapHandlers, heapAllocations, heapBytes);
+    heap.clear();
+    double heapNs = dispatchNs(heap, heapHandlers, heapAllocations, heapBytes);
+    double inlineNs = dispatchNs(inlined, inlineHandlers, inlineAllocations, inlineBytes);
+
+    REPORT("%d callbacks, heap list: %u allocations (%u bytes on this host), %.1f ns per dispatch\n", HANDLERS,
+           heapAllocations, (unsigned)heapBytes, heapNs);
+    REPORT("%d callbacks, inline (capacity %d): %u allocations, %u bytes in the object, %.1f ns per dispatch\n",
+           HANDLERS, YOTTA_CFG_BLE_GAP_DISCONNECTION_CALLBACKS, inlineAllocations, (unsigned)sizeof(inlined), inlineNs);
+    CHECK_EQUAL(HANDLERS, heapAllocations);
+    CHECK_EQUAL(0, inlineAllocations);
+    CHECK_EQUAL(2 * DISPATCHES, heapHandlers[0].calls);
+    CHECK_EQUAL(DISPATCHES, inlineHandlers[0].calls);
+
+    /* Detaching frees nothing inline either, and the slot is reused */
+    unsigned before = allocations;
+    CHECK(inlined.detach(Gap::DisconnectionEventCallback_t(&inlineHandlers[1], &Handler::onDisconnection)));
+    CHECK(inlined.add(&inlineHandlers[1], &Handler::onDisconnection) != NULL);
+    CHECK_EQUAL(before, allocations);
+}
+
+int main(void)
+{
+    RUN_TEST(test_detach_during_call);
+    RUN_TEST(test_full_chain);
+    RUN_TEST(test_dispatch_and_heap);
+    return TEST_RESULT();
+}
@@ -0,0 +1,295 @@
+/* ConnectionProfileManager with the SDK connection parameters module, on the
+ * virtual clock against a simulated central answering the update requests:
+ * FAST while authenticating, IDLE once quiet, and the retry back-off when the
+ * central keeps its own parameters. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "TimerWheel.h"
+#include "ConnectionProfileManager.h"
+#include "ALARMService.h"
+#include "host_softdevice.h"
+#include "ble_hci.h"
+#include "host_test.h"
+
+#include <vector>
+
+/* Instant of a connection update, in connection events after the request */
+#define CENTRAL_UPDATE_EVENTS 6
+/* Interval the central connects with, out of both profiles */
+#define CENTRAL_INTERVAL CONN_INTERVAL_MS(45)
+
+struct Request {
+    uint64_t us;
+    ble_gap_conn_params_t params;
+};
+
+/* Answers every update request after CENTRAL_UPDATE_EVENTS intervals, with
+ * the maximum interval requested or, if it refuses, with its own */
+struct Central {
+    Central(bool _accepts) : accepts(_accepts), seen(0), answerUs(0), answered(true)
+    {
+        current.min_conn_interval = CENTRAL_INTERVAL;
+        current.max_conn_interval = CENTRAL_INTERVAL;
+        current.slave_latency = 0;
+        current.conn_sup_timeout = CONN_TIMEOUT_MS(4000);
+    }
+
+    void connect()
+    {
+        ble_evt_t event;
+        memset(&event, 0, sizeof(event));
+        event.header.evt_id = BLE_GAP_EVT_CONNECTED;
+        event.evt.gap_evt.conn_handle = 1;
+        event.evt.gap_evt.params.connected.role = BLE_GAP_ROLE_PERIPH;
+        event.evt.gap_evt.params.connected.conn_params = current;
+        host_ble_post(event);
+    }
+
+    /* New requests from the stub, and the answer once due. True if an
+     * event was posted. */
+    bool run()
+    {
+        while (seen < host_sd_conn_param_updates.size()) {
+            Request request = {host_now_us(), host_sd_conn_param_updates[seen++]};
+            requests.push_back(request);
+            pending = request.params;
+            answerUs = host_now_us() + CENTRAL_UPDATE_EVENTS * current.max_conn_interval * 1250ULL;
+            answered = false;
+        }
+        if (!answered && host_now_us() >= answerUs) {
+            answered = true;
+            if (accepts) {
+                current = pending;
+                current.min_conn_interval = current.max_conn_interval;
+            }
+            ble_evt_t event;
+            memset(&event, 0, sizeof(event));
+            event.header.evt_id = BLE_GAP_EVT_CONN_PARAM_UPDATE;
+            event.evt.gap_evt.conn_handle = 1;
+            event.evt.gap_evt.params.conn_param_update.conn_params = current;
+            host_ble_post(event);
+            return true;
+        }
+        return false;
+    }
+
+    /* Time to the next answer, or max_us */
+    uint64_t untilNext(uint64_t max_us) const
+    {
+        if (answered) {
+            return max_us;
+        }
+        uint64_t left = (answerUs > host_now_us()) ? answerUs - host_now_us() : 0;
+        return (left < max_us) ? left : max_us;
+    }
+
+    bool accepts;
+    size_t seen;
+    ble_gap_conn_params_t current;
+    ble_gap_conn_params_t pending;
+    uint64_t answerUs;
+    bool answered;
+    std::vector<Request> requests;
+};
+
+static void setUp(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+}
+
+/* The device side: the manager, and a service for the central to write to */
+struct Link {
+    Link(bool accepts) : manager(wheel), alarm(BLE::Instance()), central(accepts), authenticated(false) {}
+
+    void start()
+    {
+        wheel.start();
+        manager.start(BLE::Instance());
+        central.connect();
+    }
+
+    /* Main loop of main.cpp, the central answering in between */
+    void run(uint64_t us)
+    {
+        uint64_t end = host_now_us() + us;
+        do {
+            BLE::Instance().processEvents();
+            wheel.poll();
+            manager.update(authenticated);
+            /* The event interrupt wakes the CPU at once */
+            if (central.run()) {
+                continue;
+            }
+            if (host_now_us() >= end) {
+                break;
+            }
+            /* PowerManager::sleep() */
+            wheel.schedule();
+            host_advance_to_next(central.untilNext(end - host_now_us()));
+        } while (true);
+    }
+
+    RtcTimerWheel wheel;
+    ConnectionProfileManager manager;
+    ALARMService alarm;
+    Central central;
+    bool authenticated;
+};
+
+static bool isFast(const ble_gap_conn_params_t &params)
+{
+    return params.max_conn_interval == CONN_INTERVAL_MS(CONN_FAST_MAX_INTERVAL);
+}
+
+static bool isIdle(const ble_gap_conn_params_t &params)
+{
+    return params.max_conn_interval == CONN_INTERVAL_MS(CONN_IDLE_MAX_INTERVAL) &&
+           params.slave_latency == CONN_IDLE_SLAVE_LATENCY;
+}
+
+static void peerWrite(void)
+{
+    uint8_t value = 0;
+    host_ble_peer_write(host_sd_value_handle(ALARMService::ALARM_STATE_CHARACTERISTIC_UUID), &value, 1);
+}
+
+/* FAST from the connection, IDLE once authenticated and quiet, back to FAST
+ * on the next write */
+static void test_fast_then_idle(void)
+{
+    setUp();
+    Link link(true);
+    link.start();
+    link.run(1000000);
+    CHECK_EQUAL(ConnectionProfileManager::PROFILE_FAST, link.manager.getProfile());
+    CHECK(isFast(link.central.current));
+    CHECK_EQUAL(1, link.central.requests.size());
+    uint64_t fastAfterUs = link.central.requests[0].us;
+
+    /* Authenticated while writing: stays FAST */
+    link.authenticated = true;
+    for (int i = 0; i < 10; i++) {
+        peerWrite();
+        link.run(CONN_IDLE_TIME * 1000 / 2);
+    }
+    CHECK_EQUAL(ConnectionProfileManager::PROFILE_FAST, link.manager.getProfile());
+
+    /* Quiet: IDLE after CONN_IDLE_TIME */
+    size_t before = link.central.requests.size();
+    peerWrite();
+    uint64_t quietAt = host_now_us();
+    link.run(10 * 1000000);
+    CHECK_EQUAL(ConnectionProfileManager::PROFILE_IDLE, link.manager.getProfile());
+    CHECK(isIdle(link.central.current));
+    CHECK(link.central.requests.size() > before);
+    Request idle = link.central.requests[before];
+    CHECK(isIdle(idle.params));
+    CHECK(idle.us - quietAt >= CONN_IDLE_TIME * 1000ULL);
+    CHECK(idle.us - quietAt <= CONN_IDLE_TIME * 1000ULL + TIMER_WHEEL_TICK_US);
+
+    /* A write brings the short interval back, once the central has let
+     * six events of the long one go by. The user keeps writing. */
+    uint64_t writeAt = host_now_us();
+    while (host_now_us() - writeAt < 5000000 && !isFast(link.central.current)) {
+        peerWrite();
+        link.run(TIMER_WHEEL_TICK_US);
+    }
+    uint64_t fastAt = host_now_us();
+    link.run(CONN_IDLE_TIME * 1000 / 2);
+    CHECK_EQUAL(ConnectionProfileManager::PROFILE_FAST, link.manager.getProfile());
+    CHECK(isFast(link.central.current));
+    CHECK(fastAt - writeAt <= (CENTRAL_UPDATE_EVENTS + 1) * CONN_IDLE_MAX_INTERVAL * 1000ULL);
+
+    REPORT("accepting central: FAST requested %llu us after connecting, IDLE %llu ms after the last write, "
+           "FAST back %llu ms after a write, %u requests in %llu s\n",
+           (unsigned long long)fastAfterUs, (unsigned long long)(idle.us - quietAt) / 1000,
+           (unsigned long long)(fastAt - writeAt) / 1000, (unsigned)link.central.requests.size(),
+           (unsigned long long)(host_now_us() / 1000000));
+    /* One per profile change, the module negotiation timer adds none once
+     * the parameters are in range */
+    CHECK_EQUAL(3, link.central.requests.size());
+}
+
+/* A single write while IDLE: the link goes quiet again before the central
+ * has answered the FAST request, IDLE is only asked for once it has */
+static void test_one_request_at_a_time(void)
+{
+    setUp();
+    Link link(true);
+    link.authenticated = true;
+    link.start();
+    link.run(10 * 1000000);
+    CHECK(isIdle(link.central.current));
+
+    size_t before = link.central.requests.size();
+    peerWrite();
+    link.run(10 * 1000000);
+    const std::vector<Request> &requests = link.central.requests;
+    CHECK_EQUAL(before + 2, requests.size());
+    CHECK(isFast(requests[before].params));
+    CHECK(isIdle(requests[before + 1].params));
+    /* FAST took six 375 ms events, longer than CONN_IDLE_TIME, and IDLE
+     * followed the answer */
+    uint64_t answerUs = CENTRAL_UPDATE_EVENTS * CONN_IDLE_MAX_INTERVAL * 1000ULL;
+    CHECK(requests[before + 1].us - requests[before].us >= answerUs);
+    CHECK(requests[before + 1].us - requests[before].us <= answerUs + TIMER_WHEEL_TICK_US);
+    CHECK_EQUAL(ConnectionProfileManager::PROFILE_IDLE, link.manager.getProfile());
+    CHECK(isIdle(link.central.current));
+}
+
+/* The central keeps 45 ms: the requests back off to CONN_RETRY_MAX_DELAY
+ * and the link survives */
+static void test_retry_back_off(void)
+{
+    setUp();
+    Link link(false);
+    link.start();
+    link.run(120 * 1000000ULL);
+    CHECK_EQUAL(ConnectionProfileManager::PROFILE_NONE, link.manager.getProfile());
+    CHECK_EQUAL(0, host_sd_count("sd_ble_gap_disconnect"));
+
+    const std::vector<Request> &requests = link.central.requests;
+    CHECK(requests.size() >= 6);
+    uint32_t expected = CONN_RETRY_FIRST_DELAY;
+    int wrongGaps = 0;
+    REPORT("refusing central: %u requests in 120 s, gaps (ms):", (unsigned)requests.size());
+    for (size_t i = 1; i < requests.size(); i++) {
+        uint64_t gapMs = (requests[i].us - requests[i - 1].us) / 1000;
+        printf(" %llu", (unsigned long long)gapMs);
+        /* Answer after six 45 ms events, then the retry delay, counted in
+         * whole ticks of the wheel */
+        int64_t offMs = (int64_t)gapMs - (CENTRAL_UPDATE_EVENTS * 45 + expected);
+        wrongGaps += (offMs < -(int64_t)(TIMER_WHEEL_TICK_US / 1000)) || (offMs > (int64_t)(TIMER_WHEEL_TICK_US / 1000));
+        if (expected < CONN_RETRY_MAX_DELAY) {
+            expected *= 2;
+        }
+        CHECK(isFast(requests[i].params));
+    }
+    printf("\n");
+    CHECK_EQUAL(0, wrongGaps);
+
+    /* A new connection starts the back-off again */
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id = BLE_GAP_EVT_DISCONNECTED;
+    event.evt.gap_evt.conn_handle = 1;
+    event.evt.gap_evt.params.disconnected.reason = BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION;
+    host_ble_post(event);
+    link.run(1000000);
+    size_t before = requests.size();
+    link.central.accepts = true;
+    link.central.connect();
+    link.run(1000000);
+    CHECK_EQUAL(before + 1, requests.size());
+    CHECK_EQUAL(ConnectionProfileManager::PROFILE_FAST, link.manager.getProfile());
+}
+
+int main(void)
+{
+    RUN_TEST(test_fast_then_idle);
+    RUN_TEST(test_one_request_at_a_time);
+    RUN_TEST(test_retry_back_off);
+    return TEST_RESULT();
+}
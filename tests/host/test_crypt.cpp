@@ -0,0 +1,183 @@
+/* crypt.h: the precomputed CTR keystream gives the same bytes as the blocks
+ * computed on the spot, against reference vectors, and the cache statistics
+ * tell the two apart. */
+
+#include "mbed.h"
+#include "crypt.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+
+/* FIPS-197 / SP 800-38A key */
+static const uint8_t key[ECB_KEY_LEN] = {
+    0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C
+};
+
+/* SP 800-38A F.1.1, the four ECB-AES128 blocks */
+static const uint8_t plain[4][ECB_KEY_LEN] = {
+    {0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A},
+    {0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51},
+    {0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11, 0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF},
+    {0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17, 0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10}
+};
+static const uint8_t ecbCipher[4][ECB_KEY_LEN] = {
+    {0x3A, 0xD7, 0x7B, 0xB4, 0x0D, 0x7A, 0x36, 0x60, 0xA8, 0x9E, 0xCA, 0xF3, 0x24, 0x66, 0xEF, 0x97},
+    {0xF5, 0xD3, 0xD5, 0x85, 0x03, 0xB9, 0x69, 0x9D, 0xE7, 0x85, 0x89, 0x5A, 0x96, 0xFD, 0xBA, 0xAF},
+    {0x43, 0xB1, 0xCD, 0x7F, 0x59, 0x8E, 0xCE, 0x23, 0x88, 0x1B, 0x00, 0xE3, 0xED, 0x03, 0x06, 0x88},
+    {0x7B, 0x0C, 0x78, 0x5E, 0x27, 0xE8, 0xAD, 0x3F, 0x82, 0x23, 0x20, 0x71, 0x04, 0x72, 0x5D, 0xD4}
+};
+
+/* Nonce with the counter block layout of crypt.h: counter little endian in
+ * bytes 0-3, random bytes 4-15 */
+static const uint8_t nonce[ECB_KEY_LEN] = {
+    0x00, 0x00, 0x00, 0x00, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF
+};
+
+#define BLOCKS 4
+
+/* The four blocks in CTR mode with that nonce, computed apart with
+ * `openssl enc -aes-128-ctr -iv <i>000000f4f5...ff` block by block */
+static const uint8_t ctrCipher[4][ECB_KEY_LEN] = {
+    {0x8A, 0xD0, 0xDC, 0xA6, 0x35, 0xD7, 0xAA, 0xCC, 0x9E, 0xFB, 0x4B, 0x6B, 0xAA, 0x7C, 0xA2, 0xFC},
+    {0x0F, 0xF6, 0xBC, 0x18, 0xCF, 0xBB, 0xE6, 0x1C, 0x84, 0x61, 0xBC, 0x93, 0xFB, 0xE6, 0x31, 0x70},
+    {0x12, 0xBA, 0xE8, 0xF1, 0x3D, 0xBB, 0x44, 0x89, 0x38, 0x2B, 0x43, 0x77, 0x1C, 0x5C, 0x34, 0x2E},
+    {0x98, 0xD6, 0x38, 0x53, 0xBF, 0x79, 0x35, 0xDF, 0xA5, 0x17, 0xD4, 0x52, 0x0A, 0x87, 0xE2, 0xC2}
+};
+
+static void statistics(uint32_t &hits, uint32_t &misses)
+{
+    static uint32_t lastHits, lastMisses;
+    uint32_t h, m;
+    ctr_cache_statistics(&h, &m);
+    hits = h - lastHits;
+    misses = m - lastMisses;
+    lastHits = h;
+    lastMisses = m;
+}
+
+/* The ECB the CTR mode is built on */
+static void test_ecb_reference_vectors(void)
+{
+    int wrong = 0;
+    for (int i = 0; i < BLOCKS; i++) {
+        nrf_ecb_hal_data_t ecb;
+        memcpy(ecb.key, key, ECB_KEY_LEN);
+        memcpy(ecb.cleartext, plain[i], ECB_KEY_LEN);
+        CHECK_EQUAL(NRF_SUCCESS, sd_ecb_block_encrypt(&ecb));
+        wrong += memcmp(ecb.ciphertext, ecbCipher[i], ECB_KEY_LEN) != 0;
+    }
+    CHECK_EQUAL(0, wrong);
+}
+
+/* Encrypt the four plaintext blocks, with or without precomputing */
+static void encrypt(bool precompute, uint8_t out[BLOCKS][ECB_KEY_LEN])
+{
+    memcpy(out, plain, sizeof(plain));
+    ctr_init(nonce, key);
+    if (precompute) {
+        while (ctr_precompute()) { }
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        CHECK_EQUAL(NRF_SUCCESS, ctr_encrypt(out[i]));
+    }
+}
+
+static void test_cached_and_uncached_paths_agree(void)
+{
+    host_hw_reset();
+    uint32_t hits, misses;
+    const uint8_t (*expected)[ECB_KEY_LEN] = ctrCipher;
+
+    /* First use of a key: every block computed on the spot */
+    statistics(hits, misses);
+    uint8_t uncached[BLOCKS][ECB_KEY_LEN];
+    encrypt(false, uncached);
+    statistics(hits, misses);
+    CHECK_EQUAL(0, hits);
+    CHECK_EQUAL(BLOCKS, misses);
+    CHECK(memcmp(expected, uncached, sizeof(ctrCipher)) == 0);
+
+    /* Another nonce drops the cache, precomputing fills it again */
+    uint8_t other[ECB_KEY_LEN];
+    memcpy(other, nonce, sizeof(other));
+    other[15] ^= 0x01;
+    ctr_init(other, key);
+    while (ctr_precompute()) { }
+    uint8_t cached[BLOCKS][ECB_KEY_LEN];
+    host_sd_reset_counts();
+    uint64_t before = host_now_us();
+    encrypt(true, cached);
+    uint64_t cachedUs = host_now_us() - before;
+    statistics(hits, misses);
+    REPORT("cached path: %u of %d blocks from the cache, %u ECB runs with the precomputing, %llu us\n",
+           (unsigned)hits, BLOCKS, host_sd_count("sd_ecb_block_encrypt"), (unsigned long long)cachedUs);
+    CHECK_EQUAL(CTR_CACHE_BLOCKS, hits);
+    CHECK_EQUAL(BLOCKS - CTR_CACHE_BLOCKS, misses);
+    CHECK(memcmp(expected, cached, sizeof(ctrCipher)) == 0);
+
+    /* A restart with the same nonce and key keeps the cache */
+    host_sd_reset_counts();
+    ctr_init(nonce, key);
+    CHECK(!ctr_precompute());
+    uint8_t block[ECB_KEY_LEN];
+    memcpy(block, cached[0], sizeof(block));
+    CHECK_EQUAL(NRF_SUCCESS, ctr_decrypt(block));
+    CHECK(memcmp(plain[0], block, sizeof(block)) == 0);
+    CHECK_EQUAL(0, host_sd_count("sd_ecb_block_encrypt"));
+    statistics(hits, misses);
+    CHECK_EQUAL(1, hits);
+
+    /* Another key drops it */
+    uint8_t otherKey[ECB_KEY_LEN];
+    memcpy(otherKey, key, sizeof(otherKey));
+    otherKey[0] ^= 0x80;
+    ctr_init(nonce, otherKey);
+    memcpy(block, plain[0], sizeof(block));
+    CHECK_EQUAL(NRF_SUCCESS, ctr_encrypt(block));
+    CHECK(memcmp(expected[0], block, sizeof(block)) != 0);
+    statistics(hits, misses);
+    CHECK_EQUAL(0, hits);
+    CHECK_EQUAL(1, misses);
+}
+
+/* The two ways through the write handler of ImobStateService: a plain XOR
+ * after precomputing, an ECB run per block otherwise */
+static void test_decrypt_in_the_handler(void)
+{
+    host_hw_reset();
+    uint8_t block[ECB_KEY_LEN];
+    uint8_t cipher[ECB_KEY_LEN];
+    memcpy(cipher, plain[0], sizeof(cipher));
+    ctr_init(nonce, key);
+    ctr_encrypt(cipher);
+
+    uint8_t fresh[ECB_KEY_LEN];
+    memcpy(fresh, nonce, sizeof(fresh));
+    fresh[4] ^= 0x55;
+    ctr_init(fresh, key);
+    ctr_init(nonce, key);
+    host_sd_reset_counts();
+    memcpy(block, cipher, sizeof(block));
+    ctr_decrypt(block);
+    unsigned uncachedRuns = host_sd_count("sd_ecb_block_encrypt");
+    CHECK(memcmp(plain[0], block, sizeof(block)) == 0);
+
+    ctr_init(fresh, key);
+    ctr_init(nonce, key);
+    while (ctr_precompute()) { }
+    host_sd_reset_counts();
+    memcpy(block, cipher, sizeof(block));
+    ctr_decrypt(block);
+    CHECK(memcmp(plain[0], block, sizeof(block)) == 0);
+    REPORT("decrypt in the handler: %u ECB run(s) uncached, %u cached\n",
+           uncachedRuns, host_sd_count("sd_ecb_block_encrypt"));
+    CHECK_EQUAL(1, uncachedRuns);
+    CHECK_EQUAL(0, host_sd_count("sd_ecb_block_encrypt"));
+}
+
+int main(void)
+{
+    RUN_TEST(test_ecb_reference_vectors);
+    RUN_TEST(test_cached_and_uncached_paths_agree);
+    RUN_TEST(test_decrypt_in_the_handler);
+    return TEST_RESULT();
+}
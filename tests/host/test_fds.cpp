@@ -0,0 +1,667 @@
+/* fds on the simulated flash: the RAM index answers as the records in flash
+ * do through clears, updates and the page swap of garbage collection, and
+ * what a lookup costs with the index against the page scan it replaces. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+
+extern "C" {
+#include "fds.h"
+#include "fds_config.h"
+#include "fstorage.h"
+#include "fstorage_config.h"
+}
+
+#include <algorithm>
+#include <chrono>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#define TYPE_A 0x1001
+#define TYPE_B 0x1002
+
+/* Pages fstorage gives fds, below the pages left to pstorage */
+#define FDS_FIRST_PAGE (HOST_FLASH_END - (FS_RESERVED_PAGES + FDS_MAX_PAGES) * HOST_FLASH_PAGE_SIZE)
+
+struct Event {
+    uint64_t us;
+    ret_code_t result;
+    fds_cmd_id_t cmd;
+    fds_record_id_t id;
+    fds_record_key_t key;
+};
+static std::vector<Event> events;
+
+static void onFdsEvent(ret_code_t result, fds_cmd_id_t cmd, fds_record_id_t id, fds_record_key_t key)
+{
+    Event event = { host_now_us(), result, cmd, id, key };
+    events.push_back(event);
+}
+
+/* Main loop until the flash is idle */
+static void pump(void)
+{
+    do {
+        BLE::Instance().processEvents();
+    } while (host_advance_to_next(1000000));
+    BLE::Instance().processEvents();
+}
+
+static unsigned failedEvents(void)
+{
+    unsigned failed = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        failed += (events[i].result != NRF_SUCCESS);
+    }
+    return failed;
+}
+
+/* A record as the flash holds it */
+struct FlashRecord {
+    uint32_t id;
+    uint16_t type;
+    uint16_t instance;
+    const uint32_t *data;
+};
+
+/* Valid records of the valid pages, in storage order, read from the flash
+ * the way page_scan() reads it */
+static std::vector<FlashRecord> flashRecords(void)
+{
+    std::vector<FlashRecord> records;
+    for (int page = 0; page < FDS_MAX_PAGES; page++) {
+        const uint32_t *start = (const uint32_t *)(uintptr_t)(FDS_FIRST_PAGE + page * HOST_FLASH_PAGE_SIZE);
+        if (start[0] != FDS_PAGE_TAG_WORD_0_VALID || start[3] != FDS_PAGE_TAG_WORD_3) {
+            continue;
+        }
+        const uint32_t *p = start + 4;
+        while (p < start + HOST_FLASH_PAGE_SIZE / 4 && *p != 0xFFFFFFFF) {
+            const fds_header_t *header = (const fds_header_t *)p;
+            bool batch = header->tl.type == FDS_TYPE_ID_BATCH;
+            if (!batch && header->tl.type != FDS_TYPE_ID_INVALID && header->ic.instance != FDS_INSTANCE_ID_INVALID) {
+                FlashRecord record = { header->id, header->tl.type, header->ic.instance, p + 3 };
+                records.push_back(record);
+            }
+            /* A committed batch holds its records as its data */
+            p += 3 + ((batch && header->ic.instance != FDS_INSTANCE_ID_INVALID) ? 0 : header->tl.length_words);
+        }
+    }
+    return records;
+}
+
+/* Record IDs returned by a search, in order */
+enum Search { BY_TYPE, BY_INSTANCE, BY_KEY };
+
+static std::vector<uint32_t> search(Search how, uint16_t type, uint16_t instance)
+{
+    std::vector<uint32_t> ids;
+    fds_find_token_t token;
+    fds_record_desc_t desc;
+    memset(&token, 0, sizeof(token));
+    memset(&desc, 0, sizeof(desc));
+    while ((how == BY_TYPE ? fds_find_by_type(type, &desc, &token) :
+            how == BY_INSTANCE ? fds_find_by_instance(instance, &desc, &token) :
+                                 fds_find(type, instance, &desc, &token)) == NRF_SUCCESS) {
+        ids.push_back(desc.record_id);
+    }
+    return ids;
+}
+
+static std::vector<uint32_t> expected(Search how, uint16_t type, uint16_t instance)
+{
+    std::vector<FlashRecord> records = flashRecords();
+    std::vector<uint32_t> ids;
+    for (size_t i = 0; i < records.size(); i++) {
+        if ((how == BY_INSTANCE || records[i].type == type) && (how == BY_TYPE || records[i].instance == instance)) {
+            ids.push_back(records[i].id);
+        }
+    }
+    return ids;
+}
+
+/* Every search and every open against the flash contents. Returns the
+ * number of mismatches. */
+static int indexMismatches(const std::vector<uint32_t> &cleared)
+{
+    int wrong = 0;
+    std::vector<FlashRecord> records = flashRecords();
+    wrong += search(BY_TYPE, TYPE_A, 0) != expected(BY_TYPE, TYPE_A, 0);
+    wrong += search(BY_TYPE, TYPE_B, 0) != expected(BY_TYPE, TYPE_B, 0);
+    for (uint16_t instance = 1; instance <= 16; instance++) {
+        wrong += search(BY_INSTANCE, 0, instance) != expected(BY_INSTANCE, 0, instance);
+        wrong += search(BY_KEY, TYPE_A, instance) != expected(BY_KEY, TYPE_A, instance);
+        wrong += search(BY_KEY, TYPE_B, instance) != expected(BY_KEY, TYPE_B, instance);
+    }
+    for (size_t i = 0; i < records.size(); i++) {
+        fds_record_desc_t desc;
+        fds_record_t record;
+        fds_descriptor_from_rec_id(&desc, records[i].id);
+        if (fds_open(&desc, &record) != NRF_SUCCESS) {
+            wrong++;
+            continue;
+        }
+        wrong += record.p_data != records[i].data;
+        fds_close(&desc);
+    }
+    for (size_t i = 0; i < cleared.size(); i++) {
+        fds_record_desc_t desc;
+        fds_record_t record;
+        fds_descriptor_from_rec_id(&desc, cleared[i]);
+        wrong += fds_open(&desc, &record) == NRF_SUCCESS;
+    }
+    return wrong;
+}
+
+/* Records written by the tests, their data stays put until written */
+struct Record {
+    fds_record_desc_t desc;
+    fds_record_key_t key;
+    uint32_t value;
+};
+
+static ret_code_t writeRecord(Record &record, uint16_t type, uint16_t instance, uint32_t value)
+{
+    record.key.type = type;
+    record.key.instance = instance;
+    record.value = value;
+    fds_record_chunk_t chunk = { &record.value, 1 };
+    return fds_write(&record.desc, record.key, 1, &chunk);
+}
+
+static ret_code_t updateRecord(Record &record, uint32_t value)
+{
+    record.value = value;
+    fds_record_chunk_t chunk = { &record.value, 1 };
+    return fds_update(&record.desc, record.key, 1, &chunk);
+}
+
+/* Clear every record and collect */
+static void emptyPages(void)
+{
+    std::vector<FlashRecord> left = flashRecords();
+    for (size_t i = 0; i < left.size(); i++) {
+        fds_clear_by_instance(left[i].instance);
+        pump();
+    }
+    fds_gc();
+    pump();
+    CHECK(flashRecords().empty());
+}
+
+#define RECORDS 12
+
+static void test_index_follows_the_flash(void)
+{
+    static Record records[RECORDS];
+    std::vector<uint32_t> cleared;
+    events.clear();
+
+    for (int i = 0; i < RECORDS; i++) {
+        CHECK_EQUAL(NRF_SUCCESS, writeRecord(records[i], (i & 1) ? TYPE_B : TYPE_A, 1 + i / 2, i));
+        pump();
+    }
+    CHECK_EQUAL(RECORDS, flashRecords().size());
+    CHECK_EQUAL(0, indexMismatches(cleared));
+
+    /* Clears */
+    for (int i = 0; i < 4; i++) {
+        cleared.push_back(records[i * 3].desc.record_id);
+        CHECK_EQUAL(NRF_SUCCESS, fds_clear(&records[i * 3].desc));
+    }
+    pump();
+    CHECK_EQUAL(RECORDS - 4, flashRecords().size());
+    CHECK_EQUAL(0, indexMismatches(cleared));
+
+    /* Updates: a new record, the old one cleared */
+    for (int i = 1; i < RECORDS; i += 3) {
+        cleared.push_back(records[i].desc.record_id);
+        CHECK_EQUAL(NRF_SUCCESS, updateRecord(records[i], 0x100 + i));
+        pump();
+        CHECK(records[i].desc.record_id != cleared.back());
+    }
+    CHECK_EQUAL(RECORDS - 4, flashRecords().size());
+    CHECK_EQUAL(0, indexMismatches(cleared));
+
+    /* The page swap moves every record */
+    std::vector<FlashRecord> before = flashRecords();
+    unsigned erases = host_sd_flash.erases;
+    CHECK_EQUAL(NRF_SUCCESS, fds_gc());
+    pump();
+    CHECK(host_sd_flash.erases > erases);
+    std::vector<FlashRecord> after = flashRecords();
+    CHECK_EQUAL(before.size(), after.size());
+    CHECK(after.size() > 0 && after[0].data != before[0].data);
+    CHECK_EQUAL(0, indexMismatches(cleared));
+
+    /* Updates of descriptors that went stale in the swap, and a clear by
+     * instance */
+    for (int i = 2; i < RECORDS; i += 3) {
+        cleared.push_back(records[i].desc.record_id);
+        CHECK_EQUAL(NRF_SUCCESS, updateRecord(records[i], 0x200 + i));
+        pump();
+    }
+    std::vector<uint32_t> instance5 = search(BY_INSTANCE, 0, 5);
+    cleared.insert(cleared.end(), instance5.begin(), instance5.end());
+    CHECK_EQUAL(NRF_SUCCESS, fds_clear_by_instance(5));
+    pump();
+    CHECK(search(BY_INSTANCE, 0, 5).empty());
+    CHECK_EQUAL(0, indexMismatches(cleared));
+    CHECK_EQUAL(0, failedEvents());
+
+    emptyPages();
+}
+
+#define INDEXED FDS_INDEX_SIZE
+#define LOOKUP_ROUNDS 20000
+
+/* fds_find() and fds_open() of every key */
+static double lookupNs(Record records[], int count)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned found = 0;
+    for (int round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (int i = 0; i < count; i++) {
+            fds_find_token_t token;
+            fds_record_desc_t desc;
+            fds_record_t record;
+            memset(&token, 0, sizeof(token));
+            if (fds_find(records[i].key.type, records[i].key.instance, &desc, &token) == NRF_SUCCESS &&
+                fds_open(&desc, &record) == NRF_SUCCESS) {
+                found += (record.p_data[0] == records[i].value);
+                fds_close(&desc);
+            }
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    CHECK_EQUAL(LOOKUP_ROUNDS * count, found);
+    return std::chrono::duration<double, std::nano>(end - start).count() / (LOOKUP_ROUNDS * count);
+}
+
+/* Fastest of a few runs, the first one warms up */
+static double bestLookupNs(Record records[], int count)
+{
+    double best = lookupNs(records, count);
+    for (int i = 0; i < 4; i++) {
+        double ns = lookupNs(records, count);
+        best = (ns < best) ? ns : best;
+    }
+    return best;
+}
+
+/* As many records as the index holds, then one more: lookups fall back to
+ * the page scan */
+static void test_lookup_index_against_scan(void)
+{
+    static Record records[INDEXED + 1];
+    events.clear();
+    for (int i = 0; i < INDEXED; i++) {
+        CHECK_EQUAL(NRF_SUCCESS, writeRecord(records[i], TYPE_A, 1 + i, i));
+        pump();
+    }
+    double indexNs = bestLookupNs(records, INDEXED);
+
+    CHECK_EQUAL(NRF_SUCCESS, writeRecord(records[INDEXED], TYPE_B, 1, INDEXED));
+    pump();
+    double scanNs = bestLookupNs(records, INDEXED);
+    CHECK_EQUAL(0, indexMismatches(std::vector<uint32_t>()));
+    CHECK_EQUAL(0, failedEvents());
+
+    REPORT("%d records on %d pages: find and open %.0f ns through the index, %.0f ns scanning the pages (%.1fx)\n",
+           INDEXED + 1, FDS_MAX_PAGES, indexNs, scanNs, scanNs / indexNs);
+    CHECK(indexNs < scanNs);
+}
+
+/* Main loop for `us`, or until an event of `cmd` for `instance` */
+static bool runUntil(uint64_t us, fds_cmd_id_t cmd, uint16_t instance)
+{
+    uint64_t end = host_now_us() + us;
+    size_t seen = events.size();
+    while (true) {
+        BLE::Instance().processEvents();
+        for (; seen < events.size(); seen++) {
+            if (events[seen].cmd == cmd && events[seen].key.instance == instance) {
+                return true;
+            }
+        }
+        if (host_now_us() >= end || !host_advance_to_next(end - host_now_us())) {
+            return false;
+        }
+    }
+}
+
+/* FDS_CMD_NONE is never reported */
+static void runFor(uint64_t us)
+{
+    runUntil(us, FDS_CMD_NONE, 0);
+}
+
+static size_t eventIndex(fds_cmd_id_t cmd, uint16_t instance)
+{
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i].cmd == cmd && (cmd == FDS_CMD_GC || events[i].key.instance == instance)) {
+            return i;
+        }
+    }
+    return events.size();
+}
+
+/* A collection with two writes and two clears queued behind it: it gives
+ * way after FDS_GC_STEP_RECORDS copies, the record cleared once copied does
+ * not come back with the swap, and the collection resumes to the end */
+static void test_gc_gives_way(void)
+{
+    static Record records[RECORDS];
+    static Record added[2];
+    emptyPages();
+    events.clear();
+    for (int i = 0; i < RECORDS; i++) {
+        CHECK_EQUAL(NRF_SUCCESS, writeRecord(records[i], TYPE_A, 1 + i, i));
+        pump();
+    }
+    /* Something to collect */
+    CHECK_EQUAL(NRF_SUCCESS, fds_clear(&records[1].desc));
+    pump();
+
+    events.clear();
+    unsigned erases = host_sd_flash.erases;
+    uint64_t start = host_now_us();
+    CHECK_EQUAL(NRF_SUCCESS, fds_gc());
+    CHECK_EQUAL(NRF_SUCCESS, writeRecord(added[0], TYPE_B, 1, 0x100));
+    uint32_t copiedId = records[0].desc.record_id;
+    uint32_t uncopiedId = records[RECORDS - 1].desc.record_id;
+    CHECK_EQUAL(NRF_SUCCESS, fds_clear(&records[0].desc));
+    CHECK_EQUAL(NRF_SUCCESS, fds_clear(&records[RECORDS - 1].desc));
+    CHECK_EQUAL(NRF_SUCCESS, writeRecord(added[1], TYPE_B, 2, 0x101));
+
+    pump();
+    size_t gc = eventIndex(FDS_CMD_GC, 0);
+    size_t write = eventIndex(FDS_CMD_WRITE, 1);
+    CHECK(gc < events.size() && write < events.size());
+    CHECK(eventIndex(FDS_CMD_WRITE, 1) < gc);
+    CHECK(eventIndex(FDS_CMD_CLEAR, 1) < gc);
+    CHECK(eventIndex(FDS_CMD_CLEAR, RECORDS) < gc);
+    CHECK(eventIndex(FDS_CMD_WRITE, 2) < gc);
+    CHECK(host_sd_flash.erases > erases);
+    CHECK_EQUAL(0, failedEvents());
+
+    /* One of each record left, the cleared ones gone */
+    std::vector<FlashRecord> left = flashRecords();
+    std::vector<uint32_t> ids;
+    for (size_t i = 0; i < left.size(); i++) {
+        ids.push_back(left[i].id);
+    }
+    std::sort(ids.begin(), ids.end());
+    CHECK(std::unique(ids.begin(), ids.end()) == ids.end());
+    CHECK_EQUAL(RECORDS - 3 + 2, left.size());
+    std::vector<uint32_t> cleared;
+    cleared.push_back(copiedId);
+    cleared.push_back(uncopiedId);
+    cleared.push_back(records[1].desc.record_id);
+    CHECK_EQUAL(0, indexMismatches(cleared));
+
+    /* The first write waits for the page tag and one step of copies */
+    uint64_t writeUs = events[write].us - start;
+    uint64_t gcUs = events[gc].us - start;
+    REPORT("write queued behind a collection done after %llu us, the collection after %llu us\n",
+           (unsigned long long)writeUs, (unsigned long long)gcUs);
+    unsigned recordUs = (3 + 1) * HOST_FLASH_WORD_US;
+    CHECK(writeUs <= (FDS_GC_STEP_RECORDS + 1) * recordUs + HOST_FLASH_WORD_US);
+    CHECK(writeUs < gcUs);
+}
+
+/* Updates of 12 keys at random times for 2000 rounds, automatic collections
+ * included. A write waits for the flash operation in progress and for at
+ * most one step of a collection: a page erase or FDS_GC_STEP_RECORDS copies. */
+#define LATENCY_KEYS 12
+#define LATENCY_WORDS 5
+#define LATENCY_ROUNDS 2000
+
+static void test_worst_write_latency(void)
+{
+    static Record records[LATENCY_KEYS];
+    static uint32_t data[LATENCY_KEYS][LATENCY_WORDS];
+    emptyPages();
+    events.clear();
+    for (int i = 0; i < LATENCY_KEYS; i++) {
+        fds_record_chunk_t chunk = { data[i], LATENCY_WORDS };
+        records[i].key.type = TYPE_A;
+        records[i].key.instance = 1 + i;
+        CHECK_EQUAL(NRF_SUCCESS, fds_write(&records[i].desc, records[i].key, 1, &chunk));
+        pump();
+    }
+
+    unsigned erases = host_sd_flash.erases;
+    uint64_t worstUs = 0, totalUs = 0;
+    unsigned noMem = 0, lost = 0;
+    uint32_t seed = 12345;
+    for (int round = 0; round < LATENCY_ROUNDS; round++) {
+        seed = seed * 1103515245 + 12345;
+        int key = (seed >> 16) % LATENCY_KEYS;
+        /* The application runs for up to 30 ms between two updates */
+        runFor((seed >> 8) % 30000);
+
+        data[key][0] = round;
+        fds_record_chunk_t chunk = { data[key], LATENCY_WORDS };
+        uint64_t start = host_now_us();
+        ret_code_t ret = fds_update(&records[key].desc, records[key].key, 1, &chunk);
+        if (ret == NRF_ERROR_NO_MEM) {
+            noMem++;
+            fds_gc();
+            continue;
+        }
+        CHECK_EQUAL(NRF_SUCCESS, ret);
+        if (!runUntil(1000000, FDS_CMD_UPDATE, 1 + key)) {
+            lost++;
+            continue;
+        }
+        uint64_t latencyUs = host_now_us() - start;
+        worstUs = (latencyUs > worstUs) ? latencyUs : worstUs;
+        totalUs += latencyUs;
+    }
+    pump();
+
+    unsigned collections = host_sd_flash.erases - erases;
+    unsigned updateUs = (3 + LATENCY_WORDS + 1) * HOST_FLASH_WORD_US;
+    unsigned copyUs = FDS_GC_STEP_RECORDS * (3 + LATENCY_WORDS) * HOST_FLASH_WORD_US;
+    unsigned boundUs = HOST_FLASH_ERASE_US + copyUs + updateUs;
+    REPORT("%d updates, %u collections: write latency %llu us on average, %llu us at worst (bound %u us), "
+           "%u writes out of space\n",
+           LATENCY_ROUNDS, collections, (unsigned long long)(totalUs / LATENCY_ROUNDS), (unsigned long long)worstUs,
+           boundUs, noMem);
+    CHECK(collections > 0);
+    CHECK_EQUAL(0, noMem);
+    CHECK_EQUAL(0, lost);
+    CHECK_EQUAL(0, failedEvents());
+    CHECK(worstUs <= boundUs);
+    CHECK(host_sd_flash.maxWordWrites <= 2);
+    CHECK_EQUAL(0, indexMismatches(std::vector<uint32_t>()));
+}
+
+/* A set of three one-word records, written as a batch or one by one */
+#define SET_RECORDS 3
+enum SetWrite { SET_BATCH, SET_SEPARATE };
+
+static uint32_t setData[SET_RECORDS] = { 0xA1, 0xA2, 0xA3 };
+
+static ret_code_t writeSet(SetWrite how)
+{
+    static fds_record_chunk_t chunks[SET_RECORDS];
+    static fds_batch_record_t batch[SET_RECORDS];
+    fds_record_desc_t desc;
+    for (int i = 0; i < SET_RECORDS; i++) {
+        chunks[i].p_data = &setData[i];
+        chunks[i].length_words = 1;
+        batch[i].key.type = TYPE_B;
+        batch[i].key.instance = 1 + i;
+        batch[i].num_chunks = 1;
+        batch[i].p_chunks = &chunks[i];
+        if (how == SET_SEPARATE) {
+            ret_code_t ret = fds_write(&desc, batch[i].key, 1, &chunks[i]);
+            if (ret != NRF_SUCCESS) {
+                return ret;
+            }
+        }
+    }
+    return (how == SET_BATCH) ? fds_write_batch(NULL, batch, SET_RECORDS) : NRF_SUCCESS;
+}
+
+/* Records of the set found, with their data */
+static int setRecordsFound(void)
+{
+    int found = 0;
+    for (int i = 0; i < SET_RECORDS; i++) {
+        std::vector<uint32_t> ids = search(BY_KEY, TYPE_B, 1 + i);
+        fds_record_desc_t desc;
+        fds_record_t record;
+        if (ids.size() == 1 && fds_descriptor_from_rec_id(&desc, ids[0]) == NRF_SUCCESS &&
+            fds_open(&desc, &record) == NRF_SUCCESS) {
+            found += (record.p_data[0] == setData[i]);
+            fds_close(&desc);
+        }
+    }
+    return found;
+}
+
+/* Boot: the stack and the clock from reset, fds mounted on the flash as
+ * it is */
+static bool mount(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+    events.clear();
+    if (fds_register(onFdsEvent) != NRF_SUCCESS || fds_init() != NRF_SUCCESS) {
+        return false;
+    }
+    pump();
+    return events.size() == 1 && events[0].cmd == FDS_CMD_INIT && events[0].result == NRF_SUCCESS;
+}
+
+/* Boots after a power cut run in a child process, this one never mounts
+ * until they are over: fds has no way back to its reset state */
+static SetWrite cutWrite;
+static uint64_t cutUs;
+
+static int writeThenCut(void)
+{
+    if (!mount() || writeSet(cutWrite) != NRF_SUCCESS) {
+        return 1;
+    }
+    uint64_t end = host_now_us() + cutUs;
+    do {
+        BLE::Instance().processEvents();
+    } while (host_now_us() < end && host_advance_to_next(end - host_now_us()));
+    host_flash_power_cut();
+    return 0;
+}
+
+static int format(void)
+{
+    return mount() ? 0 : 1;
+}
+
+static int mountAndCount(void)
+{
+    return mount() ? setRecordsFound() : 0xFF;
+}
+
+static int inChild(int (*boot)(void))
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(boot());
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+#define CUT_SPAN_US 3000
+#define CUT_STEP_US (HOST_FLASH_WORD_US / 2)
+
+/* Power cut at every half word of the set being written, then a boot:
+ * the batch is there or not at all, separate writes can leave part of it */
+static void test_power_cut_during_a_set(void)
+{
+    host_flash_erase_all();
+    CHECK_EQUAL(0, inChild(format));
+    /* Formatted, nothing written: the cuts start from here */
+    std::vector<uint32_t> formatted((const uint32_t *)HOST_FLASH_START, (const uint32_t *)HOST_FLASH_END);
+
+    for (int how = SET_BATCH; how <= SET_SEPARATE; how++) {
+        cutWrite = (SetWrite)how;
+        unsigned cuts = 0, partial = 0, failed = 0;
+        uint64_t completeUs = 0;
+        int first = -1, last = -1;
+        for (cutUs = 0; cutUs <= CUT_SPAN_US; cutUs += CUT_STEP_US) {
+            memcpy((void *)HOST_FLASH_START, &formatted[0], formatted.size() * 4);
+            int written = inChild(writeThenCut);
+            int found = inChild(mountAndCount);
+            cuts++;
+            failed += (written != 0) || (found < 0) || (found > SET_RECORDS);
+            partial += (found > 0) && (found < SET_RECORDS);
+            if (found == SET_RECORDS && completeUs == 0) {
+                completeUs = cutUs;
+            }
+            first = (first < 0) ? found : first;
+            last = found;
+        }
+        REPORT("%s: %u power cuts, %u leave part of the set, the whole set from %llu us\n",
+               how == SET_BATCH ? "batch" : "separate writes", cuts, partial, (unsigned long long)completeUs);
+        CHECK_EQUAL(0, failed);
+        CHECK_EQUAL(0, first);
+        CHECK_EQUAL(SET_RECORDS, last);
+        if (how == SET_BATCH) {
+            CHECK_EQUAL(0, partial);
+        } else {
+            CHECK(partial > 0);
+        }
+    }
+    host_flash_erase_all();
+}
+
+/* Flash operations and time to write the set, as a batch and one by one.
+ * The batch takes fewer operations, but programs its own header on top. */
+static void test_batch_against_separate_writes(void)
+{
+    unsigned operations[2], words[2];
+    uint64_t us[2];
+    for (int how = SET_BATCH; how <= SET_SEPARATE; how++) {
+        emptyPages();
+        events.clear();
+        unsigned before = host_sd_count("sd_flash_write");
+        unsigned wordsBefore = host_sd_flash.words;
+        uint64_t start = host_now_us();
+        CHECK_EQUAL(NRF_SUCCESS, writeSet((SetWrite)how));
+        pump();
+        CHECK_EQUAL(SET_RECORDS, setRecordsFound());
+        CHECK_EQUAL(0, failedEvents());
+        operations[how] = host_sd_count("sd_flash_write") - before;
+        words[how] = host_sd_flash.words - wordsBefore;
+        us[how] = events.empty() ? 0 : events.back().us - start;
+    }
+    REPORT("%d one-word records: %u flash writes, %u words and %llu us as a batch, %u, %u and %llu us one by one\n",
+           SET_RECORDS, operations[SET_BATCH], words[SET_BATCH], (unsigned long long)us[SET_BATCH],
+           operations[SET_SEPARATE], words[SET_SEPARATE], (unsigned long long)us[SET_SEPARATE]);
+    CHECK(operations[SET_BATCH] < operations[SET_SEPARATE]);
+    CHECK_EQUAL(words[SET_SEPARATE] + sizeof(fds_header_t) / 4, words[SET_BATCH]);
+    CHECK_EQUAL(words[SET_BATCH] * HOST_FLASH_WORD_US, us[SET_BATCH]);
+}
+
+int main(void)
+{
+    RUN_TEST(test_power_cut_during_a_set);
+
+    CHECK(mount());
+    RUN_TEST(test_index_follows_the_flash);
+    RUN_TEST(test_lookup_index_against_scan);
+    RUN_TEST(test_gc_gives_way);
+    RUN_TEST(test_worst_write_latency);
+    RUN_TEST(test_batch_against_separate_writes);
+    return TEST_RESULT();
+}
@@ -0,0 +1,303 @@
+/* nRF5xGattServer against the SoftDevice stub: what reaches the stack when
+ * the services refresh their characteristics. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "nRF5xn.h"
+#include "TimerWheel.h"
+#include "ImobStateService.h"
+#include "RELAYService.h"
+#include "ALARMService.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+
+#include <chrono>
+#include <vector>
+
+static nRF5xGattServer &server(void)
+{
+    return (nRF5xGattServer &) nRF5xn::Instance(BLE::DEFAULT_INSTANCE).getGattServer();
+}
+
+/* Writing the same value twice only reaches the SoftDevice once */
+static void test_value_shadow_suppresses_repeated_writes(void)
+{
+    host_ble_reset();
+
+    uint8_t initial = 0;
+    ReadOnlyGattCharacteristic<uint8_t> readOnly(0xA001, &initial);
+    ReadOnlyGattCharacteristic<uint8_t> notified(0xA002, &initial, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY);
+    GattCharacteristic *characteristics[] = {&readOnly, &notified};
+    GattService service(0xA000, characteristics, 2);
+    CHECK_EQUAL(BLE_ERROR_NONE, BLE::Instance().gattServer().addService(service));
+
+    host_sd_reset_counts();
+    uint8_t value = 1;
+    CHECK_EQUAL(BLE_ERROR_NONE, server().write(BLE_CONN_HANDLE_INVALID, readOnly.getValueHandle(), &value, 1));
+    CHECK_EQUAL(BLE_ERROR_NONE, server().write(BLE_CONN_HANDLE_INVALID, readOnly.getValueHandle(), &value, 1));
+
+    const nRF5xGattServer::ValueShadow_t::Statistics_t &stats = server().getValueShadowStatistics();
+    CHECK_EQUAL(1, stats.suppressed);
+    CHECK_EQUAL(1, stats.issued);
+    CHECK_EQUAL(1, host_sd_count("sd_ble_gatts_value_set"));
+    CHECK_EQUAL(1, host_sd_value(readOnly.getValueHandle())[0]);
+
+    /* Same for notifications, one hvx for two writes */
+    CHECK_EQUAL(BLE_ERROR_NONE, server().write(BLE_CONN_HANDLE_INVALID, notified.getValueHandle(), &value, 1));
+    CHECK_EQUAL(BLE_ERROR_NONE, server().write(BLE_CONN_HANDLE_INVALID, notified.getValueHandle(), &value, 1));
+    CHECK_EQUAL(2, stats.suppressed);
+    CHECK_EQUAL(2, stats.issued);
+    CHECK_EQUAL(1, host_sd_count("sd_ble_gatts_hvx"));
+}
+
+/* The initial value registered with the characteristic counts as written */
+static void test_value_shadow_is_seeded_by_add_service(void)
+{
+    host_ble_reset();
+
+    uint8_t initial = 7;
+    ReadOnlyGattCharacteristic<uint8_t> readOnly(0xA001, &initial);
+    GattCharacteristic *characteristics[] = {&readOnly};
+    GattService service(0xA000, characteristics, 1);
+    BLE::Instance().gattServer().addService(service);
+
+    host_sd_reset_counts();
+    CHECK_EQUAL(BLE_ERROR_NONE, server().write(BLE_CONN_HANDLE_INVALID, readOnly.getValueHandle(), &initial, 1));
+    CHECK_EQUAL(0, host_sd_total());
+    CHECK_EQUAL(1, server().getValueShadowStatistics().suppressed);
+    CHECK_EQUAL(0, server().getValueShadowStatistics().issued);
+}
+
+/* A refused notification is neither shadowed nor suppressed on retry */
+static void test_value_shadow_retries_after_busy(void)
+{
+    host_ble_reset();
+
+    uint8_t initial = 0;
+    ReadOnlyGattCharacteristic<uint8_t> notified(0xA002, &initial, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY);
+    GattCharacteristic *characteristics[] = {&notified};
+    GattService service(0xA000, characteristics, 1);
+    BLE::Instance().gattServer().addService(service);
+
+    host_sd_reset_counts();
+    uint8_t value = 3;
+    host_sd_hvx_result = NRF_ERROR_BUSY;
+    CHECK_EQUAL(BLE_STACK_BUSY, server().write(BLE_CONN_HANDLE_INVALID, notified.getValueHandle(), &value, 1));
+    host_sd_hvx_result = NRF_SUCCESS;
+    CHECK_EQUAL(BLE_ERROR_NONE, server().write(BLE_CONN_HANDLE_INVALID, notified.getValueHandle(), &value, 1));
+    CHECK_EQUAL(2, host_sd_count("sd_ble_gatts_hvx"));
+    CHECK_EQUAL(0, server().getValueShadowStatistics().suppressed);
+    CHECK_EQUAL(2, server().getValueShadowStatistics().issued);
+}
+
+#define LOOKUPS 1000000
+
+/* Suppressed write of the same byte: the handle lookup and the shadow
+ * compare, no SoftDevice call */
+static double suppressedWriteNs(GattAttribute::Handle_t handle)
+{
+    uint8_t value = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < LOOKUPS; i++) {
+        server().write(BLE_CONN_HANDLE_INVALID, handle, &value, 1);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / LOOKUPS;
+}
+
+/* The scan the handle table replaced, over the same handles */
+static double linearScanNs(const GattAttribute::Handle_t handles[], unsigned count, GattAttribute::Handle_t handle)
+{
+    volatile int found = -1;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < LOOKUPS; i++) {
+        const volatile GattAttribute::Handle_t *scanned = handles;
+        for (unsigned charIndex = 0; charIndex < count; charIndex++) {
+            if (scanned[charIndex] == handle) {
+                found = charIndex;
+                break;
+            }
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    (void)found;
+    return std::chrono::duration<double, std::nano>(end - start).count() / LOOKUPS;
+}
+
+/* A full table of notifying characteristics: every value handle resolves to
+ * its own characteristic, and the first and the last one cost the same */
+static void test_handle_table_lookup(void)
+{
+    host_ble_reset();
+
+    const unsigned count = YOTTA_CFG_BLE_GATT_TOTAL_CHARACTERISTICS;
+    uint8_t initial = 0;
+    ReadOnlyGattCharacteristic<uint8_t> *readOnly[count];
+    GattCharacteristic *characteristics[count];
+    for (unsigned i = 0; i < count; i++) {
+        readOnly[i] = new ReadOnlyGattCharacteristic<uint8_t>(0xA001 + i, &initial,
+                                                               GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY);
+        characteristics[i] = readOnly[i];
+    }
+    GattService service(0xA000, characteristics, count);
+    CHECK_EQUAL(BLE_ERROR_NONE, BLE::Instance().gattServer().addService(service));
+
+    GattAttribute::Handle_t handles[count];
+    int wrong = 0;
+    host_sd_reset_counts();
+    for (unsigned i = 0; i < count; i++) {
+        handles[i] = readOnly[i]->getValueHandle();
+        uint8_t value = i + 1;
+        server().write(BLE_CONN_HANDLE_INVALID, handles[i], &value, 1);
+        wrong += host_sd_value(handles[i])[0] != value;
+    }
+    CHECK_EQUAL(0, wrong);
+    CHECK_EQUAL(count, server().getValueShadowStatistics().issued);
+    CHECK(handles[count - 1] < (unsigned)YOTTA_CFG_BLE_GATT_HANDLE_TABLE_SIZE);
+
+    /* Back to 0 so that the timed writes are suppressed */
+    uint8_t zero = 0;
+    server().write(BLE_CONN_HANDLE_INVALID, handles[0], &zero, 1);
+    server().write(BLE_CONN_HANDLE_INVALID, handles[count - 1], &zero, 1);
+    host_sd_reset_counts();
+    /* Warm up */
+    suppressedWriteNs(handles[0]);
+    double firstNs = suppressedWriteNs(handles[0]);
+    double lastNs = suppressedWriteNs(handles[count - 1]);
+    CHECK_EQUAL(0, host_sd_total());
+    double scanFirstNs = linearScanNs(handles, count, handles[0]);
+    double scanLastNs = linearScanNs(handles, count, handles[count - 1]);
+
+    REPORT("%u characteristics, handles %u to %u of a %u entry table\n", count, handles[0], handles[count - 1],
+           (unsigned)YOTTA_CFG_BLE_GATT_HANDLE_TABLE_SIZE);
+    REPORT("suppressed write through the table: %.1f ns to the first, %.1f ns to the last\n", firstNs, lastNs);
+    REPORT("linear scan alone: %.1f ns to the first, %.1f ns to the last\n", scanFirstNs, scanLastNs);
+
+    for (unsigned i = 0; i < count; i++) {
+        delete readOnly[i];
+    }
+}
+
+static void connect(void)
+{
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id = BLE_GAP_EVT_CONNECTED;
+    event.evt.gap_evt.conn_handle = 1;
+    event.evt.gap_evt.params.connected.role = BLE_GAP_ROLE_PERIPH;
+    host_ble_event(&event);
+}
+
+static unsigned notificationsOf(uint16_t handle)
+{
+    unsigned count = 0;
+    for (size_t i = 0; i < host_sd_notifications.size(); i++) {
+        count += host_sd_notifications[i].handle == handle;
+    }
+    return count;
+}
+
+/* Writes to the other services leave ALARMService alone, and a write to a
+ * characteristic nobody handles makes no SoftDevice call at all */
+static void test_writes_to_unrelated_handles(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+    authenticated = false;
+
+    RtcTimerWheel wheel;
+    ImobStateService imob(BLE::Instance());
+    RELAYService relay(BLE::Instance(), &imob, wheel);
+    ALARMService alarm(BLE::Instance());
+    uint8_t initial = 0;
+    ReadWriteGattCharacteristic<uint8_t> unhandled(0xB001, &initial);
+    GattCharacteristic *characteristics[] = {&unhandled};
+    GattService service(0xB000, characteristics, 1);
+    BLE::Instance().gattServer().addService(service);
+    connect();
+
+    /* An alarm for the shadow not to hide a spurious write of 0 */
+    alarm.updateAlarmState(1);
+    uint16_t alarmHandle = alarm.getValueHandle();
+    host_sd_reset_counts();
+    host_sd_notifications.clear();
+
+    uint8_t value = 1;
+    host_ble_peer_write(unhandled.getValueHandle(), &value, 1);
+    CHECK_EQUAL(0, host_sd_total());
+
+    const uint16_t others[] = {
+        RELAYService::RELAY_STATE_CHARACTERISTIC_UUID,
+        ImobStateService::IMOB_STATE_PASS_CHARACTERISTIC_UUID,
+        ImobStateService::IMOB_STATE_COMMAND_CHARACTERISTIC_UUID
+    };
+    for (size_t i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+        host_ble_peer_write(host_sd_value_handle(others[i]), &value, 1);
+    }
+    unsigned otherCalls = host_sd_total();
+    CHECK_EQUAL(0, notificationsOf(alarmHandle));
+    CHECK_EQUAL(1, alarm.getAlarmState());
+    CHECK_EQUAL(1, host_sd_value(alarmHandle)[0]);
+
+    /* Its own handle still reaches it: refused without authentication */
+    host_ble_peer_write(alarmHandle, &value, 1);
+    CHECK_EQUAL(0, alarm.getAlarmState());
+    CHECK_EQUAL(1, notificationsOf(alarmHandle));
+    REPORT("writes to 3 handles of the other services: %u SoftDevice calls, none for the alarm\n", otherCalls);
+}
+
+struct WriteOrder {
+    void onAuthorize(GattWriteAuthCallbackParams *params)
+    {
+        params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+    }
+    void onCharacteristicWritten(const GattWriteCallbackParams *params)
+    {
+        order.push_back('c');
+    }
+    void onDataWritten(const GattWriteCallbackParams *params)
+    {
+        order.push_back('s');
+    }
+    std::vector<char> order;
+};
+
+/* An authorized write reaches the characteristic handler, then the server
+ * wide handlers, as a plain write does */
+static void test_authorized_write_dispatch(void)
+{
+    host_ble_reset();
+
+    WriteOrder handlers;
+    uint8_t initial = 0;
+    ReadWriteGattCharacteristic<uint8_t> authorized(0xB001, &initial);
+    authorized.setWriteAuthorizationCallback(&handlers, &WriteOrder::onAuthorize);
+    authorized.setWriteCallback(&handlers, &WriteOrder::onCharacteristicWritten);
+    GattCharacteristic *characteristics[] = {&authorized};
+    GattService service(0xB000, characteristics, 1);
+    BLE::Instance().gattServer().addService(service);
+    BLE::Instance().gattServer().onDataWritten(&handlers, &WriteOrder::onDataWritten);
+
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id = BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST;
+    event.evt.gatts_evt.params.authorize_request.type = BLE_GATTS_AUTHORIZE_TYPE_WRITE;
+    event.evt.gatts_evt.params.authorize_request.request.write.handle = authorized.getValueHandle();
+    event.evt.gatts_evt.params.authorize_request.request.write.op = BLE_GATTS_OP_WRITE_REQ;
+    event.evt.gatts_evt.params.authorize_request.request.write.len = 1;
+    host_ble_event(&event);
+
+    const char expected[] = {'c', 's'};
+    CHECK(handlers.order == std::vector<char>(expected, expected + 2));
+}
+
+int main()
+{
+    RUN_TEST(test_value_shadow_suppresses_repeated_writes);
+    RUN_TEST(test_value_shadow_is_seeded_by_add_service);
+    RUN_TEST(test_value_shadow_retries_after_busy);
+    RUN_TEST(test_handle_table_lookup);
+    RUN_TEST(test_writes_to_unrelated_handles);
+    RUN_TEST(test_authorized_write_dispatch);
+    return TEST_RESULT();
+}
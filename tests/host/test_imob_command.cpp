@@ -0,0 +1,231 @@
+/* ImobStateService: a simulated central authenticates and activates through
+ * the nonce/pass exchange and through the single write command; ATT round
+ * trips, time spent in the write handlers and refusal of stale challenges. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "ImobStateService.h"
+#include "ConnectionProfileManager.h"
+#include "host_softdevice.h"
+#include "ble_hci.h"
+#include "host_test.h"
+
+static const uint8_t key[KEYLEN] = {
+    0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C
+};
+static const uint8_t password[PASSLEN] = {'i', '-', 'm', 'o', 'b', ' ', 't', 'e', 's', 't', 0, 0, 0, 0, 0, 1};
+
+/* Central side. Every ATT request gets its response in the next connection
+ * event, so a transaction costs one connection interval on top of the time
+ * the device spends in its handler. */
+struct Central {
+    Central() : transactions(0), handlerUs(0) {}
+
+    void write(uint16_t uuid, const uint8_t *data, uint16_t len)
+    {
+        uint64_t start = host_now_us();
+        host_ble_peer_write(host_sd_value_handle(uuid), data, len);
+        handlerUs += host_now_us() - start;
+        transactions++;
+    }
+
+    std::vector<uint8_t> read(uint16_t uuid)
+    {
+        transactions++;
+        return host_sd_value(host_sd_value_handle(uuid));
+    }
+
+    uint64_t latencyUs(uint32_t intervalMs) const
+    {
+        return transactions * intervalMs * 1000ULL + handlerUs;
+    }
+
+    unsigned transactions;
+    uint64_t handlerUs;
+};
+
+static void setUp(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+    authenticated = false;
+    activated = false;
+    initial_activation = false;
+    /* The scan response goes with an advertising payload */
+    BLE::Instance().gap().accumulateAdvertisingPayload(GapAdvertisingData::BREDR_NOT_SUPPORTED | GapAdvertisingData::LE_GENERAL_DISCOVERABLE);
+}
+
+static void connect(void)
+{
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id = BLE_GAP_EVT_CONNECTED;
+    event.evt.gap_evt.conn_handle = 1;
+    event.evt.gap_evt.params.connected.role = BLE_GAP_ROLE_PERIPH;
+    for (uint8_t i = 0; i < BLE_GAP_ADDR_LEN; i++) {
+        event.evt.gap_evt.params.connected.peer_addr.addr[i] = 0xC0 + i;
+    }
+    host_ble_event(&event);
+}
+
+static void disconnect(void)
+{
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id = BLE_GAP_EVT_DISCONNECTED;
+    event.evt.gap_evt.conn_handle = 1;
+    event.evt.gap_evt.params.disconnected.reason = BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION;
+    host_ble_event(&event);
+}
+
+/* Idle work of the main loop */
+static void mainLoop(ImobStateService &service)
+{
+    while (ctr_precompute()) { }
+    while (service.precomputeChallenge()) { }
+}
+
+/* Challenge as a central reads it from the scan response */
+static bool scannedChallenge(uint8_t challenge[PASSLEN])
+{
+    const std::vector<uint8_t> &data = host_sd_adv.scanResponse;
+    for (size_t i = 0; i + 1 < data.size(); i += data[i] + 1) {
+        if ((data[i] == 1 + CHALLENGE_SERVICE_DATA_LEN) && (data[i + 1] == GapAdvertisingData::SERVICE_DATA) &&
+            ((data[i + 2] | (data[i + 3] << 8)) == ImobStateService::IMOB_STATE_SERVICE_UUID)) {
+            memset(challenge, 0, PASSLEN);
+            memcpy(&challenge[COUNTER_BYTE_LEN], &data[i + 4], NONCE_RAND_BYTE_LEN);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void signCommand(const uint8_t challenge[PASSLEN], uint8_t command, uint8_t data[COMMANDLEN])
+{
+    data[0] = command;
+    command_mac(challenge, command, key, &data[1]);
+}
+
+/* Nonce, pass, authentication check and activation: four requests after the
+ * nonce, the nonce drawn in the write handler */
+static Central legacyActivation(ImobStateService &service)
+{
+    Central central;
+    uint8_t nonce[PASSLEN] = {0};
+    central.write(ImobStateService::IMOB_STATE_NONCE_CHARACTERISTIC_UUID, nonce, PASSLEN);
+    mainLoop(service);
+    CHECK_EQUAL(1, central.read(ImobStateService::IMOB_STATE_NONCE_UPDATED_CHARACTERISTIC_UUID)[0]);
+    central.write(ImobStateService::IMOB_STATE_PASS_CHARACTERISTIC_UUID, password, PASSLEN);
+    mainLoop(service);
+    CHECK_EQUAL(1, central.read(ImobStateService::IMOB_STATE_AUTHENTICATION_CHARACTERISTIC_UUID)[0]);
+    uint8_t on = 1;
+    central.write(ImobStateService::IMOB_STATE_ACTIVATION_CHARACTERISTIC_UUID, &on, 1);
+    mainLoop(service);
+    return central;
+}
+
+/* The challenge came with the scan response: one write */
+static Central commandActivation(ImobStateService &service)
+{
+    Central central;
+    uint8_t challenge[PASSLEN], data[COMMANDLEN];
+    CHECK(scannedChallenge(challenge));
+    signCommand(challenge, COMMAND_ACTIVATE, data);
+    central.write(ImobStateService::IMOB_STATE_COMMAND_CHARACTERISTIC_UUID, data, COMMANDLEN);
+    mainLoop(service);
+    return central;
+}
+
+static void configure(ImobStateService &service)
+{
+    service.setCryptKey(key);
+    service.setCorrectPass(password);
+    mainLoop(service);
+}
+
+static void reportLatency(const char *path, const Central &central)
+{
+    REPORT("%-8s %u ATT transactions, %5llu us in the handlers, %4llu ms at %d ms, %5llu ms at %d ms\n",
+           path, central.transactions, (unsigned long long)central.handlerUs,
+           (unsigned long long)central.latencyUs(CONN_FAST_MAX_INTERVAL) / 1000, CONN_FAST_MAX_INTERVAL,
+           (unsigned long long)central.latencyUs(CONN_IDLE_MAX_INTERVAL) / 1000, CONN_IDLE_MAX_INTERVAL);
+}
+
+static void test_latency_of_the_two_paths(void)
+{
+    setUp();
+    ImobStateService service(BLE::Instance());
+    configure(service);
+
+    connect();
+    /* Pool drawn dry by the stack, as after a connection */
+    host_sd_rand_drain();
+    Central legacy = legacyActivation(service);
+    CHECK(authenticated);
+    CHECK(activated);
+    CHECK(service.isPeerAuthenticated());
+    disconnect();
+    mainLoop(service);
+    activated = false;
+
+    connect();
+    host_sd_rand_drain();
+    Central command = commandActivation(service);
+    CHECK(activated);
+    CHECK(service.isPeerAuthenticated());
+    disconnect();
+
+    reportLatency("legacy", legacy);
+    reportLatency("command", command);
+    CHECK_EQUAL(5, legacy.transactions);
+    CHECK_EQUAL(1, command.transactions);
+    /* The nonce write waits for the RNG, the command only runs one ECB */
+    CHECK(legacy.handlerUs >= NONCE_RAND_BYTE_LEN * HOST_RAND_BYTE_US);
+    CHECK(command.handlerUs <= 2 * HOST_ECB_BLOCK_US);
+}
+
+/* Every attempt burns the challenge, and without a drawn one the command is
+ * refused before any tag is computed */
+static void test_stale_challenges_are_refused(void)
+{
+    setUp();
+    ImobStateService service(BLE::Instance());
+    configure(service);
+    connect();
+
+    uint8_t challenge[PASSLEN], data[COMMANDLEN];
+    CHECK(scannedChallenge(challenge));
+    signCommand(challenge, COMMAND_ACTIVATE, data);
+
+    /* Wrong tag: refused, the challenge is gone */
+    data[COMMANDLEN - 1] ^= 1;
+    host_ble_peer_write(host_sd_value_handle(ImobStateService::IMOB_STATE_COMMAND_CHARACTERISTIC_UUID), data, COMMANDLEN);
+    CHECK(!activated);
+    data[COMMANDLEN - 1] ^= 1;
+
+    /* Replay of the right tag against the next challenge */
+    host_ble_peer_write(host_sd_value_handle(ImobStateService::IMOB_STATE_COMMAND_CHARACTERISTIC_UUID), data, COMMANDLEN);
+    CHECK(!activated);
+
+    /* No challenge drawn since: refused without an ECB run */
+    host_sd_reset_counts();
+    host_ble_peer_write(host_sd_value_handle(ImobStateService::IMOB_STATE_COMMAND_CHARACTERISTIC_UUID), data, COMMANDLEN);
+    CHECK(!activated);
+    CHECK_EQUAL(0, host_sd_count("sd_ecb_block_encrypt"));
+
+    /* The main loop draws and publishes a fresh one */
+    mainLoop(service);
+    CHECK(scannedChallenge(challenge));
+    signCommand(challenge, COMMAND_ACTIVATE, data);
+    host_ble_peer_write(host_sd_value_handle(ImobStateService::IMOB_STATE_COMMAND_CHARACTERISTIC_UUID), data, COMMANDLEN);
+    CHECK(activated);
+    std::vector<uint8_t> published = host_sd_value(host_sd_value_handle(ImobStateService::IMOB_STATE_CHALLENGE_CHARACTERISTIC_UUID));
+    CHECK(memcmp(&published[COUNTER_BYTE_LEN], &challenge[COUNTER_BYTE_LEN], NONCE_RAND_BYTE_LEN) == 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_latency_of_the_two_paths);
+    RUN_TEST(test_stale_challenges_are_refused);
+    return TEST_RESULT();
+}
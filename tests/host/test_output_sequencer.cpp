@@ -0,0 +1,207 @@
+/* OutputSequencer: edges land on the RTC tick of the timeline whatever the
+ * main loop is doing, a step the CPU could not program in time keeps the
+ * following ones in place, and the compare event survives EVTEN being
+ * rewritten between two steps. */
+
+#include "mbed.h"
+#include "TimerWheel.h"
+#include "OutputSequencer.h"
+#include "host_test.h"
+
+#define RELAY_PIN P0_8
+#define STARTER_PIN P0_9
+
+/* Relay on at once, starter pulse, relay off, a last relay pulse: two pins,
+ * a 0 delay group. Every delay is longer than the time the main loop takes
+ * to see the previous compare, up to two ticks of the wheel. */
+static const SequencerStep timeline[] = {
+    { RELAY_PIN, 1, 0 },
+    { STARTER_PIN, 1, 150 },
+    { STARTER_PIN, 0, 700 },
+    { RELAY_PIN, 0, 0 },
+    { RELAY_PIN, 1, 250 },
+    { RELAY_PIN, 0, 1000 }
+};
+#define STEPS (sizeof(timeline) / sizeof(timeline[0]))
+
+static void setUp(void)
+{
+    host_hw_reset();
+    host_edges.clear();
+}
+
+/* Tick of every step against the tick of start(), each delay rounded up on
+ * its own as the sequencer does */
+static void expectedTicks(uint64_t startTick, uint64_t ticks[STEPS])
+{
+    uint64_t tick = startTick;
+    for (size_t i = 0; i < STEPS; i++) {
+        tick += SEQUENCER_TICKS(timeline[i].delay);
+        ticks[i] = tick;
+    }
+}
+
+/* Level changes of a pin, in order, leaving out the pin turning into an
+ * output at its current level */
+static std::vector<HostEdge> edgesOf(int pin)
+{
+    std::vector<HostEdge> edges;
+    int level = 0;
+    for (size_t i = 0; i < host_edges.size(); i++) {
+        if (host_edges[i].pin == pin && host_edges[i].level != level) {
+            edges.push_back(host_edges[i]);
+            level = host_edges[i].level;
+        }
+    }
+    return edges;
+}
+
+/* Edge of every step, matched in order on its pin */
+static void stepEdges(std::vector<HostEdge> edges[STEPS])
+{
+    std::vector<HostEdge> relay = edgesOf(RELAY_PIN), starter = edgesOf(STARTER_PIN);
+    size_t r = 0, s = 0;
+    for (size_t i = 0; i < STEPS; i++) {
+        std::vector<HostEdge> &pinEdges = (timeline[i].pin == RELAY_PIN) ? relay : starter;
+        size_t &index = (timeline[i].pin == RELAY_PIN) ? r : s;
+        if (index < pinEdges.size()) {
+            edges[i].push_back(pinEdges[index++]);
+        }
+    }
+}
+
+struct Loop {
+    Loop() : sequencer(wheel), steps(0), clearEvten(false) {}
+
+    void start()
+    {
+        wheel.start();
+        sequencer.onStep(callback(this, &Loop::onStep));
+        startTick = host_rtc_ticks();
+        CHECK(sequencer.start(timeline, STEPS));
+    }
+
+    /* Main loop until the timeline is over */
+    void run()
+    {
+        uint64_t end = host_now_us() + 10000000;
+        while (sequencer.isRunning() && host_now_us() < end) {
+            wheel.poll();
+            wheel.schedule();
+            host_wait_for_event();
+        }
+    }
+
+    void onStep()
+    {
+        steps++;
+        /* As the us_ticker does when it is initialized again */
+        if (clearEvten) {
+            NRF_RTC1->EVTENCLR = 0xFFFFFFFF;
+        }
+    }
+
+    RtcTimerWheel wheel;
+    OutputSequencer sequencer;
+    uint64_t startTick;
+    unsigned steps;
+    bool clearEvten;
+};
+
+static int wrongEdges(uint64_t startTick, int &late)
+{
+    uint64_t ticks[STEPS];
+    expectedTicks(startTick, ticks);
+    std::vector<HostEdge> edges[STEPS];
+    stepEdges(edges);
+    int wrong = 0;
+    late = 0;
+    for (size_t i = 0; i < STEPS; i++) {
+        if (edges[i].size() != 1 || edges[i][0].level != timeline[i].level) {
+            wrong++;
+            continue;
+        }
+        late += edges[i][0].tick != ticks[i];
+    }
+    return wrong;
+}
+
+static void test_edges_on_the_timeline(void)
+{
+    setUp();
+    /* Start away from the tick boundary of the wheel */
+    host_advance_us(12345);
+    Loop loop;
+    loop.start();
+    loop.run();
+    CHECK_EQUAL(OutputSequencer::STATUS_DONE, loop.sequencer.getStatus());
+
+    int late;
+    CHECK_EQUAL(0, wrongEdges(loop.startTick, late));
+    CHECK_EQUAL(0, late);
+    CHECK_EQUAL(0, host_pin_level(RELAY_PIN));
+    CHECK_EQUAL(0, host_pin_level(STARTER_PIN));
+    /* The 0 delay step comes with the one before it */
+    CHECK_EQUAL(STEPS - 1, loop.steps);
+
+    uint64_t ticks[STEPS];
+    expectedTicks(loop.startTick, ticks);
+    REPORT("starter pulse %llu ticks (%u ms), relay off %llu ticks after start\n",
+           (unsigned long long)(ticks[2] - ticks[1]), timeline[2].delay,
+           (unsigned long long)(ticks[3] - loop.startTick));
+}
+
+/* The main loop is held for a second once the starter pulse has started:
+ * the hardware ends the pulse on time, the relay pulse due during the hold
+ * is applied late by the CPU and the last step keeps its place */
+static void test_late_main_loop(void)
+{
+    setUp();
+    Loop loop;
+    loop.start();
+    while (true) {
+        loop.wheel.poll();
+        loop.wheel.schedule();
+        if (loop.sequencer.getStep() >= 2) {
+            break;
+        }
+        host_wait_for_event();
+    }
+    host_advance_us(1000000);
+    loop.run();
+    CHECK_EQUAL(OutputSequencer::STATUS_DONE, loop.sequencer.getStatus());
+
+    uint64_t ticks[STEPS];
+    expectedTicks(loop.startTick, ticks);
+    std::vector<HostEdge> edges[STEPS];
+    stepEdges(edges);
+    CHECK_EQUAL(ticks[2], edges[2][0].tick);
+    CHECK_EQUAL(ticks[3], edges[3][0].tick);
+    CHECK(edges[4][0].tick > ticks[4]);
+    CHECK_EQUAL(ticks[5], edges[5][0].tick);
+    REPORT("relay pulse %llu ticks late, the next edge on its tick\n",
+           (unsigned long long)(edges[4][0].tick - ticks[4]));
+}
+
+/* EVTEN cleared from every step callback, before the next compare is
+ * programmed */
+static void test_evten_rewritten_between_steps(void)
+{
+    setUp();
+    Loop loop;
+    loop.clearEvten = true;
+    loop.start();
+    loop.run();
+    CHECK_EQUAL(OutputSequencer::STATUS_DONE, loop.sequencer.getStatus());
+    int late;
+    CHECK_EQUAL(0, wrongEdges(loop.startTick, late));
+    CHECK_EQUAL(0, late);
+}
+
+int main(void)
+{
+    RUN_TEST(test_edges_on_the_timeline);
+    RUN_TEST(test_late_main_loop);
+    RUN_TEST(test_evten_rewritten_between_steps);
+    return TEST_RESULT();
+}
@@ -0,0 +1,194 @@
+/* PowerManager on the virtual clock: wakeups per second of the idle main
+ * loop with the periodic work of main.cpp, read from getWakeups(). */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "TimerWheel.h"
+#include "PowerManager.h"
+#include "HwBlinker.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+
+/* Periods of main.cpp */
+#define TIME_CICLE 80 // ms
+#define CONTACT_SAMPLE_TIME 1000 // ms
+#define LIPO_SAMPLE_TIME 2000 // ms
+#define BATTERY_SAMPLE_TIME 10000 // ms
+#define ACCEL_SAMPLE_TIME 250 // ms, only without ACCEL_MOTION_INTERRUPT
+#define ALIVENESS_PERIOD 1000 // ms
+
+#define LED_PIN 18
+#define HOUR_US (3600ULL * 1000000)
+
+/* Periodic sampling timer, re-armed from its own callback */
+struct Sampler {
+    Sampler(TimerWheel &_wheel, uint32_t _periodMs) :
+        wheel(_wheel), periodMs(_periodMs), runs(0), timer(callback(this, &Sampler::run)) {}
+
+    void start()
+    {
+        run();
+    }
+
+    void run()
+    {
+        wheel.arm(timer, TIMER_WHEEL_MS(periodMs));
+        runs++;
+    }
+
+    TimerWheel &wheel;
+    uint32_t periodMs;
+    uint32_t runs;
+    WheelTimer timer;
+};
+
+struct Loop {
+    Loop(bool sampleAccel) :
+        powerManager(wheel),
+        led(wheel, (PinName)LED_PIN),
+        contact(wheel, CONTACT_SAMPLE_TIME),
+        charger(wheel, LIPO_SAMPLE_TIME),
+        battery(wheel, BATTERY_SAMPLE_TIME),
+        accel(wheel, ACCEL_SAMPLE_TIME),
+        sampleAccel(sampleAccel),
+        iterations(0)
+    {
+    }
+
+    /* Same order as main() */
+    void start()
+    {
+        powerManager.start(BLE::Instance());
+        wheel.start();
+        battery.start();
+        charger.start();
+        contact.start();
+        if (sampleAccel) {
+            accel.start();
+        }
+        led.start(TIME_CICLE, ALIVENESS_PERIOD);
+    }
+
+    void run(uint64_t us)
+    {
+        uint64_t end = host_now_us() + us;
+        while (host_now_us() < end) {
+            BLE::Instance().processEvents();
+            wheel.poll();
+            iterations++;
+            powerManager.sleep();
+        }
+    }
+
+    RtcTimerWheel wheel;
+    PowerManager powerManager;
+    HwBlinker led;
+    Sampler contact, charger, battery, accel;
+    bool sampleAccel;
+    uint32_t iterations;
+};
+
+static void setUp(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+}
+
+/* Flashes of the LED, the ones not turned off by the RTC compare after
+ * TIME_CICLE counted in `wrong` */
+static int ledFlashes(int &wrong)
+{
+    int flashes = 0;
+    uint64_t on = 0;
+    wrong = 0;
+    for (size_t i = 0; i < host_edges.size(); i++) {
+        if (host_edges[i].pin != LED_PIN) {
+            continue;
+        }
+        if (host_edges[i].level) {
+            flashes++;
+            on = host_edges[i].tick;
+        } else if (flashes > 0) {
+            wrong += (host_edges[i].tick - on) != HW_BLINKER_TICKS(TIME_CICLE);
+        }
+    }
+    return flashes;
+}
+
+/* Motion interrupt build: contact, charger, battery and LED share the
+ * one second wakeup */
+static void test_idle_loop_wakes_once_per_second(void)
+{
+    setUp();
+    Loop loop(false);
+    loop.start();
+    loop.run(HOUR_US);
+
+    double rate = loop.powerManager.getWakeups() / 3600.0;
+    REPORT("motion interrupt: %u wakeups/h, %.2f/s (80 ms Ticker: 12.50/s)\n",
+           (unsigned)loop.powerManager.getWakeups(), rate);
+    CHECK(loop.contact.runs >= 3600);
+    CHECK(loop.battery.runs >= 360);
+    int wrong;
+    CHECK(ledFlashes(wrong) >= 3600);
+    CHECK_EQUAL(0, wrong);
+    CHECK(loop.powerManager.getWakeups() <= 3601);
+    CHECK(rate < 1.01);
+}
+
+/* Sampling build: the accelerometer adds its own 4 Hz */
+static void test_sampling_loop_wake_rate(void)
+{
+    setUp();
+    Loop loop(true);
+    loop.start();
+    loop.run(HOUR_US);
+
+    double rate = loop.powerManager.getWakeups() / 3600.0;
+    REPORT("accelerometer sampling: %u wakeups/h, %.2f/s\n", (unsigned)loop.powerManager.getWakeups(), rate);
+    CHECK(loop.accel.runs >= 3600 * 4);
+    /* ACCEL_SAMPLE_TIME rounds up to 8 ticks, 250 ms */
+    CHECK(rate < 4.01);
+}
+
+/* Pending BLE work skips the wait and is not counted as a wakeup */
+static void test_pending_events_skip_the_sleep(void)
+{
+    setUp();
+    Loop loop(false);
+    loop.start();
+    loop.run(1000);
+    uint32_t wakeups = loop.powerManager.getWakeups();
+    uint64_t before = host_now_us();
+
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id = BLE_GAP_EVT_RSSI_CHANGED;
+    host_ble_post(event);
+    loop.powerManager.sleep();
+    CHECK_EQUAL(wakeups, loop.powerManager.getWakeups());
+    CHECK_EQUAL(before, host_now_us());
+
+    loop.powerManager.requestRun();
+    loop.powerManager.sleep();
+    CHECK_EQUAL(wakeups, loop.powerManager.getWakeups());
+    CHECK_EQUAL(before, host_now_us());
+
+    /* The event register set by the stack ends the next wait at once, the
+     * one after sleeps until the next timer */
+    BLE::Instance().processEvents();
+    loop.powerManager.sleep();
+    CHECK_EQUAL(wakeups + 1, loop.powerManager.getWakeups());
+    CHECK_EQUAL(before, host_now_us());
+    loop.powerManager.sleep();
+    CHECK_EQUAL(wakeups + 2, loop.powerManager.getWakeups());
+    CHECK(host_now_us() > before);
+}
+
+int main(void)
+{
+    RUN_TEST(test_idle_loop_wakes_once_per_second);
+    RUN_TEST(test_sampling_loop_wake_rate);
+    RUN_TEST(test_pending_events_skip_the_sleep);
+    return TEST_RESULT();
+}
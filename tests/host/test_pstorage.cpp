@@ -0,0 +1,284 @@
+/* pstorage on the simulated flash: page erases and writes of each kind of
+ * update, as the flash counts them, and the completions of updates that
+ * need no flash access reaching the application from the main loop. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+
+extern "C" {
+#include "pstorage.h"
+}
+
+#include <vector>
+
+#define BLOCK_SIZE 16
+#define BLOCK_COUNT 8
+#define BLOCK_WORDS (BLOCK_SIZE / 4)
+
+struct Completion {
+    uint8_t opCode;
+    uint32_t result;
+    const uint8_t *data;
+    bool inCall; /* called back from inside pstorage_store() or pstorage_update() */
+};
+static std::vector<Completion> completions;
+static bool inCall;
+
+static void onPstorageEvent(pstorage_handle_t *handle, uint8_t op_code, uint32_t result, uint8_t *p_data,
+                            uint32_t data_len)
+{
+    Completion completion = { op_code, result, p_data, inCall };
+    completions.push_back(completion);
+}
+
+static pstorage_handle_t base;
+
+/* Main loop until the flash is idle */
+static void pump(void)
+{
+    do {
+        BLE::Instance().processEvents();
+    } while (host_advance_to_next(1000000));
+    BLE::Instance().processEvents();
+}
+
+static void setUp(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+    host_flash_erase_all();
+    completions.clear();
+    pstorage_module_param_t param = { onPstorageEvent, BLOCK_SIZE, BLOCK_COUNT };
+    CHECK_EQUAL(NRF_SUCCESS, pstorage_init());
+    CHECK_EQUAL(NRF_SUCCESS, pstorage_register(&param, &base));
+}
+
+static pstorage_handle_t block(int n)
+{
+    pstorage_handle_t handle;
+    CHECK_EQUAL(NRF_SUCCESS, pstorage_block_identifier_get(&base, n, &handle));
+    return handle;
+}
+
+static const uint32_t *flashBlock(int n)
+{
+    return (const uint32_t *)(uintptr_t)block(n).block_id;
+}
+
+static uint32_t store(int n, const uint32_t *data)
+{
+    pstorage_handle_t handle = block(n);
+    inCall = true;
+    uint32_t ret = pstorage_store(&handle, (uint8_t *)data, BLOCK_SIZE, 0);
+    inCall = false;
+    return ret;
+}
+
+static uint32_t update(int n, const uint32_t *data)
+{
+    pstorage_handle_t handle = block(n);
+    inCall = true;
+    uint32_t ret = pstorage_update(&handle, (uint8_t *)data, BLOCK_SIZE, 0);
+    inCall = false;
+    return ret;
+}
+
+/* Flash operations as the flash sees them */
+struct Cost {
+    unsigned erases;
+    unsigned writes;
+    unsigned words;
+};
+
+static Cost flashCost(void)
+{
+    Cost cost = { host_sd_flash.erases, host_sd_count("sd_flash_write"), host_sd_flash.words };
+    return cost;
+}
+
+static Cost since(const Cost &before)
+{
+    Cost now = flashCost();
+    Cost cost = { now.erases - before.erases, now.writes - before.writes, now.words - before.words };
+    return cost;
+}
+
+/* The statistics of pstorage count what reached the flash */
+static pstorage_statistics_t checkStatistics(void)
+{
+    pstorage_statistics_t stats;
+    CHECK_EQUAL(NRF_SUCCESS, pstorage_statistics_get(&stats));
+    CHECK_EQUAL(host_sd_flash.erases, stats.page_erase_count);
+    CHECK_EQUAL(host_sd_count("sd_flash_write"), stats.write_count);
+    CHECK_EQUAL(host_sd_flash.words, stats.word_write_count);
+    /* nRF51: two writes of a word between erases */
+    CHECK(host_sd_flash.maxWordWrites <= 2);
+    return stats;
+}
+
+static unsigned failedCompletions(void)
+{
+    unsigned failed = 0;
+    for (size_t i = 0; i < completions.size(); i++) {
+        failed += (completions[i].result != NRF_SUCCESS) || completions[i].inCall;
+    }
+    return failed;
+}
+
+static bool blockHolds(int n, const uint32_t *data)
+{
+    return memcmp(flashBlock(n), data, BLOCK_SIZE) == 0;
+}
+
+/* Every block written, then one of them changed: the erase of the swap page
+ * and of the data page, the cost every update had before */
+static void test_update_of_written_words(void)
+{
+    setUp();
+    static uint32_t data[BLOCK_COUNT][BLOCK_WORDS];
+    for (int n = 0; n < BLOCK_COUNT; n++) {
+        for (int i = 0; i < BLOCK_WORDS; i++) {
+            data[n][i] = 0x1000 * n + i;
+        }
+        CHECK_EQUAL(NRF_SUCCESS, store(n, data[n]));
+        pump();
+    }
+    Cost before = flashCost();
+    static const uint32_t changed[BLOCK_WORDS] = { 0xC0, 0xC1, 0xC2, 0xC3 };
+    CHECK_EQUAL(NRF_SUCCESS, update(3, changed));
+    pump();
+    Cost cost = since(before);
+    REPORT("update of written words: %u erases, %u writes, %u words\n", cost.erases, cost.writes, cost.words);
+    CHECK_EQUAL(2, cost.erases);
+    CHECK(blockHolds(3, changed));
+    for (int n = 0; n < BLOCK_COUNT; n++) {
+        CHECK(n == 3 || blockHolds(n, data[n]));
+    }
+    CHECK_EQUAL(BLOCK_COUNT + 1, completions.size());
+    CHECK_EQUAL(0, failedCompletions());
+    CHECK_EQUAL(0, checkStatistics().update_in_place_count);
+}
+
+/* An update into erased words writes the runs that differ, nothing else */
+static void test_update_into_erased_words(void)
+{
+    setUp();
+    static const uint32_t blank[BLOCK_WORDS] = { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
+    static const uint32_t first[BLOCK_WORDS] = { 0xA0, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
+    static const uint32_t second[BLOCK_WORDS] = { 0xA0, 0xB1, 0xFFFFFFFF, 0xB3 };
+    Cost before = flashCost();
+    CHECK_EQUAL(NRF_SUCCESS, update(1, first));
+    pump();
+    Cost firstCost = since(before);
+    before = flashCost();
+    CHECK_EQUAL(NRF_SUCCESS, update(1, second));
+    pump();
+    Cost secondCost = since(before);
+    REPORT("update into an erased block: %u erases, %u writes, %u words; of two more erased words: %u, %u, %u\n",
+           firstCost.erases, firstCost.writes, firstCost.words, secondCost.erases, secondCost.writes,
+           secondCost.words);
+    CHECK_EQUAL(0, firstCost.erases);
+    CHECK_EQUAL(1, firstCost.writes);
+    CHECK_EQUAL(1, firstCost.words);
+    CHECK_EQUAL(0, secondCost.erases);
+    CHECK_EQUAL(2, secondCost.writes);
+    CHECK_EQUAL(2, secondCost.words);
+    CHECK(blockHolds(1, second));
+    CHECK(blockHolds(0, blank));
+    CHECK(blockHolds(2, blank));
+    CHECK_EQUAL(2, completions.size());
+    CHECK_EQUAL(0, failedCompletions());
+    CHECK_EQUAL(2, checkStatistics().update_in_place_count);
+    CHECK_EQUAL(1, host_sd_flash.maxWordWrites);
+}
+
+/* Updates with the data already in flash: no flash operation, and each
+ * completion arrives from the main loop, after pstorage_update() returned */
+static void test_unchanged_updates(void)
+{
+    setUp();
+    static const uint32_t data[BLOCK_WORDS] = { 0x11, 0x22, 0x33, 0x44 };
+    CHECK_EQUAL(NRF_SUCCESS, store(0, data));
+    pump();
+    Cost before = flashCost();
+    unsigned late = 0;
+    for (int i = 0; i < 10; i++) {
+        size_t done = completions.size();
+        CHECK_EQUAL(NRF_SUCCESS, update(0, data));
+        late += (completions.size() == done);
+        BLE::Instance().processEvents();
+        CHECK_EQUAL(done + 1, completions.size());
+    }
+    pump();
+    Cost cost = since(before);
+    REPORT("10 unchanged updates: %u erases, %u writes, %u completions from the main loop\n", cost.erases,
+           cost.writes, late);
+    CHECK_EQUAL(0, cost.erases);
+    CHECK_EQUAL(0, cost.writes);
+    CHECK_EQUAL(10, late);
+    CHECK_EQUAL(11, completions.size());
+    CHECK_EQUAL(0, failedCompletions());
+    CHECK_EQUAL(PSTORAGE_UPDATE_OP_CODE, completions.back().opCode);
+    CHECK_EQUAL(10, checkStatistics().update_in_place_count);
+}
+
+/* An update of written words running, then two updates of an erased block:
+ * queued behind it, the second takes over the first and one in-place write
+ * replaces a write and a page swap */
+static const uint32_t firstUpdate[BLOCK_WORDS] = { 0xA0, 0xA1, 0xA2, 0xA3 };
+static const uint32_t secondUpdate[BLOCK_WORDS] = { 0xB0, 0xB1, 0xB2, 0xB3 };
+
+static Cost updatesOfABlock(bool queued)
+{
+    static const uint32_t data[BLOCK_WORDS] = { 0x11, 0x22, 0x33, 0x44 };
+    static const uint32_t changed[BLOCK_WORDS] = { 0x55, 0x66, 0x77, 0x88 };
+    setUp();
+    CHECK_EQUAL(NRF_SUCCESS, store(2, data));
+    pump();
+    completions.clear();
+    Cost before = flashCost();
+    CHECK_EQUAL(NRF_SUCCESS, update(2, changed));
+    if (!queued) {
+        pump();
+    }
+    CHECK_EQUAL(NRF_SUCCESS, update(5, firstUpdate));
+    if (!queued) {
+        pump();
+    }
+    CHECK_EQUAL(NRF_SUCCESS, update(5, secondUpdate));
+    pump();
+    CHECK(blockHolds(2, changed));
+    CHECK(blockHolds(5, secondUpdate));
+    CHECK_EQUAL(3, completions.size());
+    CHECK_EQUAL(0, failedCompletions());
+    return since(before);
+}
+
+static void test_queued_updates_merge(void)
+{
+    Cost apart = updatesOfABlock(false);
+    CHECK_EQUAL(0, checkStatistics().update_merge_count);
+    Cost merged = updatesOfABlock(true);
+    pstorage_statistics_t stats = checkStatistics();
+    REPORT("three updates: %u erases, %u writes, %u words one at a time, %u, %u, %u with two of them merged\n",
+           apart.erases, apart.writes, apart.words, merged.erases, merged.writes, merged.words);
+    CHECK_EQUAL(1, stats.update_merge_count);
+    CHECK_EQUAL(1, stats.update_in_place_count);
+    /* The swap of block 2 only, then the newest data of block 5 */
+    CHECK_EQUAL(apart.erases - 2, merged.erases);
+    CHECK(merged.writes < apart.writes);
+    /* Both sources of block 5, in the order they were requested */
+    CHECK(completions.size() == 3 && completions[1].data == (const uint8_t *)firstUpdate &&
+          completions[2].data == (const uint8_t *)secondUpdate);
+}
+
+int main(void)
+{
+    RUN_TEST(test_update_of_written_words);
+    RUN_TEST(test_update_into_erased_words);
+    RUN_TEST(test_unchanged_updates);
+    RUN_TEST(test_queued_updates_merge);
+    return TEST_RESULT();
+}
@@ -0,0 +1,100 @@
+/* SensorConversion.h against the float code it replaced, over every reading
+ * of the 10-bit ADC: AnalogIn::read() comparisons and percentages. */
+
+#include "mbed.h"
+#include "SensorConversion.h"
+#include "host_test.h"
+
+#include <math.h>
+
+#define PIN P0_1
+
+/* Float reading as the former main loop saw it */
+static float readFloat(uint16_t raw)
+{
+    host_set_analog(PIN, raw);
+    AnalogIn input(PIN);
+    return input.read();
+}
+
+/* Thresholds of main.cpp, compared as before against read() */
+static void test_thresholds_match_the_float_comparisons(void)
+{
+    host_hw_reset();
+    int mismatches = 0;
+    for (uint16_t raw = 0; raw <= ADC_FULL_SCALE; raw++) {
+        float reading = readFloat(raw);
+        mismatches += (reading > 0.21f) != (raw > ADC_RAW(0.21f));
+        mismatches += (reading > 0.4) != (raw > ADC_RAW(0.4f));
+        mismatches += (reading > 0.9) != (raw > ADC_RAW(0.9f));
+    }
+    CHECK_EQUAL(0, mismatches);
+
+    host_set_analog(PIN, ADC_FULL_SCALE);
+    AnalogIn input(PIN);
+    CHECK_EQUAL(ADC_FULL_SCALE, input.read_u16());
+    CHECK(input.read() == 1.0f);
+}
+
+/* Uncalibrated battery level: (uint8_t)(read() * 100.0f) */
+static void test_linear_percent_matches_the_float_level(void)
+{
+    host_hw_reset();
+    int mismatches = 0;
+    for (uint16_t raw = 0; raw <= ADC_FULL_SCALE; raw++) {
+        mismatches += (uint8_t)(readFloat(raw) * 100.0f) != adcPercent(raw);
+    }
+    CHECK_EQUAL(0, mismatches);
+    CHECK_EQUAL(100, adcPercent(ADC_FULL_SCALE));
+}
+
+/* Calibrated reading against raw / full * ADC_FULL_SCALE in float, for
+ * every calibration reading the divider can give at 4.2 V */
+static void test_calibrated_scale_within_one_count(void)
+{
+    int worst = 0;
+    int notFull = 0;
+    for (uint16_t full = ADC_FULL_SCALE / 4 + 1; full <= ADC_FULL_SCALE; full++) {
+        uint32_t factor = adcFullScaleFactor(full);
+        notFull += adcScale(full, factor) != ADC_FULL_SCALE;
+        notFull += lipoPercent(adcScale(full, factor)) != 100;
+        for (uint16_t raw = 0; raw <= full; raw++) {
+            int reference = (int)floorf((float)raw / full * ADC_FULL_SCALE);
+            int error = abs((int)adcScale(raw, factor) - reference);
+            if (error > worst) {
+                worst = error;
+            }
+        }
+    }
+    REPORT("worst calibrated error: %d count(s) of %lu\n", worst, ADC_FULL_SCALE);
+    CHECK_EQUAL(0, notFull);
+    CHECK(worst <= 1);
+
+    /* Clamped factors */
+    CHECK_EQUAL(Q16_ONE, adcFullScaleFactor(0));
+    CHECK_EQUAL(ADC_SCALE_MAX, adcFullScaleFactor(1));
+    CHECK_EQUAL(ADC_FULL_SCALE, adcScale(ADC_FULL_SCALE, ADC_SCALE_MAX));
+}
+
+/* The discharge curve is monotonic, empty below 3/4 of full scale */
+static void test_lipo_curve(void)
+{
+    int decreasing = 0;
+    for (uint16_t scaled = 1; scaled <= ADC_FULL_SCALE; scaled++) {
+        decreasing += lipoPercent(scaled) < lipoPercent(scaled - 1);
+    }
+    CHECK_EQUAL(0, decreasing);
+    CHECK_EQUAL(0, lipoPercent(LIPO_CURVE_START - 1));
+    CHECK_EQUAL(0, lipoPercent(ADC_RAW(0.75f)));
+    CHECK_EQUAL(100, lipoPercent(ADC_FULL_SCALE));
+    CHECK(lipoPercent(ADC_FULL_SCALE - 1) < 100);
+}
+
+int main(void)
+{
+    RUN_TEST(test_thresholds_match_the_float_comparisons);
+    RUN_TEST(test_linear_percent_matches_the_float_level);
+    RUN_TEST(test_calibrated_scale_within_one_count);
+    RUN_TEST(test_lipo_curve);
+    return TEST_RESULT();
+}
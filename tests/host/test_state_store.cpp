@@ -0,0 +1,202 @@
+/* StateStore over the SDK fds and fstorage, on the simulated flash: a day of
+ * the firmware state changes costs the words the holdoffs allow, the store
+ * counts the words the flash sees, and the last values reach flash. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "TimerWheel.h"
+#include "StateStore.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+
+/* Keys and schedules of main.cpp */
+#define STATE_ACTIVATION_DELAY 1000
+#define STATE_ACTIVATION_HOLDOFF 5000
+#define STATE_CALIBRATION_DELAY 10000
+#define STATE_CALIBRATION_HOLDOFF 3600000
+#define STATE_CYCLES_DELAY 60000
+#define STATE_CYCLES_HOLDOFF 3600000
+
+enum StateKey {
+    STATE_KEY_ACTIVATION = 1,
+    STATE_KEY_CALIBRATION,
+    STATE_KEY_CYCLES
+};
+
+struct ActivationState {
+    uint8_t activated;
+    uint8_t initialActivation;
+    uint8_t reserved[2];
+};
+
+struct CalibrationState {
+    uint32_t batteryLevelConstant;
+    uint8_t calibrated;
+    uint8_t reserved[3];
+};
+
+struct CycleState {
+    uint32_t chargeProgramCycles;
+    uint32_t dischargeProgramCycles;
+};
+
+/* A day of use: a program cycle every LIPO_SAMPLE_TIME, a new battery
+ * constant every 10 minutes, the immobilizer armed 20 times for 10 minutes */
+#define DAY_S (24 * 3600)
+#define CYCLE_PERIOD_S 2
+#define CALIBRATION_PERIOD_S 600
+#define ACTIVATIONS 20
+#define ACTIVATION_PERIOD_S (DAY_S / ACTIVATIONS)
+#define ACTIVATION_LENGTH_S 600
+
+/* Record header, the value, and the clear of the superseded record */
+#define HEADER_WORDS (sizeof(fds_header_t) / 4)
+#define UPDATE_WORDS(T) (HEADER_WORDS + sizeof(T) / 4 + 1)
+
+/* The boot of main.cpp, then its main loop */
+struct Device {
+    Device() : store(wheel) {}
+
+    void boot()
+    {
+        wheel.start();
+        store.add<ActivationState>(STATE_KEY_ACTIVATION, TIMER_WHEEL_MS(STATE_ACTIVATION_DELAY),
+                                   TIMER_WHEEL_MS(STATE_ACTIVATION_HOLDOFF));
+        store.add<CalibrationState>(STATE_KEY_CALIBRATION, TIMER_WHEEL_MS(STATE_CALIBRATION_DELAY),
+                                    TIMER_WHEEL_MS(STATE_CALIBRATION_HOLDOFF));
+        store.add<CycleState>(STATE_KEY_CYCLES, TIMER_WHEEL_MS(STATE_CYCLES_DELAY),
+                              TIMER_WHEEL_MS(STATE_CYCLES_HOLDOFF));
+        CHECK(store.start());
+        uint64_t end = host_now_us() + 1000000;
+        while (!store.isReady() && host_now_us() < end) {
+            BLE::Instance().processEvents();
+            host_wait_for_event();
+        }
+        CHECK(store.isRestored());
+    }
+
+    void run(uint64_t us)
+    {
+        uint64_t end = host_now_us() + us;
+        do {
+            BLE::Instance().processEvents();
+            wheel.poll();
+            if (host_now_us() >= end) {
+                break;
+            }
+            wheel.schedule();
+            host_advance_to_next(end - host_now_us());
+        } while (true);
+    }
+
+    RtcTimerWheel wheel;
+    StateStore store;
+};
+
+static void setUp(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+    host_flash_erase_all();
+}
+
+/* Value of the newest record of a key in flash */
+template <typename T>
+static bool readBack(uint16_t key, T &value)
+{
+    fds_find_token_t token;
+    fds_record_desc_t desc;
+    memset(&token, 0, sizeof(token));
+    memset(&desc, 0, sizeof(desc));
+    bool found = false;
+    uint32_t newest = 0;
+    while (fds_find_by_type(STATE_STORE_RECORD_TYPE, &desc, &token) == NRF_SUCCESS) {
+        fds_record_t record;
+        if (fds_open(&desc, &record) != NRF_SUCCESS) {
+            continue;
+        }
+        if (record.header.ic.instance == key && record.header.tl.length_words * 4 == sizeof(T) &&
+            (!found || record.header.id > newest)) {
+            memcpy(&value, record.p_data, sizeof(T));
+            newest = record.header.id;
+            found = true;
+        }
+        fds_close(&desc);
+    }
+    return found;
+}
+
+static void test_flash_words_per_day(void)
+{
+    setUp();
+    Device device;
+    device.boot();
+    /* Page tags of a blank device */
+    unsigned formatWords = host_sd_flash.words;
+    CHECK_EQUAL(0, device.store.getStatistics().words);
+
+    ActivationState activation = { 0, 0, { 0, 0 } };
+    CalibrationState calibration = { 0x8000, 1, { 0, 0, 0 } };
+    CycleState cycles = { 0, 0 };
+    unsigned changes = 0;
+    for (uint32_t s = 0; s < DAY_S; s++) {
+        if (s % CYCLE_PERIOD_S == 0) {
+            cycles.chargeProgramCycles++;
+            changes++;
+        }
+        if (s % CALIBRATION_PERIOD_S == 0) {
+            calibration.batteryLevelConstant++;
+            changes++;
+        }
+        uint8_t armed = (s % ACTIVATION_PERIOD_S) < ACTIVATION_LENGTH_S;
+        if (armed != activation.activated) {
+            activation.activated = armed;
+            activation.initialActivation = 1;
+            changes++;
+        }
+        /* saveState() of every main loop iteration */
+        device.store.set(STATE_KEY_ACTIVATION, activation);
+        device.store.set(STATE_KEY_CALIBRATION, calibration);
+        device.store.set(STATE_KEY_CYCLES, cycles);
+        device.run(1000000);
+    }
+    device.store.flush();
+    device.run(1000000);
+
+    const StateStore::Statistics &stats = device.store.getStatistics();
+    /* The first write of a key, one per holdoff at most, and the flush */
+    unsigned hours = DAY_S / 3600;
+    unsigned bound = (hours + 2) * UPDATE_WORDS(CycleState) + (hours + 2) * UPDATE_WORDS(CalibrationState) +
+                     2 * ACTIVATIONS * UPDATE_WORDS(ActivationState);
+    unsigned fdsWords = host_sd_flash.words - formatWords - stats.words;
+    REPORT("%u changes in a day: %u records, %u words by the store (bound %u), %u changes coalesced\n", changes,
+           (unsigned)stats.writes, (unsigned)stats.words, bound, (unsigned)stats.coalesced);
+    REPORT("flash: %u words programmed (%u formatting, %u by garbage collection), %u page erases, "
+           "at most %u writes of a word per erase\n",
+           host_sd_flash.words, formatWords, fdsWords, host_sd_flash.erases, host_sd_flash.maxWordWrites);
+    CHECK(stats.words <= bound);
+    CHECK_EQUAL(0, stats.failures);
+    CHECK(stats.coalesced > 0);
+    /* Every word the store counts reached flash, the rest is fds moving
+     * records during garbage collection */
+    CHECK(host_sd_flash.words >= formatWords + stats.words);
+    CHECK(host_sd_flash.erases > 0 || fdsWords == 0);
+    /* nRF51: two writes of a word between erases */
+    CHECK(host_sd_flash.maxWordWrites <= 2);
+
+    ActivationState storedActivation;
+    CalibrationState storedCalibration;
+    CycleState storedCycles;
+    CHECK(readBack(STATE_KEY_ACTIVATION, storedActivation));
+    CHECK(readBack(STATE_KEY_CALIBRATION, storedCalibration));
+    CHECK(readBack(STATE_KEY_CYCLES, storedCycles));
+    CHECK_EQUAL(activation.activated, storedActivation.activated);
+    CHECK_EQUAL(calibration.batteryLevelConstant, storedCalibration.batteryLevelConstant);
+    CHECK_EQUAL(cycles.chargeProgramCycles, storedCycles.chargeProgramCycles);
+}
+
+int main(void)
+{
+    RUN_TEST(test_flash_words_per_day);
+    return TEST_RESULT();
+}
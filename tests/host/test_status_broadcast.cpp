@@ -0,0 +1,160 @@
+/* StatusBroadcast.h: the record decodes to what was encoded, foreign records
+ * are refused, and the advertising payload of main.cpp fits in 31 bytes. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "StatusBroadcast.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+
+static bool sameStatus(const ImobStatus &a, const ImobStatus &b)
+{
+    return a.activated == b.activated && a.contact == b.contact && a.alarm == b.alarm &&
+           a.lipoChargerState == b.lipoChargerState && a.batteryLevel == b.batteryLevel &&
+           a.id1Prefix == b.id1Prefix;
+}
+
+static ImobStatus makeStatus(unsigned flags, uint8_t charger, uint8_t battery, uint16_t prefix)
+{
+    ImobStatus status;
+    status.activated = (flags & 1) != 0;
+    status.contact = (flags & 2) != 0;
+    status.alarm = (flags & 4) != 0;
+    status.lipoChargerState = charger;
+    status.batteryLevel = battery;
+    status.id1Prefix = prefix;
+    return status;
+}
+
+/* Every flag and charger combination, battery levels and ID1 prefixes */
+static void test_round_trip(void)
+{
+    static const uint8_t batteries[] = {0, 1, 50, 99, 100, 255};
+    static const uint16_t prefixes[] = {0x0000, 0x0001, 0x00FF, 0x1234, 0xFF00, 0xFFFF};
+    int mismatches = 0, refused = 0;
+    for (unsigned flags = 0; flags < 8; flags++) {
+        for (uint8_t charger = 0; charger <= 2; charger++) {
+            for (size_t b = 0; b < sizeof(batteries); b++) {
+                for (size_t p = 0; p < sizeof(prefixes) / sizeof(prefixes[0]); p++) {
+                    ImobStatus status = makeStatus(flags, charger, batteries[b], prefixes[p]);
+                    uint8_t data[STATUS_BROADCAST_LEN];
+                    encodeStatus(status, data);
+                    ImobStatus decoded;
+                    if (!decodeStatus(data, sizeof(data), decoded)) {
+                        refused++;
+                    } else {
+                        mismatches += !sameStatus(status, decoded);
+                    }
+                }
+            }
+        }
+    }
+    CHECK_EQUAL(0, refused);
+    CHECK_EQUAL(0, mismatches);
+
+    /* Layout of the comment in StatusBroadcast.h */
+    uint8_t data[STATUS_BROADCAST_LEN];
+    encodeStatus(makeStatus(STATUS_FLAG_ACTIVATED | STATUS_FLAG_ALARM, 2, 87, 0xA1B2), data);
+    static const uint8_t expected[STATUS_BROADCAST_LEN] = {0xFF, 0xFF, STATUS_BROADCAST_VERSION, 0x25, 87, 0xB2, 0xA1};
+    CHECK(memcmp(expected, data, sizeof(data)) == 0);
+
+    /* Trailing bytes of a longer field are ignored */
+    uint8_t longer[STATUS_BROADCAST_LEN + 3];
+    memset(longer, 0xAA, sizeof(longer));
+    memcpy(longer, data, sizeof(data));
+    ImobStatus decoded;
+    CHECK(decodeStatus(longer, sizeof(longer), decoded));
+    CHECK_EQUAL(0xA1B2, decoded.id1Prefix);
+}
+
+static void test_foreign_records_are_refused(void)
+{
+    uint8_t data[STATUS_BROADCAST_LEN];
+    encodeStatus(makeStatus(7, 1, 42, 0x4242), data);
+    ImobStatus decoded = makeStatus(0, 0, 0, 0);
+
+    /* Unknown version, older or newer */
+    uint8_t other[STATUS_BROADCAST_LEN];
+    memcpy(other, data, sizeof(data));
+    other[2] = STATUS_BROADCAST_VERSION + 1;
+    CHECK(!decodeStatus(other, sizeof(other), decoded));
+    other[2] = 0;
+    CHECK(!decodeStatus(other, sizeof(other), decoded));
+
+    /* Another company, in either byte */
+    memcpy(other, data, sizeof(data));
+    other[0] = 0x59;
+    other[1] = 0x00;
+    CHECK(!decodeStatus(other, sizeof(other), decoded));
+    memcpy(other, data, sizeof(data));
+    other[1] = 0xFE;
+    CHECK(!decodeStatus(other, sizeof(other), decoded));
+
+    /* Truncated */
+    for (uint8_t len = 0; len < STATUS_BROADCAST_LEN; len++) {
+        CHECK(!decodeStatus(data, len, decoded));
+    }
+
+    /* Refused records leave the output alone */
+    CHECK(sameStatus(makeStatus(0, 0, 0, 0), decoded));
+    CHECK(decodeStatus(data, sizeof(data), decoded));
+}
+
+/* Six 16-bit service UUIDs, as uuid16_list of main.cpp */
+static const uint16_t uuid16_list[] = {0xA000, 0xC000, 0xE000, 0xB000, 0xD000, GattService::UUID_BATTERY_SERVICE};
+
+/* The payload of main.cpp as it reaches the stack */
+static void test_payload_fits_in_one_packet(void)
+{
+    host_ble_reset();
+    Gap &gap = BLE::Instance().gap();
+    gap.accumulateAdvertisingPayload(GapAdvertisingData::BREDR_NOT_SUPPORTED | GapAdvertisingData::LE_GENERAL_DISCOVERABLE);
+    gap.accumulateAdvertisingPayload(GapAdvertisingData::COMPLETE_LIST_16BIT_SERVICE_IDS, (uint8_t *)uuid16_list, sizeof(uuid16_list));
+    StatusBroadcast broadcast;
+    ImobStatus status = makeStatus(STATUS_FLAG_CONTACT, 1, 73, 0xBEEF);
+    CHECK_EQUAL(BLE_ERROR_NONE, broadcast.start(gap, status));
+
+    const std::vector<uint8_t> &data = host_sd_adv.data;
+    REPORT("advertising payload: %u of %u bytes\n", (unsigned)data.size(), GAP_ADVERTISING_DATA_MAX_PAYLOAD);
+    CHECK_EQUAL((2 + 1) + (2 + sizeof(uuid16_list)) + STATUS_BROADCAST_AD_LEN, data.size());
+    CHECK(data.size() <= GAP_ADVERTISING_DATA_MAX_PAYLOAD);
+
+    /* The record is the last AD structure, found as a scanner would */
+    size_t i = 0;
+    bool found = false;
+    while (i + 1 < data.size()) {
+        uint8_t len = data[i];
+        if (data[i + 1] == GapAdvertisingData::MANUFACTURER_SPECIFIC_DATA) {
+            ImobStatus decoded;
+            found = decodeStatus(&data[i + 2], len - 1, decoded) && sameStatus(status, decoded);
+        }
+        i += len + 1;
+    }
+    CHECK(found);
+    CHECK_EQUAL(data.size(), i);
+
+    /* Unchanged: no new payload, changed: same size */
+    host_sd_reset_counts();
+    CHECK_EQUAL(BLE_ERROR_NONE, broadcast.update(status));
+    CHECK_EQUAL(0, host_sd_count("sd_ble_gap_adv_data_set"));
+    status.alarm = true;
+    CHECK_EQUAL(BLE_ERROR_NONE, broadcast.update(status));
+    CHECK_EQUAL(1, host_sd_count("sd_ble_gap_adv_data_set"));
+    CHECK_EQUAL((2 + 1) + (2 + sizeof(uuid16_list)) + STATUS_BROADCAST_AD_LEN, host_sd_adv.data.size());
+
+    /* A record that does not fit is refused, the previous payload stays */
+    uint8_t padding[GAP_ADVERTISING_DATA_MAX_PAYLOAD];
+    memset(padding, 0, sizeof(padding));
+    size_t before = host_sd_adv.data.size();
+    CHECK(gap.accumulateAdvertisingPayload(GapAdvertisingData::SERVICE_DATA, padding,
+                                           GAP_ADVERTISING_DATA_MAX_PAYLOAD - before - 1) != BLE_ERROR_NONE);
+    CHECK_EQUAL(before, host_sd_adv.data.size());
+}
+
+int main(void)
+{
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_foreign_records_are_refused);
+    RUN_TEST(test_payload_fits_in_one_packet);
+    return TEST_RESULT();
+}
@@ -0,0 +1,177 @@
+/* StatusService against the single byte characteristics it packs: the same
+ * scripted state sequence, run through the main loop order of main.cpp,
+ * counting the notifications of each. */
+
+#include "mbed.h"
+#include "ble/BLE.h"
+#include "TimerWheel.h"
+#include "ImobStateService.h"
+#include "InternalValuesService.h"
+#include "RELAYService.h"
+#include "ALARMService.h"
+#include "AccelSensorService.h"
+#include "StatusService.h"
+#include "host_softdevice.h"
+#include "host_test.h"
+#include "mma8452q_model.h"
+
+/* ATT notification header: opcode and handle */
+#define ATT_HVX_HEADER 3
+
+enum Field {
+    CONTACT,
+    CHARGER,
+    ALARM,
+    RELAY,
+    MOTION /* accelerometer sample on X, MSB counts */
+};
+
+struct Change {
+    uint16_t iteration;
+    Field field;
+    int8_t value;
+};
+
+/* A phone session in the vehicle: contact bounces within one iteration,
+ * relay and charger switching together, a burst of motion raising the
+ * alarm */
+static const Change script[] = {
+    {2, CONTACT, 1},
+    {3, CONTACT, 0}, {3, CONTACT, 1},
+    {5, RELAY, 1}, {5, CHARGER, 1},
+    {8, MOTION, 20}, {9, MOTION, -20}, {10, MOTION, 20}, {11, MOTION, -20}, {12, MOTION, 0},
+    {10, ALARM, 1},
+    {14, ALARM, 0}, {14, RELAY, 0},
+    {20, CONTACT, 0}, {20, CHARGER, 2},
+    {21, CONTACT, 1}, {21, CONTACT, 0},
+    {30, CHARGER, 0}
+};
+#define ITERATIONS 40
+
+static Mma8452qModel chip;
+
+struct Device {
+    Device() :
+        imob(BLE::Instance()),
+        internalValues(BLE::Instance(), &imob),
+        relay(BLE::Instance(), &imob, wheel),
+        alarm(BLE::Instance()),
+        accel(BLE::Instance()),
+        status(BLE::Instance())
+    {
+    }
+
+    RtcTimerWheel wheel;
+    ImobStateService imob;
+    InternalValuesService internalValues;
+    RELAYService relay;
+    ALARMService alarm;
+    AccelSensorService accel;
+    StatusService status;
+};
+
+static void connect(void)
+{
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id = BLE_GAP_EVT_CONNECTED;
+    event.evt.gap_evt.conn_handle = 1;
+    event.evt.gap_evt.params.connected.role = BLE_GAP_ROLE_PERIPH;
+    host_ble_event(&event);
+}
+
+static void apply(Device &device, const Change &change)
+{
+    switch (change.field) {
+        case CONTACT:
+            device.internalValues.updateContactState(change.value);
+            break;
+        case CHARGER:
+            device.internalValues.updateLipoChargerState(change.value);
+            break;
+        case ALARM:
+            device.alarm.updateAlarmState(change.value);
+            break;
+        case RELAY:
+            device.relay.updateRelayState(change.value);
+            break;
+        case MOTION:
+            chip.setSample(change.value << 4, 0, 1024);
+            break;
+    }
+}
+
+struct Count {
+    Count() : notifications(0), bytes(0) {}
+    unsigned notifications;
+    unsigned bytes;
+};
+
+static void test_packed_against_legacy_notifications(void)
+{
+    host_hw_reset();
+    host_ble_reset();
+    chip.reset();
+    host_i2c_device = &chip;
+    chip.setSample(0, 0, 1024);
+
+    Device device;
+    device.wheel.start();
+    device.accel.start();
+    connect();
+    /* First sample, at rest */
+    device.accel.requestSample();
+    device.accel.updateAccelDetection();
+    host_sd_reset_counts();
+
+    unsigned packedChanges = 0;
+    for (uint16_t i = 0; i < ITERATIONS; i++) {
+        uint8_t before = device.status.getStatus();
+        for (size_t c = 0; c < sizeof(script) / sizeof(script[0]); c++) {
+            if (script[c].iteration == i) {
+                apply(device, script[c]);
+            }
+        }
+        /* Main loop order: sample, motion, then the packed status */
+        device.accel.requestSample();
+        device.accel.updateAccelDetection();
+        device.status.updateStatus(StatusService::packStatus(activated,
+                                                             device.internalValues.getContactState() != 0,
+                                                             device.alarm.getAlarmState() != 0,
+                                                             device.relay.getRelayState() != 0,
+                                                             device.accel.getAccelDetection() != 0,
+                                                             device.internalValues.getLipoChargerState()));
+        packedChanges += device.status.getStatus() != before;
+    }
+
+    uint16_t packedHandle = host_sd_value_handle(StatusService::PACKED_STATUS_CHARACTERISTIC_UUID);
+    Count legacy, packed;
+    for (size_t n = 0; n < host_sd_notifications.size(); n++) {
+        const HostHvx &hvx = host_sd_notifications[n];
+        Count &count = (hvx.handle == packedHandle) ? packed : legacy;
+        count.notifications++;
+        count.bytes += ATT_HVX_HEADER + hvx.data.size();
+    }
+
+    REPORT("%d iterations: legacy %u notifications (%u ATT bytes), packed %u (%u ATT bytes)\n", ITERATIONS,
+           legacy.notifications, legacy.bytes, packed.notifications, packed.bytes);
+    /* Every change of a legacy characteristic is its own notification, the
+     * bounces included: 6 contact, 3 charger, 2 alarm, 2 relay, 2 motion */
+    CHECK_EQUAL(15, legacy.notifications);
+    /* One per iteration that ends with another status: the charger state of
+     * the first one, then iterations 2, 5, 8, 10, 13, 14, 20 and 30 */
+    CHECK_EQUAL(packedChanges, packed.notifications);
+    CHECK_EQUAL(9, packed.notifications);
+    CHECK(packed.bytes < legacy.bytes);
+
+    /* The last notification holds the final state */
+    std::vector<uint8_t> last = host_sd_value(packedHandle);
+    CHECK_EQUAL(PACKED_STATUS_VERSION, last[0]);
+    CHECK_EQUAL(0, last[1]);
+}
+
+int main(void)
+{
+    RUN_TEST(test_packed_against_legacy_notifications);
+    return TEST_RESULT();
+}
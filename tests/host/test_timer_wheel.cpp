@@ -0,0 +1,206 @@
+/* TimerWheel on virtual ticks and RtcTimerWheel on the virtual clock: every
+ * timer runs on the tick it was armed for, across cascades and wraps. */
+
+#include "mbed.h"
+#include "TimerWheel.h"
+#include "host_test.h"
+
+struct Probe {
+    Probe() : timer(callback(this, &Probe::onExpiry)), count(0), tick(0), wheel(NULL) {}
+
+    void onExpiry()
+    {
+        count++;
+        tick = wheel->current() - 1;
+    }
+
+    WheelTimer timer;
+    int count;
+    uint32_t tick; /* last tick processed when it fired */
+    TimerWheel *wheel;
+};
+
+/* Step tick by tick, as poll() would with a busy main loop */
+static void stepTo(TimerWheel &wheel, uint32_t target)
+{
+    while (wheel.current() != target) {
+        wheel.advance(wheel.current() + 1);
+    }
+}
+
+static void test_arm_fires_on_its_tick(void)
+{
+    TimerWheel wheel;
+    Probe a, b, c;
+    a.wheel = b.wheel = c.wheel = &wheel;
+
+    wheel.arm(a.timer, 1);
+    wheel.arm(b.timer, 0);
+    wheel.arm(c.timer, 31);
+    CHECK(a.timer.isArmed());
+    CHECK_EQUAL(1, wheel.remaining(a.timer));
+    CHECK_EQUAL(31, wheel.remaining(c.timer));
+    CHECK_EQUAL(0, wheel.ticksToNextEvent());
+
+    wheel.advance(1);
+    CHECK_EQUAL(1, a.count);
+    CHECK_EQUAL(1, b.count);
+    CHECK_EQUAL(0, a.tick);
+    CHECK(!a.timer.isArmed());
+    CHECK_EQUAL(0, wheel.remaining(a.timer));
+    CHECK_EQUAL(29, wheel.ticksToNextEvent());
+
+    wheel.advance(30);
+    CHECK_EQUAL(0, c.count);
+    wheel.advance(31);
+    CHECK_EQUAL(1, c.count);
+    CHECK_EQUAL(30, c.tick);
+    CHECK_EQUAL(-1, wheel.ticksToNextEvent());
+}
+
+static void test_cancel_and_rearm(void)
+{
+    TimerWheel wheel;
+    Probe a, b;
+    a.wheel = b.wheel = &wheel;
+
+    wheel.arm(a.timer, 5);
+    wheel.arm(b.timer, 5);
+    wheel.cancel(a.timer);
+    CHECK(!a.timer.isArmed());
+    /* Cancelling twice is harmless */
+    wheel.cancel(a.timer);
+    wheel.advance(10);
+    CHECK_EQUAL(0, a.count);
+    CHECK_EQUAL(1, b.count);
+
+    /* Re-arming moves the deadline, it does not add a second one */
+    wheel.arm(a.timer, 100);
+    wheel.arm(a.timer, 3);
+    wheel.advance(200);
+    CHECK_EQUAL(1, a.count);
+    CHECK_EQUAL(12, a.tick);
+
+    /* Cancelled in a higher level, the slot bit goes with it */
+    wheel.arm(a.timer, 2000);
+    CHECK(wheel.ticksToNextEvent() >= 0);
+    wheel.cancel(a.timer);
+    CHECK_EQUAL(-1, wheel.ticksToNextEvent());
+}
+
+/* Deadlines filed in levels 1 and 2, and beyond the range, come back down
+ * through the cascades and fire on their own tick */
+static void test_cascade_keeps_the_deadline(void)
+{
+    static const uint32_t delays[] = {
+        32, 33, 63, 64, 1000, 1023, 1024, 1025, 5000, 31 * 1024 + 7,
+        TIMER_WHEEL_RANGE - 1, TIMER_WHEEL_RANGE, TIMER_WHEEL_RANGE + 1, 3 * TIMER_WHEEL_RANGE + 77
+    };
+    const int count = sizeof(delays) / sizeof(delays[0]);
+
+    /* From a few start offsets, the cascade points differ */
+    static const uint32_t starts[] = {0, 1, 31, 517, 1023, 30000};
+    int early = 0, late = 0;
+    for (size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); s++) {
+        TimerWheel wheel;
+        wheel.advance(starts[s]);
+        Probe probes[count];
+        for (int i = 0; i < count; i++) {
+            probes[i].wheel = &wheel;
+            wheel.arm(probes[i].timer, delays[i]);
+        }
+
+        /* Jump from event to event, as the RTC wakeups do */
+        uint32_t end = starts[s] + 3 * TIMER_WHEEL_RANGE + 100;
+        while ((int32_t)(end - wheel.current()) > 0) {
+            int32_t next = wheel.ticksToNextEvent();
+            if (next < 0) {
+                break;
+            }
+            wheel.advance(wheel.current() + next + 1);
+        }
+
+        for (int i = 0; i < count; i++) {
+            uint32_t expected = starts[s] + delays[i] - 1;
+            CHECK_EQUAL(1, probes[i].count);
+            early += probes[i].tick < expected;
+            late += probes[i].tick > expected;
+        }
+    }
+    CHECK_EQUAL(0, early);
+    CHECK_EQUAL(0, late);
+}
+
+/* The tick counter wraps at 2^32 */
+static void test_wrap(void)
+{
+    TimerWheel wheel;
+    /* advance() takes targets within half the counter range */
+    wheel.advance(0x7FFFFFFFUL);
+    wheel.advance(0xFFFFFFF0UL);
+    CHECK_EQUAL(0xFFFFFFF0UL, wheel.current());
+
+    Probe a, b, c;
+    a.wheel = b.wheel = c.wheel = &wheel;
+    wheel.arm(a.timer, 0x20);
+    wheel.arm(b.timer, 2000);
+    wheel.arm(c.timer, 0x10);
+    CHECK_EQUAL(0x20, wheel.remaining(a.timer));
+
+    stepTo(wheel, 0x20);
+    CHECK_EQUAL(1, c.count);
+    CHECK_EQUAL(0xFFFFFFFFUL, c.tick);
+    CHECK_EQUAL(1, a.count);
+    CHECK_EQUAL(0x0F, a.tick);
+    CHECK_EQUAL(0, b.count);
+
+    wheel.advance(0x1000);
+    CHECK_EQUAL(1, b.count);
+    CHECK_EQUAL((uint32_t)(0xFFFFFFF0UL + 2000 - 1), b.tick);
+}
+
+/* RtcTimerWheel: wakeups only for due timers, each within one tick of its
+ * deadline, over a wrap of the 32-bit microsecond ticker */
+static void test_rtc_wheel_on_the_virtual_clock(void)
+{
+    host_hw_reset();
+    /* Ten seconds before us_ticker_read() wraps */
+    host_advance_us(0xFFFFFFFFULL - 10000000);
+
+    RtcTimerWheel wheel;
+    wheel.start();
+    Probe probe;
+    probe.wheel = &wheel;
+    wheel.arm(probe.timer, TIMER_WHEEL_MS(60000));
+    wheel.schedule();
+
+    uint64_t armedAt = host_now_us();
+    int wakeups = 0;
+    while (probe.count == 0 && wakeups < 100) {
+        host_wait_for_event();
+        wakeups++;
+        wheel.poll();
+    }
+    uint64_t firedAfter = host_now_us() - armedAt;
+    REPORT("60 s timer: %d wakeup(s), fired after %llu us\n", wakeups, (unsigned long long)firedAfter);
+    CHECK_EQUAL(1, probe.count);
+    CHECK_EQUAL(1, wakeups);
+    CHECK(firedAfter >= 60000000ULL);
+    CHECK(firedAfter <= 60000000ULL + TIMER_WHEEL_TICK_US);
+
+    /* Nothing armed: no further wakeup */
+    CHECK_EQUAL(-1, wheel.ticksToNextEvent());
+    uint64_t before = host_now_us();
+    host_wait_for_event();
+    CHECK_EQUAL(HOST_MAX_SLEEP_US, host_now_us() - before);
+}
+
+int main(void)
+{
+    RUN_TEST(test_arm_fires_on_its_tick);
+    RUN_TEST(test_cancel_and_rearm);
+    RUN_TEST(test_cascade_keeps_the_deadline);
+    RUN_TEST(test_wrap);
+    RUN_TEST(test_rtc_wheel_on_the_virtual_clock);
+    return TEST_RESULT();
+}